@@ -0,0 +1,60 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Gradient compression sweep: train with each GRAD_COMPRESS method, then
+# evaluate the saved model on the test set, and report wire savings and
+# codec cost against convergence.
+#
+# Usage: bench/compress_convergence.sh [workers] [methods...]
+#   e.g. bench/compress_convergence.sh 4 none topk:0.1 topk:0.01 q8
+#   TRAINER_PS=1 switches the exchange from the ring to the parameter server.
+
+WORKERS="${1:-4}"
+shift || true
+METHODS=("$@")
+if [[ ${#METHODS[@]} -eq 0 ]]; then
+  METHODS=(none topk:0.1 topk:0.01 q8)
+fi
+
+TRAINER="bin/trainer"
+TRAIN_CSV="${TRAIN_CSV:-data/train.csv}"
+TEST_CSV="${TEST_CSV:-data/test.csv}"
+OUT_DIR="logs/compress_convergence"
+
+if [[ ! -x "$TRAINER" ]]; then
+  ./build.sh
+fi
+mkdir -p "$OUT_DIR"
+
+echo "[compress] workers=$WORKERS ps=${TRAINER_PS:-0} batch=${DDP_BATCH:-32} train=$TRAIN_CSV test=$TEST_CSV"
+printf "%-10s %8s %7s %10s %10s %11s %10s\n" \
+  method wall_s ratio encode_us decode_us train_loss test_loss
+
+for m in "${METHODS[@]}"; do
+  tag="${m//:/_}"
+  model="${OUT_DIR}/model-${tag}.txt"
+  err="${OUT_DIR}/train-${tag}.err"
+
+  start=$(date +%s.%N)
+  BACKWARD_MODE=train MODEL_FILE="$model" TRAINER_WORKERS="$WORKERS" \
+    GRAD_COMPRESS="$m" \
+    "$TRAINER" "$TRAIN_CSV" > "${OUT_DIR}/train-${tag}.log" 2> "$err"
+  end=$(date +%s.%N)
+
+  BACKWARD_MODE=test MODEL_FILE="$model" \
+    "$TRAINER" "$TEST_CSV" > "${OUT_DIR}/test-${tag}.log" 2> "${OUT_DIR}/test-${tag}.err"
+
+  # Average the per-worker compression lines; "none" prints none.
+  read -r ratio enc dec <<< "$(grep "compression steps=" "$err" | tr ' =' '\n\n' | awk '
+    prev == "ratio" { r += $1; n++ }
+    prev == "encode_us_per_step" { e += $1 }
+    prev == "decode_us_per_step" { d += $1 }
+    { prev = $1 }
+    END { if (n) printf "%.2f %.2f %.2f\n", r / n, e / n, d / n; else print "1.00 0.00 0.00" }')"
+  read -r _tag _n train_loss _y <<< "$(grep "^SUMMARY" "${OUT_DIR}/train-${tag}.log" | tail -n 1)"
+  read -r _tag _n test_loss _y <<< "$(grep "^SUMMARY" "${OUT_DIR}/test-${tag}.log" | tail -n 1)"
+
+  awk -v m="$m" -v a="$start" -v b="$end" -v r="$ratio" -v e="$enc" -v d="$dec" \
+      -v tr="$train_loss" -v te="$test_loss" \
+    'BEGIN { printf "%-10s %8.3f %7s %10s %10s %11s %10s\n", m, b - a, r, e, d, tr, te }'
+done
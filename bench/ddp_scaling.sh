@@ -0,0 +1,51 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Data-parallel scaling benchmark: train on one CSV with 1..N local
+# workers (TRAINER_WORKERS) and report wall time, throughput, the
+# training loss and the test loss of the saved model for each worker
+# count, with the test loss relative to the single worker's.
+#
+# Several workers take one step per DDP_BATCH x workers samples instead
+# of one per sample, so the model is not the single-process one: the
+# last column shows how far its convergence moved.
+#
+# Usage: bench/ddp_scaling.sh [max_workers] [csv] [test_csv]
+#   DDP_BATCH, DDP_OVERLAP, DDP_LR_SCALING and DDP_ENDPOINT are passed through.
+
+MAX_WORKERS="${1:-4}"
+CSV="${2:-data/train.csv}"
+TEST_CSV="${3:-data/test.csv}"
+TRAINER="bin/trainer"
+OUT_DIR="logs/ddp_scaling"
+
+if [[ ! -x "$TRAINER" ]]; then
+  ./build.sh
+fi
+mkdir -p "$OUT_DIR"
+
+samples=$(grep -cve '^\s*$' "$CSV" || echo 0)
+echo "[ddp] csv=$CSV samples=$samples batch=${DDP_BATCH:-32} overlap=${DDP_OVERLAP:-1}" \
+     "lr_scaling=${DDP_LR_SCALING:-linear}"
+printf "%-8s %10s %14s %12s %12s %10s\n" workers wall_s samples_per_s avg_loss test_loss test_vs_1
+base_test=""
+
+for ((n = 1; n <= MAX_WORKERS; n++)); do
+  log="${OUT_DIR}/workers-${n}.log"
+  start=$(date +%s.%N)
+  BACKWARD_MODE=train MODEL_FILE="${OUT_DIR}/model-${n}.txt" TRAINER_WORKERS="$n" \
+    "$TRAINER" "$CSV" > "$log" 2> "${OUT_DIR}/workers-${n}.err"
+  end=$(date +%s.%N)
+
+  summary=$(grep "^SUMMARY " "$log" | tail -n 1)
+  read -r _tag _count avg_loss _avg_yhat <<< "${summary:-SUMMARY 0 nan nan}"
+
+  test_summary=$(BACKWARD_MODE=test MODEL_FILE="${OUT_DIR}/model-${n}.txt" \
+    "$TRAINER" "$TEST_CSV" 2> /dev/null | grep "^SUMMARY " | tail -n 1)
+  read -r _tag _count test_loss _avg_yhat <<< "${test_summary:-SUMMARY 0 nan nan}"
+  base_test="${base_test:-$test_loss}"
+
+  awk -v n="$n" -v s="$start" -v e="$end" -v c="$samples" -v l="$avg_loss" \
+      -v t="$test_loss" -v b="$base_test" \
+    'BEGIN { w = e - s; printf "%-8d %10.3f %14.0f %12s %12s %9.2fx\n", n, w, (w > 0 ? c / w : 0), l, t, (b > 0 ? t / b : 0) }'
+done
@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Per-job latency of test jobs: submitted to a daemon with warm stages,
+# to a daemon that forks every job (TRAINER_WARM=0), and run directly
+# with bin/trainer. Jobs run one after another; a small CSV shows the
+# fixed per-job cost, the full test set the cost with real work.
+#
+# Usage: bench/job_server.sh [jobs]
+#   e.g. bench/job_server.sh 50
+
+JOBS="${1:-30}"
+
+TRAINER="bin/trainer"
+TRAIN_CSV="${TRAIN_CSV:-data/train.csv}"
+TEST_CSV="${TEST_CSV:-data/test.csv}"
+OUT_DIR="logs/job_server"
+MODEL="${OUT_DIR}/model.txt"
+SMALL_CSV="${OUT_DIR}/small.csv"
+
+if [[ ! -x "$TRAINER" ]]; then
+  ./build.sh
+fi
+mkdir -p "$OUT_DIR"
+
+BACKWARD_MODE=train MODEL_FILE="$MODEL" "$TRAINER" "$TRAIN_CSV" > /dev/null 2> "${OUT_DIR}/train.err"
+head -n 20 "$TEST_CSV" > "$SMALL_CSV"
+
+# Mean wall milliseconds of $JOBS runs of "$@".
+per_job_ms() {
+  local start end
+  start=$(date +%s.%N)
+  for ((i = 0; i < JOBS; ++i)); do
+    "$@" > /dev/null
+  done
+  end=$(date +%s.%N)
+  awk -v a="$start" -v b="$end" -v n="$JOBS" 'BEGIN { printf "%.2f", (b - a) * 1000 / n }'
+}
+
+start_daemon() { # <socket> <TRAINER_WARM>
+  TRAINER_SOCKET="$1" TRAINER_WARM="$2" TRAINER_JOBS=1 \
+    "$TRAINER" --daemon 2> "${OUT_DIR}/daemon-warm$2.err" &
+  for _ in $(seq 50); do
+    [[ -S "$1" ]] && return 0
+    sleep 0.1
+  done
+  echo "[job_server] daemon on $1 did not start" >&2
+  exit 1
+}
+
+WARM_SOCK="/tmp/trainer-bench-warm-$$.sock"
+COLD_SOCK="/tmp/trainer-bench-cold-$$.sock"
+start_daemon "$WARM_SOCK" 1
+start_daemon "$COLD_SOCK" 0
+trap 'TRAINER_SOCKET="$WARM_SOCK" "$TRAINER" --submit shutdown > /dev/null || true;
+      TRAINER_SOCKET="$COLD_SOCK" "$TRAINER" --submit shutdown > /dev/null || true; wait' EXIT
+
+direct() { # <csv>
+  BACKWARD_MODE=test MODEL_FILE="$MODEL" "$TRAINER" "$1" 2> /dev/null
+}
+submit() { # <socket> <csv>
+  TRAINER_SOCKET="$1" "$TRAINER" --submit csv="$2" phase=test model="$MODEL"
+}
+
+echo "[job_server] jobs=$JOBS model=$MODEL"
+printf "%-14s %10s %10s %10s\n" csv warm_ms forked_ms direct_ms
+for csv in "$SMALL_CSV" "$TEST_CSV"; do
+  # One unmeasured job each, so both daemons have served before.
+  submit "$WARM_SOCK" "$csv" > /dev/null
+  submit "$COLD_SOCK" "$csv" > /dev/null
+  warm=$(per_job_ms submit "$WARM_SOCK" "$csv")
+  cold=$(per_job_ms submit "$COLD_SOCK" "$csv")
+  plain=$(per_job_ms direct "$csv")
+  printf "%-14s %10s %10s %10s\n" "$(basename "$csv")" "$warm" "$cold" "$plain"
+done
+
+# The warm lane must answer like a direct run.
+diff <(direct "$TEST_CSV" | grep "^SUMMARY ") \
+     <(submit "$WARM_SOCK" "$TEST_CSV" | grep "^SUMMARY ") > /dev/null ||
+  { echo "[job_server] warm SUMMARY differs from a direct run" >&2; exit 1; }
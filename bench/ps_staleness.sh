@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Parameter-server staleness sweep: train with TRAINER_PS=1 for each
+# staleness bound, then evaluate the saved model on the test set, and
+# report throughput against convergence. The server's stderr comes
+# through the trainer with a "[time param_server]" prefix.
+#
+# DDP_LR_SCALING is passed through (see param_server.hpp).
+#
+# Usage: bench/ps_staleness.sh [workers] [bounds...]
+#   e.g. bench/ps_staleness.sh 4 0 1 2 4 8
+
+WORKERS="${1:-4}"
+shift || true
+BOUNDS=("$@")
+if [[ ${#BOUNDS[@]} -eq 0 ]]; then
+  BOUNDS=(0 1 2 4 8)
+fi
+
+TRAINER="bin/trainer"
+TRAIN_CSV="${TRAIN_CSV:-data/train.csv}"
+TEST_CSV="${TEST_CSV:-data/test.csv}"
+OUT_DIR="logs/ps_staleness"
+
+if [[ ! -x "$TRAINER" ]]; then
+  ./build.sh
+fi
+mkdir -p "$OUT_DIR"
+
+echo "[ps] workers=$WORKERS batch=${DDP_BATCH:-32} lr_scaling=${DDP_LR_SCALING:-linear} train=$TRAIN_CSV test=$TEST_CSV"
+printf "%-9s %8s %14s %10s %10s %8s %11s %10s\n" \
+  staleness wall_s samples_per_s mean_stale max_stale blocked train_loss test_loss
+
+for s in "${BOUNDS[@]}"; do
+  model="${OUT_DIR}/model-s${s}.txt"
+  err="${OUT_DIR}/train-s${s}.err"
+
+  start=$(date +%s.%N)
+  BACKWARD_MODE=train MODEL_FILE="$model" TRAINER_WORKERS="$WORKERS" \
+    TRAINER_PS=1 PS_STALENESS="$s" \
+    "$TRAINER" "$TRAIN_CSV" > "${OUT_DIR}/train-s${s}.log" 2> "$err"
+  end=$(date +%s.%N)
+
+  BACKWARD_MODE=test MODEL_FILE="$model" \
+    "$TRAINER" "$TEST_CSV" > "${OUT_DIR}/test-s${s}.log" 2> "${OUT_DIR}/test-s${s}.err"
+
+  read -r _tag _bound _updates sps mean_stale max_stale blocked _blocked_s \
+    <<< "$(grep -o "PS_SUMMARY .*" "$err" | tail -n 1)"
+  read -r _tag _n train_loss _y <<< "$(grep "^SUMMARY " "${OUT_DIR}/train-s${s}.log" | tail -n 1)"
+  read -r _tag _n test_loss _y <<< "$(grep "^SUMMARY " "${OUT_DIR}/test-s${s}.log" | tail -n 1)"
+
+  awk -v s="$s" -v a="$start" -v b="$end" -v sps="$sps" -v ms="$mean_stale" \
+      -v xs="$max_stale" -v bl="$blocked" -v tr="$train_loss" -v te="$test_loss" \
+    'BEGIN { printf "%-9s %8.3f %14.0f %10.3f %10s %8s %11s %10s\n", s, b - a, sps, ms, xs, bl, tr, te }'
+done
@@ -0,0 +1,43 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Stage-isolated throughput: capture every pipeline edge during one
+# normal training run, then replay each stage from memory with its
+# captured input and report the stage's own records/s.
+#
+# Usage: bench/stage_replay.sh [csv] [repeat]
+#   e.g. bench/stage_replay.sh data/train.csv 20
+
+CSV="${1:-data/train.csv}"
+REPEAT="${2:-10}"
+OUT_DIR="logs/stage_replay"
+MODEL="${OUT_DIR}/model.txt"
+
+if [[ ! -x bin/trainer ]]; then
+  ./build.sh
+fi
+rm -rf "$OUT_DIR"
+mkdir -p "$OUT_DIR"
+
+CAPTURE_DIR="$OUT_DIR" BACKWARD_MODE=train MODEL_FILE="$MODEL" \
+  bin/trainer "$CSV" > /dev/null 2> "${OUT_DIR}/capture.err"
+
+echo "[replay] csv=$CSV repeat=$REPEAT"
+printf "%-15s %10s %14s %10s\n" stage records records_per_s mb_per_s
+
+replay() {
+  local stage="$1" input="$2"
+  shift 2
+  local line
+  line=$(env "$@" "bin/$stage" --replay "$input" --repeat "$REPEAT" 2>&1 >/dev/null | grep "^REPLAY")
+  awk -v s="$stage" '{
+      for (i = 3; i <= NF; ++i) { split($i, kv, "="); v[kv[1]] = kv[2] }
+      printf "%-15s %10s %14.0f %10.2f\n", s, v["records"], v["records_per_s"], v["mb_per_s"]
+    }' <<< "$line"
+}
+
+replay preprocess "$CSV"
+replay forward_layer "${OUT_DIR}/preprocess.cap"
+# Test mode so repeated passes do not keep rewriting the model.
+replay backward_layer "${OUT_DIR}/forward_layer.cap" BACKWARD_MODE=test MODEL_FILE="$MODEL"
+replay logger "${OUT_DIR}/backward_layer.cap"
@@ -16,19 +16,80 @@ $CXX $CXXFLAGS -Iinclude -c src/common.cpp -o bin/common.o
 echo "[build] Compiling math_layer.cpp"
 $CXX $CXXFLAGS -Iinclude -c src/math_layer.cpp -o bin/math_layer.o
 
+echo "[build] Compiling dataset.cpp"
+$CXX $CXXFLAGS -Iinclude -c src/dataset.cpp -o bin/dataset.o
+
+echo "[build] Compiling net.cpp"
+$CXX $CXXFLAGS -Iinclude -c src/net.cpp -o bin/net.o
+
+echo "[build] Compiling allreduce.cpp"
+$CXX $CXXFLAGS -Iinclude -c src/allreduce.cpp -o bin/allreduce.o
+
+echo "[build] Compiling compress.cpp"
+$CXX $CXXFLAGS -Iinclude -c src/compress.cpp -o bin/compress.o
+
+echo "[build] Compiling stage_io.cpp"
+$CXX $CXXFLAGS -Iinclude -c src/stage_io.cpp -o bin/stage_io.o
+
+echo "[build] Compiling transform.cpp"
+$CXX $CXXFLAGS -Iinclude -c src/transform.cpp -o bin/transform.o
+
 echo "[build] Compiling preprocess.cpp"
-$CXX $CXXFLAGS -Iinclude src/preprocess.cpp bin/common.o bin/math_layer.o -o bin/preprocess
+$CXX $CXXFLAGS -Iinclude src/preprocess.cpp bin/common.o bin/math_layer.o bin/net.o bin/stage_io.o bin/transform.o -o bin/preprocess
+
+echo "[build] Compiling feature_plugin.cpp"
+$CXX $CXXFLAGS -Iinclude -c src/feature_plugin.cpp -o bin/feature_plugin.o
 
 echo "[build] Compiling forward_layer.cpp"
-$CXX $CXXFLAGS -Iinclude src/forward_layer.cpp bin/common.o bin/math_layer.o -o bin/forward_layer
+$CXX $CXXFLAGS -Iinclude src/forward_layer.cpp bin/common.o bin/math_layer.o bin/net.o bin/stage_io.o bin/feature_plugin.o -o bin/forward_layer -ldl
+
+echo "[build] Compiling plugins"
+mkdir -p bin/plugins
+$CXX $CXXFLAGS -fPIC -shared -Iinclude plugins/clip_features.cpp -o bin/plugins/clip_features.so
 
 echo "[build] Compiling backward_layer.cpp"
-$CXX $CXXFLAGS -Iinclude src/backward_layer.cpp bin/common.o bin/math_layer.o -o bin/backward_layer
+$CXX $CXXFLAGS -Iinclude src/backward_layer.cpp bin/common.o bin/math_layer.o bin/net.o bin/allreduce.o bin/compress.o bin/stage_io.o -o bin/backward_layer -pthread
 
 echo "[build] Compiling logger.cpp"
-$CXX $CXXFLAGS -Iinclude src/logger.cpp -o bin/logger
+$CXX $CXXFLAGS -Iinclude src/logger.cpp bin/net.o bin/stage_io.o -o bin/logger
+
+echo "[build] Compiling topology.cpp"
+$CXX $CXXFLAGS -Iinclude -c src/topology.cpp -o bin/topology.o
+
+echo "[build] Compiling job_server.cpp"
+$CXX $CXXFLAGS -Iinclude -c src/job_server.cpp -o bin/job_server.o
+
+echo "[build] Compiling autotune.cpp"
+$CXX $CXXFLAGS -Iinclude -c src/autotune.cpp -o bin/autotune.o
 
 echo "[build] Compiling trainer.cpp"
-$CXX $CXXFLAGS -Iinclude src/trainer.cpp -o bin/trainer
+$CXX $CXXFLAGS -Iinclude src/trainer.cpp bin/autotune.o bin/job_server.o bin/net.o bin/topology.o bin/transform.o bin/common.o bin/math_layer.o -o bin/trainer
+
+echo "[build] Compiling param_server.cpp"
+$CXX $CXXFLAGS -Iinclude src/param_server.cpp bin/common.o bin/math_layer.o bin/net.o bin/compress.o bin/stage_io.o -o bin/param_server
+
+echo "[build] Compiling crossval.cpp"
+$CXX $CXXFLAGS -Iinclude src/crossval.cpp bin/common.o bin/math_layer.o bin/dataset.o -o bin/crossval
+
+echo "[build] Compiling lbfgs.cpp"
+$CXX $CXXFLAGS -Iinclude src/lbfgs.cpp bin/common.o bin/math_layer.o bin/dataset.o -o bin/lbfgs -pthread
+
+echo "[build] Compiling bench.cpp"
+$CXX $CXXFLAGS -Iinclude -c src/bench.cpp -o bin/bench.o
+
+echo "[build] Compiling bench_io.cpp"
+$CXX $CXXFLAGS -Iinclude src/bench_io.cpp bin/common.o bin/bench.o -o bin/bench_io
+
+echo "[build] Compiling bench_math.cpp"
+$CXX $CXXFLAGS -Iinclude src/bench_math.cpp bin/math_layer.o bin/bench.o -o bin/bench_math
+
+echo "[build] Compiling bench_pipeline.cpp"
+$CXX $CXXFLAGS -Iinclude src/bench_pipeline.cpp bin/bench.o -o bin/bench_pipeline
+
+echo "[build] Compiling bench_ipc.cpp"
+$CXX $CXXFLAGS -Iinclude src/bench_ipc.cpp bin/bench.o -o bin/bench_ipc
+
+echo "[build] Compiling bench_compare.cpp"
+$CXX $CXXFLAGS -Iinclude src/bench_compare.cpp bin/bench.o -o bin/bench_compare
 
 echo "[build] Done."
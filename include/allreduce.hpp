@@ -0,0 +1,80 @@
+/// @file allreduce.hpp
+/// @brief Ring all-reduce over stream sockets between local or remote ranks.
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "net.hpp"
+
+namespace allreduce
+{
+    /**
+     * @brief One rank's connections in a ring of 'world' ranks.
+     *
+     * Each rank sends to rank+1 and receives from rank-1 (mod world).
+     */
+    struct Ring
+    {
+        int rank = 0;                          ///< This rank.
+        int world = 1;                         ///< Number of ranks.
+        int next_fd = -1;                      ///< Socket to rank + 1.
+        int prev_fd = -1;                      ///< Socket from rank - 1.
+        std::size_t segment_bytes = 16 * 1024; ///< Pipelining granularity.
+        std::vector<float> scratch;            ///< Receive buffer for reduction.
+    };
+
+    /**
+     * @brief Connect this rank into the ring.
+     *
+     * Listens on the rank's own address, connects to the next rank and
+     * accepts the previous one, then checks ranks with a short handshake.
+     * A world of 1 needs no sockets.
+     *
+     * @param ep    Base endpoint shared by all ranks.
+     * @param rank  This rank (0 <= rank < world).
+     * @param world Number of ranks.
+     * @param out   Output ring.
+     * @return true on success, false on error.
+     */
+    bool ring_connect(const net::Endpoint &ep, int rank, int world, Ring &out);
+
+    /**
+     * @brief Sum a float buffer element-wise across all ranks, in place.
+     *
+     * Classic two-phase ring algorithm (reduce-scatter, then all-gather),
+     * moving 2 * (world - 1) / world of the buffer per rank. Within each
+     * step the chunk is streamed in segments of ring.segment_bytes over
+     * non-blocking sockets: sending, receiving and adding the received
+     * floats proceed concurrently instead of one whole chunk at a time.
+     *
+     * Every rank must call this with the same n.
+     *
+     * @param ring Connected ring.
+     * @param data Buffer of n floats; holds the sum on return.
+     * @param n    Number of floats.
+     * @return true on success, false on a socket error.
+     */
+    bool ring_allreduce(Ring &ring, float *data, std::size_t n);
+
+    /**
+     * @brief Gather every rank's byte payload on all ranks.
+     *
+     * Payloads may differ in size (e.g. compressed gradients, which
+     * cannot be summed in flight). Each payload travels W-1 hops.
+     *
+     * @param ring Connected ring.
+     * @param mine This rank's payload.
+     * @param all  Output: all[r] holds rank r's payload.
+     * @return true on success, false on a socket error.
+     */
+    bool ring_allgather(Ring &ring,
+                        const std::vector<char> &mine,
+                        std::vector<std::vector<char>> &all);
+
+    /**
+     * @brief Close the ring's sockets.
+     *
+     * @param ring Ring to close.
+     */
+    void ring_close(Ring &ring);
+} // namespace allreduce
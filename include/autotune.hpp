@@ -0,0 +1,78 @@
+/// @file autotune.hpp
+/// @brief trainer --autotune: pick batch size and transport (and, on request, workers) per host.
+#pragma once
+
+#include <string>
+
+namespace autotune
+{
+    /**
+     * @brief Calibrate the pipeline on this host and save the best profile.
+     *
+     * Copies the first TRAINER_AUTOTUNE_SAMPLES (default 2000) rows of
+     * the CSV to a temporary file and times short runs of trainer::run()
+     * over it, each in a child process with its output read back
+     * through a pipe. The sample first grows (repeating the CSV if it
+     * is short) until a baseline run, with none of the tuned variables
+     * set, lasts TRAINER_AUTOTUNE_MIN_MS (default 200) of wall time.
+     * Then the baseline and every combination of
+     *   - FORWARD_BATCH     : 16, 64, 256, 1024
+     *   - TRAINER_TRANSPORT : pipe, socketpair
+     * These do not change what is computed, only how fast. With
+     * TRAINER_AUTOTUNE_WORKERS=1 also
+     *   - TRAINER_WORKERS   : 1, 2, ..., online CPUs (powers of two, at most 8)
+     * which trains a different model (data parallel); otherwise the
+     * micro-runs keep the workers of the environment or topology.
+     * run TRAINER_AUTOTUNE_REPEATS (default 5, at least 3) times each
+     * and are scored by their medians. Throughput is sample rows per
+     * second of wall time; latency is the time until the first output
+     * line. The winner is the highest throughput among the combinations
+     * whose latency is within TRAINER_AUTOTUNE_MAX_LATENCY_MS (no bound
+     * if unset), or the lowest latency if none is. It is saved only if
+     * it beats the baseline by more than the spread (max - min) of
+     * either one's runs; otherwise the profile keeps the defaults.
+     *
+     * Micro-runs train into a temporary MODEL_FILE and run without
+     * CAPTURE_DIR, QUARANTINE_DIR and TRAINER_STATS, so they leave
+     * nothing behind. A table of all results goes to stderr.
+     *
+     * The profile is written to profile_path() as
+     *   host <fingerprint>
+     *   <VARIABLE> <value>            (one line per tuned variable, none
+     *                                  if the defaults were kept)
+     *   # records_per_s=<r> spread=<s> latency_ms=<l>
+     *
+     * @param csv_path Dataset to sample.
+     * @param fuse     Passed to trainer::run().
+     * @param config   Pipeline description passed to trainer::run().
+     * @return 0 if a profile was written, 1 otherwise.
+     */
+    int run(const std::string &csv_path, bool fuse, const std::string &config);
+
+    /**
+     * @brief This host's fingerprint: CPU model and online CPU count,
+     *        e.g. "Intel(R) Xeon(R) CPU @ 2.20GHz x8".
+     */
+    std::string host_fingerprint();
+
+    /**
+     * @brief Where this host's profile lives:
+     *        TRAINER_AUTOTUNE_DIR (default $HOME/.cache/trainer) /
+     *        <fingerprint with unusual characters as '_'>.profile
+     */
+    std::string profile_path();
+
+    /**
+     * @brief Apply this host's saved profile to the environment.
+     *
+     * Variables already set in the environment keep their values.
+     * TRAINER_WORKERS is applied only with TRAINER_AUTOTUNE_WORKERS=1
+     * (it changes the model; see run()), else it is skipped with a note.
+     * Does nothing if TRAINER_AUTOTUNE_PROFILE=0, if there is no
+     * profile, or if it was written for another host.
+     *
+     * @return true if a profile was applied (a note goes to stderr).
+     */
+    bool apply_profile();
+
+} // namespace autotune
@@ -8,6 +8,9 @@ namespace backward_layer
      * @brief Run the backward pass stage.
      *
      * Reads samples with (possibly augmented) features from stdin.
+     * The network's input width is that of the first line, so wider
+     * rows from FORWARD_EXPAND need no extra configuration; a test-mode
+     * model of another width is rejected.
      * Behavior is controlled by the BACKWARD_MODE environment variable:
      *
      *   - BACKWARD_MODE=train (default):
@@ -24,6 +27,43 @@ namespace backward_layer
      *         id loss y_hat
      *       for each sample to stdout.
      *
+     *       MODEL_FILE may also hold a comma-separated list of model files.
+     *       All models are then evaluated in one pass over the stream and
+     *       each sample produces one (loss, y_hat) pair per model:
+     *         id loss_0 y_hat_0 loss_1 y_hat_1 ...
+     *
+     *   - MODEL_CONFIGS (train mode, optional):
+     *       Semicolon-separated list of model configurations such as
+     *         "lr=0.001;lr=0.01,hidden=16;opt=momentum"
+     *       (keys: hidden, lr, opt=sgd|momentum, momentum). One independent
+     *       model is trained per entry over the same parsed stream, output
+     *       lines carry one (loss, y_hat) pair per model, and model k is
+     *       saved to the k-th MODEL_FILE entry. A single MODEL_FILE is
+     *       expanded to <path>.0, <path>.1, ... for K > 1 models.
+     *
+     *   - DDP_WORLD_SIZE > 1 (train mode, set by trainer for TRAINER_WORKERS):
+     *       Data-parallel worker DDP_RANK of DDP_WORLD_SIZE. Gradients of
+     *       DDP_BATCH samples (default 32) per worker are summed across all
+     *       workers by ring all-reduce over DDP_ENDPOINT ("unix:<path>" or
+     *       "tcp:<host>:<port>"); the step applies lr times that sum
+     *       (lr scaled by the global batch; DDP_LR_SCALING=none averages
+     *       instead). The exchange overlaps the next batch's computation
+     *       unless DDP_OVERLAP=0. Rank 0 saves the model.
+     *
+     *   - PS_ENDPOINT set (train mode, set by trainer for TRAINER_PS=1):
+     *       Asynchronous worker DDP_RANK of a param_server: per DDP_BATCH
+     *       samples it pulls parameters and pushes the batch gradient,
+     *       which the server applies with the same DDP_LR_SCALING.
+     *       The server owns and saves the model.
+     *
+     *   - GRAD_COMPRESS (with either multi-worker mode): none (default),
+     *       topk[:fraction] (largest entries plus error feedback) or q8
+     *       (8-bit stochastic quantization). Compressed ring gradients are
+     *       all-gathered and decoded instead of summed in flight. A summary
+     *       of compression ratio and encode/decode time is printed at exit;
+     *       GRAD_COMPRESS_VERBOSE=1 adds a per-step line
+     *         COMPRESS <step> <raw_bytes> <wire_bytes> <encode_us>
+     *
      * @return 0 on success, non-zero on error.
      */
     int run();
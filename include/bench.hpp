@@ -0,0 +1,167 @@
+/// @file bench.hpp
+/// @brief Shared harness for the bench_* microbenchmark executables.
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench
+{
+    /**
+     * @brief Measurement settings shared by all benchmarks.
+     *
+     * Environment:
+     *   - BENCH_WARMUP : untimed runs before measuring (default 3).
+     *   - BENCH_REPS   : timed repetitions (default 15).
+     *   - BENCH_CPU    : CPU to pin the process to; -1 disables (default 0).
+     */
+    struct Options
+    {
+        int warmup = 3;
+        int reps = 15;
+        int cpu = 0;
+    };
+
+    /**
+     * @brief Read Options from the environment.
+     *
+     * @param defaults Values used for unset variables.
+     */
+    Options options_from_env(const Options &defaults = Options());
+
+    /**
+     * @brief Pin the calling process to one CPU.
+     *
+     * Prints a warning and returns false if the CPU is unavailable; the
+     * benchmark still runs, only less reproducibly.
+     */
+    bool pin_cpu(int cpu);
+
+    /**
+     * @brief One CSV record shaped like the files in data/.
+     *
+     * Features are standard normal and the label a noisy linear function
+     * of them, written with 17 significant digits (no newline).
+     *
+     * @param id  Record id (first column).
+     * @param rng Random source.
+     */
+    std::string csv_record(std::size_t id, std::mt19937 &rng);
+
+    /**
+     * @brief Write an n-record CSV dataset (see csv_record()).
+     *
+     * @return true on success.
+     */
+    bool write_csv(const std::string &path, std::size_t n, unsigned seed);
+
+    /// @brief Robust summary of repeated measurements.
+    struct Summary
+    {
+        double min = 0.0;
+        double median = 0.0;
+        double mean = 0.0;
+        double stddev = 0.0; ///< Sample standard deviation.
+        double mad = 0.0;    ///< Median absolute deviation from the median.
+    };
+
+    /// @brief Summarize a set of measurements (empty input gives zeros).
+    Summary summarize(std::vector<double> values);
+
+    /// @brief Keep the compiler from discarding a computed value.
+    template <typename T>
+    inline void do_not_optimize(const T &value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    /**
+     * @brief Time fn() over opt.reps repetitions after opt.warmup runs.
+     *
+     * @return Wall-clock seconds of each timed repetition.
+     */
+    template <typename Fn>
+    std::vector<double> measure(const Options &opt, Fn &&fn)
+    {
+        using clock = std::chrono::steady_clock;
+        for (int i = 0; i < opt.warmup; ++i)
+        {
+            fn();
+        }
+        std::vector<double> seconds;
+        seconds.reserve(static_cast<std::size_t>(opt.reps));
+        for (int i = 0; i < opt.reps; ++i)
+        {
+            const clock::time_point t0 = clock::now();
+            fn();
+            seconds.push_back(std::chrono::duration<double>(clock::now() - t0).count());
+        }
+        return seconds;
+    }
+
+    /**
+     * @brief One benchmark case: its parameters and summarized metrics.
+     *
+     * Metric names carry their unit (e.g. "ns_per_record", "mb_per_s").
+     */
+    struct Result
+    {
+        std::string name;
+        std::vector<std::pair<std::string, double>> params;
+        std::vector<std::pair<std::string, Summary>> metrics;
+    };
+
+    /**
+     * @brief Apply f to every repetition time and summarize the result.
+     *
+     * Used to turn seconds per repetition into per-record metrics.
+     */
+    template <typename F>
+    Summary summarize_as(const std::vector<double> &seconds, F f)
+    {
+        std::vector<double> v;
+        v.reserve(seconds.size());
+        for (double s : seconds)
+        {
+            v.push_back(f(s));
+        }
+        return summarize(std::move(v));
+    }
+
+    /**
+     * @brief Write a suite's results as one JSON document.
+     *
+     * Layout:
+     *   {"suite": ..., "host": ..., "timestamp": ..., "warmup": ...,
+     *    "reps": ..., "cpu": ..., "results": [
+     *      {"name": ..., "params": {...},
+     *       "metrics": {"<metric>": {"min","median","mean","stddev","mad"}}}]}
+     */
+    void write_json(std::ostream &os, const std::string &suite,
+                    const Options &opt, const std::vector<Result> &results);
+
+    /// @brief A suite's results as read back from write_json() output.
+    struct Report
+    {
+        std::string suite;
+        std::string host;
+        std::vector<Result> results;
+    };
+
+    /**
+     * @brief Parse a document written by write_json().
+     *
+     * Unknown keys are ignored, so older and newer reports stay readable.
+     *
+     * @param is  Input stream.
+     * @param out Parsed report.
+     * @return false on malformed JSON or a missing "results" array.
+     */
+    bool read_json(std::istream &is, Report &out);
+
+} // namespace bench
@@ -0,0 +1,34 @@
+/// @file bench_compare.hpp
+/// @brief Interface for the bench_compare executable (regression check).
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace bench_compare
+{
+    /**
+     * @brief Run benchmark suites and compare them with stored baselines.
+     *
+     * Each suite s runs as bin/bench_<s> and its JSON is compared with
+     * bench/baseline/<s>.json, case by case (name plus params). Only the
+     * first metric of each case is compared: it is the primary one
+     * (ns_per_record, samples_per_s, ...); metrics named *per_s are
+     * higher-is-better, all others lower-is-better.
+     *
+     * A change counts as a regression only if the median got worse by
+     * more than both
+     *   BENCH_COMPARE_SIGMAS (default 4) * 1.4826 * sqrt(MAD_base^2 + MAD_new^2)
+     * (the MADs scaled to standard deviations) and
+     *   BENCH_COMPARE_MIN_PCT (default 5) percent of the baseline median,
+     * so noisy cases need a proportionally larger change. Improvements
+     * are reported the same way; cases present on one side only are
+     * listed but never fail the comparison.
+     *
+     * @param suites Suites to run (e.g. "io", "math", "ipc", "pipeline").
+     * @param update Overwrite the baselines with the new results instead.
+     * @return 0 if nothing regressed (or after --update), 1 on a
+     *         regression, 2 on an error.
+     */
+    int run(const std::vector<std::string> &suites, bool update);
+} // namespace bench_compare
@@ -0,0 +1,24 @@
+/// @file bench_io.hpp
+/// @brief Interface for the bench_io executable (parse/format microbenchmarks).
+#pragma once
+
+namespace bench_io
+{
+    /**
+     * @brief Benchmark the line parsing and formatting primitives.
+     *
+     * Generates BENCH_RECORDS (default 100000) CSV lines shaped like the
+     * files in data/ and the matching inter-stage lines, checks that every
+     * fast variant in common.hpp agrees exactly with its stream-based
+     * reference, then times each primitive over the whole set:
+     *   parse_csv_line, parse_sample_line, sample_to_line
+     * each as "<name>/stream" (reference) and "<name>/fast".
+     *
+     * Measurement settings come from bench::options_from_env(). Results
+     * (ns_per_record and mb_per_s) are printed on stdout as JSON (see
+     * bench::write_json); a one-line summary per case goes to stderr.
+     *
+     * @return 0 on success, non-zero if a fast variant disagrees.
+     */
+    int run();
+} // namespace bench_io
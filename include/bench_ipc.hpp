@@ -0,0 +1,36 @@
+/// @file bench_ipc.hpp
+/// @brief Interface for the bench_ipc executable (inter-stage transport comparison).
+#pragma once
+
+namespace bench_ipc
+{
+    /**
+     * @brief Benchmark moving Sample records between two processes.
+     *
+     * A forked producer sends BENCH_IPC_RECORDS records (default 50000)
+     * in batches to the parent over each transport:
+     *   pipe/<bytes>      pipe resized with F_SETPIPE_SZ, write()/read()
+     *   vmsplice/<bytes>  same pipe, producer maps its pages in with vmsplice()
+     *   unix              SOCK_STREAM socketpair
+     *   shm               single-producer/single-consumer ring in shared memory
+     * Each record is a common::Sample followed by the producer's
+     * CLOCK_MONOTONIC send time, from which the consumer derives the
+     * per-record latency.
+     *
+     * Environment (besides bench::options_from_env(); defaults here are
+     * 1 warmup, 5 repetitions):
+     *   - BENCH_IPC_RECORDS    : records per repetition.
+     *   - BENCH_IPC_BATCHES    : records per send (default 1,16,256).
+     *   - BENCH_IPC_PIPE_SIZES : F_SETPIPE_SZ sizes (default 4096,65536,1048576).
+     *   - BENCH_IPC_TRANSPORTS : subset of pipe,vmsplice,unix,shm (default all).
+     * With BENCH_CPU >= 0 the consumer runs on that CPU and the producer
+     * on the next one (the same one on a single-CPU machine).
+     *
+     * Metrics per case: records_per_s, mb_per_s, latency_p50_us,
+     * latency_p99_us, latency_p999_us and cpu_ns_per_record (user plus
+     * system time of both processes).
+     *
+     * @return 0 on success, non-zero on error.
+     */
+    int run();
+} // namespace bench_ipc
@@ -0,0 +1,35 @@
+/// @file bench_math.hpp
+/// @brief Interface for the bench_math executable (math kernel microbenchmarks).
+#pragma once
+
+namespace bench_math
+{
+    /**
+     * @brief Benchmark the math kernels across batch sizes and network shapes.
+     *
+     * Cases, for every shape D x H (input x hidden) and batch size b:
+     *   forward/scalar  math::forward() per sample (once per shape, b = 1)
+     *   forward/batch   math::forward_batch() in chunks of b
+     *   train/scalar    accumulate_gradient() per sample, apply per b
+     *   train/batch     accumulate_gradient_batch() per b, apply per b
+     * plus the fixed-shape single-model API used by the pipeline stages:
+     *   compute_forward, compute_backward_and_update
+     *
+     * Before timing, every batched variant is checked against the scalar
+     * reference (relative error at most 1e-4), and the single-model API
+     * against forward()/train_step() (exact).
+     *
+     * Environment (besides bench::options_from_env()):
+     *   - BENCH_SHAPES  : comma-separated DxH list (default 4x8,16x32,64x64,256x128).
+     *   - BENCH_BATCHES : comma-separated batch sizes (default 1,8,32,128,512).
+     *
+     * Metrics per case: samples_per_s and gflop_per_s. The params record
+     * input, hidden, batch and bytes_per_sample; FLOPs count multiplies
+     * and adds of the dense layers (forward 2HD + 3H, training another
+     * 2HD + 5H plus the update), bytes count the sample's own inputs and
+     * outputs plus parameter traffic amortized over the batch.
+     *
+     * @return 0 on success, non-zero on a numerical mismatch or bad option.
+     */
+    int run();
+} // namespace bench_math
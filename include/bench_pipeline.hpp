@@ -0,0 +1,38 @@
+/// @file bench_pipeline.hpp
+/// @brief Interface for the bench_pipeline executable (end-to-end throughput).
+#pragma once
+
+#include <string>
+
+namespace bench_pipeline
+{
+    /**
+     * @brief Benchmark whole trainer runs across datasets and configurations.
+     *
+     * For every dataset size and configuration, runs bin/trainer for a
+     * train phase and then a test phase of the trained model, each
+     * repeated as set by bench::options_from_env() (defaults: 1 warmup,
+     * 3 repetitions, unpinned, since the pipeline spans processes).
+     * Per-stage CPU time and peak RSS come from the trainer's
+     * TRAINER_STATS report. A run in which any stage fails aborts the
+     * benchmark.
+     *
+     * Environment (besides the BENCH_* options):
+     *   - BENCH_PIPELINE_SIZES   : comma-separated dataset sizes in records
+     *       (default 10000,100000); generated once under logs/bench_pipeline/.
+     *   - BENCH_PIPELINE_CONFIGS : semicolon-separated "name:VAR=value,..."
+     *       entries whose variables are set for that configuration's trainer
+     *       runs (default: single pipeline, ring all-reduce with 2 workers
+     *       over UNIX and TCP sockets, 2 workers with DDP_BATCH=128, and
+     *       the parameter server with 2 workers).
+     *
+     * Each result is named "<config>/<phase>" with params samples and
+     * workers, and metrics wall_s, samples_per_s, and per stage kind
+     * cpu_s.<stage> (summed over workers) and max_rss_kb.<stage> (largest
+     * worker).
+     *
+     * @param out_path JSON output file; empty writes to stdout.
+     * @return 0 on success, non-zero on error.
+     */
+    int run(const std::string &out_path);
+} // namespace bench_pipeline
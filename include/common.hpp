@@ -3,7 +3,11 @@
 #pragma once
 
 #include <cstddef>
+#include <limits.h>
+#include <streambuf>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace common
 {
@@ -57,6 +61,111 @@ namespace common
      */
     bool parse_sample_line(const std::string &line, Sample &out);
 
+    /**
+     * @brief Allocation-free equivalent of parse_csv_line().
+     *
+     * Accepts the same lines and yields the same values, but parses with
+     * std::from_chars instead of constructing a stringstream per line.
+     */
+    bool parse_csv_fast(std::string_view line, Sample &out);
+
+    /**
+     * @brief Allocation-free equivalent of parse_sample_line().
+     */
+    bool parse_sample_fast(std::string_view line, Sample &out);
+
+    /**
+     * @brief Append sample_to_line(s) to out.
+     *
+     * Produces byte-identical text (6 significant digits) with
+     * std::to_chars; reusing out across calls avoids all allocation.
+     */
+    void append_sample_line(const Sample &s, std::string &out);
+
+    /**
+     * @brief Round a sample's values as a trip through the line format would.
+     *
+     * Afterwards s equals parse_sample_line(sample_to_line(s)), without
+     * building the line. Used where stages run fused in one process but
+     * must produce exactly the output of separate processes.
+     */
+    void round_to_wire(Sample &s);
+
+    /**
+     * @brief A sample of any feature width.
+     *
+     * Stages after forward_layer see rows of INPUT_DIM features, or more
+     * when forward_layer expands them (FORWARD_EXPAND).
+     */
+    struct FeatureRow
+    {
+        int id = 0;           ///< Sample identifier.
+        std::vector<float> x; ///< Features.
+        float y = 0.0f;       ///< Target label.
+    };
+
+    /**
+     * @brief Parse "id x_0 ... x_{D-1} y" for any width D >= 1.
+     *
+     * Accepts the same numbers as parse_sample_line(); out.x is resized
+     * to the number of features on the line.
+     *
+     * @return false on a malformed line.
+     */
+    bool parse_feature_line(std::string_view line, FeatureRow &out);
+
+    /**
+     * @brief Reason code for a line the parsers above rejected.
+     *
+     * @param line     Rejected line.
+     * @param sep      Field separator: ',' for CSV, ' ' for whitespace.
+     * @param expected Fields of a good line (0: any number from 3 up).
+     * @return "field_count" if the line has a wrong number of fields,
+     *         else "bad_number".
+     */
+    const char *reject_reason(std::string_view line, char sep, std::size_t expected);
+
+    /**
+     * @brief Append "id x_0 ... x_{dim-1} y" to out (no newline).
+     *
+     * Formatted like sample_to_line(), which it matches for dim == INPUT_DIM.
+     */
+    void append_feature_line(int id, const float *x, std::size_t dim, float y, std::string &out);
+
+    /**
+     * @brief Output buffer that writes only whole lines, PIPE_BUF bytes at most.
+     *
+     * POSIX guarantees that pipe writes of up to PIPE_BUF bytes are not
+     * interleaved with other writers, so several processes can share one
+     * output pipe through this buffer without mixing partial lines.
+     * Typical use: std::cout.rdbuf(&buf).
+     */
+    class AtomicLineBuf : public std::streambuf
+    {
+    public:
+        /**
+         * @param fd File descriptor to write to (not owned).
+         */
+        explicit AtomicLineBuf(int fd);
+        ~AtomicLineBuf() override;
+
+    protected:
+        int_type overflow(int_type ch) override;
+        int sync() override;
+
+    private:
+        /**
+         * @brief Write buffered data up to the last complete line.
+         *
+         * @param all Also write a trailing partial line.
+         * @return true on success.
+         */
+        bool flush_lines(bool all);
+
+        int fd_;
+        char buf_[PIPE_BUF];
+    };
+
 } // namespace common
 
 
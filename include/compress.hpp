@@ -0,0 +1,108 @@
+/// @file compress.hpp
+/// @brief Lossy gradient compression for multi-worker training.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace compress
+{
+    /// @brief Compression scheme.
+    enum class Method : std::uint32_t
+    {
+        None = 0, ///< Raw floats.
+        TopK = 1, ///< Largest-magnitude k entries as (index, value) pairs.
+        Q8 = 2    ///< 8-bit stochastic quantization over [min, max].
+    };
+
+    /// @brief Compression settings.
+    struct Config
+    {
+        Method method = Method::None; ///< Scheme.
+        float fraction = 0.01f;       ///< TopK: share of entries kept.
+    };
+
+    /// @brief Running totals for compression metrics.
+    struct Stats
+    {
+        std::uint64_t steps = 0;      ///< Encoded gradients.
+        std::uint64_t raw_bytes = 0;  ///< Sum of uncompressed sizes.
+        std::uint64_t wire_bytes = 0; ///< Sum of encoded sizes.
+        double encode_seconds = 0.0;  ///< Time spent in encode().
+        double decode_seconds = 0.0;  ///< Time spent in decode_add().
+    };
+
+    /**
+     * @brief Per-worker compressor state.
+     *
+     * TopK keeps an error-feedback residual: whatever was not sent in one
+     * step is added to the next step's gradient, so no update is lost,
+     * only delayed. Q8 rounds up or down at random with probabilities
+     * that make the decoded value unbiased.
+     */
+    struct Compressor
+    {
+        Config config;              ///< Settings.
+        std::vector<float> residual; ///< TopK error feedback.
+        std::mt19937 rng;           ///< Q8 rounding noise.
+        Stats stats;                ///< Metrics.
+        bool verbose = false;       ///< Print a COMPRESS line per step.
+    };
+
+    /**
+     * @brief Parse a GRAD_COMPRESS value: "none", "topk[:fraction]" or "q8".
+     *
+     * @param spec Specification.
+     * @param out  Output settings.
+     * @return true on success, false if spec is malformed.
+     */
+    bool parse_config(const std::string &spec, Config &out);
+
+    /**
+     * @brief Build a compressor from GRAD_COMPRESS and GRAD_COMPRESS_VERBOSE.
+     *
+     * @param seed Seed for the stochastic rounding (e.g. the worker rank).
+     * @param out  Output compressor.
+     * @return true on success, false on a malformed GRAD_COMPRESS.
+     */
+    bool from_env(unsigned seed, Compressor &out);
+
+    /**
+     * @brief Encode n floats into a self-describing byte payload.
+     *
+     * @param c    Compressor (residual, RNG and stats are updated).
+     * @param grad Gradient to encode.
+     * @param n    Number of floats.
+     * @param out  Output payload (replaced).
+     */
+    void encode(Compressor &c, const float *grad, std::size_t n, std::vector<char> &out);
+
+    /**
+     * @brief Largest payload encode() writes for n floats (any method),
+     *        for bounding what a receiver accepts.
+     */
+    std::size_t max_payload(std::size_t n);
+
+    /**
+     * @brief Decode a payload written by encode() and add it to dst.
+     *
+     * @param c    Compressor whose stats are updated.
+     * @param data Payload.
+     * @param len  Payload size in bytes.
+     * @param dst  Accumulator of n floats.
+     * @param n    Expected number of floats.
+     * @return true on success, false if the payload is malformed.
+     */
+    bool decode_add(Compressor &c, const char *data, std::size_t len, float *dst, std::size_t n);
+
+    /**
+     * @brief Print a one-line summary of the compressor's metrics to stderr.
+     *
+     * @param c   Compressor.
+     * @param who Prefix identifying the worker.
+     */
+    void report(const Compressor &c, const std::string &who);
+} // namespace compress
@@ -0,0 +1,33 @@
+/// @file crossval.hpp
+/// @brief Interface for the crossval executable (k-fold cross-validation).
+#pragma once
+
+#include <string>
+
+namespace crossval
+{
+    /**
+     * @brief Run k-fold cross-validation over a CSV dataset.
+     *
+     * The CSV is parsed once into a binary dataset cache (see dataset.hpp)
+     * which is mapped read-only and shared by all folds. Sample i belongs
+     * to fold hash(id) mod k. Each fold runs in its own child process,
+     * trains a fresh model on the other k-1 folds and evaluates it on its
+     * own fold; at most CROSSVAL_JOBS folds run at the same time.
+     *
+     * Environment:
+     *   - CROSSVAL_FOLDS  : number of folds k (default 5).
+     *   - CROSSVAL_JOBS   : maximum concurrent folds (default: online CPUs).
+     *   - CROSSVAL_EPOCHS : passes over the training folds (default 1).
+     *   - CROSSVAL_CONFIG : model spec as in MODEL_CONFIGS, e.g. "lr=0.01".
+     *   - DATASET_CACHE   : cache path (default logs/<csv basename>.bin).
+     *
+     * Output on stdout, one line per fold followed by the aggregate:
+     *   FOLD <k> <train_samples> <train_avg_loss> <test_samples> <test_avg_loss>
+     *   CROSSVAL_SUMMARY <folds> <mean_test_loss> <stddev_test_loss>
+     *
+     * @param csv_path Path to the CSV dataset.
+     * @return 0 on success, non-zero on error.
+     */
+    int run(const std::string &csv_path);
+} // namespace crossval
@@ -0,0 +1,64 @@
+/// @file dataset.hpp
+/// @brief Binary, memory-mappable cache of a preprocessed CSV dataset.
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "common.hpp"
+
+namespace dataset
+{
+    /**
+     * @brief A dataset cache mapped read-only into memory.
+     *
+     * The samples are stored exactly as the pipeline would hand them to
+     * backward_layer (parsed, normalized and augmented), so training code
+     * can use them without any further parsing.
+     */
+    struct MappedDataset
+    {
+        const common::Sample *samples = nullptr; ///< First sample.
+        std::size_t count = 0;                   ///< Number of samples.
+        void *base = nullptr;                    ///< Start of the mapping.
+        std::size_t length = 0;                  ///< Length of the mapping.
+    };
+
+    /**
+     * @brief Default cache path for a CSV file.
+     *
+     * Uses DATASET_CACHE if set, otherwise "logs/<csv basename>.bin".
+     *
+     * @param csv_path Path to the CSV dataset.
+     * @return Cache file path.
+     */
+    std::string default_cache_path(const std::string &csv_path);
+
+    /**
+     * @brief Build the binary cache for a CSV file unless it is up to date.
+     *
+     * The cache is rebuilt when it is missing, older than the CSV file or
+     * was written for a different Sample layout. Lines that fail to parse
+     * are skipped, as in preprocess.
+     *
+     * @param csv_path   Path to the CSV dataset.
+     * @param cache_path Path to the binary cache.
+     * @return true on success, false on error.
+     */
+    bool ensure_cache(const std::string &csv_path, const std::string &cache_path);
+
+    /**
+     * @brief Map a binary cache read-only.
+     *
+     * @param cache_path Path to a cache written by ensure_cache.
+     * @param out        Output mapping.
+     * @return true on success, false on error.
+     */
+    bool map_dataset(const std::string &cache_path, MappedDataset &out);
+
+    /**
+     * @brief Release a mapping obtained from map_dataset.
+     *
+     * @param ds Mapping to release (reset to empty).
+     */
+    void unmap_dataset(MappedDataset &ds);
+} // namespace dataset
@@ -0,0 +1,110 @@
+/// @file feature_plugin.hpp
+/// @brief Feature transform plugins: C ABI and loader used by forward_layer.
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/// @brief Version of the plugin ABI below; bumped on any layout change.
+#define FEATURE_PLUGIN_ABI 1
+
+extern "C"
+{
+    /**
+     * @brief A batch of samples handed to a plugin.
+     *
+     * Features are row-major: sample i's features are
+     * x[i * dim] .. x[i * dim + dim - 1]. Plugins transform x (and may
+     * touch y) in place; n, dim and id are read-only.
+     */
+    struct SampleBatch
+    {
+        float *x;        ///< n * dim features.
+        float *y;        ///< n labels.
+        const int *id;   ///< n sample ids.
+        std::size_t n;   ///< Samples in the batch.
+        std::size_t dim; ///< Features per sample.
+    };
+
+    /**
+     * @brief What a plugin exports, through a function named
+     *        get_feature_plugin() returning a pointer to a static instance.
+     *
+     * create() and destroy() may be null for plugins without state.
+     */
+    struct FeaturePlugin
+    {
+        unsigned abi;     ///< Must be FEATURE_PLUGIN_ABI.
+        const char *name; ///< Short name for diagnostics.
+
+        /// @brief Build the plugin's state from its argument string
+        ///        ("" if none); null means the arguments were rejected.
+        void *(*create)(const char *args);
+
+        /// @brief Transform a batch in place; non-zero means failure.
+        int (*apply)(void *state, SampleBatch *batch);
+
+        void (*destroy)(void *state);
+    };
+
+    /// @brief Signature of the exported entry point.
+    typedef const FeaturePlugin *(*feature_plugin_fn)(void);
+}
+
+namespace feature_plugin
+{
+    /**
+     * @brief Plugins loaded with dlopen() and applied in order.
+     *
+     * Each transform costs one call per batch instead of a pipeline
+     * stage of its own.
+     */
+    class Chain
+    {
+    public:
+        Chain() = default;
+        ~Chain();
+
+        Chain(const Chain &) = delete;
+        Chain &operator=(const Chain &) = delete;
+
+        /**
+         * @brief Load the plugins named by a spec.
+         *
+         * Format: "<path.so>[:<args>];<path.so>[:<args>];..." - e.g.
+         * FORWARD_PLUGINS="bin/plugins/clip_features.so:2.5".
+         *
+         * @return false (with a message on stderr) if a library cannot be
+         *         loaded, lacks get_feature_plugin(), has another ABI version
+         *         or rejects its arguments.
+         */
+        bool load(const std::string &spec);
+
+        /// @brief Whether no plugin is loaded.
+        bool empty() const { return plugins_.empty(); }
+
+        /**
+         * @brief Run every plugin over a batch.
+         *
+         * @return false (with a message on stderr) if a plugin fails.
+         */
+        bool apply(SampleBatch &batch);
+
+        /// @brief Print per-plugin batch count and time to stderr.
+        void report(const char *stage) const;
+
+    private:
+        struct Loaded
+        {
+            void *handle;
+            const FeaturePlugin *api;
+            void *state;
+            std::size_t batches;
+            double seconds;
+        };
+
+        std::vector<Loaded> plugins_;
+    };
+
+} // namespace feature_plugin
@@ -10,6 +10,19 @@ namespace forward_layer
      * Reads normalized samples from stdin, performs simple feature
      * augmentation, and writes them to stdout in the same format.
      *
+     * Samples are processed in batches of FORWARD_BATCH (default 256).
+     * FORWARD_PLUGINS loads feature transform plugins (shared objects,
+     * see feature_plugin.hpp) that run on each batch, in order, after
+     * the built-in augmentation; e.g.
+     *   FORWARD_PLUGINS="bin/plugins/clip_features.so:2.5"
+     *
+     * FORWARD_EXPAND (e.g. "pairs,pow:3,cross:0*3", see
+     * math::parse_expansion) appends polynomial and cross terms of the
+     * augmented features (the last one already squared) last, so
+     * the output lines carry more than INPUT_DIM features; backward_layer
+     * sizes its network from the first line it reads. The expansion's
+     * time and output bytes per sample are reported on stderr at exit.
+     *
      * @return 0 on success, non-zero on error.
      */
     int run();
@@ -0,0 +1,72 @@
+/// @file job_server.hpp
+/// @brief trainer --daemon: a priority queue of train/test jobs.
+#pragma once
+
+#include <string>
+
+namespace job_server
+{
+    /**
+     * @brief Settings of the daemon.
+     *
+     * Environment:
+     *   - TRAINER_SOCKET : UNIX socket path (default /tmp/trainer.sock).
+     *   - TRAINER_JOBS   : jobs run at the same time (default 2).
+     *   - TRAINER_WARM   : "0" forks every job instead of keeping warm
+     *                      stages (see serve()).
+     */
+    struct Options
+    {
+        std::string socket_path = "/tmp/trainer.sock";
+        int jobs = 2;
+        bool warm = true;   ///< Keep a lane of warm stages per slot.
+        std::string config; ///< Pipeline description passed to trainer::run.
+    };
+
+    /// @brief Read Options from the environment.
+    Options options_from_env();
+
+    /**
+     * @brief Run the daemon until SIGINT/SIGTERM or a SHUTDOWN request.
+     *
+     * Clients connect to the socket and send one line:
+     *   JOB csv=<path> [phase=train|test] [model=<path>] [priority=<n>]
+     *       [workers=<n>] [fuse=0|1]
+     * or
+     *   SHUTDOWN
+     * Jobs run highest priority first, FIFO within a priority. The
+     * client gets "QUEUED <id> <position>", "START <id>", the logger's
+     * output (SAMPLE / SUMMARY lines) as it is produced, and finally
+     * "DONE <id> <status>"; a bad request gets "ERROR <message>".
+     *
+     * Every slot keeps a lane: one long-lived process per stage of the
+     * pipeline, started at daemon start as "<stage> --serve <fd>" (see
+     * stage_io::serve()). A job on a lane gets fresh edges between the
+     * stages, the logger's output goes to the client's socket, and the
+     * stages run it without being spawned, dynamically linked or set up
+     * again; backward_layer keeps models it has loaded while the file is
+     * unchanged. A stage that exits is started again for the next job.
+     *
+     * Jobs a lane cannot run go to a forked runner, which points its
+     * stdout at the client's socket, calls trainer::run() and exits:
+     * jobs with workers > 1 or fuse=1, and every job if the daemon has
+     * TRAINER_WARM=0, several workers in its topology or TRAINER_WORKERS,
+     * or runs with TRAINER_PS, TRAINER_STALL_SECS, TRAINER_MEMORY_BUDGET
+     * or TRAINER_STATS. Stage stderr on a lane goes to the daemon's
+     * stderr unprefixed, and the rejected-row total is not reported.
+     *
+     * @return 0 on a clean shutdown, non-zero on a setup error.
+     */
+    int serve(const Options &opt);
+
+    /**
+     * @brief Submit a job and copy the daemon's replies to stdout.
+     *
+     * @param socket_path Daemon socket.
+     * @param request     Request line without the newline (see serve()).
+     * @return The job's status from its DONE line, 0 for SHUTDOWN, or
+     *         1 if the job was rejected or the connection failed.
+     */
+    int submit(const std::string &socket_path, const std::string &request);
+
+} // namespace job_server
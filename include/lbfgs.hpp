@@ -0,0 +1,47 @@
+/// @file lbfgs.hpp
+/// @brief Interface for the lbfgs executable (full-batch L-BFGS training).
+#pragma once
+
+#include <string>
+
+namespace lbfgs
+{
+    /**
+     * @brief Train a model with full-batch L-BFGS over a CSV dataset.
+     *
+     * The CSV is parsed once into the binary dataset cache (see
+     * dataset.hpp), which is mapped read-only. Every iteration needs the
+     * mean loss 0.5 * (y_hat - y)^2 and its gradient over the whole
+     * dataset. They are computed on LBFGS_THREADS threads over shards
+     * of 1024 samples. Each shard's partial sums go to a slot of their
+     * own and are added in shard order, so the result does not depend
+     * on the thread count or scheduling. The search direction comes from
+     * the last LBFGS_HISTORY curvature pairs (two-loop recursion); the
+     * step from a backtracking line search with the Armijo condition.
+     *
+     * The model is math_layer's network, starting from the usual
+     * initial parameters, and is saved with math::save_model(), so
+     * backward_layer can evaluate or keep training it.
+     *
+     * Environment:
+     *   - LBFGS_ITERS   : maximum iterations (default 100).
+     *   - LBFGS_HISTORY : curvature pairs kept (default 10).
+     *   - LBFGS_THREADS : gradient threads (default: online CPUs).
+     *   - LBFGS_GTOL    : stop once the gradient norm is below this
+     *                     (default 1e-6).
+     *   - LBFGS_FTOL    : stop once an iteration lowers the loss by
+     *                     less than this, relative (default 1e-9).
+     *   - LBFGS_CONFIG  : model spec as in MODEL_CONFIGS; only hidden
+     *                     applies.
+     *   - MODEL_FILE    : output (default logs/model_params.txt).
+     *   - DATASET_CACHE : cache path (default logs/<csv basename>.bin).
+     *
+     * Output on stdout, one line per iteration followed by the result:
+     *   ITER <k> <loss> <grad_norm> <step> <evaluations>
+     *   LBFGS_SUMMARY <iterations> <evaluations> <loss> <grad_norm> <seconds>
+     *
+     * @param csv_path Path to the CSV dataset.
+     * @return 0 on success, non-zero on error.
+     */
+    int run(const std::string &csv_path);
+} // namespace lbfgs
@@ -10,7 +10,16 @@ namespace logger
      * Reads lines of the form:
      *   id loss y_hat
      *
-     * from stdin, maintains summary statistics, and reacts to signals:
+     * from stdin and maintains summary statistics. Lines may carry several
+     * (loss, y_hat) pairs, one per model evaluated by backward_layer:
+     *   id loss_0 y_hat_0 loss_1 y_hat_1 ...
+     *
+     * With one pair per line the final summary is
+     *   SUMMARY <samples> <avg_loss> <avg_yhat>
+     * and with several pairs one line per model is written instead:
+     *   SUMMARY_MODEL <k> <samples> <avg_loss> <avg_yhat>
+     *
+     * Signals:
      *   - SIGUSR1: print intermediate statistics to stderr.
      *   - SIGTERM: request graceful termination (flush and exit).
      *
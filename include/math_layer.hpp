@@ -4,10 +4,258 @@
 
 #include <cstddef>
 #include <string>
+#include <vector>
 #include "common.hpp"
 
 namespace math
 {
+    /// @brief Hidden layer size of the default network.
+    constexpr std::size_t DEFAULT_HIDDEN_DIM = 8;
+
+    /**
+     * @brief Parameters of one small fully connected network.
+     *
+     * All parameters live in one flat vector with the layout
+     *   W1 (hidden_dim x input_dim, row-major), b1 (hidden_dim),
+     *   w2 (hidden_dim), b2 (1)
+     * so that whole-model operations can treat them as a single buffer.
+     */
+    struct Model
+    {
+        std::size_t input_dim = 0;  ///< Number of input features.
+        std::size_t hidden_dim = 0; ///< Number of hidden (ReLU) units.
+        std::vector<float> params;  ///< Flat parameter storage.
+
+        float *W1() { return params.data(); }
+        float *b1() { return W1() + hidden_dim * input_dim; }
+        float *w2() { return b1() + hidden_dim; }
+        float &b2() { return w2()[hidden_dim]; }
+        const float *W1() const { return params.data(); }
+        const float *b1() const { return W1() + hidden_dim * input_dim; }
+        const float *w2() const { return b1() + hidden_dim; }
+        float b2() const { return w2()[hidden_dim]; }
+    };
+
+    /**
+     * @brief Several models packed for joint evaluation.
+     *
+     * The hidden layers of all models are stacked into one matrix, so a
+     * sample goes through every model in a single pass over contiguous
+     * memory instead of one small matrix-vector product per model.
+     * All stacked models share the same input dimension.
+     */
+    struct ModelStack
+    {
+        std::size_t input_dim = 0;            ///< Shared input dimension.
+        std::vector<float> W1;                ///< Stacked W1 rows.
+        std::vector<float> b1;                ///< Stacked hidden biases.
+        std::vector<float> w2;                ///< Stacked output weights.
+        std::vector<float> b2;                ///< Output bias per model.
+        std::vector<std::size_t> hidden_end;  ///< End row of each model.
+    };
+
+    /// @brief Default SGD learning rate.
+    constexpr float DEFAULT_LEARNING_RATE = 0.001f;
+
+    /// @brief Parameter update rule.
+    enum class Optimizer
+    {
+        Sgd,      ///< p -= lr * g
+        Momentum  ///< v = mu * v + g; p -= lr * v
+    };
+
+    /// @brief Hyperparameters for training one model.
+    struct TrainConfig
+    {
+        std::size_t hidden_dim = DEFAULT_HIDDEN_DIM; ///< Hidden layer size.
+        float learning_rate = DEFAULT_LEARNING_RATE; ///< Step size.
+        Optimizer optimizer = Optimizer::Sgd;        ///< Update rule.
+        float momentum = 0.9f;                       ///< mu for Optimizer::Momentum.
+    };
+
+    /**
+     * @brief A model together with its training configuration and state.
+     *
+     * Scratch buffers are kept here so per-sample steps do not allocate.
+     */
+    struct TrainState
+    {
+        Model model;                 ///< Parameters being trained.
+        TrainConfig config;          ///< Hyperparameters.
+        std::vector<float> velocity; ///< Momentum buffer (model layout).
+        std::vector<float> grad;     ///< Gradient scratch (model layout).
+        std::vector<float> z1;       ///< Hidden pre-activation scratch.
+        std::vector<float> a1;       ///< Hidden activation scratch.
+        std::vector<float> batch;    ///< Scratch of the *_batch functions.
+    };
+
+    /// @brief Samples processed together by the *_batch functions.
+    constexpr std::size_t BATCH_BLOCK = 32;
+
+    /**
+     * @brief Create a model with the deterministic initial parameters.
+     *
+     * Hidden unit j starts as +/-0.1 times input feature (j mod input_dim),
+     * with the sign flipping every input_dim units; output weights are
+     * +/-0.05 with the same sign pattern, biases are zero.
+     *
+     * @param input_dim  Number of input features.
+     * @param hidden_dim Number of hidden units.
+     * @return Initialized model.
+     */
+    Model make_model(std::size_t input_dim, std::size_t hidden_dim);
+
+    /**
+     * @brief Forward pass of a single model.
+     *
+     * @param m Model to evaluate.
+     * @param x Input features (m.input_dim values).
+     * @return Scalar prediction.
+     */
+    float forward(const Model &m, const float *x);
+
+    /**
+     * @brief Create a training state with freshly initialized parameters.
+     *
+     * @param input_dim Number of input features.
+     * @param config    Hyperparameters (hidden_dim sizes the model).
+     * @return Ready-to-train state.
+     */
+    TrainState make_train_state(std::size_t input_dim, const TrainConfig &config);
+
+    /**
+     * @brief Parse a model configuration such as "hidden=16,lr=0.01,opt=momentum".
+     *
+     * Recognized keys: hidden, lr, opt (sgd | momentum), momentum.
+     * Keys not present keep their default values.
+     *
+     * @param spec Comma-separated key=value list (may be empty).
+     * @param out  Output configuration.
+     * @return true on success, false on an unknown key or bad value.
+     */
+    bool parse_train_config(const std::string &spec, TrainConfig &out);
+
+    /**
+     * @brief Accumulate the MSE gradient of one sample.
+     *
+     * Adds dL/dparams for L = 0.5 * (y_hat - y)^2 to grad (model layout).
+     *
+     * @param st    Training state (model and scratch buffers).
+     * @param x     Input features (model.input_dim values).
+     * @param y     Target label.
+     * @param grad  Gradient accumulator (model.params.size() values).
+     * @param loss  Output loss of this sample.
+     * @param y_hat Output prediction of this sample.
+     */
+    void accumulate_gradient(TrainState &st,
+                             const float *x,
+                             float y,
+                             float *grad,
+                             float &loss,
+                             float &y_hat);
+
+    /**
+     * @brief Apply a gradient with the state's optimizer.
+     *
+     * @param st    Training state to update.
+     * @param grad  Gradient (model layout).
+     * @param scale Factor applied to grad first (e.g. 1/batch for averaging).
+     */
+    void apply_gradient(TrainState &st, const float *grad, float scale);
+
+    /**
+     * @brief One SGD step on a single sample.
+     *
+     * @param st        Training state to update.
+     * @param x         Input features.
+     * @param y         Target label.
+     * @param loss      Output loss (before the update).
+     * @param y_hat     Output prediction (before the update).
+     * @param grad_norm Output L2 norm of the gradient.
+     */
+    void train_step(TrainState &st,
+                    const float *x,
+                    float y,
+                    float &loss,
+                    float &y_hat,
+                    float &grad_norm);
+
+    /**
+     * @brief Forward pass of st.model over n samples.
+     *
+     * Processes BATCH_BLOCK samples at a time with the features transposed
+     * into the scratch buffer, so the inner loops run over samples and
+     * vectorize regardless of the (small) input and hidden sizes.
+     * Batches of only a few samples take the scalar path instead.
+     * Results match forward() up to float rounding.
+     *
+     * @param st    Training state (model and scratch).
+     * @param X     Inputs, n rows of model.input_dim values.
+     * @param n     Number of samples.
+     * @param y_hat Output predictions (n values).
+     */
+    void forward_batch(TrainState &st, const float *X, std::size_t n, float *y_hat);
+
+    /**
+     * @brief Batched accumulate_gradient() over n samples.
+     *
+     * Same blocking as forward_batch(). The gradient is summed over the
+     * block before being added to grad, so it matches the per-sample
+     * accumulation up to float rounding.
+     *
+     * @param st    Training state (model and scratch).
+     * @param X     Inputs, n rows of model.input_dim values.
+     * @param Y     Target labels (n values).
+     * @param n     Number of samples.
+     * @param grad  Gradient accumulator (model layout).
+     * @param loss  Output loss per sample (n values).
+     * @param y_hat Output prediction per sample (n values).
+     */
+    void accumulate_gradient_batch(TrainState &st,
+                                   const float *X,
+                                   const float *Y,
+                                   std::size_t n,
+                                   float *grad,
+                                   float *loss,
+                                   float *y_hat);
+
+    /**
+     * @brief Pack models into a ModelStack.
+     *
+     * @param models Models to stack (all with the same input_dim).
+     * @return Packed stack.
+     */
+    ModelStack stack_models(const std::vector<Model> &models);
+
+    /**
+     * @brief Forward pass of every model in a stack for one sample.
+     *
+     * @param stack  Packed models.
+     * @param x      Input features (stack.input_dim values).
+     * @param y_hat  Output predictions, one per stacked model.
+     */
+    void forward_stack(const ModelStack &stack, const float *x, float *y_hat);
+
+    /**
+     * @brief Save a model to a text file (same format as save_parameters).
+     *
+     * @param path Path to the file (will be overwritten).
+     * @param m    Model to save.
+     * @return true on success, false on failure.
+     */
+    bool save_model(const std::string &path, const Model &m);
+
+    /**
+     * @brief Load a model from a text file written by save_model.
+     *
+     * The dimensions are taken from the file header.
+     *
+     * @param path Path to the file.
+     * @param m    Output model (unchanged on failure).
+     * @return true on success, false on failure.
+     */
+    bool load_model(const std::string &path, Model &m);
+
     /**
      * @brief Normalize a single sample in-place.
      *
@@ -27,6 +275,70 @@ namespace math
      */
     void augment_features(common::Sample &s);
 
+    /**
+     * @brief Extra features generated from a sample's features.
+     *
+     * Each term is the product of the listed input features: {0, 3} is
+     * x0 * x3, {2, 2, 2} is x2^3. Expanded rows hold the input features
+     * followed by one value per term.
+     *
+     * In forward_layer the input features are the augmented ones
+     * (augment_features() has already squared the last feature), so a
+     * term on that feature raises the square: pow:2 gives x3^4 there.
+     */
+    struct Expansion
+    {
+        std::size_t input_dim = 0;                    ///< Features per input row.
+        std::vector<std::vector<std::size_t>> terms;  ///< Factor indices per term.
+    };
+
+    /// @brief Features per expanded row.
+    inline std::size_t expanded_dim(const Expansion &e)
+    {
+        return e.input_dim + e.terms.size();
+    }
+
+    /**
+     * @brief Parse an expansion such as "pairs,pow:3,cross:0*3".
+     *
+     * Comma-separated items, terms added in the order given:
+     *   - pairs          : x_i * x_j for all i < j
+     *   - pow:<d>        : x_i^k for every feature i and 2 <= k <= d
+     *   - cross:<i>*<j>[*<k>...] : one product of the listed features
+     *
+     * @param spec      Expansion spec (empty gives no terms).
+     * @param input_dim Features per input row.
+     * @param out       Parsed expansion.
+     * @return false on an unknown item or an out-of-range index.
+     */
+    bool parse_expansion(const std::string &spec, std::size_t input_dim, Expansion &out);
+
+    /**
+     * @brief Expand n rows of e.input_dim features into expanded_dim(e) each.
+     *
+     * Works on BATCH_BLOCK rows at a time with the features transposed so
+     * every term is a few vector multiplies across the block.
+     *
+     * @param e       Expansion to apply.
+     * @param X       Inputs, n rows of e.input_dim values.
+     * @param n       Number of rows.
+     * @param out     Output, n rows of expanded_dim(e) values.
+     * @param scratch Reused scratch buffer.
+     */
+    void expand_batch(const Expansion &e, const float *X, std::size_t n,
+                      float *out, std::vector<float> &scratch);
+
+    /**
+     * @brief Feature width of forward_layer's output under FORWARD_EXPAND.
+     *
+     * For stages that must know the width without reading the stream
+     * (the parameter server, a worker with an empty shard).
+     *
+     * @return The expanded width, or INPUT_DIM if FORWARD_EXPAND is unset
+     *         or invalid.
+     */
+    std::size_t stream_dim_from_env();
+
     /**
      * @brief Compute the forward pass for a single sample.
      *
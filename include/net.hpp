@@ -0,0 +1,107 @@
+/// @file net.hpp
+/// @brief Small socket helpers shared by the multi-process training modes.
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace net
+{
+    /**
+     * @brief Base address from which per-rank socket addresses are derived.
+     *
+     * Textual forms:
+     *   - "unix:<path>"      : rank r listens on the UNIX socket <path>.<r>
+     *   - "tcp:<host>:<port>": rank r listens on <host>:<port + r>
+     */
+    struct Endpoint
+    {
+        bool is_unix = true; ///< UNIX domain socket (true) or TCP (false).
+        std::string path;    ///< Socket path prefix (UNIX).
+        std::string host;    ///< IPv4 host (TCP).
+        int port = 0;        ///< Base port (TCP).
+    };
+
+    /**
+     * @brief Parse an endpoint specification.
+     *
+     * @param spec Text such as "unix:/tmp/ddp" or "tcp:127.0.0.1:29500".
+     * @param out  Output endpoint.
+     * @return true on success, false on a malformed spec.
+     */
+    bool parse_endpoint(const std::string &spec, Endpoint &out);
+
+    /**
+     * @brief Create a listening socket for a rank.
+     *
+     * A stale UNIX socket file at the rank's path is removed first.
+     *
+     * @param ep   Base endpoint.
+     * @param rank Rank whose address to listen on.
+     * @return Listening socket, or -1 on error.
+     */
+    int listen_rank(const Endpoint &ep, int rank);
+
+    /**
+     * @brief Connect to a rank's listening socket, retrying until it exists.
+     *
+     * @param ep         Base endpoint.
+     * @param rank       Rank to connect to.
+     * @param timeout_ms Give up after this many milliseconds.
+     * @return Connected socket, or -1 on error or timeout.
+     */
+    int connect_rank(const Endpoint &ep, int rank, int timeout_ms);
+
+    /**
+     * @brief Accept one connection on a socket created by listen_rank.
+     *
+     * @param ep        Base endpoint (selects socket options).
+     * @param listen_fd Listening socket.
+     * @return Connected socket, or -1 on error.
+     */
+    int accept_peer(const Endpoint &ep, int listen_fd);
+
+    /**
+     * @brief Remove the UNIX socket file of a rank (no-op for TCP).
+     *
+     * @param ep   Base endpoint.
+     * @param rank Rank whose socket file to remove.
+     */
+    void unlink_rank(const Endpoint &ep, int rank);
+
+    /**
+     * @brief Write exactly len bytes, retrying on short writes and EINTR.
+     *
+     * @return true on success, false on error or closed peer.
+     */
+    bool send_all(int fd, const void *buf, std::size_t len);
+
+    /**
+     * @brief Read exactly len bytes, retrying on short reads and EINTR.
+     *
+     * @return true on success, false on error or EOF.
+     */
+    bool recv_all(int fd, void *buf, std::size_t len);
+
+    /**
+     * @brief Send one message with file descriptors attached (SCM_RIGHTS).
+     *
+     * @param sock UNIX socket (SOCK_SEQPACKET keeps messages whole).
+     * @param msg  Message text.
+     * @param fds  Descriptors to pass (duplicated into the receiver).
+     * @return true if the whole message was sent.
+     */
+    bool send_fds(int sock, const std::string &msg, const std::vector<int> &fds);
+
+    /**
+     * @brief Receive a message sent by send_fds().
+     *
+     * @param sock UNIX socket.
+     * @param msg  Output message text.
+     * @param fds  Output descriptors (close-on-exec), up to max_fds.
+     * @param max_fds Most descriptors accepted.
+     * @return Message size, 0 when the peer has closed, -1 on error.
+     */
+    long recv_fds(int sock, std::string &msg, std::vector<int> &fds, std::size_t max_fds);
+} // namespace net
@@ -0,0 +1,69 @@
+/// @file param_server.hpp
+/// @brief Interface and wire protocol of the param_server executable.
+#pragma once
+
+#include <cstdint>
+
+namespace param_server
+{
+    /// @brief Message types exchanged between workers and the server.
+    enum MsgType : std::uint32_t
+    {
+        MSG_HELLO = 1,  ///< worker -> server: register worker id.
+        MSG_PULL = 2,   ///< worker -> server: request parameters for clock.
+        MSG_PARAMS = 3, ///< server -> worker: parameters (clock = version).
+        MSG_PUSH = 4,   ///< worker -> server: gradient sum for clock.
+        MSG_DONE = 5,   ///< worker -> server: no more data.
+        MSG_PUSH_PACKED = 6 ///< worker -> server: compressed gradient sum.
+    };
+
+    /**
+     * @brief Fixed header preceding every message.
+     *
+     * MSG_PARAMS and MSG_PUSH are followed by 'floats' floats in the
+     * model's flat parameter layout. MSG_PUSH_PACKED is followed by a
+     * compress::encode() payload of 'floats' bytes.
+     */
+    struct MsgHeader
+    {
+        std::uint32_t type;    ///< MsgType.
+        std::uint32_t worker;  ///< Sender's worker id (worker messages).
+        std::uint64_t clock;   ///< Worker clock, or model version for PARAMS.
+        std::uint32_t floats;  ///< Floats (bytes for PUSH_PACKED) that follow.
+        std::uint32_t samples; ///< Samples summed into a PUSH gradient.
+    };
+
+    /**
+     * @brief Run the parameter server.
+     *
+     * Owns the model and applies gradients pushed asynchronously by
+     * PS_WORKERS backward_layer workers, under a stale synchronous
+     * parallel (SSP) bound: a worker at clock c (its number of pushes)
+     * only gets parameters once the slowest unfinished worker has
+     * reached clock c - PS_STALENESS. PS_STALENESS=0 is fully synchronous;
+     * larger bounds let fast workers run ahead.
+     *
+     * Environment:
+     *   - PS_ENDPOINT   : "unix:<path>" or "tcp:<host>:<port>" (required).
+     *   - PS_WORKERS    : number of workers (default 1).
+     *   - PS_STALENESS  : clock bound s (default 2).
+     *   - PS_HELLO_TIMEOUT_MS : time for all workers to register
+     *                     (default 30000); the run fails if they do not,
+     *                     or if a connection closes before registering.
+     *   - DDP_LR_SCALING : linear (default) applies each pushed gradient
+     *                     sum at the base lr, i.e. lr scaled by the
+     *                     pushed batch, as DDP does; none applies the
+     *                     batch mean.
+     *   - MODEL_CONFIGS : first entry configures the model (optional).
+     *   - MODEL_FILE    : where the final model is saved.
+     *
+     * When all workers are done the model is saved and a line
+     *   PS_SUMMARY <staleness> <updates> <samples_per_s> <mean_staleness>
+     *              <max_staleness> <blocked_pulls> <blocked_seconds>
+     * is written to stderr (staleness of an update = versions applied
+     * between the worker's pull and its push).
+     *
+     * @return 0 on success, non-zero on error.
+     */
+    int run();
+} // namespace param_server
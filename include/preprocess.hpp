@@ -12,8 +12,20 @@ namespace preprocess
      * Reads a CSV dataset file, parses and normalizes samples, and writes
      * whitespace-separated samples to stdout.
      *
+     * With shards > 1 only every shards-th non-empty line, starting at
+     * line index 'shard', is emitted (used by data-parallel training to
+     * give each worker its own slice of the dataset).
+     *
+     * fuse names downstream stateless stages (see transform.hpp) to run
+     * in this process after normalization; their output is written
+     * instead, byte-identical to what the separate stages would write.
+     *
      * @param csv_path Path to CSV file.
+     * @param shard    Index of the shard to emit (0-based).
+     * @param shards   Total number of shards.
+     * @param fuse     Comma-separated stages to fuse (may be empty).
      * @return 0 on success, non-zero on error.
      */
-    int run(const std::string &csv_path);
+    int run(const std::string &csv_path, int shard = 0, int shards = 1,
+            const std::string &fuse = "");
 } // namespace preprocess
@@ -0,0 +1,436 @@
+/// @file stage_io.hpp
+/// @brief Stream capture and in-memory replay for the pipeline stages.
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace stage_io
+{
+    /**
+     * @brief Copies everything a stage writes to std::cout into a file.
+     *
+     * Enabled by CAPTURE_DIR: while a Capture is alive, std::cout is
+     * teed into CAPTURE_DIR/<stage>.cap (or <stage>.<rank>.cap when
+     * DDP_WORLD_SIZE > 1, using DDP_RANK), i.e. the stream on the
+     * pipeline edge leaving that stage. The captures of a normal run are
+     * the replay inputs of the next stage downstream (see replay()).
+     * Without CAPTURE_DIR it does nothing.
+     *
+     * Construct it after any other std::cout redirection and destroy it
+     * before that redirection is undone.
+     */
+    class Capture
+    {
+    public:
+        explicit Capture(const char *stage);
+        ~Capture();
+
+        Capture(const Capture &) = delete;
+        Capture &operator=(const Capture &) = delete;
+
+    private:
+        /// @brief Streambuf writing to two others.
+        class TeeBuf : public std::streambuf
+        {
+        public:
+            TeeBuf(std::streambuf *a, std::streambuf *b) : a_(a), b_(b) {}
+
+        protected:
+            int_type overflow(int_type ch) override;
+            std::streamsize xsputn(const char *s, std::streamsize n) override;
+            int sync() override;
+
+        private:
+            std::streambuf *a_;
+            std::streambuf *b_;
+        };
+
+        std::ofstream file_;
+        TeeBuf *tee_ = nullptr;
+        std::streambuf *saved_ = nullptr;
+    };
+
+    /**
+     * @brief Records a stage has read and written so far.
+     *
+     * The trainer's stall watchdog reads these: it passes
+     * TRAINER_PROGRESS=<fd>:<slot>, naming a slot in a shared memory
+     * region (an inherited memfd), and progress() maps that slot.
+     * Without the variable the counters are private to the process.
+     * Only the stage's main thread updates them, so an update is a
+     * plain load and store rather than a locked add.
+     *
+     * A stage that needs no more input (e.g. backward_layer stopping
+     * early) calls request_stop(); the trainer then stops the stages
+     * feeding it.
+     */
+    struct Progress
+    {
+        std::atomic<std::uint64_t> records_in{0};
+        std::atomic<std::uint64_t> records_out{0};
+        std::atomic<std::uint64_t> records_rejected{0}; ///< See Quarantine.
+        std::atomic<std::uint64_t> stop_requested{0};   ///< See request_stop().
+
+        void count_in(std::uint64_t n = 1)
+        {
+            records_in.store(records_in.load(std::memory_order_relaxed) + n,
+                             std::memory_order_relaxed);
+        }
+
+        void count_out(std::uint64_t n = 1)
+        {
+            records_out.store(records_out.load(std::memory_order_relaxed) + n,
+                              std::memory_order_relaxed);
+        }
+
+        void count_rejected(std::uint64_t n = 1)
+        {
+            records_rejected.store(records_rejected.load(std::memory_order_relaxed) + n,
+                                   std::memory_order_relaxed);
+        }
+
+        /// @brief Ask the trainer to stop this stage's upstream stages.
+        void request_stop()
+        {
+            stop_requested.store(1, std::memory_order_release);
+        }
+    };
+
+    /// @brief This process's counters (attached on first use, see Progress).
+    Progress &progress();
+
+    /**
+     * @brief Rate-limited reporting of per-record problems (bad lines).
+     *
+     * The first DIAG_BURST (default 10) events of a kind are printed in
+     * full as "<stage>: <kind>: <detail>", one write each. Later ones
+     * are only counted: a "<stage>: <kind>: <n> more suppressed" line
+     * goes out at most once per DIAG_INTERVAL_MS (default 1000), and the
+     * destructor prints the total of every kind that was suppressed.
+     * A corrupt input therefore costs a few lines of stderr, not one
+     * flushed line per record.
+     */
+    class Diagnostics
+    {
+    public:
+        explicit Diagnostics(const char *stage);
+        ~Diagnostics();
+
+        Diagnostics(const Diagnostics &) = delete;
+        Diagnostics &operator=(const Diagnostics &) = delete;
+
+        /**
+         * @brief Record one event.
+         *
+         * @param kind   Short description; events are grouped by its text.
+         * @param detail The offending input, printed while within the burst.
+         */
+        void report(const char *kind, const std::string &detail);
+
+        /// @brief Events of a kind so far.
+        std::uint64_t count(const char *kind) const;
+
+    private:
+        struct Kind
+        {
+            const char *name;
+            std::uint64_t total = 0;
+            std::uint64_t unreported = 0; ///< Suppressed since the last note.
+            std::chrono::steady_clock::time_point last_note{};
+        };
+
+        void write(const std::string &line) const;
+
+        const char *stage_;
+        std::uint64_t burst_ = 10;
+        std::chrono::milliseconds interval_{1000};
+        std::vector<Kind> kinds_;
+    };
+
+    /// @brief STAGE_MEMORY_LIMIT in bytes, or 0 if there is no limit.
+    std::size_t memory_limit();
+
+    /**
+     * @brief A stage's share of the trainer's memory budget.
+     *
+     * Under TRAINER_MEMORY_BUDGET the trainer passes every process its
+     * share as STAGE_MEMORY_LIMIT=<bytes>. Stages size their buffers
+     * with fit(); the destructor reports the peak RSS against the share:
+     *   <stage>: memory peak=<MiB> share=<MiB> (<pct>%)
+     * Without a limit fit() changes nothing and nothing is reported.
+     */
+    class MemoryShare
+    {
+    public:
+        explicit MemoryShare(const char *stage);
+        ~MemoryShare();
+
+        MemoryShare(const MemoryShare &) = delete;
+        MemoryShare &operator=(const MemoryShare &) = delete;
+
+        /// @brief The share in bytes (0: no limit).
+        std::size_t limit() const { return limit_; }
+
+        /**
+         * @brief Largest count up to requested whose buffers fit in
+         *        1/divisor of the share (at least 1).
+         *
+         * @param what       Setting name for the message when reduced.
+         * @param requested  Configured count.
+         * @param bytes_each Memory per item.
+         * @param divisor    Part of the share the buffers may use.
+         */
+        std::size_t fit(const char *what, std::size_t requested,
+                        std::size_t bytes_each, std::size_t divisor) const;
+
+    private:
+        const char *stage_;
+        std::size_t limit_;
+    };
+
+    /**
+     * @brief Dead-letter file for the rows a stage rejects.
+     *
+     * With QUARANTINE_DIR set, rejected rows are written to
+     * QUARANTINE_DIR/<stage>.bad (<stage>.<rank>.bad with several
+     * workers, as for Capture; created with the first one) through a
+     * 1 MiB buffer (at most 1/16 of a memory share), one
+     *   <offset>\t<reason>\t<row>
+     * line each. <offset> is the row's byte offset in the stage's input
+     * (for preprocess: in the CSV file) and <reason> a short code such
+     * as field_count or bad_number. `cut -f3-` of the file gives the
+     * rows back, to fix and feed in again without rescanning the
+     * dataset. Without QUARANTINE_DIR rows are reported through a
+     * Diagnostics instead.
+     *
+     * Either way they are counted in progress() (so the trainer can
+     * total them), and the destructor prints one line per stage:
+     *   <stage>: rejected <n> rows (<reason>=<n> ...) [-> <file>]
+     */
+    class Quarantine
+    {
+    public:
+        explicit Quarantine(const char *stage);
+        ~Quarantine();
+
+        Quarantine(const Quarantine &) = delete;
+        Quarantine &operator=(const Quarantine &) = delete;
+
+        /**
+         * @brief Reject one row.
+         *
+         * @param reason Reason code (a string literal).
+         * @param offset Byte offset of the row in the stage's input.
+         * @param row    The row, without its newline.
+         */
+        void add(const char *reason, std::uint64_t offset, const std::string &row);
+
+        /// @brief Rows rejected so far.
+        std::uint64_t count() const { return total_; }
+
+    private:
+        const char *stage_;
+        std::string path_;
+        std::vector<char> buf_;
+        std::ofstream file_;
+        Diagnostics diag_;
+        std::vector<std::pair<const char *, std::uint64_t>> reasons_;
+        std::uint64_t total_ = 0;
+    };
+
+    /**
+     * @brief Adaptive batch size and flush deadline for a batching stage.
+     *
+     * Enabled by BATCH_TARGET_P99_MS=<ms>: the target for the 99th
+     * percentile of the time a record spends in this stage's batches,
+     * from its arrival to the batch being written out (the only
+     * batching delay in the pipeline; other hops add pipe latency). The
+     * stage reads through wait_input(), which
+     *   - flushes std::cout before blocking on empty input, so records
+     *     never sit in an output buffer while the stage idles, and
+     *   - ends a started batch early once its flush deadline passes.
+     * After each batch, done() measures the batch latency (first
+     * arrival to written) and processing time, keeps the p99 over the
+     * last 128 batches, and decides:
+     *   - shrink : p99 above target -> halve the batch size;
+     *   - grow   : p99 under half the target while input is queued
+     *              (backlog) -> double it, up to BATCH_MAX (default 4096);
+     *   - hold   : otherwise.
+     * The deadline is half the target minus the estimated processing
+     * time of a full batch. Every decision is exported as a line of
+     * BATCH_METRICS_DIR/<stage>[.<rank>].metrics:
+     *   <seconds> size=<n> next=<n> deadline_ms=<d> fill_ms=<f>
+     *   proc_ms=<p> queue_bytes=<q> p99_ms=<l> action=<grow|shrink|hold>
+     * and the destructor prints a summary on stderr. Without
+     * BATCH_TARGET_P99_MS (and in replay runs) the batch size stays at
+     * its initial value and wait_input() never blocks or flushes.
+     *
+     * Stages that handle one record at a time (preprocess, the
+     * single-process loops of backward_layer) batch their output
+     * instead: wait_record() / wrote_record() make the lines written
+     * since the last flush the batch, flushed when it is full, when its
+     * deadline passes or before waiting for input. When enabled, the
+     * controller unties the input from std::cout, so reading no longer
+     * flushes every line.
+     */
+    class BatchController
+    {
+    public:
+        /**
+         * @param stage      Stage name (messages, metrics file).
+         * @param initial    Starting (and, when disabled, fixed) batch size.
+         * @param memory     The stage's share; BATCH_MAX is fitted into
+         *                   a quarter of it.
+         * @param bytes_each Memory per batched record.
+         * @param in         The stage's input stream.
+         * @param in_fd      Descriptor to poll for in, or -1 if reading
+         *                   it never blocks (a regular file).
+         */
+        BatchController(const char *stage, std::size_t initial,
+                        const MemoryShare &memory, std::size_t bytes_each,
+                        std::istream &in = std::cin, int in_fd = 0);
+        ~BatchController();
+
+        BatchController(const BatchController &) = delete;
+        BatchController &operator=(const BatchController &) = delete;
+
+        bool enabled() const { return enabled_; }
+
+        /// @brief Current batch size.
+        std::size_t batch_size() const { return size_; }
+
+        /**
+         * @brief Wait until a line can be read from the input.
+         *
+         * @param batch_empty No record of the current batch is read yet
+         *                    (then there is no deadline, and a true
+         *                    return starts the batch clock).
+         * @return true to read the next line (or hit end of input),
+         *         false if the batch's deadline passed: process it now.
+         */
+        bool wait_input(bool batch_empty);
+
+        /// @brief The batch is complete; processing starts.
+        void filled();
+
+        /// @brief The batch of n records is written; measure and decide.
+        void done(std::size_t n);
+
+        /// @brief Before reading a record: flush the output batch if its
+        ///        deadline passed or the input has nothing to read yet.
+        void wait_record();
+
+        /// @brief A record's output line is written; flush a full batch.
+        void wrote_record();
+
+        /// @brief Flush the output batch now.
+        void flush_records();
+
+    private:
+        const char *stage_;
+        std::istream &in_;
+        int in_fd_;
+        bool enabled_ = false;
+        std::size_t size_;
+        std::size_t pending_ = 0; ///< Output lines not flushed yet (per-record use).
+        std::size_t max_;
+        double target_ms_ = 0.0;
+        double deadline_ms_ = 0.0;
+        double proc_ms_per_record_ = 0.0; ///< Smoothed processing cost.
+        std::chrono::steady_clock::time_point created_;
+        std::chrono::steady_clock::time_point batch_start_;
+        std::chrono::steady_clock::time_point fill_end_;
+        std::vector<double> window_; ///< Latest batch latencies (ms).
+        std::size_t next_slot_ = 0;
+        std::ofstream metrics_;
+        std::uint64_t batches_ = 0;
+        std::uint64_t grows_ = 0;
+        std::uint64_t shrinks_ = 0;
+        std::uint64_t deadline_flushes_ = 0;
+        double p99_ms_ = 0.0;
+    };
+
+    /// @brief Options of a replay run.
+    struct ReplayOptions
+    {
+        std::string path; ///< Capture (or CSV) file to replay.
+        long repeat = 1;  ///< Number of passes over it.
+    };
+
+    /**
+     * @brief Recognize "--replay <file> [--repeat N]" on a stage's command line.
+     *
+     * @param argc Argument count.
+     * @param argv Arguments.
+     * @param opts Output options (when 1 is returned).
+     * @return 1 if replay was requested, 0 if the arguments are something
+     *         else, -1 if they are a malformed replay request.
+     */
+    int parse_replay_args(int argc, char *argv[], ReplayOptions &opts);
+
+    /**
+     * @brief Run a stage's loop over a file held in memory.
+     *
+     * Loads opts.path, points std::cin at the in-memory copy and calls
+     * body() opts.repeat times, rewinding in between. The stage runs with
+     * its usual environment and writes its usual output (redirect stdout
+     * to /dev/null to measure the stage alone). Timing excludes loading:
+     *   REPLAY <stage> records=<lines> bytes=<bytes> repeat=<N>
+     *          seconds=<s> records_per_s=<r> mb_per_s=<m>
+     * is printed to stderr at the end.
+     *
+     * @param stage Stage name for the report.
+     * @param opts  Replay options.
+     * @param body  Stage loop reading std::cin; returns an exit code.
+     * @return First non-zero exit code of body, 1 if the file cannot be
+     *         read, else 0.
+     */
+    int replay(const char *stage, const ReplayOptions &opts, const std::function<int()> &body);
+
+    /**
+     * @brief Recognize "--serve <fd>" on a stage's command line.
+     *
+     * @param argc    Argument count.
+     * @param argv    Arguments.
+     * @param control Output control socket descriptor.
+     * @return true if serving was requested.
+     */
+    bool parse_serve_args(int argc, char *argv[], int &control);
+
+    /**
+     * @brief Keep the stage process alive and run one job per request.
+     *
+     * This is how trainer --daemon keeps warm stages (see
+     * job_server.hpp): the process is started once, and each job skips
+     * the spawn, the dynamic linking and the stage's startup. control is
+     * a SOCK_SEQPACKET socket. A request is one message of lines
+     *   ARG <value>          job arguments, in order
+     *   ENV <name>=<value>   environment of the job
+     * with two descriptors attached: the job's input and output streams.
+     * For each request, body runs with stdin and stdout on those streams
+     * and the variables set. When it returns, both streams are closed
+     * so the next stage sees end of input. The environment and the
+     * state of std::cin / std::cout are restored, and the reply
+     *   EXIT <status>
+     * is sent. SIGPIPE is ignored, so a job whose reader has gone fails
+     * its writes instead of killing the process.
+     *
+     * @param stage   Stage name for messages.
+     * @param control Control socket.
+     * @param body    Stage loop over std::cin; gets the job arguments.
+     * @return 0 when control is closed, 1 on a malformed request.
+     */
+    int serve(const char *stage, int control,
+              const std::function<int(const std::vector<std::string> &args)> &body);
+
+} // namespace stage_io
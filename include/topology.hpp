@@ -0,0 +1,96 @@
+/// @file topology.hpp
+/// @brief Declarative description of the trainer's process/pipe graph.
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace topology
+{
+    /// @brief How a stage's output reaches the next stage.
+    enum class Transport
+    {
+        Pipe,      ///< pipe(2); pipe_size sets F_SETPIPE_SZ.
+        SocketPair ///< socketpair(AF_UNIX, SOCK_STREAM); pipe_size sets the socket buffers.
+    };
+
+    /// @brief One stage of the pipeline.
+    struct Stage
+    {
+        std::string name;                ///< Stage name, e.g. "forward_layer".
+        std::string prog;                ///< Executable (default bin/<name>).
+        std::vector<std::string> args;   ///< Arguments; see parse() for placeholders.
+        bool shared = false;             ///< One instance fed by every worker chain.
+        std::vector<int> cpus;           ///< CPU affinity (empty: inherit).
+        std::vector<std::pair<std::string, std::string>> env; ///< Extra environment.
+        Transport transport = Transport::Pipe; ///< Edge to the next stage.
+        std::size_t pipe_size = 0;       ///< Edge buffer size in bytes (0: default).
+    };
+
+    /// @brief A whole pipeline: per-worker stages, then shared ones.
+    struct Topology
+    {
+        int workers = 1;           ///< Worker chains (TRAINER_WORKERS overrides).
+        std::vector<Stage> stages; ///< In stream order.
+    };
+
+    /**
+     * @brief Parse a pipeline description.
+     *
+     * Line format ('#' starts a comment):
+     *   workers <N>
+     *   stage <name> [shared] [key=value ...]
+     * with keys
+     *   bin=<path>                 executable (default bin/<name>)
+     *   args=<a>,<b>,...           arguments; "{csv}" is the CSV path and
+     *                              "{shard}" is "<w>/<workers>" (dropped
+     *                              with a single worker)
+     *   cpus=<list>                affinity, e.g. "0-3,6"
+     *   env=<NAME>=<value>         extra variable (repeatable)
+     *   transport=pipe|socketpair  edge to the next stage
+     *   pipe_size=<bytes>          buffer size of that edge
+     *
+     * Per-worker stages are replicated once per worker chain. The first
+     * shared stage reads the fan-in of all chains; later shared stages
+     * follow it one to one. Shared stages must come last.
+     *
+     * Replication is per chain, not per stage: every per-worker stage
+     * runs `workers` times and every shared stage once. A stage cannot
+     * have a replica count of its own (e.g. 2 preprocess feeding 1
+     * forward_layer): between per-worker stages there is no fan-in, and
+     * no fan-out of a stream to several readers. A `replicas=` option is
+     * rejected with a message saying so.
+     *
+     * @param in  Description text.
+     * @param out Parsed topology.
+     * @param err Message on failure ("line N: ...").
+     * @return false on a malformed description.
+     */
+    bool parse(std::istream &in, Topology &out, std::string &err);
+
+    /**
+     * @brief Load a description from a file (see parse()).
+     *
+     * @return false (with a message on stderr) on a missing or bad file.
+     */
+    bool load(const std::string &path, Topology &out);
+
+    /**
+     * @brief The standard layout, as shipped in config/pipeline.conf:
+     *        preprocess -> forward_layer -> backward_layer -> logger (shared).
+     */
+    Topology default_topology();
+
+    /**
+     * @brief Create the edge leaving a stage.
+     *
+     * @param from Stage writing into the edge (its transport and pipe_size).
+     * @param fds  Output: fds[0] read end, fds[1] write end, both close-on-exec.
+     * @return false on failure (with a message on stderr).
+     */
+    bool make_edge(const Stage &from, int fds[2]);
+
+} // namespace topology
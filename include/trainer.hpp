@@ -14,8 +14,14 @@ namespace trainer
      *
      * and manages their lifetime.
      *
+     * The layout, worker count and run modes are set by a pipeline
+     * description and environment variables (README.md, section 10).
+     *
      * @param csv_path Path to the input CSV dataset.
-     * @return 0 on success, non-zero on error.
+     * @param fuse     Fuse stateless stages into preprocess.
+     * @param config   Pipeline description file ("" for the built-in one).
+     * @return 0 if every stage exited with status 0, non-zero otherwise.
      */
-    int run(const std::string &csv_path);
+    int run(const std::string &csv_path, bool fuse = false,
+            const std::string &config = "");
 } // namespace trainer
@@ -0,0 +1,50 @@
+/// @file transform.hpp
+/// @brief Registry of stateless per-sample stages that can run fused in-process.
+#pragma once
+
+#include <string>
+#include <vector>
+#include "common.hpp"
+
+namespace transform
+{
+    /**
+     * @brief A pipeline stage that maps each sample independently.
+     *
+     * Such a stage keeps no state between samples, so instead of running
+     * as its own process it can be applied inside the upstream stage's
+     * process ("fused"), saving a process, a pipe hop and a
+     * format/parse cycle per sample.
+     */
+    struct Stateless
+    {
+        const char *stage;                  ///< Executable name, e.g. "forward_layer".
+        void (*apply)(common::Sample &s);   ///< The stage's per-sample work.
+    };
+
+    /**
+     * @brief Look up a stateless stage by executable name.
+     *
+     * @return The stage, or nullptr if it is unknown or keeps state.
+     */
+    const Stateless *find(const std::string &stage);
+
+    /**
+     * @brief Parse a comma-separated list of stages to fuse.
+     *
+     * @param spec Stage names, e.g. "forward_layer".
+     * @param out  Stages in order.
+     * @return false (with a message on stderr) on an unknown or stateful stage.
+     */
+    bool parse_fuse_list(const std::string &spec, std::vector<const Stateless *> &out);
+
+    /**
+     * @brief Apply fused stages to a sample, in order.
+     *
+     * Before each stage the values are rounded exactly as the text format
+     * between stages would round them (see common::round_to_wire), so a
+     * fused pipeline produces the same bytes as the separate processes.
+     */
+    void apply_fused(const std::vector<const Stateless *> &stages, common::Sample &s);
+
+} // namespace transform
@@ -0,0 +1,52 @@
+/// @file clip_features.cpp
+/// @brief Example feature plugin: clamps every feature to [-limit, limit].
+///
+/// Build: g++ -std=c++17 -O2 -fPIC -shared -Iinclude plugins/clip_features.cpp
+///            -o bin/plugins/clip_features.so
+/// Use:   FORWARD_PLUGINS=bin/plugins/clip_features.so:<limit> (default 3)
+#include "feature_plugin.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace
+{
+    void *create(const char *args)
+    {
+        float limit = 3.0f;
+        if (*args)
+        {
+            char *end = nullptr;
+            limit = std::strtof(args, &end);
+            if (*end != '\0' || !(limit > 0.0f))
+            {
+                return nullptr;
+            }
+        }
+        return new float(limit);
+    }
+
+    int apply(void *state, SampleBatch *batch)
+    {
+        const float limit = *static_cast<float *>(state);
+        float *x = batch->x;
+        const std::size_t count = batch->n * batch->dim;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            x[i] = std::min(limit, std::max(-limit, x[i]));
+        }
+        return 0;
+    }
+
+    void destroy(void *state)
+    {
+        delete static_cast<float *>(state);
+    }
+
+    const FeaturePlugin PLUGIN = {FEATURE_PLUGIN_ABI, "clip_features", create, apply, destroy};
+} // namespace
+
+extern "C" const FeaturePlugin *get_feature_plugin(void)
+{
+    return &PLUGIN;
+}
@@ -115,17 +115,26 @@ run_phase() {
   #          [run] Phase '<phase>' summary: (no SUMMARY line found)
   # ------------------------------------------------------------------
   local summary=""
-  summary=$(grep "^SUMMARY" "$log_file" | tail -n 1)
+  summary=$(grep "^SUMMARY " "$log_file" | tail -n 1)
 
   if [[ -n "$summary" ]]; then
     local _tag samples avg_loss avg_yhat
     read -r _tag samples avg_loss avg_yhat <<< "$summary"
 
     echo "[run] Phase '$phase' summary: samples=$samples avg_loss=$avg_loss avg_yhat=$avg_yhat"
-  else
+  elif ! grep -q "^SUMMARY_MODEL" "$log_file"; then
     echo "[run] Phase '$phase' summary: (no SUMMARY line found)"
   fi
 
+  # With a comma-separated MODEL_FILE in test mode, the logger writes one
+  #   SUMMARY_MODEL <k> <samples> <avg_loss> <avg_yhat>
+  # line per model instead of a single SUMMARY line.
+  local _k
+  grep "^SUMMARY_MODEL" "$log_file" | \
+  while read -r _tag _k samples avg_loss avg_yhat; do
+    echo "[run] Phase '$phase' model $_k summary: samples=$samples avg_loss=$avg_loss avg_yhat=$avg_yhat"
+  done || true
+
   echo "[run] Phase '$phase' finished."
   echo "[run] Final logs: $log_file"
 }
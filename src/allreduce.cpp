@@ -0,0 +1,306 @@
+/// @file allreduce.cpp
+/// @brief Implementation of the ring all-reduce.
+#include "allreduce.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    /// @brief How long ring_connect waits for the next rank to appear.
+    constexpr int CONNECT_TIMEOUT_MS = 30 * 1000;
+
+    /**
+     * @brief Bounds of chunk c when n floats are split over world ranks.
+     */
+    void chunk_range(std::size_t n, int world, int c,
+                     std::size_t &begin, std::size_t &end)
+    {
+        begin = n * static_cast<std::size_t>(c) / static_cast<std::size_t>(world);
+        end = n * static_cast<std::size_t>(c + 1) / static_cast<std::size_t>(world);
+    }
+
+    /**
+     * @brief Send one buffer to next while receiving another from prev.
+     *
+     * Both sockets are non-blocking and driven by poll(), so neither side
+     * can deadlock on a full socket buffer. Data is sent in segments of
+     * ring.segment_bytes; if 'reduce' is set, the buffers hold floats and
+     * received floats are added into dst as soon as they arrive,
+     * otherwise received bytes are copied.
+     *
+     * @param ring       Connected ring.
+     * @param src        Bytes to send.
+     * @param send_total Number of bytes to send.
+     * @param dst        Destination of received bytes.
+     * @param recv_total Number of bytes to receive.
+     * @param reduce     Add as floats (true) or overwrite (false).
+     * @return true on success, false on a socket error.
+     */
+    bool exchange(allreduce::Ring &ring,
+                  const char *src, std::size_t send_total,
+                  char *dst, std::size_t recv_total,
+                  bool reduce)
+    {
+        std::size_t sent = 0;
+        std::size_t received = 0;
+        std::size_t applied = 0; // floats already added into dst
+
+        char *recv_buf = dst;
+        if (reduce)
+        {
+            const std::size_t floats = recv_total / sizeof(float);
+            if (ring.scratch.size() < floats)
+            {
+                ring.scratch.resize(floats);
+            }
+            recv_buf = reinterpret_cast<char *>(ring.scratch.data());
+        }
+
+        while (sent < send_total || received < recv_total)
+        {
+            pollfd fds[2];
+            nfds_t nfds = 0;
+            if (sent < send_total)
+            {
+                fds[nfds++] = {ring.next_fd, POLLOUT, 0};
+            }
+            if (received < recv_total)
+            {
+                fds[nfds++] = {ring.prev_fd, POLLIN, 0};
+            }
+            if (poll(fds, nfds, -1) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                std::perror("allreduce: poll");
+                return false;
+            }
+
+            for (nfds_t i = 0; i < nfds; ++i)
+            {
+                if (fds[i].revents == 0)
+                {
+                    continue;
+                }
+                if (fds[i].fd == ring.next_fd && sent < send_total)
+                {
+                    const std::size_t len = std::min(ring.segment_bytes, send_total - sent);
+                    const ssize_t n = send(ring.next_fd, src + sent, len, MSG_NOSIGNAL);
+                    if (n < 0 && errno != EAGAIN && errno != EINTR)
+                    {
+                        std::perror("allreduce: send");
+                        return false;
+                    }
+                    sent += n > 0 ? static_cast<std::size_t>(n) : 0;
+                }
+                else if (fds[i].fd == ring.prev_fd && received < recv_total)
+                {
+                    const std::size_t len = std::min(ring.segment_bytes, recv_total - received);
+                    const ssize_t n = recv(ring.prev_fd, recv_buf + received, len, 0);
+                    if (n == 0)
+                    {
+                        std::fprintf(stderr, "allreduce: peer closed connection\n");
+                        return false;
+                    }
+                    if (n < 0 && errno != EAGAIN && errno != EINTR)
+                    {
+                        std::perror("allreduce: recv");
+                        return false;
+                    }
+                    received += n > 0 ? static_cast<std::size_t>(n) : 0;
+
+                    // Reduce whatever complete floats have arrived so far.
+                    if (reduce)
+                    {
+                        float *out = reinterpret_cast<float *>(dst);
+                        const std::size_t complete = received / sizeof(float);
+                        for (std::size_t k = applied; k < complete; ++k)
+                        {
+                            out[k] += ring.scratch[k];
+                        }
+                        applied = complete;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief exchange() for float chunks.
+     */
+    bool exchange_floats(allreduce::Ring &ring,
+                         const float *src, std::size_t src_n,
+                         float *dst, std::size_t dst_n,
+                         bool reduce)
+    {
+        return exchange(ring,
+                        reinterpret_cast<const char *>(src), src_n * sizeof(float),
+                        reinterpret_cast<char *>(dst), dst_n * sizeof(float),
+                        reduce);
+    }
+
+    /**
+     * @brief Put a socket into non-blocking mode.
+     */
+    bool set_nonblocking(int fd)
+    {
+        const int flags = fcntl(fd, F_GETFL);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+} // namespace
+
+namespace allreduce
+{
+    bool ring_connect(const net::Endpoint &ep, int rank, int world, Ring &out)
+    {
+        out.rank = rank;
+        out.world = world;
+        if (world <= 1)
+        {
+            return true;
+        }
+
+        const int listen_fd = net::listen_rank(ep, rank);
+        if (listen_fd < 0)
+        {
+            return false;
+        }
+
+        // Connecting first cannot deadlock: the next rank's listen()
+        // backlog completes the connection before it calls accept().
+        out.next_fd = net::connect_rank(ep, (rank + 1) % world, CONNECT_TIMEOUT_MS);
+        if (out.next_fd >= 0)
+        {
+            out.prev_fd = net::accept_peer(ep, listen_fd);
+        }
+        close(listen_fd);
+        net::unlink_rank(ep, rank);
+        if (out.next_fd < 0 || out.prev_fd < 0)
+        {
+            ring_close(out);
+            return false;
+        }
+
+        // Handshake: tell next who we are, check who prev is.
+        int peer = -1;
+        if (!net::send_all(out.next_fd, &rank, sizeof(rank)) ||
+            !net::recv_all(out.prev_fd, &peer, sizeof(peer)) ||
+            peer != (rank + world - 1) % world)
+        {
+            std::fprintf(stderr, "allreduce: rank %d: bad handshake from %d\n",
+                         rank, peer);
+            ring_close(out);
+            return false;
+        }
+
+        if (!set_nonblocking(out.next_fd) || !set_nonblocking(out.prev_fd))
+        {
+            std::perror("allreduce: fcntl");
+            ring_close(out);
+            return false;
+        }
+        return true;
+    }
+
+    bool ring_allreduce(Ring &ring, float *data, std::size_t n)
+    {
+        const int W = ring.world;
+        if (W <= 1)
+        {
+            return true;
+        }
+
+        std::size_t sb = 0, se = 0, rb = 0, re = 0;
+
+        // Reduce-scatter: after W-1 steps rank r holds the full sum of
+        // chunk (r + 1) mod W.
+        for (int step = 0; step < W - 1; ++step)
+        {
+            const int send_c = ((ring.rank - step) % W + W) % W;
+            const int recv_c = ((ring.rank - step - 1) % W + W) % W;
+            chunk_range(n, W, send_c, sb, se);
+            chunk_range(n, W, recv_c, rb, re);
+            if (!exchange_floats(ring, data + sb, se - sb, data + rb, re - rb, true))
+            {
+                return false;
+            }
+        }
+
+        // All-gather: circulate the reduced chunks.
+        for (int step = 0; step < W - 1; ++step)
+        {
+            const int send_c = ((ring.rank + 1 - step) % W + W) % W;
+            const int recv_c = ((ring.rank - step) % W + W) % W;
+            chunk_range(n, W, send_c, sb, se);
+            chunk_range(n, W, recv_c, rb, re);
+            if (!exchange_floats(ring, data + sb, se - sb, data + rb, re - rb, false))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool ring_allgather(Ring &ring,
+                        const std::vector<char> &mine,
+                        std::vector<std::vector<char>> &all)
+    {
+        const int W = ring.world;
+        all.resize(static_cast<std::size_t>(W));
+        all[ring.rank] = mine;
+
+        // Step s forwards the payload of rank (rank - s) and receives that
+        // of rank (rank - s - 1); sizes travel ahead of each payload.
+        for (int step = 0; step < W - 1; ++step)
+        {
+            const int send_r = ((ring.rank - step) % W + W) % W;
+            const int recv_r = ((ring.rank - step - 1) % W + W) % W;
+
+            std::uint64_t send_len = all[send_r].size();
+            std::uint64_t recv_len = 0;
+            if (!exchange(ring,
+                          reinterpret_cast<const char *>(&send_len), sizeof(send_len),
+                          reinterpret_cast<char *>(&recv_len), sizeof(recv_len),
+                          false))
+            {
+                return false;
+            }
+
+            all[recv_r].resize(static_cast<std::size_t>(recv_len));
+            if (!exchange(ring,
+                          all[send_r].data(), all[send_r].size(),
+                          all[recv_r].data(), all[recv_r].size(),
+                          false))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ring_close(Ring &ring)
+    {
+        if (ring.next_fd >= 0)
+        {
+            close(ring.next_fd);
+        }
+        if (ring.prev_fd >= 0)
+        {
+            close(ring.prev_fd);
+        }
+        ring.next_fd = -1;
+        ring.prev_fd = -1;
+    }
+
+} // namespace allreduce
@@ -0,0 +1,570 @@
+/// @file autotune.cpp
+/// @brief Implementation of the startup autotuner.
+#include "autotune.hpp"
+#include "trainer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    /// @brief One configuration to try.
+    struct Candidate
+    {
+        std::size_t batch;     ///< FORWARD_BATCH
+        int workers;           ///< TRAINER_WORKERS (0: not tuned, left as it is)
+        const char *transport; ///< TRAINER_TRANSPORT (nullptr: left as it is)
+    };
+
+    /// @brief Timing of one micro-run, or the median of repeated ones.
+    struct Result
+    {
+        bool ok = false;
+        double records_per_s = 0.0;
+        double latency_ms = 0.0;
+        double seconds = 0.0;
+        double spread = 0.0;   ///< Max minus min records_per_s over the repeats.
+    };
+
+    /// @brief Settings of the temporary micro-runs.
+    struct Bench
+    {
+        std::string sample; ///< Sampled CSV.
+        std::string model;  ///< Scratch MODEL_FILE.
+        std::size_t rows = 0;
+        bool fuse = false;
+        std::string config;
+    };
+
+    long env_long(const char *name, long fallback)
+    {
+        const char *env = std::getenv(name);
+        if (!env || !*env)
+        {
+            return fallback;
+        }
+        char *end = nullptr;
+        const long v = std::strtol(env, &end, 10);
+        return (end && *end == '\0') ? v : fallback;
+    }
+
+    /**
+     * @brief Whether TRAINER_WORKERS is tuned and applied
+     *        (TRAINER_AUTOTUNE_WORKERS=1).
+     *
+     * Off by default: more workers train a different model (data
+     * parallel, see backward_layer.hpp), so a profile must not change
+     * it behind the user's back.
+     */
+    bool tune_workers()
+    {
+        const char *env = std::getenv("TRAINER_AUTOTUNE_WORKERS");
+        return env && std::strcmp(env, "1") == 0;
+    }
+
+    /**
+     * @brief Copy the first rows of a CSV into a temporary file.
+     *
+     * A CSV shorter than rows is copied again from its start until
+     * there are enough; the sample only has to take long enough to time.
+     *
+     * @param path Output file; a new temporary file if empty.
+     * @return Number of non-empty rows copied (0 on failure).
+     */
+    std::size_t write_sample(const std::string &csv_path, std::size_t rows, std::string &path)
+    {
+        std::ifstream in(csv_path);
+        if (!in)
+        {
+            std::cerr << "autotune: cannot open " << csv_path << "\n";
+            return 0;
+        }
+        if (path.empty())
+        {
+            char tmpl[] = "/tmp/trainer-autotune-XXXXXX";
+            const int fd = mkstemp(tmpl);
+            if (fd < 0)
+            {
+                std::perror("autotune: mkstemp");
+                return 0;
+            }
+            close(fd);
+            path = tmpl;
+        }
+
+        std::ofstream out(path, std::ios::trunc);
+        std::string line;
+        std::size_t n = 0;
+        while (n < rows)
+        {
+            if (!std::getline(in, line))
+            {
+                if (n == 0)
+                {
+                    break;
+                }
+                in.clear();
+                in.seekg(0);
+                continue;
+            }
+            if (!line.empty())
+            {
+                out << line << '\n';
+                ++n;
+            }
+        }
+        return out ? n : 0;
+    }
+
+    /**
+     * @brief Time one trainer::run() over the sample in a child process.
+     *
+     * The child gets the candidate's settings in its environment and
+     * its stdout (the logger's output) on a pipe read here; stderr goes
+     * to /dev/null.
+     */
+    Result measure(const Bench &bench, const Candidate &c)
+    {
+        Result r;
+        int fds[2];
+        if (pipe(fds) < 0)
+        {
+            std::perror("autotune: pipe");
+            return r;
+        }
+
+        const Clock::time_point start = Clock::now();
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            std::perror("autotune: fork");
+            close(fds[0]);
+            close(fds[1]);
+            return r;
+        }
+        if (pid == 0)
+        {
+            close(fds[0]);
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[1]);
+            const int null_fd = open("/dev/null", O_WRONLY);
+            if (null_fd >= 0)
+            {
+                dup2(null_fd, STDERR_FILENO);
+                close(null_fd);
+            }
+            if (c.batch > 0)
+            {
+                setenv("FORWARD_BATCH", std::to_string(c.batch).c_str(), 1);
+            }
+            if (c.workers > 0)
+            {
+                setenv("TRAINER_WORKERS", std::to_string(c.workers).c_str(), 1);
+            }
+            if (c.transport)
+            {
+                setenv("TRAINER_TRANSPORT", c.transport, 1);
+            }
+            setenv("MODEL_FILE", bench.model.c_str(), 1);
+            unsetenv("CAPTURE_DIR");
+            unsetenv("QUARANTINE_DIR");
+            unsetenv("TRAINER_STATS");
+            _exit(trainer::run(bench.sample, bench.fuse, bench.config));
+        }
+
+        close(fds[1]);
+        char buf[65536];
+        bool first = true;
+        for (;;)
+        {
+            const ssize_t n = read(fds[0], buf, sizeof(buf));
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                break;
+            }
+            if (first)
+            {
+                r.latency_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                first = false;
+            }
+        }
+        close(fds[0]);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        {
+        }
+        r.ok = !first && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        r.records_per_s = seconds > 0 ? bench.rows / seconds : 0.0;
+        r.seconds = seconds;
+        return r;
+    }
+
+    /**
+     * @brief Time a candidate repeats times.
+     *
+     * @return Median throughput and latency, and the throughput spread;
+     *         not ok if any run failed.
+     */
+    Result measure_repeated(const Bench &bench, const Candidate &c, int repeats)
+    {
+        std::vector<double> rates;
+        std::vector<double> latencies;
+        for (int i = 0; i < repeats; ++i)
+        {
+            const Result r = measure(bench, c);
+            if (!r.ok)
+            {
+                return r;
+            }
+            rates.push_back(r.records_per_s);
+            latencies.push_back(r.latency_ms);
+        }
+        std::sort(rates.begin(), rates.end());
+        std::sort(latencies.begin(), latencies.end());
+        Result out;
+        out.ok = true;
+        out.records_per_s = rates[rates.size() / 2];
+        out.latency_ms = latencies[latencies.size() / 2];
+        out.spread = rates.back() - rates.front();
+        return out;
+    }
+
+    /**
+     * @brief Grow the sample until a run of c takes min_seconds.
+     *
+     * Short runs time little but process start-up and scheduling noise.
+     * The sample is regrown from the CSV, at most up to max_rows.
+     *
+     * @return false if a run failed or the sample could not be written.
+     */
+    bool calibrate(Bench &bench, const std::string &csv_path, const Candidate &c,
+                   double min_seconds, std::size_t max_rows)
+    {
+        for (;;)
+        {
+            const Result r = measure(bench, c);
+            if (!r.ok)
+            {
+                return false;
+            }
+            if (r.seconds >= min_seconds || bench.rows >= max_rows)
+            {
+                return true;
+            }
+            // Aim past the minimum; at least double so start-up cannot stall growth.
+            const double factor = std::max(2.0, 1.2 * min_seconds / std::max(r.seconds, 1e-3));
+            const std::size_t rows = std::min(max_rows, static_cast<std::size_t>(bench.rows * factor));
+            bench.rows = write_sample(csv_path, rows, bench.sample);
+            if (bench.rows == 0)
+            {
+                return false;
+            }
+        }
+    }
+
+    /// @brief All combinations tried on this host.
+    std::vector<Candidate> candidates()
+    {
+        const long cpus = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+        std::vector<int> workers;
+        for (int w = 1; w <= std::min(cpus, 8L) && tune_workers(); w *= 2)
+        {
+            workers.push_back(w);
+        }
+        if (workers.empty())
+        {
+            workers.push_back(0);
+        }
+
+        std::vector<Candidate> out;
+        for (std::size_t batch : {16, 64, 256, 1024})
+        {
+            for (int w : workers)
+            {
+                for (const char *transport : {"pipe", "socketpair"})
+                {
+                    out.push_back(Candidate{batch, w, transport});
+                }
+            }
+        }
+        return out;
+    }
+
+    /// @brief Directory of the profiles.
+    std::string profile_dir()
+    {
+        const char *dir = std::getenv("TRAINER_AUTOTUNE_DIR");
+        if (dir && *dir)
+        {
+            return dir;
+        }
+        const char *home = std::getenv("HOME");
+        return std::string(home && *home ? home : "/tmp") + "/.cache/trainer";
+    }
+
+    /// @brief mkdir -p.
+    void make_dirs(const std::string &path)
+    {
+        for (std::size_t at = path.find('/', 1); ; at = path.find('/', at + 1))
+        {
+            mkdir(path.substr(0, at).c_str(), 0755);
+            if (at == std::string::npos)
+            {
+                break;
+            }
+        }
+    }
+} // namespace
+
+namespace autotune
+{
+    std::string host_fingerprint()
+    {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        std::string model = "unknown-cpu";
+        while (std::getline(cpuinfo, line))
+        {
+            if (line.compare(0, 10, "model name") == 0)
+            {
+                const std::size_t colon = line.find(':');
+                if (colon != std::string::npos && colon + 2 <= line.size())
+                {
+                    model = line.substr(colon + 2);
+                }
+                break;
+            }
+        }
+        return model + " x" + std::to_string(std::max(1L, sysconf(_SC_NPROCESSORS_ONLN)));
+    }
+
+    std::string profile_path()
+    {
+        std::string name;
+        for (const char ch : host_fingerprint())
+        {
+            const bool plain = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+                               (ch >= '0' && ch <= '9') || ch == '.' || ch == '-';
+            if (plain)
+            {
+                name.push_back(ch);
+            }
+            else if (name.empty() || name.back() != '_')
+            {
+                name.push_back('_');
+            }
+        }
+        return profile_dir() + "/" + name + ".profile";
+    }
+
+    bool apply_profile()
+    {
+        const char *use = std::getenv("TRAINER_AUTOTUNE_PROFILE");
+        if (use && std::strcmp(use, "0") == 0)
+        {
+            return false;
+        }
+        const std::string path = profile_path();
+        std::ifstream in(path);
+        std::string line;
+        if (!in || !std::getline(in, line) || line != "host " + host_fingerprint())
+        {
+            return false;
+        }
+
+        std::string applied;
+        std::string skipped;
+        bool listed = false;
+        while (std::getline(in, line))
+        {
+            std::stringstream ss(line);
+            std::string key, value;
+            if (line.empty() || line[0] == '#' || !(ss >> key >> value))
+            {
+                continue;
+            }
+            listed = true;
+            if (key == "TRAINER_WORKERS" && !tune_workers())
+            {
+                skipped += " " + key + "=" + value;
+                continue;
+            }
+            const char *current = std::getenv(key.c_str());
+            if (!current || !*current)
+            {
+                setenv(key.c_str(), value.c_str(), 1);
+                applied += " " + key + "=" + value;
+            }
+        }
+        std::cerr << "trainer: autotune profile " << path << ":"
+                  << (!listed ? " defaults are fastest"
+                      : applied.empty() ? " all settings overridden by the environment" : applied)
+                  << "\n";
+        if (!skipped.empty())
+        {
+            std::cerr << "trainer: autotune profile: not applied (changes the model, "
+                      << "TRAINER_AUTOTUNE_WORKERS=1 applies it):" << skipped << "\n";
+        }
+        return true;
+    }
+
+    int run(const std::string &csv_path, bool fuse, const std::string &config)
+    {
+        Bench bench;
+        bench.fuse = fuse;
+        bench.config = config;
+        bench.rows = write_sample(csv_path,
+                                  static_cast<std::size_t>(std::max(1L, env_long("TRAINER_AUTOTUNE_SAMPLES", 2000))),
+                                  bench.sample);
+        if (bench.rows == 0)
+        {
+            if (!bench.sample.empty())
+            {
+                unlink(bench.sample.c_str());
+            }
+            return 1;
+        }
+        bench.model = bench.sample + ".model";
+        const double max_latency = static_cast<double>(env_long("TRAINER_AUTOTUNE_MAX_LATENCY_MS", 0));
+        const double min_seconds = std::max(1L, env_long("TRAINER_AUTOTUNE_MIN_MS", 200)) / 1000.0;
+        const int repeats = static_cast<int>(std::max(3L, env_long("TRAINER_AUTOTUNE_REPEATS", 5)));
+        auto cleanup = [&bench]() {
+            unlink(bench.sample.c_str());
+            unlink(bench.model.c_str());
+        };
+
+        // The baseline is what a run gets without a profile.
+        const Candidate baseline{0, 0, nullptr};
+        if (!calibrate(bench, csv_path, baseline, min_seconds, 1000000))
+        {
+            std::cerr << "autotune: the baseline run failed\n";
+            cleanup();
+            return 1;
+        }
+        std::cerr << "autotune: host " << host_fingerprint() << ", " << bench.rows
+                  << " sample rows, " << repeats << " runs each\n";
+        const Result base = measure_repeated(bench, baseline, repeats);
+        if (!base.ok)
+        {
+            std::cerr << "autotune: the baseline run failed\n";
+            cleanup();
+            return 1;
+        }
+        std::fprintf(stderr, "autotune: baseline (no profile)          records_per_s=%.0f +-%.0f latency_ms=%.2f\n",
+                     base.records_per_s, base.spread / 2, base.latency_ms);
+
+        const Candidate *best = nullptr;
+        Result best_result;
+        bool best_in_bound = false;
+        const std::vector<Candidate> all = candidates();
+        for (const Candidate &c : all)
+        {
+            const Result r = measure_repeated(bench, c, repeats);
+
+            std::fprintf(stderr, "autotune: batch=%-5zu ", c.batch);
+            if (c.workers > 0)
+            {
+                std::fprintf(stderr, "workers=%d ", c.workers);
+            }
+            std::fprintf(stderr, "transport=%-10s ", c.transport);
+            if (!r.ok)
+            {
+                std::fprintf(stderr, "failed\n");
+                continue;
+            }
+            std::fprintf(stderr, "records_per_s=%.0f +-%.0f latency_ms=%.2f\n",
+                         r.records_per_s, r.spread / 2, r.latency_ms);
+
+            // Within the bound, the fastest wins; until one is within
+            // it, the one closest to it.
+            const bool in_bound = max_latency <= 0 || r.latency_ms <= max_latency;
+            const bool better = !best ||
+                (in_bound && (!best_in_bound || r.records_per_s > best_result.records_per_s)) ||
+                (!in_bound && !best_in_bound && r.latency_ms < best_result.latency_ms);
+            if (better)
+            {
+                best = &c;
+                best_result = r;
+                best_in_bound = in_bound;
+            }
+        }
+        cleanup();
+
+        if (!best)
+        {
+            std::cerr << "autotune: every micro-run failed\n";
+            return 1;
+        }
+        if (!best_in_bound)
+        {
+            std::cerr << "autotune: no configuration within " << max_latency
+                      << " ms latency; keeping the lowest-latency one\n";
+        }
+
+        // A winner has to beat the baseline by more than runs of either
+        // vary; otherwise it only won on noise and the defaults stay.
+        const bool base_in_bound = max_latency <= 0 || base.latency_ms <= max_latency;
+        const double margin = best_result.records_per_s - base.records_per_s;
+        if (best_in_bound && base_in_bound && margin <= std::max(best_result.spread, base.spread))
+        {
+            std::fprintf(stderr, "autotune: best is %.0f records/s over the baseline, "
+                                 "within the run-to-run spread of %.0f; keeping the defaults\n",
+                         margin, std::max(best_result.spread, base.spread));
+            best = nullptr;
+        }
+
+        const std::string path = profile_path();
+        make_dirs(profile_dir());
+        std::ofstream out(path);
+        out << "host " << host_fingerprint() << "\n";
+        if (best)
+        {
+            out << "FORWARD_BATCH " << best->batch << "\n";
+            if (best->workers > 0)
+            {
+                out << "TRAINER_WORKERS " << best->workers << "\n";
+            }
+            out << "TRAINER_TRANSPORT " << best->transport << "\n";
+        }
+        const Result &saved = best ? best_result : base;
+        out << "# records_per_s=" << saved.records_per_s << " spread=" << saved.spread
+            << " latency_ms=" << saved.latency_ms << "\n";
+        if (!out)
+        {
+            std::cerr << "autotune: cannot write " << path << "\n";
+            return 1;
+        }
+        if (best)
+        {
+            std::cerr << "autotune: chose batch=" << best->batch
+                      << (best->workers > 0 ? " workers=" + std::to_string(best->workers) : "")
+                      << " transport=" << best->transport << ", saved to " << path << "\n";
+        }
+        else
+        {
+            std::cerr << "autotune: saved the defaults to " << path << "\n";
+        }
+        return 0;
+    }
+
+} // namespace autotune
@@ -1,12 +1,31 @@
 /// @file backward_layer.cpp
 /// @brief Implementation of the backward_layer executable.
 #include "backward_layer.hpp"
+#include "allreduce.hpp"
 #include "common.hpp"
+#include "compress.hpp"
 #include "math_layer.hpp"
+#include "stage_io.hpp"
+#include "param_server.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
 namespace
 {
@@ -60,6 +79,472 @@ namespace
         return "logs/model_params.txt";
     }
 
+    /// @brief Data-parallel settings read from the DDP_* environment.
+    struct DdpConfig
+    {
+        int world = 1;          ///< DDP_WORLD_SIZE: number of workers.
+        int rank = 0;           ///< DDP_RANK: this worker.
+        std::string endpoint;   ///< DDP_ENDPOINT: unix:<path> or tcp:<host>:<port>.
+        std::size_t batch = 32; ///< DDP_BATCH: samples per worker per step.
+        bool overlap = true;    ///< DDP_OVERLAP: all-reduce during next batch.
+        bool linear_lr = true;  ///< DDP_LR_SCALING: lr times the global batch.
+    };
+
+    /**
+     * @brief Read an integer environment variable.
+     *
+     * @param name     Variable name.
+     * @param fallback Value used if unset or not a number.
+     * @return Parsed value.
+     */
+    long env_long(const char *name, long fallback)
+    {
+        const char *env = std::getenv(name);
+        if (!env || !*env)
+        {
+            return fallback;
+        }
+        char *end = nullptr;
+        const long v = std::strtol(env, &end, 10);
+        return (end && *end == '\0') ? v : fallback;
+    }
+
+    /**
+     * @brief Obtain data-parallel settings from the environment.
+     *
+     * @return Parsed settings (world == 1 means data parallelism is off).
+     */
+    DdpConfig get_ddp_config()
+    {
+        DdpConfig cfg;
+        cfg.world = static_cast<int>(std::max(1L, env_long("DDP_WORLD_SIZE", 1)));
+        cfg.rank = static_cast<int>(env_long("DDP_RANK", 0));
+        cfg.batch = static_cast<std::size_t>(std::max(1L, env_long("DDP_BATCH", 32)));
+        cfg.overlap = env_long("DDP_OVERLAP", 1) != 0;
+        const char *scaling = std::getenv("DDP_LR_SCALING");
+        if (scaling && *scaling)
+        {
+            if (std::strcmp(scaling, "none") == 0)
+            {
+                cfg.linear_lr = false;
+            }
+            else if (std::strcmp(scaling, "linear") != 0)
+            {
+                std::cerr << "backward_layer: invalid DDP_LR_SCALING=" << scaling
+                          << ", using linear\n";
+            }
+        }
+        const char *ep = std::getenv("DDP_ENDPOINT");
+        cfg.endpoint = ep ? ep : "";
+        return cfg;
+    }
+
+    /**
+     * @brief Runs gradient exchanges on a background thread.
+     *
+     * Lets a worker compute the next batch's gradient while the previous
+     * one is still being exchanged.
+     */
+    class AsyncExchange
+    {
+    public:
+        /// @brief Exchange function: reduces a buffer across workers in place.
+        using Fn = std::function<bool(std::vector<float> &)>;
+
+        explicit AsyncExchange(Fn fn)
+            : fn_(std::move(fn)), thread_(&AsyncExchange::loop, this)
+        {
+        }
+
+        ~AsyncExchange()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            thread_.join();
+        }
+
+        /// @brief Start exchanging buf in the background.
+        void start(std::vector<float> *buf)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                buf_ = buf;
+                busy_ = true;
+            }
+            cv_.notify_all();
+        }
+
+        /// @brief Wait for the running exchange; false if it failed.
+        bool wait()
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            cv_.wait(lock, [this] { return !busy_; });
+            return ok_;
+        }
+
+    private:
+        void loop()
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            for (;;)
+            {
+                cv_.wait(lock, [this] { return stop_ || busy_; });
+                if (stop_)
+                {
+                    return;
+                }
+                std::vector<float> *buf = buf_;
+                lock.unlock();
+                const bool ok = fn_(*buf);
+                lock.lock();
+                ok_ = ok;
+                busy_ = false;
+                cv_.notify_all();
+            }
+        }
+
+        Fn fn_;
+        std::mutex mu_;
+        std::condition_variable cv_;
+        std::vector<float> *buf_ = nullptr;
+        bool busy_ = false;
+        bool stop_ = false;
+        bool ok_ = true;
+        std::thread thread_;
+    };
+
+    /**
+     * @brief Split a separator-delimited list, skipping empty entries.
+     *
+     * @param spec Input string.
+     * @param sep  Separator character.
+     * @return List of non-empty entries.
+     */
+    std::vector<std::string> split_list(const std::string &spec, char sep)
+    {
+        std::vector<std::string> items;
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, sep))
+        {
+            if (!item.empty())
+            {
+                items.push_back(item);
+            }
+        }
+        return items;
+    }
+
+    /**
+     * @brief Reads "id x_0 ... x_{D-1} y" rows from stdin.
+     *
+     * The feature width D is that of the first row, so the network is
+     * sized to whatever forward_layer sends (wider under FORWARD_EXPAND).
+     * Malformed rows and rows of another width are quarantined (see
+     * stage_io::Quarantine) and skipped.
+     */
+    class RowReader
+    {
+    public:
+        /// @param batching Output batches to flush while reading (nullptr: none).
+        explicit RowReader(stage_io::BatchController *batching = nullptr)
+            : batching_(batching)
+        {
+        }
+
+        /**
+         * @brief Feature width of the stream (reads ahead one row).
+         *
+         * @return Width of the first row, or math::stream_dim_from_env()
+         *         for an empty stream.
+         */
+        std::size_t dim()
+        {
+            if (!started_)
+            {
+                started_ = true;
+                ahead_ = read(first_);
+                dim_ = ahead_ ? first_.x.size() : math::stream_dim_from_env();
+            }
+            return dim_;
+        }
+
+        /// @brief Next row of width dim(); false at end of input.
+        bool next(common::FeatureRow &row)
+        {
+            dim();
+            if (ahead_)
+            {
+                ahead_ = false;
+                std::swap(row, first_);
+                return true;
+            }
+            while (read(row))
+            {
+                if (row.x.size() == dim_)
+                {
+                    return true;
+                }
+                quarantine_.add("width", at_, line_);
+            }
+            return false;
+        }
+
+    private:
+        bool read(common::FeatureRow &row)
+        {
+            for (;;)
+            {
+                if (batching_)
+                {
+                    batching_->wait_record();
+                }
+                if (!std::getline(std::cin, line_))
+                {
+                    return false;
+                }
+                at_ = offset_;
+                offset_ += line_.size() + 1;
+                if (line_.empty())
+                {
+                    continue;
+                }
+                progress_.count_in();
+                if (common::parse_feature_line(line_, row))
+                {
+                    return true;
+                }
+                quarantine_.add(common::reject_reason(line_, ' ', 0), at_, line_);
+            }
+        }
+
+        stage_io::BatchController *batching_;
+        stage_io::Progress &progress_ = stage_io::progress();
+        stage_io::Quarantine quarantine_{"backward_layer"};
+        std::string line_;
+        std::uint64_t at_ = 0;     ///< Offset of line_ in the input.
+        std::uint64_t offset_ = 0; ///< Offset of the next line.
+        common::FeatureRow first_;
+        bool started_ = false;
+        bool ahead_ = false;
+        std::size_t dim_ = 0;
+    };
+
+    /**
+     * @brief Validation-driven early stopping for single-model training.
+     *
+     * Enabled by EARLY_STOP_PATIENCE=<n>. The validation set is either
+     *   - EARLY_STOP_VALIDATION_FILE: rows in this stage's input format
+     *     (e.g. forward_layer's capture of a test run), or
+     *   - held out of the stream: every EARLY_STOP_HOLDOUT-th row
+     *     (default 10) until EARLY_STOP_VALIDATION rows (default 200)
+     *     are held. Held rows are evaluated, not trained on.
+     * Every EARLY_STOP_INTERVAL trained rows (default 2000) the model's
+     * mean validation loss 0.5 * (y_hat - y)^2 is computed; a loss below
+     * the best one by more than EARLY_STOP_MIN_DELTA (default 0) makes
+     * the model the new best. After `patience` evaluations in a row
+     * without one, training stops: the stage asks the trainer to stop
+     * its upstream stages (stage_io::Progress::request_stop()) and
+     * leaves the rest of its input unread. The best model evaluated is
+     * the one saved.
+     */
+    class EarlyStopping
+    {
+    public:
+        EarlyStopping()
+            : patience_(env_long("EARLY_STOP_PATIENCE", 0)),
+              holdout_(std::max(2L, env_long("EARLY_STOP_HOLDOUT", 10))),
+              wanted_(static_cast<std::size_t>(std::max(1L, env_long("EARLY_STOP_VALIDATION", 200)))),
+              interval_(static_cast<std::uint64_t>(std::max(1L, env_long("EARLY_STOP_INTERVAL", 2000))))
+        {
+            const char *delta = std::getenv("EARLY_STOP_MIN_DELTA");
+            min_delta_ = delta && *delta ? std::strtod(delta, nullptr) : 0.0;
+        }
+
+        bool enabled() const { return patience_ > 0; }
+
+        /**
+         * @brief Load EARLY_STOP_VALIDATION_FILE, if set.
+         *
+         * @param dim Feature width of the training stream.
+         * @return false if the file is set but unusable.
+         */
+        bool load(std::size_t dim)
+        {
+            dim_ = dim;
+            const char *path = std::getenv("EARLY_STOP_VALIDATION_FILE");
+            if (!enabled() || !path || !*path)
+            {
+                return true;
+            }
+            std::ifstream in(path);
+            if (!in)
+            {
+                std::cerr << "backward_layer: cannot open EARLY_STOP_VALIDATION_FILE " << path << '\n';
+                return false;
+            }
+            std::string line;
+            common::FeatureRow row;
+            while (std::getline(in, line))
+            {
+                if (!line.empty() && common::parse_feature_line(line, row) && row.x.size() == dim)
+                {
+                    add(row);
+                }
+            }
+            if (ys_.empty())
+            {
+                std::cerr << "backward_layer: no rows of width " << dim << " in " << path << '\n';
+                return false;
+            }
+            from_file_ = true;
+            return true;
+        }
+
+        /// @brief Whether this stream row goes to the validation set instead of training.
+        bool hold(const common::FeatureRow &row)
+        {
+            if (!enabled() || from_file_ || ys_.size() >= wanted_ || ++seen_ % holdout_ != 0)
+            {
+                return false;
+            }
+            add(row);
+            return true;
+        }
+
+        /**
+         * @brief Count a trained row and evaluate when one is due.
+         *
+         * @return true if training should stop.
+         */
+        bool trained(const math::Model &model)
+        {
+            if (!enabled() || ++trained_ % interval_ != 0 || (!from_file_ && ys_.size() < wanted_))
+            {
+                return false;
+            }
+            return evaluate(model);
+        }
+
+        /// @brief Evaluate the final model unless it just was; report the outcome.
+        void finish(const math::Model &model)
+        {
+            if (!enabled())
+            {
+                return;
+            }
+            if (!stopped_ && !ys_.empty() && trained_ != evaluated_at_)
+            {
+                evaluate(model);
+            }
+            if (evaluations_ == 0)
+            {
+                std::cerr << "backward_layer: early stopping: no evaluation ("
+                          << ys_.size() << " validation rows, " << trained_ << " trained)\n";
+                return;
+            }
+            std::cerr << "backward_layer: early stopping: " << (stopped_ ? "stopped" : "completed")
+                      << " after " << trained_ << " rows; best validation loss " << best_loss_
+                      << " at row " << best_at_ << " of " << evaluations_ << " evaluations\n";
+        }
+
+        /// @brief The model to save: the best evaluated one, else current.
+        const math::Model &best(const math::Model &current) const
+        {
+            return evaluations_ > 0 ? best_ : current;
+        }
+
+    private:
+        void add(const common::FeatureRow &row)
+        {
+            xs_.insert(xs_.end(), row.x.begin(), row.x.end());
+            ys_.push_back(row.y);
+        }
+
+        bool evaluate(const math::Model &model)
+        {
+            double sum = 0.0;
+            for (std::size_t i = 0; i < ys_.size(); ++i)
+            {
+                const float diff = math::forward(model, &xs_[i * dim_]) - ys_[i];
+                sum += 0.5 * diff * diff;
+            }
+            const double loss = sum / ys_.size();
+            ++evaluations_;
+            evaluated_at_ = trained_;
+
+            if (evaluations_ == 1 || loss < best_loss_ - min_delta_)
+            {
+                best_loss_ = loss;
+                best_at_ = trained_;
+                best_ = model;
+                waited_ = 0;
+            }
+            else
+            {
+                ++waited_;
+            }
+            std::cerr << "backward_layer: validation loss " << loss << " after " << trained_
+                      << " rows (best " << best_loss_ << ", " << waited_ << '/' << patience_ << ")\n";
+            stopped_ = waited_ >= patience_;
+            return stopped_;
+        }
+
+        long patience_;
+        long holdout_;
+        std::size_t wanted_;
+        std::uint64_t interval_;
+        double min_delta_ = 0.0;
+        bool from_file_ = false;
+        std::size_t dim_ = 0;
+        std::vector<float> xs_; ///< Validation features, dim_ per row.
+        std::vector<float> ys_;
+        std::uint64_t seen_ = 0;    ///< Stream rows considered for holding out.
+        std::uint64_t trained_ = 0;
+        std::uint64_t evaluated_at_ = 0;
+        long evaluations_ = 0;
+        long waited_ = 0;           ///< Evaluations since the last improvement.
+        bool stopped_ = false;
+        double best_loss_ = 0.0;
+        std::uint64_t best_at_ = 0;
+        math::Model best_;
+    };
+
+    /**
+     * @brief Read per-model training configurations from MODEL_CONFIGS.
+     *
+     * MODEL_CONFIGS is a semicolon-separated list of model specs, each a
+     * comma-separated key=value list understood by math::parse_train_config,
+     * e.g. "lr=0.001;lr=0.01,hidden=16;opt=momentum".
+     *
+     * @param configs Output list (empty if MODEL_CONFIGS is unset).
+     * @return true on success, false on a malformed spec.
+     */
+    bool get_model_configs(std::vector<math::TrainConfig> &configs)
+    {
+        configs.clear();
+        const char *env = std::getenv("MODEL_CONFIGS");
+        if (!env || !*env)
+        {
+            return true;
+        }
+        for (const std::string &spec : split_list(env, ';'))
+        {
+            math::TrainConfig cfg;
+            if (!math::parse_train_config(spec, cfg))
+            {
+                std::cerr << "backward_layer: bad MODEL_CONFIGS entry: "
+                          << spec << '\n';
+                return false;
+            }
+            configs.push_back(cfg);
+        }
+        return true;
+    }
+
     /**
      * @brief Streaming loop implementing the backward stage.
      *
@@ -71,43 +556,39 @@ namespace
      *   - forward only, compute loss = 0.5 * (y_hat - y)^2
      *   - output "id loss y_hat"
      *
-     * @param mode Selected operating mode.
+     * With early stopping, held-out validation rows are evaluated as
+     * in test mode.
+     *
+     * @param mode   Selected operating mode.
+     * @param st     Model to train or evaluate.
+     * @param reader   Input rows.
+     * @param stop     Early stopping (train mode).
+     * @param batching Output batching (see stage_io::BatchController).
      * @return 0 on success, non-zero on error.
      */
-    int run_stream(Mode mode)
+    int run_stream(Mode mode, math::TrainState &st, RowReader &reader, EarlyStopping &stop,
+                   stage_io::BatchController &batching)
     {
         std::ios::sync_with_stdio(false);
 
-        std::string line;
+        common::FeatureRow s;
         std::size_t count = 0;
 
-        while (std::getline(std::cin, line))
+        while (reader.next(s))
         {
-            if (line.empty())
-            {
-                continue;
-            }
-
-            common::Sample s{};
-            if (!common::parse_sample_line(line, s))
-            {
-                std::cerr << "backward_layer: failed to parse line: "
-                          << line << '\n';
-                continue;
-            }
-
             float y_hat = 0.0f;
-            math::compute_forward(s, y_hat);
-
             float loss = 0.0f;
             float grad_norm = 0.0f;
 
-            if (mode == Mode::Train)
+            bool done = false;
+            if (mode == Mode::Train && !stop.hold(s))
             {
-                math::compute_backward_and_update(s, y_hat, loss, grad_norm);
+                math::train_step(st, s.x.data(), s.y, loss, y_hat, grad_norm);
+                done = stop.trained(st.model);
             }
             else
             {
+                y_hat = math::forward(st.model, s.x.data());
                 const float diff = y_hat - s.y;
                 loss = 0.5f * diff * diff;
                 grad_norm = 0.0f;
@@ -115,40 +596,671 @@ namespace
 
             ++count;
             std::cout << s.id << ' ' << loss << ' ' << y_hat << '\n';
+            stage_io::progress().count_out();
+            batching.wrote_record();
+            if (done)
+            {
+                stage_io::progress().request_stop();
+                break;
+            }
         }
 
         return 0;
     }
 
-} // namespace
+    /**
+     * @brief math::load_model() with the models of earlier calls kept.
+     *
+     * A stage served by the job daemon (--serve) runs many test jobs in
+     * one process; a model file that is unchanged since it was last read
+     * (same inode, size and mtime) is not parsed again.
+     *
+     * @return false if the file could not be loaded (m is untouched).
+     */
+    bool load_model_cached(const std::string &path, math::Model &m)
+    {
+        struct Entry
+        {
+            struct stat st;
+            math::Model model;
+        };
+        static std::map<std::string, Entry> cache;
 
-namespace backward_layer
-{
-    int run()
+        struct stat st{};
+        if (::stat(path.c_str(), &st) != 0)
+        {
+            return math::load_model(path, m);
+        }
+        const auto it = cache.find(path);
+        if (it != cache.end() && it->second.st.st_ino == st.st_ino &&
+            it->second.st.st_size == st.st_size &&
+            it->second.st.st_mtim.tv_sec == st.st_mtim.tv_sec &&
+            it->second.st.st_mtim.tv_nsec == st.st_mtim.tv_nsec)
+        {
+            m = it->second.model;
+            return true;
+        }
+        math::Model loaded;
+        if (!math::load_model(path, loaded))
+        {
+            return false;
+        }
+        if (cache.size() >= 16)
+        {
+            cache.clear();
+        }
+        cache[path] = Entry{st, loaded};
+        m = std::move(loaded);
+        return true;
+    }
+
+    /**
+     * @brief Test-mode loop evaluating several models in one pass.
+     *
+     * Each model is loaded from its path (initial parameters are used if
+     * the file is missing), all models are packed into one ModelStack,
+     * and every sample is evaluated against all of them. Output per sample:
+     *   id loss_0 y_hat_0 loss_1 y_hat_1 ...
+     *
+     * @param paths    Model files, in output order.
+     * @param batching Output batching (see stage_io::BatchController).
+     * @return 0 on success, non-zero on error.
+     */
+    int run_multi_test(const std::vector<std::string> &paths, stage_io::BatchController &batching)
     {
-        const Mode mode = get_mode();
-        const std::string model_path = get_model_path();
+        RowReader reader(&batching);
+        const std::size_t dim = reader.dim();
+
+        std::vector<math::Model> models;
+        for (std::size_t k = 0; k < paths.size(); ++k)
+        {
+            math::Model m = math::make_model(dim, math::DEFAULT_HIDDEN_DIM);
+            if (!load_model_cached(paths[k], m))
+            {
+                std::cerr << "backward_layer: no model file at "
+                          << paths[k]
+                          << ", using initial parameters\n";
+            }
+            else if (m.input_dim != dim)
+            {
+                std::cerr << "backward_layer: model " << paths[k]
+                          << " expects " << m.input_dim
+                          << " inputs, stream has " << dim << '\n';
+                return 1;
+            }
+            std::cerr << "backward_layer: model " << k << " = "
+                      << paths[k] << '\n';
+            models.push_back(std::move(m));
+        }
+
+        const math::ModelStack stack = math::stack_models(models);
+        std::vector<float> y_hat(models.size());
+
+        common::FeatureRow s;
+        while (reader.next(s))
+        {
+            math::forward_stack(stack, s.x.data(), y_hat.data());
+
+            std::cout << s.id;
+            for (const float yh : y_hat)
+            {
+                const float diff = yh - s.y;
+                std::cout << ' ' << 0.5f * diff * diff << ' ' << yh;
+            }
+            std::cout << '\n';
+            stage_io::progress().count_out();
+            batching.wrote_record();
+        }
+
+        return 0;
+    }
+
+    /**
+     * @brief Train-mode loop updating several independent models.
+     *
+     * Every sample is parsed once and fed to all models; each model has
+     * its own hidden size, learning rate and optimizer. Output per sample:
+     *   id loss_0 y_hat_0 loss_1 y_hat_1 ...
+     * At the end of the stream model k is saved to paths[k].
+     *
+     * @param paths    Output model files, one per config.
+     * @param configs  Training configuration of each model.
+     * @param batching Output batching (see stage_io::BatchController).
+     * @return 0 on success, non-zero on error.
+     */
+    int run_multi_train(const std::vector<std::string> &paths,
+                        const std::vector<math::TrainConfig> &configs,
+                        stage_io::BatchController &batching)
+    {
+        RowReader reader(&batching);
+
+        std::vector<math::TrainState> states;
+        for (std::size_t k = 0; k < configs.size(); ++k)
+        {
+            const math::TrainConfig &cfg = configs[k];
+            std::cerr << "backward_layer: model " << k << " = " << paths[k]
+                      << " (hidden=" << cfg.hidden_dim
+                      << " lr=" << cfg.learning_rate
+                      << " opt=" << (cfg.optimizer == math::Optimizer::Momentum
+                                         ? "momentum" : "sgd")
+                      << ")\n";
+            states.push_back(math::make_train_state(reader.dim(), cfg));
+        }
+
+        common::FeatureRow s;
+        while (reader.next(s))
+        {
+            std::cout << s.id;
+            for (math::TrainState &st : states)
+            {
+                float loss = 0.0f;
+                float y_hat = 0.0f;
+                float grad_norm = 0.0f;
+                math::train_step(st, s.x.data(), s.y, loss, y_hat, grad_norm);
+                std::cout << ' ' << loss << ' ' << y_hat;
+            }
+            std::cout << '\n';
+            stage_io::progress().count_out();
+            batching.wrote_record();
+        }
+
+        int rc = 0;
+        for (std::size_t k = 0; k < states.size(); ++k)
+        {
+            if (!math::save_model(paths[k], states[k].model))
+            {
+                std::cerr << "backward_layer: failed to save parameters to "
+                          << paths[k] << '\n';
+                rc = 1;
+            }
+            else
+            {
+                std::cerr << "backward_layer: saved parameters to "
+                          << paths[k] << '\n';
+            }
+        }
+        return rc;
+    }
+
+    /**
+     * @brief Train-mode loop of one data-parallel worker.
+     *
+     * Each worker reads its own shard from stdin and, per step, sums the
+     * gradients of up to cfg.batch samples. The ring all-reduce sums the
+     * gradients of all workers together with two trailing counters
+     * (samples in the step, workers that still had data), and every
+     * worker applies the same update, so all replicas stay identical.
+     * The update is lr times the summed gradient: the averaged gradient
+     * with lr scaled by the global batch (DDP_LR_SCALING=linear), about
+     * what the per-sample steps of a single process would add up to.
+     * DDP_LR_SCALING=none applies the plain average, which moves the
+     * model a global batch's worth less per step and, at this learning
+     * rate, ends a pass far from the single-process loss.
+     * Workers whose shard is exhausted keep joining with empty steps until
+     * no worker has data left.
+     *
+     * With overlap enabled, step t's all-reduce runs on a background
+     * thread while step t+1's gradient is computed, and is applied once
+     * that batch is done (one step of gradient delay).
+     *
+     * @param model_path Where rank 0 saves the final model.
+     * @param config     Model configuration.
+     * @param ddp        Data-parallel settings.
+     * @return 0 on success, non-zero on error.
+     */
+    int run_ddp_train(const std::string &model_path,
+                      const math::TrainConfig &config,
+                      const DdpConfig &ddp)
+    {
+        net::Endpoint ep;
+        if (!net::parse_endpoint(ddp.endpoint, ep))
+        {
+            std::cerr << "backward_layer: invalid DDP_ENDPOINT '"
+                      << ddp.endpoint << "'\n";
+            return 1;
+        }
+
+        allreduce::Ring ring;
+        if (!allreduce::ring_connect(ep, ddp.rank, ddp.world, ring))
+        {
+            std::cerr << "backward_layer: rank " << ddp.rank
+                      << " failed to join the ring\n";
+            return 1;
+        }
+
+        RowReader reader;
+        math::TrainState st = math::make_train_state(reader.dim(), config);
+        const std::size_t P = st.model.params.size();
+        std::vector<float> bufs[2] = {std::vector<float>(P + 2),
+                                      std::vector<float>(P + 2)};
+
+        compress::Compressor comp;
+        if (!compress::from_env(static_cast<unsigned>(ddp.rank), comp))
+        {
+            allreduce::ring_close(ring);
+            return 1;
+        }
+
+        // Uncompressed gradients are summed in flight by the ring
+        // all-reduce. Compressed ones cannot be, so every worker gathers
+        // all payloads and decodes them in rank order (identical sums on
+        // every worker). The two counters always travel uncompressed.
+        std::vector<char> payload;
+        std::vector<std::vector<char>> gathered;
+        auto reduce = [&](std::vector<float> &b) {
+            if (comp.config.method == compress::Method::None)
+            {
+                return allreduce::ring_allreduce(ring, b.data(), b.size());
+            }
+
+            constexpr std::size_t counters = 2 * sizeof(float);
+            compress::encode(comp, b.data(), P, payload);
+            payload.insert(payload.begin(),
+                           reinterpret_cast<const char *>(&b[P]),
+                           reinterpret_cast<const char *>(&b[P]) + counters);
+            if (!allreduce::ring_allgather(ring, payload, gathered))
+            {
+                return false;
+            }
+
+            std::fill(b.begin(), b.end(), 0.0f);
+            for (const std::vector<char> &g : gathered)
+            {
+                float c[2];
+                if (g.size() < counters)
+                {
+                    return false;
+                }
+                std::memcpy(c, g.data(), counters);
+                b[P] += c[0];
+                b[P + 1] += c[1];
+                if (!compress::decode_add(comp, g.data() + counters,
+                                          g.size() - counters, b.data(), P))
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        std::ios::sync_with_stdio(false);
+
+        using Clock = std::chrono::steady_clock;
+        double wait_seconds = 0.0;
+        std::size_t steps = 0;
+        bool eof = false;
+        bool ok = true;
+        int cur = 0;
+        bool pending = false;
+
+        // Apply a reduced buffer; returns false once no worker had data.
+        auto apply = [&](const std::vector<float> &b) {
+            if (b[P] > 0.0f)
+            {
+                math::apply_gradient(st, b.data(), ddp.linear_lr ? 1.0f : 1.0f / b[P]);
+            }
+            return b[P + 1] > 0.0f;
+        };
+
+        {
+            AsyncExchange comm(reduce);
+            common::FeatureRow s;
+            for (;;)
+            {
+                std::vector<float> &b = bufs[cur];
+                std::fill(b.begin(), b.end(), 0.0f);
+
+                std::size_t n = 0;
+                while (n < ddp.batch && !eof)
+                {
+                    if (!reader.next(s))
+                    {
+                        eof = true;
+                        break;
+                    }
+
+                    float loss = 0.0f;
+                    float y_hat = 0.0f;
+                    math::accumulate_gradient(st, s.x.data(), s.y, b.data(), loss, y_hat);
+                    std::cout << s.id << ' ' << loss << ' ' << y_hat << '\n';
+                    stage_io::progress().count_out();
+                    ++n;
+                }
+                b[P] = static_cast<float>(n);
+                b[P + 1] = n > 0 ? 1.0f : 0.0f;
+
+                if (pending)
+                {
+                    const auto t0 = Clock::now();
+                    ok = comm.wait();
+                    wait_seconds += std::chrono::duration<double>(Clock::now() - t0).count();
+                    pending = false;
+                    if (!ok || !apply(bufs[1 - cur]))
+                    {
+                        break;
+                    }
+                }
+
+                comm.start(&b);
+                pending = true;
+                ++steps;
+
+                if (!ddp.overlap)
+                {
+                    const auto t0 = Clock::now();
+                    ok = comm.wait();
+                    wait_seconds += std::chrono::duration<double>(Clock::now() - t0).count();
+                    pending = false;
+                    if (!ok || !apply(b))
+                    {
+                        break;
+                    }
+                }
+                cur = 1 - cur;
+            }
+        }
+        allreduce::ring_close(ring);
+        std::cout.flush();
+
+        std::cerr << "backward_layer: rank " << ddp.rank << '/' << ddp.world
+                  << " steps=" << steps
+                  << " allreduce_wait=" << wait_seconds << "s\n";
+        compress::report(comp, "backward_layer: rank " + std::to_string(ddp.rank));
+        if (!ok)
+        {
+            std::cerr << "backward_layer: rank " << ddp.rank
+                      << " gradient exchange failed\n";
+            return 1;
+        }
+
+        if (ddp.rank == 0)
+        {
+            if (!math::save_model(model_path, st.model))
+            {
+                std::cerr << "backward_layer: failed to save parameters to "
+                          << model_path << '\n';
+                return 1;
+            }
+            std::cerr << "backward_layer: saved parameters to "
+                      << model_path << '\n';
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Train-mode loop of one parameter-server worker.
+     *
+     * Per step the worker reads up to ddp.batch samples, pulls the
+     * current parameters (the server may hold the reply back to enforce
+     * its staleness bound), sums the batch gradient and pushes it.
+     * The server owns, updates and saves the model.
+     *
+     * @param endpoint Server address (PS_ENDPOINT).
+     * @param config   Model configuration (must match the server's).
+     * @param ddp      Worker id (DDP_RANK) and batch size.
+     * @return 0 on success, non-zero on error.
+     */
+    int run_ps_worker(const std::string &endpoint,
+                      const math::TrainConfig &config,
+                      const DdpConfig &ddp)
+    {
+        net::Endpoint ep;
+        if (!net::parse_endpoint(endpoint, ep))
+        {
+            std::cerr << "backward_layer: invalid PS_ENDPOINT '" << endpoint << "'\n";
+            return 1;
+        }
+        const int fd = net::connect_rank(ep, 0, 30 * 1000);
+        if (fd < 0)
+        {
+            return 1;
+        }
+
+        RowReader reader;
+        math::TrainState st = math::make_train_state(reader.dim(), config);
+        std::vector<common::FeatureRow> batch;
+        std::vector<float> grad;
+
+        compress::Compressor comp;
+        if (!compress::from_env(static_cast<unsigned>(ddp.rank), comp))
+        {
+            close(fd);
+            return 1;
+        }
+        const bool packed = comp.config.method != compress::Method::None;
+        std::vector<char> payload;
+
+        param_server::MsgHeader h{};
+        h.type = param_server::MSG_HELLO;
+        h.worker = static_cast<std::uint32_t>(ddp.rank);
+        bool ok = net::send_all(fd, &h, sizeof(h));
+
+        std::ios::sync_with_stdio(false);
+
+        using Clock = std::chrono::steady_clock;
+        double pull_seconds = 0.0;
+        std::uint64_t clock = 0;
+        bool eof = false;
+        while (ok && !eof)
+        {
+            // Rows are reused across batches to keep their buffers.
+            std::size_t n = 0;
+            while (n < ddp.batch)
+            {
+                if (n == batch.size())
+                {
+                    batch.emplace_back();
+                }
+                if (!reader.next(batch[n]))
+                {
+                    eof = true;
+                    break;
+                }
+                ++n;
+            }
+            if (n == 0)
+            {
+                break;
+            }
+
+            // Pull: reply carries the parameters (size fixed by the server).
+            const auto t0 = Clock::now();
+            h = param_server::MsgHeader{};
+            h.type = param_server::MSG_PULL;
+            h.worker = static_cast<std::uint32_t>(ddp.rank);
+            h.clock = clock;
+            ok = net::send_all(fd, &h, sizeof(h)) && net::recv_all(fd, &h, sizeof(h)) &&
+                 h.type == param_server::MSG_PARAMS &&
+                 h.floats == st.model.params.size() &&
+                 net::recv_all(fd, st.model.params.data(), h.floats * sizeof(float));
+            pull_seconds += std::chrono::duration<double>(Clock::now() - t0).count();
+            if (!ok)
+            {
+                break;
+            }
+
+            grad.assign(st.model.params.size(), 0.0f);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                const common::FeatureRow &s = batch[i];
+                float loss = 0.0f;
+                float y_hat = 0.0f;
+                math::accumulate_gradient(st, s.x.data(), s.y, grad.data(), loss, y_hat);
+                std::cout << s.id << ' ' << loss << ' ' << y_hat << '\n';
+                stage_io::progress().count_out();
+            }
+
+            h = param_server::MsgHeader{};
+            h.type = packed ? param_server::MSG_PUSH_PACKED : param_server::MSG_PUSH;
+            h.worker = static_cast<std::uint32_t>(ddp.rank);
+            h.clock = clock++;
+            h.samples = static_cast<std::uint32_t>(n);
+            if (packed)
+            {
+                compress::encode(comp, grad.data(), grad.size(), payload);
+                h.floats = static_cast<std::uint32_t>(payload.size());
+                ok = net::send_all(fd, &h, sizeof(h)) &&
+                     net::send_all(fd, payload.data(), payload.size());
+            }
+            else
+            {
+                h.floats = static_cast<std::uint32_t>(grad.size());
+                ok = net::send_all(fd, &h, sizeof(h)) &&
+                     net::send_all(fd, grad.data(), grad.size() * sizeof(float));
+            }
+        }
+
+        if (ok)
+        {
+            h = param_server::MsgHeader{};
+            h.type = param_server::MSG_DONE;
+            h.worker = static_cast<std::uint32_t>(ddp.rank);
+            ok = net::send_all(fd, &h, sizeof(h));
+        }
+        close(fd);
+        std::cout.flush();
+
+        std::cerr << "backward_layer: ps worker " << ddp.rank
+                  << " steps=" << clock
+                  << " pull_wait=" << pull_seconds << "s\n";
+        compress::report(comp, "backward_layer: ps worker " + std::to_string(ddp.rank));
+        if (!ok)
+        {
+            std::cerr << "backward_layer: ps worker " << ddp.rank
+                      << " lost the parameter server\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Pick and run the loop matching mode and environment.
+     *
+     * The single-process loops batch their output through batching;
+     * the data-parallel ones keep their per-step batching (DDP_BATCH).
+     *
+     * @param mode     Selected operating mode.
+     * @param ddp      Data-parallel settings.
+     * @param batching Output batching (see stage_io::BatchController).
+     * @return 0 on success, non-zero on error.
+     */
+    int run_selected(Mode mode, const DdpConfig &ddp, stage_io::BatchController &batching)
+    {
+        std::vector<std::string> model_paths =
+            split_list(get_model_path(), ',');
+        if (model_paths.empty())
+        {
+            std::cerr << "backward_layer: MODEL_FILE lists no paths\n";
+            return 1;
+        }
+        if (mode == Mode::Test && model_paths.size() > 1)
+        {
+            return run_multi_test(model_paths, batching);
+        }
+
+        std::vector<math::TrainConfig> configs;
+        if (!get_model_configs(configs))
+        {
+            return 1;
+        }
+        const char *ps_endpoint = std::getenv("PS_ENDPOINT");
+        const bool single = !(ps_endpoint && *ps_endpoint) && ddp.world == 1 &&
+                            model_paths.size() == 1 && configs.empty();
+        if (mode == Mode::Train && !single && EarlyStopping().enabled())
+        {
+            std::cerr << "backward_layer: early stopping only applies to single-model, "
+                         "single-worker training; ignoring EARLY_STOP_PATIENCE\n";
+        }
+        if (mode == Mode::Train && ps_endpoint && *ps_endpoint)
+        {
+            return run_ps_worker(ps_endpoint,
+                                 configs.empty() ? math::TrainConfig{} : configs.front(),
+                                 ddp);
+        }
+        if (mode == Mode::Train && ddp.world > 1)
+        {
+            if (configs.size() > 1 || model_paths.size() > 1)
+            {
+                std::cerr << "backward_layer: data-parallel training supports "
+                             "a single model\n";
+                return 1;
+            }
+            return run_ddp_train(model_paths.front(),
+                                 configs.empty() ? math::TrainConfig{} : configs.front(),
+                                 ddp);
+        }
+        if (mode == Mode::Train && (model_paths.size() > 1 || !configs.empty()))
+        {
+            // One model per config; a single MODEL_FILE is expanded into
+            // <path>.<k> so each configuration gets its own file.
+            const std::size_t k_models = std::max(model_paths.size(), configs.size());
+            if (configs.empty())
+            {
+                configs.resize(k_models);
+            }
+            if (model_paths.size() == 1 && k_models > 1)
+            {
+                const std::string base = model_paths.front();
+                model_paths.clear();
+                for (std::size_t k = 0; k < k_models; ++k)
+                {
+                    model_paths.push_back(base + '.' + std::to_string(k));
+                }
+            }
+            if (model_paths.size() != configs.size())
+            {
+                std::cerr << "backward_layer: " << model_paths.size()
+                          << " model files for " << configs.size()
+                          << " MODEL_CONFIGS entries\n";
+                return 1;
+            }
+            return run_multi_train(model_paths, configs, batching);
+        }
+        const std::string &model_path = model_paths.front();
+
+        RowReader reader(&batching);
+        math::TrainState st = math::make_train_state(reader.dim(), math::TrainConfig{});
+        EarlyStopping stop;
+        if (mode == Mode::Train && !stop.load(reader.dim()))
+        {
+            return 1;
+        }
 
         if (mode == Mode::Test)
         {
-            if (!math::load_parameters(model_path))
+            math::Model loaded;
+            if (!load_model_cached(model_path, loaded))
             {
                 std::cerr << "backward_layer: no model file at "
                           << model_path
                           << ", using initial parameters\n";
             }
+            else if (loaded.input_dim != st.model.input_dim)
+            {
+                std::cerr << "backward_layer: model " << model_path
+                          << " expects " << loaded.input_dim
+                          << " inputs, stream has " << st.model.input_dim << '\n';
+                return 1;
+            }
             else
             {
+                // The hidden size is the file's (e.g. trained under
+                // MODEL_CONFIGS), not the default.
+                math::TrainConfig cfg;
+                cfg.hidden_dim = loaded.hidden_dim;
+                st = math::make_train_state(loaded.input_dim, cfg);
+                st.model = std::move(loaded);
                 std::cerr << "backward_layer: loaded parameters from "
                           << model_path << '\n';
             }
         }
 
-        const int rc = run_stream(mode);
+        const int rc = run_stream(mode, st, reader, stop, batching);
 
         if (mode == Mode::Train)
         {
-            if (!math::save_parameters(model_path))
+            stop.finish(st.model);
+            if (!math::save_model(model_path, stop.best(st.model)))
             {
                 std::cerr << "backward_layer: failed to save parameters to "
                           << model_path << '\n';
@@ -163,9 +1275,64 @@ namespace backward_layer
         return rc;
     }
 
+} // namespace
+
+namespace backward_layer
+{
+    int run()
+    {
+        // Before any input is read: switching later drops what stdio
+        // has already buffered (the row readers read ahead).
+        std::ios::sync_with_stdio(false);
+
+        const Mode mode = get_mode();
+        const DdpConfig ddp = get_ddp_config();
+
+        // Data-parallel workers share the logger's input pipe; only ever
+        // write whole lines so their outputs cannot interleave mid-line.
+        common::AtomicLineBuf shared_out(STDOUT_FILENO);
+        std::streambuf *const saved_out = std::cout.rdbuf();
+        if (ddp.world > 1)
+        {
+            std::cout.rdbuf(&shared_out);
+        }
+
+        int rc;
+        {
+            const stage_io::MemoryShare memory("backward_layer");
+            stage_io::Capture capture("backward_layer");
+            // Rows are handled one at a time; under BATCH_TARGET_P99_MS
+            // the output lines are flushed in controlled batches.
+            stage_io::BatchController batching("backward_layer", 128, memory, 32);
+            rc = run_selected(mode, ddp, batching);
+        }
+
+        std::cout.flush();
+        std::cout.rdbuf(saved_out);
+        return rc;
+    }
+
 } // namespace backward_layer
 
-int main()
+int main(int argc, char *argv[])
 {
+    int control = -1;
+    if (stage_io::parse_serve_args(argc, argv, control))
+    {
+        return stage_io::serve("backward_layer", control,
+                               [](const std::vector<std::string> &) { return backward_layer::run(); });
+    }
+
+    stage_io::ReplayOptions replay;
+    const int replay_args = stage_io::parse_replay_args(argc, argv, replay);
+    if (replay_args > 0)
+    {
+        return stage_io::replay("backward_layer", replay, backward_layer::run);
+    }
+    if (replay_args < 0 || argc != 1)
+    {
+        std::cerr << "Usage: backward_layer [--replay <file> [--repeat N] | --serve <fd>]\n";
+        return 1;
+    }
     return backward_layer::run();
 }
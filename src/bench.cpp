@@ -0,0 +1,450 @@
+/// @file bench.cpp
+/// @brief Implementation of the shared microbenchmark harness.
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sched.h>
+#include <unistd.h>
+
+namespace
+{
+    /**
+     * @brief Read an integer from an environment variable.
+     *
+     * @param name     Variable name.
+     * @param fallback Value used if unset or invalid.
+     * @param min      Smallest accepted value.
+     * @return Parsed value.
+     */
+    int env_int(const char *name, int fallback, int min)
+    {
+        const char *v = std::getenv(name);
+        if (!v || !*v)
+        {
+            return fallback;
+        }
+        char *end = nullptr;
+        const long n = std::strtol(v, &end, 10);
+        if (*end != '\0' || n < min)
+        {
+            std::cerr << "bench: ignoring invalid " << name << "=" << v << "\n";
+            return fallback;
+        }
+        return static_cast<int>(n);
+    }
+
+    double median_of(std::vector<double> &v)
+    {
+        std::sort(v.begin(), v.end());
+        const std::size_t n = v.size();
+        return n % 2 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+    }
+
+    /// @brief Write s as a JSON string literal.
+    void write_string(std::ostream &os, const std::string &s)
+    {
+        os << '"';
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+            {
+                os << '\\';
+            }
+            os << c;
+        }
+        os << '"';
+    }
+
+    /// @brief Write a number; JSON has no inf/nan, so those become null.
+    void write_number(std::ostream &os, double v)
+    {
+        if (std::isfinite(v))
+        {
+            os << v;
+        }
+        else
+        {
+            os << "null";
+        }
+    }
+    /// @brief Parsed JSON value (only what read_json() needs).
+    struct JsonValue
+    {
+        enum class Type { Null, Bool, Number, String, Array, Object } type = Type::Null;
+        double number = 0.0;
+        std::string str;
+        std::vector<JsonValue> array;
+        std::vector<std::pair<std::string, JsonValue>> object;
+
+        const JsonValue *get(const std::string &key) const
+        {
+            for (const auto &kv : object)
+            {
+                if (kv.first == key)
+                {
+                    return &kv.second;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+    /// @brief Minimal recursive-descent JSON parser.
+    class JsonParser
+    {
+    public:
+        explicit JsonParser(const std::string &text) : p_(text.data()), end_(p_ + text.size()) {}
+
+        bool parse(JsonValue &out)
+        {
+            return value(out) && (skip(), p_ == end_);
+        }
+
+    private:
+        void skip()
+        {
+            while (p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t'))
+            {
+                ++p_;
+            }
+        }
+
+        bool literal(const char *word)
+        {
+            const std::size_t n = std::strlen(word);
+            if (static_cast<std::size_t>(end_ - p_) < n || std::strncmp(p_, word, n) != 0)
+            {
+                return false;
+            }
+            p_ += n;
+            return true;
+        }
+
+        bool string(std::string &out)
+        {
+            if (p_ == end_ || *p_ != '"')
+            {
+                return false;
+            }
+            for (++p_; p_ != end_ && *p_ != '"'; ++p_)
+            {
+                // Escapes are kept verbatim except for the escaped character
+                // itself; write_json() only escapes quotes and backslashes.
+                if (*p_ == '\\' && ++p_ == end_)
+                {
+                    return false;
+                }
+                out.push_back(*p_);
+            }
+            return p_ != end_ && *p_++ == '"';
+        }
+
+        bool value(JsonValue &out)
+        {
+            skip();
+            if (p_ == end_)
+            {
+                return false;
+            }
+            switch (*p_)
+            {
+            case '{':
+                out.type = JsonValue::Type::Object;
+                ++p_;
+                skip();
+                if (p_ != end_ && *p_ == '}')
+                {
+                    ++p_;
+                    return true;
+                }
+                for (;;)
+                {
+                    std::string key;
+                    JsonValue v;
+                    skip();
+                    if (!string(key) || (skip(), p_ == end_ || *p_++ != ':') || !value(v))
+                    {
+                        return false;
+                    }
+                    out.object.emplace_back(std::move(key), std::move(v));
+                    skip();
+                    if (p_ != end_ && *p_ == ',')
+                    {
+                        ++p_;
+                        continue;
+                    }
+                    return p_ != end_ && *p_++ == '}';
+                }
+            case '[':
+                out.type = JsonValue::Type::Array;
+                ++p_;
+                skip();
+                if (p_ != end_ && *p_ == ']')
+                {
+                    ++p_;
+                    return true;
+                }
+                for (;;)
+                {
+                    JsonValue v;
+                    if (!value(v))
+                    {
+                        return false;
+                    }
+                    out.array.push_back(std::move(v));
+                    skip();
+                    if (p_ != end_ && *p_ == ',')
+                    {
+                        ++p_;
+                        continue;
+                    }
+                    return p_ != end_ && *p_++ == ']';
+                }
+            case '"':
+                out.type = JsonValue::Type::String;
+                return string(out.str);
+            case 't':
+            case 'f':
+                out.type = JsonValue::Type::Bool;
+                out.number = *p_ == 't';
+                return literal(*p_ == 't' ? "true" : "false");
+            case 'n':
+                out.type = JsonValue::Type::Null;
+                return literal("null");
+            default:
+            {
+                char *num_end = nullptr;
+                out.type = JsonValue::Type::Number;
+                out.number = std::strtod(p_, &num_end);
+                if (num_end == p_)
+                {
+                    return false;
+                }
+                p_ = num_end;
+                return true;
+            }
+            }
+        }
+
+        const char *p_;
+        const char *end_;
+    };
+
+    /// @brief Number of a JSON value; null (non-finite when written) is NaN.
+    double number_of(const JsonValue &v)
+    {
+        return v.type == JsonValue::Type::Number ? v.number : std::nan("");
+    }
+
+} // namespace
+
+namespace bench
+{
+    Options options_from_env(const Options &defaults)
+    {
+        Options opt = defaults;
+        opt.warmup = env_int("BENCH_WARMUP", opt.warmup, 0);
+        opt.reps = env_int("BENCH_REPS", opt.reps, 1);
+        opt.cpu = env_int("BENCH_CPU", opt.cpu, -1);
+        return opt;
+    }
+
+    bool pin_cpu(int cpu)
+    {
+        if (cpu < 0)
+        {
+            return true;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        {
+            std::cerr << "bench: cannot pin to CPU " << cpu << ", running unpinned\n";
+            return false;
+        }
+        return true;
+    }
+
+    std::string csv_record(std::size_t id, std::mt19937 &rng)
+    {
+        std::normal_distribution<double> normal(0.0, 1.0);
+        double x[4];
+        double y = normal(rng);
+        for (double &v : x)
+        {
+            v = normal(rng);
+            y += 0.5 * v;
+        }
+        char buf[256];
+        const int len = std::snprintf(buf, sizeof(buf), "%zu,%.17g,%.17g,%.17g,%.17g,%.17g",
+                                      id, x[0], x[1], x[2], x[3], y);
+        return std::string(buf, static_cast<std::size_t>(len));
+    }
+
+    bool write_csv(const std::string &path, std::size_t n, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::ofstream ofs(path);
+        for (std::size_t i = 1; i <= n && ofs; ++i)
+        {
+            ofs << csv_record(i, rng) << '\n';
+        }
+        return static_cast<bool>(ofs);
+    }
+
+    Summary summarize(std::vector<double> values)
+    {
+        Summary s;
+        if (values.empty())
+        {
+            return s;
+        }
+
+        const std::size_t n = values.size();
+        double sum = 0.0;
+        for (double v : values)
+        {
+            sum += v;
+        }
+        s.mean = sum / n;
+
+        double sq = 0.0;
+        for (double v : values)
+        {
+            sq += (v - s.mean) * (v - s.mean);
+        }
+        s.stddev = n > 1 ? std::sqrt(sq / (n - 1)) : 0.0;
+
+        s.median = median_of(values);
+        s.min = values.front();
+
+        for (double &v : values)
+        {
+            v = std::fabs(v - s.median);
+        }
+        s.mad = median_of(values);
+        return s;
+    }
+
+    void write_json(std::ostream &os, const std::string &suite,
+                    const Options &opt, const std::vector<Result> &results)
+    {
+        char host[256] = "unknown";
+        gethostname(host, sizeof(host) - 1);
+
+        const std::streamsize old_precision = os.precision(10);
+        os << "{\"suite\": ";
+        write_string(os, suite);
+        os << ", \"host\": ";
+        write_string(os, host);
+        os << ", \"timestamp\": " << static_cast<long long>(std::time(nullptr))
+           << ", \"warmup\": " << opt.warmup
+           << ", \"reps\": " << opt.reps
+           << ", \"cpu\": " << opt.cpu
+           << ", \"results\": [";
+
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            const Result &r = results[i];
+            os << (i ? ",\n  " : "\n  ") << "{\"name\": ";
+            write_string(os, r.name);
+
+            os << ", \"params\": {";
+            for (std::size_t j = 0; j < r.params.size(); ++j)
+            {
+                os << (j ? ", " : "");
+                write_string(os, r.params[j].first);
+                os << ": ";
+                write_number(os, r.params[j].second);
+            }
+
+            os << "}, \"metrics\": {";
+            for (std::size_t j = 0; j < r.metrics.size(); ++j)
+            {
+                const Summary &m = r.metrics[j].second;
+                os << (j ? ", " : "");
+                write_string(os, r.metrics[j].first);
+                os << ": {\"min\": ";
+                write_number(os, m.min);
+                os << ", \"median\": ";
+                write_number(os, m.median);
+                os << ", \"mean\": ";
+                write_number(os, m.mean);
+                os << ", \"stddev\": ";
+                write_number(os, m.stddev);
+                os << ", \"mad\": ";
+                write_number(os, m.mad);
+                os << "}";
+            }
+            os << "}}";
+        }
+        os << "\n]}\n";
+        os.precision(old_precision);
+    }
+
+    bool read_json(std::istream &is, Report &out)
+    {
+        const std::string text((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        JsonValue doc;
+        if (!JsonParser(text).parse(doc) || doc.type != JsonValue::Type::Object)
+        {
+            return false;
+        }
+        const JsonValue *results = doc.get("results");
+        if (!results || results->type != JsonValue::Type::Array)
+        {
+            return false;
+        }
+
+        out = Report{};
+        if (const JsonValue *v = doc.get("suite"))
+        {
+            out.suite = v->str;
+        }
+        if (const JsonValue *v = doc.get("host"))
+        {
+            out.host = v->str;
+        }
+        for (const JsonValue &item : results->array)
+        {
+            Result r;
+            if (const JsonValue *v = item.get("name"))
+            {
+                r.name = v->str;
+            }
+            if (const JsonValue *params = item.get("params"))
+            {
+                for (const auto &kv : params->object)
+                {
+                    r.params.emplace_back(kv.first, number_of(kv.second));
+                }
+            }
+            if (const JsonValue *metrics = item.get("metrics"))
+            {
+                for (const auto &kv : metrics->object)
+                {
+                    Summary m;
+                    const JsonValue &sv = kv.second;
+                    if (const JsonValue *v = sv.get("min")) m.min = number_of(*v);
+                    if (const JsonValue *v = sv.get("median")) m.median = number_of(*v);
+                    if (const JsonValue *v = sv.get("mean")) m.mean = number_of(*v);
+                    if (const JsonValue *v = sv.get("stddev")) m.stddev = number_of(*v);
+                    if (const JsonValue *v = sv.get("mad")) m.mad = number_of(*v);
+                    r.metrics.emplace_back(kv.first, m);
+                }
+            }
+            out.results.push_back(std::move(r));
+        }
+        return true;
+    }
+
+} // namespace bench
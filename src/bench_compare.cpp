@@ -0,0 +1,311 @@
+/// @file bench_compare.cpp
+/// @brief Implementation of the bench_compare executable.
+#include "bench_compare.hpp"
+#include "bench.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    const char *const BASELINE_DIR = "bench/baseline";
+
+    /// @brief Scales a MAD to a normal distribution's standard deviation.
+    constexpr double MAD_TO_SIGMA = 1.4826;
+
+    double env_double(const char *name, double fallback)
+    {
+        const char *v = std::getenv(name);
+        if (!v || !*v)
+        {
+            return fallback;
+        }
+        char *end = nullptr;
+        const double d = std::strtod(v, &end);
+        if (*end != '\0' || d < 0.0)
+        {
+            std::cerr << "bench_compare: ignoring invalid " << name << "=" << v << "\n";
+            return fallback;
+        }
+        return d;
+    }
+
+    /**
+     * @brief Run bin/bench_<suite> and capture its stdout.
+     *
+     * The suite's stderr (progress lines) is passed through.
+     */
+    bool run_suite(const std::string &suite, std::string &out)
+    {
+        const std::string prog = "bin/bench_" + suite;
+        int fds[2];
+        if (pipe(fds) < 0)
+        {
+            std::perror("pipe");
+            return false;
+        }
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            std::perror("fork");
+            return false;
+        }
+        if (pid == 0)
+        {
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            execl(prog.c_str(), prog.c_str(), static_cast<char *>(nullptr));
+            std::perror(prog.c_str());
+            _exit(127);
+        }
+        close(fds[1]);
+
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(fds[0], buf, sizeof(buf))) != 0)
+        {
+            if (n > 0)
+            {
+                out.append(buf, static_cast<std::size_t>(n));
+            }
+            else if (errno != EINTR)
+            {
+                break;
+            }
+        }
+        close(fds[0]);
+
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        {
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            std::cerr << "bench_compare: " << prog << " failed\n";
+            return false;
+        }
+        return true;
+    }
+
+    /// @brief Identity of a case: its name and parameters.
+    std::string case_key(const bench::Result &r)
+    {
+        std::ostringstream oss;
+        oss << r.name;
+        for (const auto &p : r.params)
+        {
+            // bytes/bytes_per_sample describe the input, not the case.
+            if (p.first.compare(0, 5, "bytes") != 0)
+            {
+                oss << ' ' << p.first << '=' << p.second;
+            }
+        }
+        return oss.str();
+    }
+
+    bool higher_is_better(const std::string &metric)
+    {
+        return metric.size() >= 5 && metric.compare(metric.size() - 5, 5, "per_s") == 0;
+    }
+
+    /// @brief Outcome counts of one suite's comparison.
+    struct Tally
+    {
+        int regressions = 0;
+        int improvements = 0;
+        int unchanged = 0;
+        int unmatched = 0;
+    };
+
+    void print_row(const std::string &key, const std::string &metric, const std::string &base,
+                   const std::string &cur, const std::string &change, const char *verdict)
+    {
+        std::printf("  %-56s %-14s %22s %22s %8s  %s\n", key.c_str(), metric.c_str(),
+                    base.c_str(), cur.c_str(), change.c_str(), verdict);
+    }
+
+    std::string median_mad(const bench::Summary &s)
+    {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%.4g +/- %.2g", s.median, s.mad);
+        return buf;
+    }
+
+    /// @brief Compare one suite's results against its baseline and print the table.
+    Tally compare(const bench::Report &base, const bench::Report &cur, double sigmas, double min_pct)
+    {
+        Tally t;
+        std::printf("suite %s (baseline host %s, current host %s)\n", cur.suite.c_str(),
+                    base.host.c_str(), cur.host.c_str());
+        print_row("case", "metric", "baseline", "current", "change", "verdict");
+
+        std::vector<bool> matched(base.results.size(), false);
+        for (const bench::Result &r : cur.results)
+        {
+            const std::string key = case_key(r);
+            const bench::Result *b = nullptr;
+            for (std::size_t i = 0; i < base.results.size(); ++i)
+            {
+                if (!matched[i] && case_key(base.results[i]) == key)
+                {
+                    matched[i] = true;
+                    b = &base.results[i];
+                    break;
+                }
+            }
+            if (r.metrics.empty())
+            {
+                continue;
+            }
+            const std::string &metric = r.metrics.front().first;
+            const bench::Summary &c = r.metrics.front().second;
+            if (!b || b->metrics.empty() || b->metrics.front().first != metric)
+            {
+                print_row(key, metric, "-", median_mad(c), "", "new");
+                ++t.unmatched;
+                continue;
+            }
+
+            const bench::Summary &o = b->metrics.front().second;
+            const double worse = higher_is_better(metric) ? o.median - c.median : c.median - o.median;
+            const double noise = sigmas * MAD_TO_SIGMA * std::sqrt(o.mad * o.mad + c.mad * c.mad);
+            const double threshold = std::max(noise, min_pct / 100.0 * std::fabs(o.median));
+
+            const char *verdict = "ok";
+            if (worse > threshold)
+            {
+                verdict = "REGRESSION";
+                ++t.regressions;
+            }
+            else if (-worse > threshold)
+            {
+                verdict = "improved";
+                ++t.improvements;
+            }
+            else
+            {
+                ++t.unchanged;
+            }
+
+            char change[32] = "";
+            if (o.median != 0.0)
+            {
+                std::snprintf(change, sizeof(change), "%+.1f%%", 100.0 * (c.median - o.median) / o.median);
+            }
+            print_row(key, metric, median_mad(o), median_mad(c), change, verdict);
+        }
+        for (std::size_t i = 0; i < base.results.size(); ++i)
+        {
+            if (!matched[i] && !base.results[i].metrics.empty())
+            {
+                print_row(case_key(base.results[i]), base.results[i].metrics.front().first,
+                          median_mad(base.results[i].metrics.front().second), "-", "", "missing");
+                ++t.unmatched;
+            }
+        }
+        std::printf("  %d regressed, %d improved, %d unchanged, %d unmatched\n\n",
+                    t.regressions, t.improvements, t.unchanged, t.unmatched);
+        return t;
+    }
+} // namespace
+
+namespace bench_compare
+{
+    int run(const std::vector<std::string> &suites, bool update)
+    {
+        const double sigmas = env_double("BENCH_COMPARE_SIGMAS", 4.0);
+        const double min_pct = env_double("BENCH_COMPARE_MIN_PCT", 5.0);
+
+        int regressions = 0;
+        for (const std::string &suite : suites)
+        {
+            const std::string path = std::string(BASELINE_DIR) + "/" + suite + ".json";
+            std::string json;
+            if (!run_suite(suite, json))
+            {
+                return 2;
+            }
+
+            if (update)
+            {
+                std::ofstream ofs(path);
+                ofs << json;
+                if (!ofs)
+                {
+                    std::cerr << "bench_compare: cannot write " << path << "\n";
+                    return 2;
+                }
+                std::cerr << "bench_compare: updated " << path << "\n";
+                continue;
+            }
+
+            bench::Report cur, base;
+            std::istringstream cur_is(json);
+            std::ifstream base_is(path);
+            if (!bench::read_json(cur_is, cur))
+            {
+                std::cerr << "bench_compare: malformed output from bin/bench_" << suite << "\n";
+                return 2;
+            }
+            if (!base_is || !bench::read_json(base_is, base))
+            {
+                std::cerr << "bench_compare: no usable baseline " << path
+                          << " (create it with --update)\n";
+                return 2;
+            }
+            if (base.host != cur.host)
+            {
+                std::cerr << "bench_compare: warning: baseline " << path << " was recorded on "
+                          << base.host << ", not " << cur.host << "\n";
+            }
+            regressions += compare(base, cur, sigmas, min_pct).regressions;
+        }
+        std::fflush(stdout);
+
+        if (regressions > 0)
+        {
+            std::cerr << "bench_compare: " << regressions << " significant regression(s)\n";
+            return 1;
+        }
+        return 0;
+    }
+} // namespace bench_compare
+
+int main(int argc, char *argv[])
+{
+    bool update = false;
+    std::vector<std::string> suites;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--update") == 0)
+        {
+            update = true;
+        }
+        else if (argv[i][0] == '-')
+        {
+            std::cerr << "Usage: bench_compare [--update] [suite...]\n";
+            return 2;
+        }
+        else
+        {
+            suites.push_back(argv[i]);
+        }
+    }
+    if (suites.empty())
+    {
+        suites = {"io", "math"};
+    }
+    return bench_compare::run(suites, update);
+}
@@ -0,0 +1,198 @@
+/// @file bench_io.cpp
+/// @brief Implementation of the bench_io executable.
+#include "bench_io.hpp"
+#include "bench.hpp"
+#include "common.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /// @brief Generated benchmark inputs.
+    struct Inputs
+    {
+        std::vector<std::string> csv_lines;    ///< "id,f0,f1,f2,f3,y" at full precision.
+        std::vector<std::string> sample_lines; ///< "id f0 f1 f2 f3 y" as stages emit them.
+        std::vector<common::Sample> samples;   ///< Parsed values of csv_lines.
+        std::size_t csv_bytes = 0;
+        std::size_t sample_bytes = 0;
+    };
+
+    std::size_t get_records()
+    {
+        const char *v = std::getenv("BENCH_RECORDS");
+        if (v && *v)
+        {
+            char *end = nullptr;
+            const long n = std::strtol(v, &end, 10);
+            if (*end == '\0' && n > 0)
+            {
+                return static_cast<std::size_t>(n);
+            }
+            std::cerr << "bench_io: ignoring invalid BENCH_RECORDS=" << v << "\n";
+        }
+        return 100000;
+    }
+
+    /// @brief Generate n records (see bench::csv_record()) in every form.
+    Inputs generate(std::size_t n)
+    {
+        Inputs in;
+        std::mt19937 rng(42);
+
+        in.csv_lines.reserve(n);
+        in.sample_lines.reserve(n);
+        in.samples.reserve(n);
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            in.csv_lines.push_back(bench::csv_record(i + 1, rng));
+            in.csv_bytes += in.csv_lines.back().size() + 1;
+
+            common::Sample s;
+            common::parse_csv_line(in.csv_lines.back(), s);
+            in.samples.push_back(s);
+            in.sample_lines.push_back(common::sample_to_line(s));
+            in.sample_bytes += in.sample_lines.back().size() + 1;
+        }
+        return in;
+    }
+
+    bool same_sample(const common::Sample &a, const common::Sample &b)
+    {
+        return a.id == b.id && std::memcmp(a.x, b.x, sizeof(a.x)) == 0 &&
+               std::memcmp(&a.y, &b.y, sizeof(a.y)) == 0;
+    }
+
+    /// @brief Check that every fast variant reproduces its reference exactly.
+    bool verify(const Inputs &in)
+    {
+        std::string out;
+        for (std::size_t i = 0; i < in.samples.size(); ++i)
+        {
+            common::Sample ref, fast;
+            if (!common::parse_csv_fast(in.csv_lines[i], fast) || !same_sample(in.samples[i], fast))
+            {
+                std::cerr << "bench_io: parse_csv_fast disagrees on: " << in.csv_lines[i] << "\n";
+                return false;
+            }
+            if (!common::parse_sample_line(in.sample_lines[i], ref) ||
+                !common::parse_sample_fast(in.sample_lines[i], fast) || !same_sample(ref, fast))
+            {
+                std::cerr << "bench_io: parse_sample_fast disagrees on: " << in.sample_lines[i] << "\n";
+                return false;
+            }
+            out.clear();
+            common::append_sample_line(in.samples[i], out);
+            if (out != in.sample_lines[i])
+            {
+                std::cerr << "bench_io: append_sample_line wrote '" << out
+                          << "', expected '" << in.sample_lines[i] << "'\n";
+                return false;
+            }
+        }
+
+        // Malformed input must be rejected by both parsers alike.
+        const char *bad[] = {"", "1,2,3", "x,1,2,3,4,5", "1,2,3,4,5", "1 2 3 4 nan 6",
+                             "1,2,3,4,5,+-6", "1;2;3;4;5;6"};
+        for (const char *line : bad)
+        {
+            common::Sample s;
+            if (common::parse_csv_line(line, s) != common::parse_csv_fast(line, s) ||
+                common::parse_sample_line(line, s) != common::parse_sample_fast(line, s))
+            {
+                std::cerr << "bench_io: fast parser disagrees on malformed '" << line << "'\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Time one case over all records and append its Result.
+     *
+     * @param body  Processes every record once.
+     * @param bytes Bytes read or written by one call of body.
+     */
+    void run_case(const bench::Options &opt, const std::string &name, std::size_t records,
+                  std::size_t bytes, const std::function<void()> &body,
+                  std::vector<bench::Result> &results)
+    {
+        const std::vector<double> seconds = bench::measure(opt, body);
+
+        bench::Result r;
+        r.name = name;
+        r.params = {{"records", static_cast<double>(records)},
+                    {"bytes", static_cast<double>(bytes)}};
+        r.metrics = {
+            {"ns_per_record", bench::summarize_as(seconds, [&](double s) { return s * 1e9 / records; })},
+            {"mb_per_s", bench::summarize_as(seconds, [&](double s) { return bytes / s / 1e6; })}};
+        std::cerr << "bench_io: " << name << " " << r.metrics[0].second.median
+                  << " ns/record " << r.metrics[1].second.median << " MB/s\n";
+        results.push_back(std::move(r));
+    }
+} // namespace
+
+namespace bench_io
+{
+    int run()
+    {
+        const bench::Options opt = bench::options_from_env();
+        bench::pin_cpu(opt.cpu);
+
+        const Inputs in = generate(get_records());
+        if (!verify(in))
+        {
+            return 1;
+        }
+
+        const std::size_t n = in.samples.size();
+        std::vector<bench::Result> results;
+        common::Sample s;
+        std::string out;
+        std::size_t sink = 0;
+
+        run_case(opt, "parse_csv_line/stream", n, in.csv_bytes, [&] {
+            for (const std::string &line : in.csv_lines) sink += common::parse_csv_line(line, s);
+            bench::do_not_optimize(s);
+        }, results);
+        run_case(opt, "parse_csv_line/fast", n, in.csv_bytes, [&] {
+            for (const std::string &line : in.csv_lines) sink += common::parse_csv_fast(line, s);
+            bench::do_not_optimize(s);
+        }, results);
+        run_case(opt, "parse_sample_line/stream", n, in.sample_bytes, [&] {
+            for (const std::string &line : in.sample_lines) sink += common::parse_sample_line(line, s);
+            bench::do_not_optimize(s);
+        }, results);
+        run_case(opt, "parse_sample_line/fast", n, in.sample_bytes, [&] {
+            for (const std::string &line : in.sample_lines) sink += common::parse_sample_fast(line, s);
+            bench::do_not_optimize(s);
+        }, results);
+        run_case(opt, "sample_to_line/stream", n, in.sample_bytes, [&] {
+            for (const common::Sample &x : in.samples) sink += common::sample_to_line(x).size();
+        }, results);
+        run_case(opt, "sample_to_line/fast", n, in.sample_bytes, [&] {
+            for (const common::Sample &x : in.samples)
+            {
+                out.clear();
+                common::append_sample_line(x, out);
+                sink += out.size();
+            }
+        }, results);
+        bench::do_not_optimize(sink);
+
+        bench::write_json(std::cout, "io", opt, results);
+        return 0;
+    }
+} // namespace bench_io
+
+int main()
+{
+    return bench_io::run();
+}
@@ -0,0 +1,594 @@
+/// @file bench_ipc.cpp
+/// @brief Implementation of the bench_ipc executable.
+#include "bench_ipc.hpp"
+#include "bench.hpp"
+#include "common.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    /// @brief One record on the wire.
+    struct Wire
+    {
+        common::Sample sample;
+        std::uint64_t sent_ns; ///< CLOCK_MONOTONIC time the batch was sent.
+    };
+
+    enum class Kind
+    {
+        Pipe,
+        Vmsplice,
+        Unix,
+        Shm
+    };
+
+    struct Transport
+    {
+        std::string name;
+        Kind kind;
+        int pipe_size; ///< F_SETPIPE_SZ argument (pipe kinds only).
+    };
+
+    /// @brief Shared-memory ring capacity in records (power of two).
+    constexpr std::uint64_t SHM_CAPACITY = 1 << 15;
+
+    /**
+     * @brief Single-producer/single-consumer ring shared across fork().
+     *
+     * head counts records published by the producer, tail records
+     * consumed; slot i lives at records[i % SHM_CAPACITY].
+     */
+    struct ShmRing
+    {
+        alignas(64) std::atomic<std::uint64_t> head;
+        alignas(64) std::atomic<std::uint64_t> tail;
+        alignas(64) Wire records[SHM_CAPACITY];
+    };
+
+    /// @brief Measurements of one repetition.
+    struct RunResult
+    {
+        double seconds = 0.0;
+        double cpu_seconds = 0.0;
+        double p50_us = 0.0;
+        double p99_us = 0.0;
+        double p999_us = 0.0;
+    };
+
+    std::uint64_t now_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+    double cpu_seconds(const struct rusage &ru)
+    {
+        return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+               ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    }
+
+    /// @brief Wait politely: the peer may share this CPU.
+    void backoff(unsigned &spins)
+    {
+        if (++spins > 64)
+        {
+            sched_yield();
+        }
+    }
+
+    bool parse_sizes(const char *name, const char *def, std::vector<int> &out)
+    {
+        const char *v = std::getenv(name);
+        std::stringstream ss((v && *v) ? v : def);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            char *end = nullptr;
+            const long n = std::strtol(item.c_str(), &end, 10);
+            if (item.empty() || *end != '\0' || n <= 0)
+            {
+                std::cerr << "bench_ipc: bad " << name << " item '" << item << "'\n";
+                return false;
+            }
+            out.push_back(static_cast<int>(n));
+        }
+        return !out.empty();
+    }
+
+    bool write_all(int fd, const char *p, std::size_t n)
+    {
+        while (n > 0)
+        {
+            const ssize_t w = write(fd, p, n);
+            if (w < 0)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            p += w;
+            n -= static_cast<std::size_t>(w);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Producer side of vmsplice: gift nothing, reuse pages safely.
+     *
+     * vmsplice() only references the pages, so a region may not be
+     * rewritten until the reader has copied it out. The staging buffer
+     * is used cyclically and holds one pipe capacity plus one batch:
+     * while a batch is staged the pipe holds at most the capacity's worth
+     * of older records, and those are never the ones being overwritten.
+     */
+    class VmspliceWriter
+    {
+    public:
+        VmspliceWriter(int fd, std::size_t pipe_bytes, std::size_t batch)
+            : fd_(fd), buf_((pipe_bytes / sizeof(Wire) + batch + 1) * sizeof(Wire))
+        {
+        }
+
+        /// @brief Stage one record at the write position.
+        Wire &next()
+        {
+            if (pos_ + sizeof(Wire) > buf_.size())
+            {
+                pos_ = 0;
+            }
+            Wire *w = reinterpret_cast<Wire *>(&buf_[pos_]);
+            pos_ += sizeof(Wire);
+            return *w;
+        }
+
+        /// @brief Splice the records staged since the last flush.
+        bool flush()
+        {
+            // The staged range wraps at most once.
+            if (pos_ < start_)
+            {
+                if (!splice_range(start_, buf_.size() - start_))
+                {
+                    return false;
+                }
+                start_ = 0;
+            }
+            const bool ok = splice_range(start_, pos_ - start_);
+            start_ = pos_;
+            return ok;
+        }
+
+    private:
+        bool splice_range(std::size_t off, std::size_t len)
+        {
+            struct iovec iov = {&buf_[off], len};
+            while (iov.iov_len > 0)
+            {
+                const ssize_t n = vmsplice(fd_, &iov, 1, 0);
+                if (n < 0)
+                {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                iov.iov_base = static_cast<char *>(iov.iov_base) + n;
+                iov.iov_len -= static_cast<std::size_t>(n);
+            }
+            return true;
+        }
+
+        int fd_;
+        std::vector<char> buf_;
+        std::size_t pos_ = 0;
+        std::size_t start_ = 0;
+    };
+
+    /// @brief Fill a record as a stage would emit it.
+    void fill(Wire &w, std::size_t i)
+    {
+        w.sample.id = static_cast<int>(i);
+        for (std::size_t k = 0; k < common::INPUT_DIM; ++k)
+        {
+            w.sample.x[k] = static_cast<float>(i + k);
+        }
+        w.sample.y = static_cast<float>(i);
+    }
+
+    /// @brief Producer process body; returns the exit code.
+    int produce(const Transport &t, int fd, ShmRing *ring, std::size_t records, std::size_t batch)
+    {
+        if (t.kind == Kind::Shm)
+        {
+            unsigned spins = 0;
+            std::uint64_t head = 0;
+            while (head < records)
+            {
+                const std::uint64_t nb = std::min<std::uint64_t>(batch, records - head);
+                while (head + nb - ring->tail.load(std::memory_order_acquire) > SHM_CAPACITY)
+                {
+                    backoff(spins);
+                }
+                spins = 0;
+                const std::uint64_t sent = now_ns();
+                for (std::uint64_t i = head; i < head + nb; ++i)
+                {
+                    Wire &w = ring->records[i % SHM_CAPACITY];
+                    fill(w, i);
+                    w.sent_ns = sent;
+                }
+                head += nb;
+                ring->head.store(head, std::memory_order_release);
+            }
+            return 0;
+        }
+
+        if (t.kind == Kind::Vmsplice)
+        {
+            VmspliceWriter writer(fd, static_cast<std::size_t>(fcntl(fd, F_GETPIPE_SZ)), batch);
+            for (std::size_t i = 0; i < records; i += batch)
+            {
+                const std::size_t nb = std::min(batch, records - i);
+                const std::uint64_t sent = now_ns();
+                for (std::size_t k = i; k < i + nb; ++k)
+                {
+                    Wire &w = writer.next();
+                    fill(w, k);
+                    w.sent_ns = sent;
+                }
+                if (!writer.flush())
+                {
+                    std::perror("bench_ipc: vmsplice");
+                    return 1;
+                }
+            }
+            return 0;
+        }
+
+        std::vector<Wire> buf(batch);
+        for (std::size_t i = 0; i < records; i += batch)
+        {
+            const std::size_t nb = std::min(batch, records - i);
+            const std::uint64_t sent = now_ns();
+            for (std::size_t k = 0; k < nb; ++k)
+            {
+                fill(buf[k], i + k);
+                buf[k].sent_ns = sent;
+            }
+            if (!write_all(fd, reinterpret_cast<const char *>(buf.data()), nb * sizeof(Wire)))
+            {
+                std::perror("bench_ipc: write");
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Consume all records, recording each one's latency.
+     *
+     * @return false if a record arrives out of order or the stream ends early.
+     */
+    bool consume(const Transport &t, int fd, ShmRing *ring, std::size_t records,
+                 std::vector<std::uint32_t> &latency_ns)
+    {
+        std::size_t got = 0;
+        auto take = [&](const Wire &w) {
+            if (w.sample.id != static_cast<int>(got))
+            {
+                return false;
+            }
+            latency_ns[got++] = static_cast<std::uint32_t>(
+                std::min<std::uint64_t>(now_ns() - w.sent_ns, UINT32_MAX));
+            return true;
+        };
+
+        if (t.kind == Kind::Shm)
+        {
+            unsigned spins = 0;
+            std::uint64_t tail = 0;
+            while (tail < records)
+            {
+                const std::uint64_t head = ring->head.load(std::memory_order_acquire);
+                if (head == tail)
+                {
+                    backoff(spins);
+                    continue;
+                }
+                spins = 0;
+                for (; tail < head; ++tail)
+                {
+                    if (!take(ring->records[tail % SHM_CAPACITY]))
+                    {
+                        return false;
+                    }
+                }
+                ring->tail.store(tail, std::memory_order_release);
+            }
+            return true;
+        }
+
+        // Read in large chunks regardless of the producer's batch size,
+        // as a stage reading through a stream buffer would.
+        std::vector<char> buf(64 * 1024);
+        std::size_t have = 0;
+        while (got < records)
+        {
+            const ssize_t n = read(fd, buf.data() + have, buf.size() - have);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+            have += static_cast<std::size_t>(n);
+            const std::size_t whole = have / sizeof(Wire);
+            for (std::size_t k = 0; k < whole; ++k)
+            {
+                Wire w;
+                std::memcpy(&w, buf.data() + k * sizeof(Wire), sizeof(Wire));
+                if (!take(w))
+                {
+                    return false;
+                }
+            }
+            have -= whole * sizeof(Wire);
+            std::memmove(buf.data(), buf.data() + whole * sizeof(Wire), have);
+        }
+        return true;
+    }
+
+    double percentile(const std::vector<std::uint32_t> &sorted, double p)
+    {
+        return sorted[static_cast<std::size_t>(p * (sorted.size() - 1))] / 1e3;
+    }
+
+    /// @brief One repetition: set up the channel, fork the producer, consume.
+    bool run_once(const Transport &t, std::size_t records, std::size_t batch, int cpu,
+                  RunResult &out)
+    {
+        int fds[2] = {-1, -1};
+        ShmRing *ring = nullptr;
+
+        if (t.kind == Kind::Shm)
+        {
+            void *mem = mmap(nullptr, sizeof(ShmRing), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (mem == MAP_FAILED)
+            {
+                std::perror("bench_ipc: mmap");
+                return false;
+            }
+            ring = new (mem) ShmRing;
+            ring->head.store(0);
+            ring->tail.store(0);
+        }
+        else if (t.kind == Kind::Unix)
+        {
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+            {
+                std::perror("bench_ipc: socketpair");
+                return false;
+            }
+        }
+        else
+        {
+            if (pipe(fds) < 0)
+            {
+                std::perror("bench_ipc: pipe");
+                return false;
+            }
+            if (fcntl(fds[1], F_SETPIPE_SZ, t.pipe_size) < 0)
+            {
+                std::perror("bench_ipc: F_SETPIPE_SZ");
+                close(fds[0]);
+                close(fds[1]);
+                return false;
+            }
+        }
+        // Pipes: read fds[0], write fds[1]. Socketpair: either works.
+
+        std::vector<std::uint32_t> latency_ns(records);
+        struct rusage self_before, self_after, child;
+        getrusage(RUSAGE_SELF, &self_before);
+        const std::uint64_t start = now_ns();
+
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            std::perror("bench_ipc: fork");
+            return false;
+        }
+        if (pid == 0)
+        {
+            if (cpu >= 0)
+            {
+                const long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+                bench::pin_cpu(static_cast<int>((cpu + 1) % std::max(1L, ncpu)));
+            }
+            if (fds[0] >= 0)
+            {
+                close(fds[0]);
+            }
+            _exit(produce(t, fds[1], ring, records, batch));
+        }
+
+        if (fds[1] >= 0)
+        {
+            close(fds[1]);
+        }
+        const bool ok = consume(t, fds[0], ring, records, latency_ns);
+        const std::uint64_t end = now_ns();
+        getrusage(RUSAGE_SELF, &self_after);
+
+        if (fds[0] >= 0)
+        {
+            close(fds[0]);
+        }
+        int status = 0;
+        while (wait4(pid, &status, 0, &child) < 0 && errno == EINTR)
+        {
+        }
+        if (ring)
+        {
+            munmap(ring, sizeof(ShmRing));
+        }
+        if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            std::cerr << "bench_ipc: " << t.name << " transfer failed\n";
+            return false;
+        }
+
+        std::sort(latency_ns.begin(), latency_ns.end());
+        out.seconds = (end - start) / 1e9;
+        out.cpu_seconds = cpu_seconds(self_after) - cpu_seconds(self_before) + cpu_seconds(child);
+        out.p50_us = percentile(latency_ns, 0.50);
+        out.p99_us = percentile(latency_ns, 0.99);
+        out.p999_us = percentile(latency_ns, 0.999);
+        return true;
+    }
+
+    bool bench_case(const bench::Options &opt, const Transport &t, std::size_t records,
+                    std::size_t batch, std::vector<bench::Result> &results)
+    {
+        RunResult rr;
+        for (int i = 0; i < opt.warmup; ++i)
+        {
+            if (!run_once(t, records, batch, opt.cpu, rr))
+            {
+                return false;
+            }
+        }
+
+        std::vector<double> rate, mbps, p50, p99, p999, cpu;
+        for (int i = 0; i < opt.reps; ++i)
+        {
+            if (!run_once(t, records, batch, opt.cpu, rr))
+            {
+                return false;
+            }
+            rate.push_back(records / rr.seconds);
+            mbps.push_back(records * sizeof(Wire) / rr.seconds / 1e6);
+            p50.push_back(rr.p50_us);
+            p99.push_back(rr.p99_us);
+            p999.push_back(rr.p999_us);
+            cpu.push_back(rr.cpu_seconds * 1e9 / records);
+        }
+
+        bench::Result r;
+        r.name = t.name;
+        r.params = {{"batch", static_cast<double>(batch)},
+                    {"records", static_cast<double>(records)},
+                    {"record_bytes", static_cast<double>(sizeof(Wire))}};
+        r.metrics = {{"records_per_s", bench::summarize(rate)},
+                     {"mb_per_s", bench::summarize(mbps)},
+                     {"latency_p50_us", bench::summarize(p50)},
+                     {"latency_p99_us", bench::summarize(p99)},
+                     {"latency_p999_us", bench::summarize(p999)},
+                     {"cpu_ns_per_record", bench::summarize(cpu)}};
+        std::cerr << "bench_ipc: " << t.name << " batch=" << batch << " "
+                  << r.metrics[0].second.median << " records/s p50="
+                  << r.metrics[2].second.median << "us p99=" << r.metrics[3].second.median
+                  << "us cpu=" << r.metrics[5].second.median << "ns/record\n";
+        results.push_back(std::move(r));
+        return true;
+    }
+} // namespace
+
+namespace bench_ipc
+{
+    int run()
+    {
+        bench::Options defaults;
+        defaults.warmup = 1;
+        defaults.reps = 5;
+        const bench::Options opt = bench::options_from_env(defaults);
+
+        std::vector<int> records_list, batches, pipe_sizes;
+        if (!parse_sizes("BENCH_IPC_RECORDS", "50000", records_list) ||
+            !parse_sizes("BENCH_IPC_BATCHES", "1,16,256", batches) ||
+            !parse_sizes("BENCH_IPC_PIPE_SIZES", "4096,65536,1048576", pipe_sizes))
+        {
+            return 1;
+        }
+        const std::size_t records = static_cast<std::size_t>(records_list.front());
+
+        const char *env = std::getenv("BENCH_IPC_TRANSPORTS");
+        const std::string wanted = "," + std::string((env && *env) ? env : "pipe,vmsplice,unix,shm") + ",";
+        auto enabled = [&](const char *kind) {
+            return wanted.find("," + std::string(kind) + ",") != std::string::npos;
+        };
+
+        std::vector<Transport> transports;
+        for (int size : pipe_sizes)
+        {
+            if (enabled("pipe"))
+            {
+                transports.push_back(Transport{"pipe/" + std::to_string(size), Kind::Pipe, size});
+            }
+        }
+        for (int size : pipe_sizes)
+        {
+            if (enabled("vmsplice"))
+            {
+                transports.push_back(Transport{"vmsplice/" + std::to_string(size), Kind::Vmsplice, size});
+            }
+        }
+        if (enabled("unix"))
+        {
+            transports.push_back(Transport{"unix", Kind::Unix, 0});
+        }
+        if (enabled("shm"))
+        {
+            transports.push_back(Transport{"shm", Kind::Shm, 0});
+        }
+        if (transports.empty())
+        {
+            std::cerr << "bench_ipc: no known transport in BENCH_IPC_TRANSPORTS\n";
+            return 1;
+        }
+
+        bench::pin_cpu(opt.cpu);
+
+        std::vector<bench::Result> results;
+        for (const Transport &t : transports)
+        {
+            for (int b : batches)
+            {
+                if (!bench_case(opt, t, records, static_cast<std::size_t>(b), results))
+                {
+                    return 1;
+                }
+            }
+        }
+
+        bench::write_json(std::cout, "ipc", opt, results);
+        return 0;
+    }
+} // namespace bench_ipc
+
+int main()
+{
+    return bench_ipc::run();
+}
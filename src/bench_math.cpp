@@ -0,0 +1,387 @@
+/// @file bench_math.cpp
+/// @brief Implementation of the bench_math executable.
+#include "bench_math.hpp"
+#include "bench.hpp"
+#include "common.hpp"
+#include "math_layer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /// @brief Network shape of one sweep point.
+    struct Shape
+    {
+        std::size_t input;
+        std::size_t hidden;
+    };
+
+    /// @brief Samples per timed repetition aim at this many FLOPs.
+    constexpr double FLOPS_PER_REP = 2e7;
+
+    /// @brief Tolerance of the batched variants against the scalar ones.
+    constexpr double TOLERANCE = 1e-4;
+
+    /**
+     * @brief Parse a comma-separated list of sizes or DxH shapes.
+     *
+     * @param name Environment variable to read.
+     * @param def  Value used if unset.
+     * @param out  Output items; the second size is 0 for plain sizes.
+     * @return false on a malformed item.
+     */
+    bool parse_list(const char *name, const char *def,
+                    std::vector<std::pair<std::size_t, std::size_t>> &out)
+    {
+        const char *v = std::getenv(name);
+        std::stringstream ss((v && *v) ? v : def);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            std::stringstream is(item);
+            std::size_t a = 0, b = 0;
+            char x = 0;
+            if (!(is >> a) || a == 0 || ((is >> x) && (x != 'x' || !(is >> b) || b == 0)))
+            {
+                std::cerr << "bench_math: bad " << name << " item '" << item << "'\n";
+                return false;
+            }
+            out.emplace_back(a, b);
+        }
+        return !out.empty();
+    }
+
+    /// @brief Random inputs and labels shaped like the pipeline's data.
+    void make_data(std::size_t n, std::size_t d, std::vector<float> &X, std::vector<float> &Y)
+    {
+        std::mt19937 rng(7);
+        std::normal_distribution<float> normal(0.0f, 1.0f);
+        X.resize(n * d);
+        Y.resize(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            float y = normal(rng);
+            for (std::size_t k = 0; k < d; ++k)
+            {
+                X[i * d + k] = normal(rng);
+                y += 0.5f * X[i * d + k];
+            }
+            Y[i] = y;
+        }
+    }
+
+    /// @brief Largest |a - b| relative to max(1, |b|) over n values.
+    double max_rel_error(const float *a, const float *b, std::size_t n)
+    {
+        double worst = 0.0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const double scale = std::max(1.0, std::fabs(static_cast<double>(b[i])));
+            worst = std::max(worst, std::fabs(static_cast<double>(a[i]) - b[i]) / scale);
+        }
+        return worst;
+    }
+
+    /**
+     * @brief Check the batched kernels against the scalar ones for a shape.
+     *
+     * Uses a sample count that is not a multiple of BATCH_BLOCK so the
+     * padded tail block is covered as well.
+     */
+    bool verify_shape(const Shape &sh)
+    {
+        const std::size_t n = 3 * math::BATCH_BLOCK + 5;
+        std::vector<float> X, Y;
+        make_data(n, sh.input, X, Y);
+
+        math::TrainConfig cfg;
+        cfg.hidden_dim = sh.hidden;
+        math::TrainState st = math::make_train_state(sh.input, cfg);
+        const std::size_t P = st.model.params.size();
+
+        // Perturb the deterministic init so every weight is exercised.
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<float> u(-0.2f, 0.2f);
+        for (float &p : st.model.params)
+        {
+            p += u(rng);
+        }
+
+        std::vector<float> ref_y(n), ref_loss(n), ref_grad(P, 0.0f);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            math::accumulate_gradient(st, &X[i * sh.input], Y[i], ref_grad.data(),
+                                      ref_loss[i], ref_y[i]);
+        }
+
+        std::vector<float> y(n), loss(n), grad(P, 0.0f);
+        math::forward_batch(st, X.data(), n, y.data());
+        double err = max_rel_error(y.data(), ref_y.data(), n);
+
+        math::accumulate_gradient_batch(st, X.data(), Y.data(), n, grad.data(),
+                                        loss.data(), y.data());
+        err = std::max({err,
+                        max_rel_error(y.data(), ref_y.data(), n),
+                        max_rel_error(loss.data(), ref_loss.data(), n),
+                        max_rel_error(grad.data(), ref_grad.data(), P)});
+
+        if (err > TOLERANCE)
+        {
+            std::cerr << "bench_math: batched kernels disagree for " << sh.input << "x"
+                      << sh.hidden << " (max relative error " << err << ")\n";
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Check the single-model API against forward()/train_step().
+     *
+     * Must run before that API is benchmarked, while its model still has
+     * the initial parameters.
+     */
+    bool verify_single_model()
+    {
+        math::TrainState st = math::make_train_state(common::INPUT_DIM, math::TrainConfig{});
+        std::vector<float> X, Y;
+        make_data(64, common::INPUT_DIM, X, Y);
+
+        for (std::size_t i = 0; i < Y.size(); ++i)
+        {
+            common::Sample s;
+            std::copy(&X[i * common::INPUT_DIM], &X[(i + 1) * common::INPUT_DIM], s.x);
+            s.y = Y[i];
+
+            float y_hat = 0.0f, loss = 0.0f, norm = 0.0f;
+            float ref_y = 0.0f, ref_loss = 0.0f, ref_norm = 0.0f;
+            math::compute_forward(s, y_hat);
+            math::compute_backward_and_update(s, y_hat, loss, norm);
+            math::train_step(st, s.x, s.y, ref_loss, ref_y, ref_norm);
+            if (y_hat != ref_y || loss != ref_loss || norm != ref_norm)
+            {
+                std::cerr << "bench_math: single-model API disagrees with train_step\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// @brief Shared description of one timed case.
+    struct Case
+    {
+        std::string name;
+        Shape shape;
+        std::size_t batch;
+        std::size_t samples;    ///< Samples per repetition.
+        double flops;           ///< FLOPs per sample.
+        double bytes;           ///< Bytes per sample.
+    };
+
+    void run_case(const bench::Options &opt, const Case &c, const std::function<void()> &body,
+                  std::vector<bench::Result> &results)
+    {
+        const std::vector<double> seconds = bench::measure(opt, body);
+
+        bench::Result r;
+        r.name = c.name;
+        r.params = {{"input", static_cast<double>(c.shape.input)},
+                    {"hidden", static_cast<double>(c.shape.hidden)},
+                    {"batch", static_cast<double>(c.batch)},
+                    {"bytes_per_sample", c.bytes}};
+        r.metrics = {
+            {"samples_per_s", bench::summarize_as(seconds, [&](double s) { return c.samples / s; })},
+            {"gflop_per_s", bench::summarize_as(seconds, [&](double s) { return c.samples * c.flops / s / 1e9; })}};
+        std::cerr << "bench_math: " << c.name << " " << c.shape.input << "x" << c.shape.hidden
+                  << " batch=" << c.batch << " " << r.metrics[0].second.median << " samples/s "
+                  << r.metrics[1].second.median << " GFLOP/s\n";
+        results.push_back(std::move(r));
+    }
+
+    /// @brief Time all variants of one shape.
+    void bench_shape(const bench::Options &opt, const Shape &sh,
+                     const std::vector<std::size_t> &batches,
+                     std::vector<bench::Result> &results)
+    {
+        const double D = static_cast<double>(sh.input);
+        const double H = static_cast<double>(sh.hidden);
+        const double fwd_flops = 2 * H * D + 3 * H;
+        const double train_flops = fwd_flops + 2 * H * D + 5 * H + 2;
+
+        const std::size_t max_batch = *std::max_element(batches.begin(), batches.end());
+        std::size_t n = static_cast<std::size_t>(FLOPS_PER_REP / train_flops);
+        n = std::min<std::size_t>(std::max<std::size_t>(n, 1024), 65536);
+        n = (n + max_batch - 1) / max_batch * max_batch;
+
+        std::vector<float> X, Y;
+        make_data(n, sh.input, X, Y);
+        std::vector<float> y(n), loss(n);
+
+        math::TrainConfig cfg;
+        cfg.hidden_dim = sh.hidden;
+        math::TrainState st = math::make_train_state(sh.input, cfg);
+        const std::vector<float> init = st.model.params;
+        const double P = static_cast<double>(init.size());
+        float sink = 0.0f;
+
+        Case c{"forward/scalar", sh, 1, n, fwd_flops, 4 * (D + 1) + 4 * P};
+        run_case(opt, c, [&] {
+            for (std::size_t i = 0; i < n; ++i) sink += math::forward(st.model, &X[i * sh.input]);
+        }, results);
+
+        for (std::size_t b : batches)
+        {
+            c = Case{"forward/batch", sh, b, n, fwd_flops, 4 * (D + 1) + 4 * P / b};
+            run_case(opt, c, [&] {
+                for (std::size_t i = 0; i < n; i += b)
+                {
+                    math::forward_batch(st, &X[i * sh.input], std::min(b, n - i), &y[i]);
+                }
+                sink += y[n - 1];
+            }, results);
+        }
+
+        // Training cases restart from the initial parameters every
+        // repetition so all repetitions see the same numbers.
+        auto train = [&](std::size_t b, bool batched) {
+            st.model.params = init;
+            for (std::size_t i = 0; i < n; i += b)
+            {
+                const std::size_t nb = std::min(b, n - i);
+                std::fill(st.grad.begin(), st.grad.end(), 0.0f);
+                if (batched)
+                {
+                    math::accumulate_gradient_batch(st, &X[i * sh.input], &Y[i], nb,
+                                                    st.grad.data(), &loss[i], &y[i]);
+                }
+                else
+                {
+                    for (std::size_t k = i; k < i + nb; ++k)
+                    {
+                        math::accumulate_gradient(st, &X[k * sh.input], Y[k],
+                                                  st.grad.data(), loss[k], y[k]);
+                    }
+                }
+                math::apply_gradient(st, st.grad.data(), 1.0f / nb);
+            }
+            sink += loss[n - 1];
+        };
+        for (std::size_t b : batches)
+        {
+            c = Case{"train/scalar", sh, b, n, train_flops + 2 * P / b, 4 * (D + 3) + 12 * P / b};
+            run_case(opt, c, [&] { train(b, false); }, results);
+            c.name = "train/batch";
+            run_case(opt, c, [&] { train(b, true); }, results);
+        }
+        bench::do_not_optimize(sink);
+    }
+
+    /// @brief Time the fixed-shape single-model API used by the stages.
+    void bench_single_model(const bench::Options &opt, std::vector<bench::Result> &results)
+    {
+        const Shape sh{common::INPUT_DIM, math::DEFAULT_HIDDEN_DIM};
+        const double D = static_cast<double>(sh.input);
+        const double H = static_cast<double>(sh.hidden);
+        const double P = H * D + 2 * H + 1;
+        const std::size_t n = 65536;
+
+        std::vector<float> X, Y;
+        make_data(n, sh.input, X, Y);
+        std::vector<common::Sample> samples(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::copy(&X[i * sh.input], &X[(i + 1) * sh.input], samples[i].x);
+            samples[i].y = Y[i];
+        }
+        float sink = 0.0f;
+
+        Case c{"compute_forward", sh, 1, n, 2 * H * D + 3 * H, 4 * (D + 1) + 4 * P};
+        run_case(opt, c, [&] {
+            float y_hat = 0.0f;
+            for (const common::Sample &s : samples)
+            {
+                math::compute_forward(s, y_hat);
+                sink += y_hat;
+            }
+        }, results);
+
+        c = Case{"compute_backward_and_update", sh, 1, n,
+                 4 * H * D + 8 * H + 2 + 2 * P, 4 * (D + 3) + 12 * P};
+        run_case(opt, c, [&] {
+            float y_hat = 0.0f, loss = 0.0f, norm = 0.0f;
+            for (const common::Sample &s : samples)
+            {
+                math::compute_forward(s, y_hat);
+                math::compute_backward_and_update(s, y_hat, loss, norm);
+                sink += loss;
+            }
+        }, results);
+        bench::do_not_optimize(sink);
+    }
+} // namespace
+
+namespace bench_math
+{
+    int run()
+    {
+        const bench::Options opt = bench::options_from_env();
+        std::vector<std::pair<std::size_t, std::size_t>> shape_list, batch_list;
+        if (!parse_list("BENCH_SHAPES", "4x8,16x32,64x64,256x128", shape_list) ||
+            !parse_list("BENCH_BATCHES", "1,8,32,128,512", batch_list))
+        {
+            return 1;
+        }
+
+        std::vector<Shape> shapes;
+        for (const auto &s : shape_list)
+        {
+            if (s.second == 0)
+            {
+                std::cerr << "bench_math: BENCH_SHAPES items must be DxH\n";
+                return 1;
+            }
+            shapes.push_back(Shape{s.first, s.second});
+        }
+        std::vector<std::size_t> batches;
+        for (const auto &b : batch_list)
+        {
+            batches.push_back(b.first);
+        }
+
+        bench::pin_cpu(opt.cpu);
+
+        if (!verify_single_model())
+        {
+            return 1;
+        }
+        for (const Shape &sh : shapes)
+        {
+            if (!verify_shape(sh))
+            {
+                return 1;
+            }
+        }
+
+        std::vector<bench::Result> results;
+        bench_single_model(opt, results);
+        for (const Shape &sh : shapes)
+        {
+            bench_shape(opt, sh, batches, results);
+        }
+
+        bench::write_json(std::cout, "math", opt, results);
+        return 0;
+    }
+} // namespace bench_math
+
+int main()
+{
+    return bench_math::run();
+}
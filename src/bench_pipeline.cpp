@@ -0,0 +1,337 @@
+/// @file bench_pipeline.cpp
+/// @brief Implementation of the bench_pipeline executable.
+#include "bench_pipeline.hpp"
+#include "bench.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    const char *const OUT_DIR = "logs/bench_pipeline";
+    const char *const TRAINER = "bin/trainer";
+
+    const char *const DEFAULT_CONFIGS =
+        "single:;"
+        "ring2_unix:TRAINER_WORKERS=2;"
+        "ring2_tcp:TRAINER_WORKERS=2,DDP_ENDPOINT=tcp:127.0.0.1:47311;"
+        "ring2_batch128:TRAINER_WORKERS=2,DDP_BATCH=128;"
+        "ps2:TRAINER_WORKERS=2,TRAINER_PS=1";
+
+    /// @brief A named set of environment variables for the trainer.
+    struct Config
+    {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> env;
+        int workers = 1;
+    };
+
+    /// @brief Resource usage of one trainer run, from TRAINER_STATS.
+    struct RunStats
+    {
+        double wall = 0.0;
+        std::map<std::string, double> cpu;    ///< Stage -> CPU seconds (summed).
+        std::map<std::string, double> rss_kb; ///< Stage -> peak RSS (max).
+        bool ok = true;                       ///< Every stage exited with 0.
+    };
+
+    bool parse_configs(const std::string &spec, std::vector<Config> &out)
+    {
+        std::stringstream ss(spec);
+        std::string entry;
+        while (std::getline(ss, entry, ';'))
+        {
+            if (entry.empty())
+            {
+                continue;
+            }
+            const std::size_t colon = entry.find(':');
+            Config c;
+            c.name = entry.substr(0, colon);
+            if (c.name.empty())
+            {
+                std::cerr << "bench_pipeline: configuration without a name: " << entry << "\n";
+                return false;
+            }
+            std::stringstream vs(colon == std::string::npos ? "" : entry.substr(colon + 1));
+            std::string var;
+            while (std::getline(vs, var, ','))
+            {
+                const std::size_t eq = var.find('=');
+                if (eq == std::string::npos || eq == 0)
+                {
+                    std::cerr << "bench_pipeline: bad variable '" << var << "' in " << c.name << "\n";
+                    return false;
+                }
+                c.env.emplace_back(var.substr(0, eq), var.substr(eq + 1));
+                if (c.env.back().first == "TRAINER_WORKERS")
+                {
+                    c.workers = std::atoi(c.env.back().second.c_str());
+                }
+            }
+            out.push_back(std::move(c));
+        }
+        return !out.empty();
+    }
+
+    bool parse_sizes(const std::string &spec, std::vector<std::size_t> &out)
+    {
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            char *end = nullptr;
+            const long long n = std::strtoll(item.c_str(), &end, 10);
+            if (item.empty() || *end != '\0' || n <= 0)
+            {
+                std::cerr << "bench_pipeline: bad dataset size '" << item << "'\n";
+                return false;
+            }
+            out.push_back(static_cast<std::size_t>(n));
+        }
+        return !out.empty();
+    }
+
+    std::string env_or(const char *name, const char *fallback)
+    {
+        const char *v = std::getenv(name);
+        return (v && *v) ? v : fallback;
+    }
+
+    bool read_stats(const std::string &path, RunStats &st)
+    {
+        std::ifstream ifs(path);
+        std::string tag;
+        bool have_wall = false;
+        while (ifs >> tag)
+        {
+            if (tag == "STAGE")
+            {
+                std::string stage;
+                int worker, exit_code;
+                long pid, rss;
+                double user, sys;
+                if (!(ifs >> stage >> worker >> pid >> exit_code >> user >> sys >> rss))
+                {
+                    return false;
+                }
+                st.cpu[stage] += user + sys;
+                st.rss_kb[stage] = std::max(st.rss_kb[stage], static_cast<double>(rss));
+                st.ok = st.ok && exit_code == 0;
+            }
+            else if (tag == "WALL")
+            {
+                have_wall = static_cast<bool>(ifs >> st.wall);
+            }
+        }
+        return have_wall;
+    }
+
+    /**
+     * @brief Run the trainer once and collect its statistics.
+     *
+     * stdout goes to <log>.log and stderr to <log>.err.
+     */
+    bool run_trainer(const Config &c, const std::string &phase, const std::string &csv,
+                     const std::string &model, const std::string &log, RunStats &st)
+    {
+        const std::string stats = log + ".stats";
+        const std::string out = log + ".log";
+        const std::string err = log + ".err";
+
+        const auto t0 = std::chrono::steady_clock::now();
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            std::perror("fork");
+            return false;
+        }
+        if (pid == 0)
+        {
+            const int out_fd = open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            const int err_fd = open(err.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (out_fd < 0 || err_fd < 0 || dup2(out_fd, STDOUT_FILENO) < 0 ||
+                dup2(err_fd, STDERR_FILENO) < 0)
+            {
+                _exit(127);
+            }
+            for (const auto &kv : c.env)
+            {
+                setenv(kv.first.c_str(), kv.second.c_str(), 1);
+            }
+            setenv("BACKWARD_MODE", phase.c_str(), 1);
+            setenv("MODEL_FILE", model.c_str(), 1);
+            setenv("TRAINER_STATS", stats.c_str(), 1);
+            execl(TRAINER, TRAINER, csv.c_str(), static_cast<char *>(nullptr));
+            _exit(127);
+        }
+
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0)
+        {
+        }
+        const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        st = RunStats{};
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !read_stats(stats, st) || !st.ok)
+        {
+            std::cerr << "bench_pipeline: " << c.name << "/" << phase
+                      << " failed, see " << err << "\n";
+            return false;
+        }
+        // Include fork/exec of the trainer itself in the wall time.
+        st.wall = wall;
+        return true;
+    }
+
+    /// @brief Collect a metric over repetitions.
+    struct Series
+    {
+        std::vector<std::pair<std::string, std::vector<double>>> metrics;
+
+        void add(const std::string &name, double v)
+        {
+            for (auto &m : metrics)
+            {
+                if (m.first == name)
+                {
+                    m.second.push_back(v);
+                    return;
+                }
+            }
+            metrics.emplace_back(name, std::vector<double>{v});
+        }
+    };
+
+    /// @brief Benchmark one phase of one configuration on one dataset.
+    bool bench_phase(const bench::Options &opt, const Config &c, const std::string &phase,
+                     const std::string &csv, std::size_t samples, const std::string &model,
+                     std::vector<bench::Result> &results)
+    {
+        const std::string log = std::string(OUT_DIR) + "/" + c.name + "-" + phase + "-" +
+                                std::to_string(samples);
+        RunStats st;
+        for (int i = 0; i < opt.warmup; ++i)
+        {
+            if (!run_trainer(c, phase, csv, model, log, st))
+            {
+                return false;
+            }
+        }
+
+        Series series;
+        for (int i = 0; i < opt.reps; ++i)
+        {
+            if (!run_trainer(c, phase, csv, model, log, st))
+            {
+                return false;
+            }
+            series.add("wall_s", st.wall);
+            series.add("samples_per_s", samples / st.wall);
+            for (const auto &kv : st.cpu)
+            {
+                series.add("cpu_s." + kv.first, kv.second);
+            }
+            for (const auto &kv : st.rss_kb)
+            {
+                series.add("max_rss_kb." + kv.first, kv.second);
+            }
+        }
+
+        bench::Result r;
+        r.name = c.name + "/" + phase;
+        r.params = {{"samples", static_cast<double>(samples)},
+                    {"workers", static_cast<double>(c.workers)}};
+        for (auto &m : series.metrics)
+        {
+            r.metrics.emplace_back(m.first, bench::summarize(std::move(m.second)));
+        }
+        std::cerr << "bench_pipeline: " << r.name << " samples=" << samples << " "
+                  << r.metrics[0].second.median << " s " << r.metrics[1].second.median
+                  << " samples/s\n";
+        results.push_back(std::move(r));
+        return true;
+    }
+} // namespace
+
+namespace bench_pipeline
+{
+    int run(const std::string &out_path)
+    {
+        bench::Options defaults;
+        defaults.warmup = 1;
+        defaults.reps = 3;
+        defaults.cpu = -1;
+        const bench::Options opt = bench::options_from_env(defaults);
+        bench::pin_cpu(opt.cpu);
+
+        std::vector<std::size_t> sizes;
+        std::vector<Config> configs;
+        if (!parse_sizes(env_or("BENCH_PIPELINE_SIZES", "10000,100000"), sizes) ||
+            !parse_configs(env_or("BENCH_PIPELINE_CONFIGS", DEFAULT_CONFIGS), configs))
+        {
+            return 1;
+        }
+
+        mkdir("logs", 0755);
+        mkdir(OUT_DIR, 0755);
+
+        std::vector<bench::Result> results;
+        for (std::size_t n : sizes)
+        {
+            const std::string csv = std::string(OUT_DIR) + "/data-" + std::to_string(n) + ".csv";
+            struct stat sb;
+            if (stat(csv.c_str(), &sb) != 0 && !bench::write_csv(csv, n, 1234))
+            {
+                std::cerr << "bench_pipeline: cannot write " << csv << "\n";
+                return 1;
+            }
+
+            for (const Config &c : configs)
+            {
+                const std::string model = std::string(OUT_DIR) + "/model-" + c.name + ".txt";
+                if (!bench_phase(opt, c, "train", csv, n, model, results) ||
+                    !bench_phase(opt, c, "test", csv, n, model, results))
+                {
+                    return 1;
+                }
+            }
+        }
+
+        if (out_path.empty())
+        {
+            bench::write_json(std::cout, "pipeline", opt, results);
+            return 0;
+        }
+        std::ofstream ofs(out_path);
+        bench::write_json(ofs, "pipeline", opt, results);
+        if (!ofs)
+        {
+            std::cerr << "bench_pipeline: cannot write " << out_path << "\n";
+            return 1;
+        }
+        return 0;
+    }
+} // namespace bench_pipeline
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2)
+    {
+        std::cerr << "Usage: bench_pipeline [results.json]\n";
+        return 1;
+    }
+    return bench_pipeline::run(argc == 2 ? argv[1] : "");
+}
@@ -2,7 +2,70 @@
 /// @brief Implementation of shared utility functions.
 #include "common.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
 #include <sstream>
+#include <unistd.h>
+
+namespace
+{
+    /// @brief Skip whitespace the way operator>> does.
+    const char *skip_space(const char *p, const char *end)
+    {
+        while (p != end && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+        {
+            ++p;
+        }
+        return p;
+    }
+
+    /**
+     * @brief Read one number after optional whitespace, like operator>>.
+     *
+     * from_chars is stricter than operator>> about a leading '+' and
+     * looser about "inf"/"nan"; both are normalized here so the fast
+     * parsers accept exactly what the stream parsers accept.
+     */
+    template <typename T>
+    bool read_number(const char *&p, const char *end, T &value)
+    {
+        p = skip_space(p, end);
+        if (p != end && *p == '+')
+        {
+            ++p;
+            if (p != end && *p == '-')
+            {
+                return false;
+            }
+        }
+        const char *digits = (p != end && *p == '-') ? p + 1 : p;
+        if (digits == end || !((*digits >= '0' && *digits <= '9') || *digits == '.'))
+        {
+            return false;
+        }
+        const std::from_chars_result r = std::from_chars(p, end, value);
+        if (r.ec != std::errc())
+        {
+            return false;
+        }
+        p = r.ptr;
+        return true;
+    }
+
+    /// @brief Consume an expected separator after optional whitespace.
+    bool expect_char(const char *&p, const char *end, char c)
+    {
+        p = skip_space(p, end);
+        if (p == end || *p != c)
+        {
+            return false;
+        }
+        ++p;
+        return true;
+    }
+} // namespace
 
 namespace common
 {
@@ -51,4 +114,184 @@ namespace common
         return true;
     }
 
+    bool parse_csv_fast(std::string_view line, Sample &out)
+    {
+        const char *p = line.data();
+        const char *end = p + line.size();
+
+        if (!read_number(p, end, out.id) || !expect_char(p, end, ',')) return false;
+        for (std::size_t i = 0; i < INPUT_DIM; ++i)
+        {
+            if (!read_number(p, end, out.x[i]) || !expect_char(p, end, ',')) return false;
+        }
+        return read_number(p, end, out.y);
+    }
+
+    bool parse_sample_fast(std::string_view line, Sample &out)
+    {
+        const char *p = line.data();
+        const char *end = p + line.size();
+
+        if (!read_number(p, end, out.id)) return false;
+        for (std::size_t i = 0; i < INPUT_DIM; ++i)
+        {
+            if (!read_number(p, end, out.x[i])) return false;
+        }
+        return read_number(p, end, out.y);
+    }
+
+    void append_sample_line(const Sample &s, std::string &out)
+    {
+        // "%.6g" floats need at most 13 characters, ints 11.
+        char buf[16 * (INPUT_DIM + 2)];
+        char *p = buf;
+        char *end = buf + sizeof(buf);
+
+        p = std::to_chars(p, end, s.id).ptr;
+        for (std::size_t i = 0; i < INPUT_DIM; ++i)
+        {
+            *p++ = ' ';
+            p = std::to_chars(p, end, s.x[i], std::chars_format::general, 6).ptr;
+        }
+        *p++ = ' ';
+        p = std::to_chars(p, end, s.y, std::chars_format::general, 6).ptr;
+        out.append(buf, p);
+    }
+
+    void round_to_wire(Sample &s)
+    {
+        char buf[32];
+        auto round = [&buf](float &v) {
+            const char *end = std::to_chars(buf, buf + sizeof(buf), v,
+                                            std::chars_format::general, 6).ptr;
+            std::from_chars(buf, end, v);
+        };
+        for (std::size_t i = 0; i < INPUT_DIM; ++i)
+        {
+            round(s.x[i]);
+        }
+        round(s.y);
+    }
+
+    bool parse_feature_line(std::string_view line, FeatureRow &out)
+    {
+        const char *p = line.data();
+        const char *end = p + line.size();
+
+        if (!read_number(p, end, out.id)) return false;
+        out.x.clear();
+        float v = 0.0f;
+        while (skip_space(p, end) != end)
+        {
+            if (!read_number(p, end, v)) return false;
+            out.x.push_back(v);
+        }
+        if (out.x.size() < 2) return false;
+        out.y = out.x.back();
+        out.x.pop_back();
+        return true;
+    }
+
+    const char *reject_reason(std::string_view line, char sep, std::size_t expected)
+    {
+        std::size_t fields = 0;
+        if (sep == ',')
+        {
+            fields = 1 + static_cast<std::size_t>(std::count(line.begin(), line.end(), ','));
+        }
+        else
+        {
+            const char *p = line.data();
+            const char *end = p + line.size();
+            while ((p = skip_space(p, end)) != end)
+            {
+                ++fields;
+                while (p != end && !(*p == ' ' || (*p >= '\t' && *p <= '\r')))
+                {
+                    ++p;
+                }
+            }
+        }
+        const bool ok = expected ? fields == expected : fields >= 3;
+        return ok ? "bad_number" : "field_count";
+    }
+
+    void append_feature_line(int id, const float *x, std::size_t dim, float y, std::string &out)
+    {
+        char buf[16];
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), id).ptr);
+        for (std::size_t i = 0; i <= dim; ++i)
+        {
+            buf[0] = ' ';
+            const float v = i < dim ? x[i] : y;
+            out.append(buf, std::to_chars(buf + 1, buf + sizeof(buf), v,
+                                          std::chars_format::general, 6).ptr);
+        }
+    }
+
+    AtomicLineBuf::AtomicLineBuf(int fd) : fd_(fd)
+    {
+        setp(buf_, buf_ + sizeof(buf_));
+    }
+
+    AtomicLineBuf::~AtomicLineBuf()
+    {
+        flush_lines(true);
+    }
+
+    AtomicLineBuf::int_type AtomicLineBuf::overflow(int_type ch)
+    {
+        // A single line longer than the buffer cannot be written atomically;
+        // write it out anyway rather than fail.
+        if (!flush_lines(false) || (pptr() == epptr() && !flush_lines(true)))
+        {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int AtomicLineBuf::sync()
+    {
+        return flush_lines(true) ? 0 : -1;
+    }
+
+    bool AtomicLineBuf::flush_lines(bool all)
+    {
+        std::size_t len = static_cast<std::size_t>(pptr() - pbase());
+        if (!all)
+        {
+            while (len > 0 && pbase()[len - 1] != '\n')
+            {
+                --len;
+            }
+        }
+
+        std::size_t off = 0;
+        while (off < len)
+        {
+            const ssize_t n = write(fd_, pbase() + off, len - off);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            off += static_cast<std::size_t>(n);
+        }
+
+        // Keep the unwritten partial line at the front of the buffer.
+        const std::size_t rest = static_cast<std::size_t>(pptr() - pbase()) - len;
+        std::memmove(buf_, pbase() + len, rest);
+        setp(buf_, buf_ + sizeof(buf_));
+        pbump(static_cast<int>(rest));
+        return true;
+    }
+
 } // namespace common
@@ -0,0 +1,300 @@
+/// @file compress.cpp
+/// @brief Implementation of gradient compression.
+#include "compress.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    /// @brief Header at the start of every payload.
+    struct PayloadHeader
+    {
+        std::uint32_t method; ///< compress::Method.
+        std::uint32_t n;      ///< Number of floats encoded.
+        std::uint32_t k;      ///< TopK: entries that follow.
+        float lo;             ///< Q8: value of code 0.
+        float step;           ///< Q8: value difference per code.
+    };
+
+    /// @brief One kept TopK entry.
+    struct Entry
+    {
+        std::uint32_t index;
+        float value;
+    };
+
+    /**
+     * @brief Seconds elapsed since t0.
+     */
+    double since(Clock::time_point t0)
+    {
+        return std::chrono::duration<double>(Clock::now() - t0).count();
+    }
+
+    /**
+     * @brief TopK with error feedback.
+     */
+    void encode_topk(compress::Compressor &c, const float *grad, std::size_t n,
+                     std::vector<char> &out)
+    {
+        if (c.residual.size() != n)
+        {
+            c.residual.assign(n, 0.0f);
+        }
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            c.residual[i] += grad[i];
+        }
+
+        const std::size_t k = std::min(n, std::max<std::size_t>(
+            1, static_cast<std::size_t>(std::ceil(c.config.fraction * n))));
+
+        // Select the k largest magnitudes by index.
+        std::vector<std::uint32_t> order(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            order[i] = static_cast<std::uint32_t>(i);
+        }
+        std::nth_element(order.begin(), order.begin() + (k - 1), order.end(),
+                         [&](std::uint32_t a, std::uint32_t b) {
+                             return std::fabs(c.residual[a]) > std::fabs(c.residual[b]);
+                         });
+
+        PayloadHeader h{};
+        h.method = static_cast<std::uint32_t>(compress::Method::TopK);
+        h.n = static_cast<std::uint32_t>(n);
+        h.k = static_cast<std::uint32_t>(k);
+        out.resize(sizeof(h) + k * sizeof(Entry));
+        std::memcpy(out.data(), &h, sizeof(h));
+
+        Entry *entries = reinterpret_cast<Entry *>(out.data() + sizeof(h));
+        for (std::size_t j = 0; j < k; ++j)
+        {
+            const std::uint32_t i = order[j];
+            entries[j] = {i, c.residual[i]};
+            c.residual[i] = 0.0f; // sent; the rest stays as feedback
+        }
+    }
+
+    /**
+     * @brief 8-bit stochastic quantization.
+     */
+    void encode_q8(compress::Compressor &c, const float *grad, std::size_t n,
+                   std::vector<char> &out)
+    {
+        float lo = 0.0f;
+        float hi = 0.0f;
+        if (n > 0)
+        {
+            const auto mm = std::minmax_element(grad, grad + n);
+            lo = *mm.first;
+            hi = *mm.second;
+        }
+
+        PayloadHeader h{};
+        h.method = static_cast<std::uint32_t>(compress::Method::Q8);
+        h.n = static_cast<std::uint32_t>(n);
+        h.lo = lo;
+        h.step = (hi > lo) ? (hi - lo) / 255.0f : 0.0f;
+        out.resize(sizeof(h) + n);
+        std::memcpy(out.data(), &h, sizeof(h));
+
+        std::uniform_real_distribution<float> noise(0.0f, 1.0f);
+        unsigned char *codes = reinterpret_cast<unsigned char *>(out.data() + sizeof(h));
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const float q = (h.step > 0.0f) ? (grad[i] - lo) / h.step : 0.0f;
+            const float r = std::floor(q + noise(c.rng));
+            codes[i] = static_cast<unsigned char>(std::min(255.0f, std::max(0.0f, r)));
+        }
+    }
+} // namespace
+
+namespace compress
+{
+    bool parse_config(const std::string &spec, Config &out)
+    {
+        if (spec.empty() || spec == "none")
+        {
+            out.method = Method::None;
+            return true;
+        }
+        if (spec == "q8")
+        {
+            out.method = Method::Q8;
+            return true;
+        }
+        if (spec.compare(0, 4, "topk") == 0)
+        {
+            out.method = Method::TopK;
+            if (spec.size() == 4)
+            {
+                return true;
+            }
+            if (spec[4] != ':')
+            {
+                return false;
+            }
+            char *end = nullptr;
+            const float f = std::strtof(spec.c_str() + 5, &end);
+            if (!end || *end != '\0' || !(f > 0.0f) || f > 1.0f)
+            {
+                return false;
+            }
+            out.fraction = f;
+            return true;
+        }
+        return false;
+    }
+
+    bool from_env(unsigned seed, Compressor &out)
+    {
+        out = Compressor{};
+        out.rng.seed(seed);
+        const char *spec = std::getenv("GRAD_COMPRESS");
+        const char *verbose = std::getenv("GRAD_COMPRESS_VERBOSE");
+        out.verbose = verbose && std::strcmp(verbose, "1") == 0;
+        if (spec && !parse_config(spec, out.config))
+        {
+            std::cerr << "compress: bad GRAD_COMPRESS '" << spec
+                      << "' (expected none, topk[:fraction] or q8)\n";
+            return false;
+        }
+        return true;
+    }
+
+    std::size_t max_payload(std::size_t n)
+    {
+        // TopK of all n entries is the largest: index and value per float.
+        return sizeof(PayloadHeader) + n * std::max(sizeof(Entry), sizeof(float));
+    }
+
+    void encode(Compressor &c, const float *grad, std::size_t n, std::vector<char> &out)
+    {
+        const Clock::time_point t0 = Clock::now();
+
+        switch (c.config.method)
+        {
+        case Method::TopK:
+            encode_topk(c, grad, n, out);
+            break;
+        case Method::Q8:
+            encode_q8(c, grad, n, out);
+            break;
+        case Method::None:
+        {
+            PayloadHeader h{};
+            h.method = static_cast<std::uint32_t>(Method::None);
+            h.n = static_cast<std::uint32_t>(n);
+            out.resize(sizeof(h) + n * sizeof(float));
+            std::memcpy(out.data(), &h, sizeof(h));
+            std::memcpy(out.data() + sizeof(h), grad, n * sizeof(float));
+            break;
+        }
+        }
+
+        const double seconds = since(t0);
+        ++c.stats.steps;
+        c.stats.raw_bytes += n * sizeof(float);
+        c.stats.wire_bytes += out.size();
+        c.stats.encode_seconds += seconds;
+        if (c.verbose)
+        {
+            std::cerr << "COMPRESS " << c.stats.steps << ' '
+                      << n * sizeof(float) << ' ' << out.size() << ' '
+                      << seconds * 1e6 << '\n';
+        }
+    }
+
+    bool decode_add(Compressor &c, const char *data, std::size_t len, float *dst, std::size_t n)
+    {
+        const Clock::time_point t0 = Clock::now();
+
+        PayloadHeader h{};
+        if (len < sizeof(h))
+        {
+            return false;
+        }
+        std::memcpy(&h, data, sizeof(h));
+        if (h.n != n)
+        {
+            return false;
+        }
+        const char *body = data + sizeof(h);
+        const std::size_t body_len = len - sizeof(h);
+
+        switch (static_cast<Method>(h.method))
+        {
+        case Method::None:
+        {
+            if (body_len != n * sizeof(float))
+            {
+                return false;
+            }
+            const float *v = reinterpret_cast<const float *>(body);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                dst[i] += v[i];
+            }
+            break;
+        }
+        case Method::TopK:
+        {
+            if (body_len != h.k * sizeof(Entry))
+            {
+                return false;
+            }
+            const Entry *e = reinterpret_cast<const Entry *>(body);
+            for (std::size_t j = 0; j < h.k; ++j)
+            {
+                if (e[j].index >= n)
+                {
+                    return false;
+                }
+                dst[e[j].index] += e[j].value;
+            }
+            break;
+        }
+        case Method::Q8:
+        {
+            if (body_len != n)
+            {
+                return false;
+            }
+            const unsigned char *codes = reinterpret_cast<const unsigned char *>(body);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                dst[i] += h.lo + static_cast<float>(codes[i]) * h.step;
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+
+        c.stats.decode_seconds += since(t0);
+        return true;
+    }
+
+    void report(const Compressor &c, const std::string &who)
+    {
+        const Stats &s = c.stats;
+        if (s.steps == 0)
+        {
+            return;
+        }
+        std::cerr << who << ": compression steps=" << s.steps
+                  << " ratio=" << (s.wire_bytes ? static_cast<double>(s.raw_bytes) / s.wire_bytes : 0.0)
+                  << " encode_us_per_step=" << s.encode_seconds * 1e6 / s.steps
+                  << " decode_us_per_step=" << s.decode_seconds * 1e6 / s.steps
+                  << '\n';
+    }
+
+} // namespace compress
@@ -0,0 +1,288 @@
+/// @file crossval.cpp
+/// @brief Implementation of the crossval executable.
+#include "crossval.hpp"
+#include "common.hpp"
+#include "dataset.hpp"
+#include "math_layer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    /// @brief Result record sent from a fold process to the parent.
+    ///
+    /// Small enough to be written atomically to a pipe (< PIPE_BUF).
+    struct FoldResult
+    {
+        int fold;
+        std::uint64_t train_samples;
+        double train_loss;
+        std::uint64_t test_samples;
+        double test_loss;
+    };
+
+    /**
+     * @brief Read a positive integer from an environment variable.
+     *
+     * @param name     Variable name.
+     * @param fallback Value used if unset or invalid.
+     * @return Parsed value.
+     */
+    long env_long(const char *name, long fallback)
+    {
+        const char *env = std::getenv(name);
+        if (!env || !*env)
+        {
+            return fallback;
+        }
+        char *end = nullptr;
+        const long v = std::strtol(env, &end, 10);
+        return (end && *end == '\0' && v > 0) ? v : fallback;
+    }
+
+    /**
+     * @brief Map a sample id to its fold.
+     *
+     * Ids are mixed (32-bit murmur3 finalizer) first so that consecutive
+     * ids spread evenly over the folds.
+     */
+    int fold_of(int id, int folds)
+    {
+        std::uint32_t h = static_cast<std::uint32_t>(id);
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35u;
+        h ^= h >> 16;
+        return static_cast<int>(h % static_cast<std::uint32_t>(folds));
+    }
+
+    /**
+     * @brief Train on all folds except 'fold' and evaluate on 'fold'.
+     *
+     * @param ds     Mapped dataset.
+     * @param fold   Held-out fold.
+     * @param folds  Number of folds.
+     * @param epochs Passes over the training folds.
+     * @param config Model configuration.
+     * @return Fold result.
+     */
+    FoldResult run_fold(const dataset::MappedDataset &ds,
+                        int fold,
+                        int folds,
+                        long epochs,
+                        const math::TrainConfig &config)
+    {
+        math::TrainState st = math::make_train_state(common::INPUT_DIM, config);
+
+        FoldResult r{};
+        r.fold = fold;
+
+        double train_loss = 0.0;
+        for (long e = 0; e < epochs; ++e)
+        {
+            for (std::size_t i = 0; i < ds.count; ++i)
+            {
+                const common::Sample &s = ds.samples[i];
+                if (fold_of(s.id, folds) == fold)
+                {
+                    continue;
+                }
+                float loss = 0.0f;
+                float y_hat = 0.0f;
+                float grad_norm = 0.0f;
+                math::train_step(st, s.x, s.y, loss, y_hat, grad_norm);
+                train_loss += loss;
+                ++r.train_samples;
+            }
+        }
+
+        double test_loss = 0.0;
+        for (std::size_t i = 0; i < ds.count; ++i)
+        {
+            const common::Sample &s = ds.samples[i];
+            if (fold_of(s.id, folds) != fold)
+            {
+                continue;
+            }
+            const float diff = math::forward(st.model, s.x) - s.y;
+            test_loss += 0.5 * static_cast<double>(diff) * diff;
+            ++r.test_samples;
+        }
+
+        r.train_loss = r.train_samples ? train_loss / r.train_samples : 0.0;
+        r.test_loss = r.test_samples ? test_loss / r.test_samples : 0.0;
+        return r;
+    }
+
+    /**
+     * @brief Drain all complete result records currently in the pipe.
+     *
+     * @param fd      Non-blocking read end.
+     * @param results Per-fold results (indexed by fold).
+     * @param have    Per-fold "result received" flags.
+     */
+    void drain_results(int fd,
+                       std::vector<FoldResult> &results,
+                       std::vector<bool> &have)
+    {
+        FoldResult r{};
+        while (read(fd, &r, sizeof(r)) == static_cast<ssize_t>(sizeof(r)))
+        {
+            if (r.fold >= 0 && static_cast<std::size_t>(r.fold) < results.size())
+            {
+                results[r.fold] = r;
+                have[r.fold] = true;
+            }
+        }
+    }
+} // namespace
+
+namespace crossval
+{
+    int run(const std::string &csv_path)
+    {
+        const int folds = static_cast<int>(env_long("CROSSVAL_FOLDS", 5));
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        const long jobs = env_long("CROSSVAL_JOBS", cpus > 0 ? cpus : 1);
+        const long epochs = env_long("CROSSVAL_EPOCHS", 1);
+
+        math::TrainConfig config;
+        const char *spec = std::getenv("CROSSVAL_CONFIG");
+        if (spec && !math::parse_train_config(spec, config))
+        {
+            std::cerr << "crossval: bad CROSSVAL_CONFIG: " << spec << '\n';
+            return 1;
+        }
+        if (folds < 2)
+        {
+            std::cerr << "crossval: CROSSVAL_FOLDS must be at least 2\n";
+            return 1;
+        }
+
+        // Parse the CSV once; every fold reads the same mapped copy.
+        const std::string cache_path = dataset::default_cache_path(csv_path);
+        dataset::MappedDataset ds;
+        if (!dataset::ensure_cache(csv_path, cache_path) ||
+            !dataset::map_dataset(cache_path, ds))
+        {
+            return 1;
+        }
+        std::cerr << "crossval: " << ds.count << " samples, " << folds
+                  << " folds, " << jobs << " jobs, cache " << cache_path << '\n';
+
+        int result_pipe[2];
+        if (pipe2(result_pipe, O_CLOEXEC) < 0)
+        {
+            std::perror("pipe");
+            dataset::unmap_dataset(ds);
+            return 1;
+        }
+        fcntl(result_pipe[0], F_SETFL, fcntl(result_pipe[0], F_GETFL) | O_NONBLOCK);
+
+        std::vector<FoldResult> results(folds);
+        std::vector<bool> have(folds, false);
+        int next_fold = 0;
+        long running = 0;
+        int rc = 0;
+
+        while (next_fold < folds || running > 0)
+        {
+            // Keep up to 'jobs' fold processes running.
+            while (next_fold < folds && running < jobs)
+            {
+                const pid_t pid = fork();
+                if (pid < 0)
+                {
+                    std::perror("fork");
+                    rc = 1;
+                    next_fold = folds;
+                    break;
+                }
+                if (pid == 0)
+                {
+                    close(result_pipe[0]);
+                    const FoldResult r = run_fold(ds, next_fold, folds, epochs, config);
+                    const bool ok = write(result_pipe[1], &r, sizeof(r)) ==
+                                    static_cast<ssize_t>(sizeof(r));
+                    _exit(ok ? 0 : 1);
+                }
+                ++next_fold;
+                ++running;
+            }
+
+            int status = 0;
+            const pid_t wpid = wait(&status);
+            if (wpid < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            --running;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                std::cerr << "crossval: fold process " << wpid << " failed\n";
+                rc = 1;
+            }
+            drain_results(result_pipe[0], results, have);
+        }
+        drain_results(result_pipe[0], results, have);
+        close(result_pipe[0]);
+        close(result_pipe[1]);
+        dataset::unmap_dataset(ds);
+
+        double sum = 0.0;
+        double sum_sq = 0.0;
+        int done = 0;
+        for (int f = 0; f < folds; ++f)
+        {
+            if (!have[f])
+            {
+                std::cerr << "crossval: no result for fold " << f << '\n';
+                rc = 1;
+                continue;
+            }
+            const FoldResult &r = results[f];
+            std::cout << "FOLD " << f << ' '
+                      << r.train_samples << ' ' << r.train_loss << ' '
+                      << r.test_samples << ' ' << r.test_loss << '\n';
+            sum += r.test_loss;
+            sum_sq += r.test_loss * r.test_loss;
+            ++done;
+        }
+
+        if (done > 0)
+        {
+            const double mean = sum / done;
+            const double var = std::max(0.0, sum_sq / done - mean * mean);
+            std::cout << "CROSSVAL_SUMMARY " << done << ' '
+                      << mean << ' ' << std::sqrt(var) << '\n';
+        }
+        return rc;
+    }
+
+} // namespace crossval
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: crossval <csv_path>\n";
+        return 1;
+    }
+    return crossval::run(argv[1]);
+}
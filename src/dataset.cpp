@@ -0,0 +1,210 @@
+/// @file dataset.cpp
+/// @brief Implementation of the binary dataset cache.
+#include "dataset.hpp"
+#include "math_layer.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    /// @brief Magic bytes identifying a cache file.
+    constexpr char CACHE_MAGIC[8] = {'M', 'L', 'D', 'S', 'E', 'T', '1', '\0'};
+
+    /// @brief Fixed-size header at the start of a cache file.
+    struct CacheHeader
+    {
+        char magic[8];            ///< CACHE_MAGIC.
+        std::uint32_t sample_size; ///< sizeof(common::Sample) when written.
+        std::uint32_t input_dim;   ///< common::INPUT_DIM when written.
+        std::uint64_t count;       ///< Number of Sample records that follow.
+    };
+
+    /**
+     * @brief Check whether a header matches this build's Sample layout.
+     */
+    bool header_ok(const CacheHeader &h)
+    {
+        return std::memcmp(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+               h.sample_size == sizeof(common::Sample) &&
+               h.input_dim == common::INPUT_DIM;
+    }
+
+    /**
+     * @brief Check whether cache_path is a valid cache newer than csv_path.
+     */
+    bool cache_is_fresh(const std::string &csv_path, const std::string &cache_path)
+    {
+        struct stat csv_st{};
+        struct stat cache_st{};
+        if (stat(csv_path.c_str(), &csv_st) < 0 ||
+            stat(cache_path.c_str(), &cache_st) < 0 ||
+            cache_st.st_mtime < csv_st.st_mtime)
+        {
+            return false;
+        }
+
+        std::ifstream in(cache_path, std::ios::binary);
+        CacheHeader h{};
+        if (!in.read(reinterpret_cast<char *>(&h), sizeof(h)) || !header_ok(h))
+        {
+            return false;
+        }
+        return static_cast<std::uint64_t>(cache_st.st_size) ==
+               sizeof(CacheHeader) + h.count * sizeof(common::Sample);
+    }
+} // namespace
+
+namespace dataset
+{
+    std::string default_cache_path(const std::string &csv_path)
+    {
+        const char *env = std::getenv("DATASET_CACHE");
+        if (env && *env)
+        {
+            return std::string(env);
+        }
+
+        std::string base = csv_path;
+        const std::size_t slash = base.find_last_of('/');
+        if (slash != std::string::npos)
+        {
+            base = base.substr(slash + 1);
+        }
+        return "logs/" + base + ".bin";
+    }
+
+    bool ensure_cache(const std::string &csv_path, const std::string &cache_path)
+    {
+        if (cache_is_fresh(csv_path, cache_path))
+        {
+            return true;
+        }
+
+        std::ifstream in(csv_path);
+        if (!in)
+        {
+            std::cerr << "dataset: failed to open CSV file: " << csv_path << '\n';
+            return false;
+        }
+
+        // Create the cache directory (one level, e.g. logs/) if needed.
+        const std::size_t slash = cache_path.find_last_of('/');
+        if (slash != std::string::npos && slash > 0)
+        {
+            mkdir(cache_path.substr(0, slash).c_str(), 0755);
+        }
+
+        // Write to a temporary file and rename, so concurrent readers never
+        // see a half-written cache.
+        const std::string tmp_path = cache_path + ".tmp." + std::to_string(getpid());
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            std::cerr << "dataset: failed to create cache file: " << tmp_path << '\n';
+            return false;
+        }
+
+        CacheHeader h{};
+        std::memcpy(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        h.sample_size = sizeof(common::Sample);
+        h.input_dim = common::INPUT_DIM;
+        out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.empty())
+            {
+                continue;
+            }
+
+            common::Sample s{};
+            if (!common::parse_csv_line(line, s))
+            {
+                std::cerr << "dataset: failed to parse line: " << line << '\n';
+                continue;
+            }
+
+            // Same transforms as preprocess + forward_layer.
+            math::normalize_sample(s);
+            math::augment_features(s);
+
+            out.write(reinterpret_cast<const char *>(&s), sizeof(s));
+            ++h.count;
+        }
+
+        out.seekp(0);
+        out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        out.close();
+        if (!out || std::rename(tmp_path.c_str(), cache_path.c_str()) < 0)
+        {
+            std::cerr << "dataset: failed to write cache file: " << cache_path << '\n';
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool map_dataset(const std::string &cache_path, MappedDataset &out)
+    {
+        const int fd = open(cache_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            std::perror("dataset: open");
+            return false;
+        }
+
+        struct stat st{};
+        if (fstat(fd, &st) < 0 ||
+            static_cast<std::size_t>(st.st_size) < sizeof(CacheHeader))
+        {
+            close(fd);
+            std::cerr << "dataset: truncated cache file: " << cache_path << '\n';
+            return false;
+        }
+
+        const std::size_t length = static_cast<std::size_t>(st.st_size);
+        void *base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+            std::perror("dataset: mmap");
+            return false;
+        }
+
+        const CacheHeader *h = static_cast<const CacheHeader *>(base);
+        if (!header_ok(*h) ||
+            length != sizeof(CacheHeader) + h->count * sizeof(common::Sample))
+        {
+            munmap(base, length);
+            std::cerr << "dataset: incompatible cache file: " << cache_path << '\n';
+            return false;
+        }
+
+        out.base = base;
+        out.length = length;
+        out.count = static_cast<std::size_t>(h->count);
+        out.samples = reinterpret_cast<const common::Sample *>(
+            static_cast<const char *>(base) + sizeof(CacheHeader));
+        return true;
+    }
+
+    void unmap_dataset(MappedDataset &ds)
+    {
+        if (ds.base)
+        {
+            munmap(ds.base, ds.length);
+        }
+        ds = MappedDataset{};
+    }
+
+} // namespace dataset
@@ -0,0 +1,95 @@
+/// @file feature_plugin.cpp
+/// @brief Implementation of the feature transform plugin loader.
+#include "feature_plugin.hpp"
+
+#include <chrono>
+#include <dlfcn.h>
+#include <iostream>
+#include <sstream>
+
+namespace feature_plugin
+{
+    Chain::~Chain()
+    {
+        for (Loaded &p : plugins_)
+        {
+            if (p.api->destroy)
+            {
+                p.api->destroy(p.state);
+            }
+            dlclose(p.handle);
+        }
+    }
+
+    bool Chain::load(const std::string &spec)
+    {
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, ';'))
+        {
+            if (item.empty())
+            {
+                continue;
+            }
+            const std::size_t colon = item.find(':');
+            const std::string path = item.substr(0, colon);
+            const std::string args = colon == std::string::npos ? "" : item.substr(colon + 1);
+
+            void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+            if (!handle)
+            {
+                std::cerr << "feature_plugin: " << dlerror() << "\n";
+                return false;
+            }
+            const auto entry = reinterpret_cast<feature_plugin_fn>(dlsym(handle, "get_feature_plugin"));
+            const FeaturePlugin *api = entry ? entry() : nullptr;
+            if (!api || api->abi != FEATURE_PLUGIN_ABI || !api->apply)
+            {
+                std::cerr << "feature_plugin: " << path
+                          << ": no get_feature_plugin() with ABI " << FEATURE_PLUGIN_ABI << "\n";
+                dlclose(handle);
+                return false;
+            }
+            void *state = api->create ? api->create(args.c_str()) : nullptr;
+            if (api->create && !state)
+            {
+                std::cerr << "feature_plugin: " << api->name
+                          << ": rejected arguments '" << args << "'\n";
+                dlclose(handle);
+                return false;
+            }
+            plugins_.push_back(Loaded{handle, api, state, 0, 0.0});
+        }
+        return true;
+    }
+
+    bool Chain::apply(SampleBatch &batch)
+    {
+        using clock = std::chrono::steady_clock;
+        for (Loaded &p : plugins_)
+        {
+            const clock::time_point t0 = clock::now();
+            const int rc = p.api->apply(p.state, &batch);
+            p.seconds += std::chrono::duration<double>(clock::now() - t0).count();
+            ++p.batches;
+            if (rc != 0)
+            {
+                std::cerr << "feature_plugin: " << p.api->name
+                          << " failed with " << rc << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Chain::report(const char *stage) const
+    {
+        for (const Loaded &p : plugins_)
+        {
+            std::cerr << stage << ": plugin " << p.api->name << " batches=" << p.batches
+                      << " us_per_batch="
+                      << (p.batches ? 1e6 * p.seconds / p.batches : 0.0) << "\n";
+        }
+    }
+
+} // namespace feature_plugin
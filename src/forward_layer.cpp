@@ -2,45 +2,236 @@
 /// @brief Implementation of the forward_layer executable.
 #include "forward_layer.hpp"
 #include "common.hpp"
+#include "feature_plugin.hpp"
 #include "math_layer.hpp"
+#include "stage_io.hpp"
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Samples per batch from FORWARD_BATCH.
+     *
+     * @return Value of FORWARD_BATCH if it is a positive integer, else 256.
+     */
+    std::size_t get_batch_size()
+    {
+        const char *env = std::getenv("FORWARD_BATCH");
+        if (!env || !*env)
+        {
+            return 256;
+        }
+        char *end = nullptr;
+        const long v = std::strtol(env, &end, 10);
+        return (end && *end == '\0' && v > 0) ? static_cast<std::size_t>(v) : 256;
+    }
+
+    /**
+     * @brief Run the plugin chain over a batch of samples.
+     *
+     * Copies the samples into the plugins' row-major layout and back.
+     */
+    bool apply_plugins(feature_plugin::Chain &plugins, std::vector<common::Sample> &batch,
+                       std::vector<float> &x, std::vector<float> &y, std::vector<int> &id)
+    {
+        const std::size_t n = batch.size();
+        x.resize(n * common::INPUT_DIM);
+        y.resize(n);
+        id.resize(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::memcpy(&x[i * common::INPUT_DIM], batch[i].x, sizeof(batch[i].x));
+            y[i] = batch[i].y;
+            id[i] = batch[i].id;
+        }
+
+        SampleBatch view{x.data(), y.data(), id.data(), n, common::INPUT_DIM};
+        if (!plugins.apply(view))
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::memcpy(batch[i].x, &x[i * common::INPUT_DIM], sizeof(batch[i].x));
+            batch[i].y = y[i];
+        }
+        return true;
+    }
+    /// @brief FORWARD_EXPAND state and its running cost.
+    struct Expander
+    {
+        math::Expansion expansion;
+        std::vector<float> x;       ///< Packed input rows.
+        std::vector<float> wide;    ///< Expanded rows.
+        std::vector<float> scratch; ///< expand_batch() scratch.
+        std::string text;           ///< Formatted output lines.
+        std::size_t samples = 0;
+        std::size_t bytes = 0;
+        double seconds = 0.0;
+    };
+
+    /// @brief Expand a batch and write it as wide lines.
+    void write_expanded(Expander &ex, const std::vector<common::Sample> &batch)
+    {
+        const std::size_t n = batch.size();
+        const std::size_t width = math::expanded_dim(ex.expansion);
+        ex.x.resize(n * common::INPUT_DIM);
+        ex.wide.resize(n * width);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::memcpy(&ex.x[i * common::INPUT_DIM], batch[i].x, sizeof(batch[i].x));
+        }
+
+        const auto t0 = std::chrono::steady_clock::now();
+        math::expand_batch(ex.expansion, ex.x.data(), n, ex.wide.data(), ex.scratch);
+        ex.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        ex.text.clear();
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            common::append_feature_line(batch[i].id, &ex.wide[i * width], width, batch[i].y, ex.text);
+            ex.text.push_back('\n');
+        }
+        ex.samples += n;
+        ex.bytes += ex.text.size();
+        std::cout.write(ex.text.data(), static_cast<std::streamsize>(ex.text.size()));
+    }
+} // namespace
 
 namespace forward_layer
 {
     int run()
     {
         std::ios::sync_with_stdio(false);
+        stage_io::Capture capture("forward_layer");
+        stage_io::Progress &progress = stage_io::progress();
+        stage_io::Quarantine quarantine("forward_layer");
+        const stage_io::MemoryShare memory("forward_layer");
+
+        feature_plugin::Chain plugins;
+        const char *spec = std::getenv("FORWARD_PLUGINS");
+        if (spec && *spec && !plugins.load(spec))
+        {
+            return 1;
+        }
+
+        Expander ex;
+        const char *expand = std::getenv("FORWARD_EXPAND");
+        if (expand && *expand &&
+            !math::parse_expansion(expand, common::INPUT_DIM, ex.expansion))
+        {
+            std::cerr << "forward_layer: invalid FORWARD_EXPAND=" << expand << "\n";
+            return 1;
+        }
+        const bool expanding = !ex.expansion.terms.empty();
+
+        // A batch row costs its Sample plus, per value, the plugin and
+        // expansion copies and the output text.
+        const std::size_t width = expanding ? math::expanded_dim(ex.expansion) : common::INPUT_DIM;
+        const std::size_t row_bytes = sizeof(common::Sample) + 16 * (width + 2);
+        const std::size_t batch_size = memory.fit("FORWARD_BATCH", get_batch_size(), row_bytes, 4);
+        // Under BATCH_TARGET_P99_MS, the batch size and flush deadline
+        // follow the load instead.
+        stage_io::BatchController batching("forward_layer", batch_size, memory, row_bytes);
+        std::vector<common::Sample> batch;
+        batch.reserve(batching.batch_size());
+        std::vector<float> x, y;
+        std::vector<int> id;
 
         std::string line;
-        while (std::getline(std::cin, line))
+        std::uint64_t offset = 0; // of the next input line
+        bool more = true;
+        while (more)
         {
-            if (line.empty())
+            batch.clear();
+            while (batch.size() < batching.batch_size() && batching.wait_input(batch.empty()) &&
+                   (more = static_cast<bool>(std::getline(std::cin, line))))
             {
-                continue;
+                const std::uint64_t at = offset;
+                offset += line.size() + 1;
+                if (line.empty())
+                {
+                    continue;
+                }
+                progress.count_in();
+
+                common::Sample s{};
+                if (!common::parse_sample_line(line, s))
+                {
+                    quarantine.add(common::reject_reason(line, ' ', common::INPUT_DIM + 2), at, line);
+                    continue;
+                }
+
+                // Feature augmentation (e.g., simple nonlinearity).
+                math::augment_features(s);
+                batch.push_back(s);
             }
+            batching.filled();
 
-            common::Sample s{};
-            if (!common::parse_sample_line(line, s))
+            // Plugin transforms run once per batch, after the built-in one.
+            if (!plugins.empty() && !batch.empty() && !apply_plugins(plugins, batch, x, y, id))
             {
-                std::cerr << "forward_layer: failed to parse line: " << line << std::endl;
-                continue;
+                return 1;
             }
 
-            // Feature augmentation (e.g., simple nonlinearity).
-            math::augment_features(s);
-
-            // Pass augmented sample forward in the pipeline.
-            std::cout << common::sample_to_line(s) << '\n';
+            // Pass augmented samples forward in the pipeline.
+            if (expanding)
+            {
+                write_expanded(ex, batch);
+            }
+            else
+            {
+                for (const common::Sample &s : batch)
+                {
+                    std::cout << common::sample_to_line(s) << '\n';
+                }
+            }
+            progress.count_out(batch.size());
+            batching.done(batch.size());
         }
 
+        plugins.report("forward_layer");
+        if (expanding)
+        {
+            // What the wider rows cost here; the model pays again downstream.
+            std::cerr << "forward_layer: expand terms=" << ex.expansion.terms.size()
+                      << " width=" << math::expanded_dim(ex.expansion)
+                      << " samples=" << ex.samples
+                      << " ns_per_sample=" << (ex.samples ? 1e9 * ex.seconds / ex.samples : 0.0)
+                      << " bytes_per_sample=" << (ex.samples ? double(ex.bytes) / ex.samples : 0.0)
+                      << "\n";
+        }
         return 0;
     }
 
 } // namespace forward_layer
 
-int main()
+int main(int argc, char *argv[])
 {
+    int control = -1;
+    if (stage_io::parse_serve_args(argc, argv, control))
+    {
+        return stage_io::serve("forward_layer", control,
+                               [](const std::vector<std::string> &) { return forward_layer::run(); });
+    }
+
+    stage_io::ReplayOptions replay;
+    const int replay_args = stage_io::parse_replay_args(argc, argv, replay);
+    if (replay_args > 0)
+    {
+        return stage_io::replay("forward_layer", replay, forward_layer::run);
+    }
+    if (replay_args < 0 || argc != 1)
+    {
+        std::cerr << "Usage: forward_layer [--replay <file> [--repeat N] | --serve <fd>]\n";
+        return 1;
+    }
     return forward_layer::run();
 }
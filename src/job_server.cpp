@@ -0,0 +1,853 @@
+/// @file job_server.cpp
+/// @brief Implementation of the trainer job-server daemon and its client.
+#include "job_server.hpp"
+#include "net.hpp"
+#include "topology.hpp"
+#include "trainer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <poll.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    volatile std::sig_atomic_t g_stop = 0;
+
+    void stop_handler(int)
+    {
+        g_stop = 1;
+    }
+
+    /// @brief A queued or running job.
+    struct Job
+    {
+        std::uint64_t id = 0;
+        int priority = 0;
+        std::uint64_t seq = 0;     ///< Arrival order (FIFO within a priority).
+        std::string csv;
+        std::string phase = "train";
+        std::string model;         ///< MODEL_FILE ("" keeps the default).
+        int workers = 0;           ///< TRAINER_WORKERS (0 keeps the default).
+        bool fuse = false;
+        int client = -1;           ///< Client socket.
+    };
+
+    /// @brief Heap order: a job runs after b if it has lower priority or came later.
+    bool runs_after(const Job &a, const Job &b)
+    {
+        return a.priority != b.priority ? a.priority < b.priority : a.seq > b.seq;
+    }
+
+    /// @brief Parse a non-negative or signed integer; false on garbage.
+    bool parse_int(const std::string &s, long &out)
+    {
+        char *end = nullptr;
+        out = std::strtol(s.c_str(), &end, 10);
+        return !s.empty() && *end == '\0';
+    }
+
+    /**
+     * @brief Parse "JOB key=value ..." (see job_server::serve()).
+     *
+     * @return false with a message in err on a malformed request.
+     */
+    bool parse_job(const std::string &line, Job &job, std::string &err)
+    {
+        std::stringstream ss(line);
+        std::string word;
+        ss >> word;
+        if (word != "JOB")
+        {
+            err = "expected JOB or SHUTDOWN";
+            return false;
+        }
+        while (ss >> word)
+        {
+            const std::size_t eq = word.find('=');
+            const std::string key = word.substr(0, eq);
+            const std::string value = eq == std::string::npos ? "" : word.substr(eq + 1);
+            long n = 0;
+            if (key == "csv" && !value.empty())
+            {
+                job.csv = value;
+            }
+            else if (key == "phase" && (value == "train" || value == "test"))
+            {
+                job.phase = value;
+            }
+            else if (key == "model" && !value.empty())
+            {
+                job.model = value;
+            }
+            else if (key == "priority" && parse_int(value, n))
+            {
+                job.priority = static_cast<int>(n);
+            }
+            else if (key == "workers" && parse_int(value, n) && n > 0)
+            {
+                job.workers = static_cast<int>(n);
+            }
+            else if (key == "fuse" && (value == "0" || value == "1"))
+            {
+                job.fuse = value == "1";
+            }
+            else
+            {
+                err = "bad field '" + word + "'";
+                return false;
+            }
+        }
+        if (job.csv.empty())
+        {
+            err = "missing csv=<path>";
+            return false;
+        }
+        return true;
+    }
+
+    /// @brief Write a whole reply line; errors mean the client left.
+    void reply(int fd, const std::string &line)
+    {
+        const std::string s = line + "\n";
+        net::send_all(fd, s.data(), s.size());
+    }
+
+    sockaddr_un unix_address(const std::string &path)
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        return addr;
+    }
+
+    int connect_unix(const std::string &path)
+    {
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const sockaddr_un addr = unix_address(path);
+        if (fd >= 0 && connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0)
+        {
+            return fd;
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    /// @brief Listen on path, replacing a stale socket but not a live daemon.
+    int listen_unix(const std::string &path)
+    {
+        const int live = connect_unix(path);
+        if (live >= 0)
+        {
+            close(live);
+            std::cerr << "trainer: a daemon already listens on " << path << "\n";
+            return -1;
+        }
+        unlink(path.c_str());
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const sockaddr_un addr = unix_address(path);
+        if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0 ||
+            listen(fd, 64) < 0)
+        {
+            std::perror(("trainer: listen " + path).c_str());
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            return -1;
+        }
+        return fd;
+    }
+
+    /// @brief A warm stage process, serving jobs over a control socket
+    ///        (see stage_io::serve()).
+    struct Warm
+    {
+        pid_t pid = -1;          ///< -1 until (re)started.
+        int control = -1;        ///< Daemon's end of the SOCK_SEQPACKET control socket.
+        bool busy = false;       ///< Has a job whose EXIT has not come back.
+    };
+
+    /**
+     * @brief A job slot.
+     *
+     * A job runs either on the slot's lane of warm stages or, when it
+     * needs what only trainer::run() sets up, in a forked runner.
+     */
+    struct Runner
+    {
+        pid_t pid = -1;          ///< Forked runner.
+        int done = -1;           ///< Read end of a pipe that hangs up when the runner exits.
+        std::uint64_t job = 0;   ///< Running job id, 0 while idle.
+        std::vector<Warm> lane;  ///< One warm process per stage (empty: every job is forked).
+        int client = -1;         ///< Client of the job on the lane.
+        int status = 0;          ///< Status of the job on the lane so far.
+    };
+
+    /**
+     * @brief Body of a runner: run one job with stdout on the client, exit.
+     *
+     * The daemon's other descriptors are closed first so a runner (and
+     * the stages it spawns) holds no client socket but its own.
+     */
+    [[noreturn]] void runner_main(const Job &job, int done, const std::string &config)
+    {
+        const long max_fd = std::min(sysconf(_SC_OPEN_MAX), 4096L);
+        for (int fd = 3; fd < max_fd; ++fd)
+        {
+            if (fd != job.client && fd != done)
+            {
+                close(fd);
+            }
+        }
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+
+        // The job's output (the logger's stdout) goes straight to the client.
+        dup2(job.client, STDOUT_FILENO);
+        close(job.client);
+        setenv("BACKWARD_MODE", job.phase.c_str(), 1);
+        if (!job.model.empty())
+        {
+            setenv("MODEL_FILE", job.model.c_str(), 1);
+        }
+        if (job.workers > 0)
+        {
+            setenv("TRAINER_WORKERS", std::to_string(job.workers).c_str(), 1);
+        }
+
+        reply(STDOUT_FILENO, "START " + std::to_string(job.id));
+        const int rc = trainer::run(job.csv, job.fuse, config);
+        std::cout.flush();
+        reply(STDOUT_FILENO, "DONE " + std::to_string(job.id) + " " + std::to_string(rc));
+        _exit(0);
+    }
+
+    /// @brief Fork a runner for job in slot r.
+    bool start_runner(Runner &r, const Job &job, const job_server::Options &opt)
+    {
+        int done[2];
+        if (pipe2(done, O_CLOEXEC) < 0)
+        {
+            std::perror("trainer: pipe");
+            return false;
+        }
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            std::perror("trainer: fork");
+            close(done[0]);
+            close(done[1]);
+            return false;
+        }
+        if (pid == 0)
+        {
+            runner_main(job, done[1], opt.config);
+        }
+        close(done[1]);
+        r.pid = pid;
+        r.done = done[0];
+        r.job = job.id;
+        return true;
+    }
+
+    /**
+     * @brief The stages a lane keeps warm; empty to fork every job.
+     *
+     * A lane is one chain, preprocess to logger, with nothing of what
+     * trainer::run() arranges around it: no second worker, parameter
+     * server, stall watchdog, memory budget or stats file. If the
+     * daemon's environment or topology asks for any of those, jobs keep
+     * being forked. TRAINER_TRANSPORT applies to the lane's edges.
+     */
+    std::vector<topology::Stage> warm_stages(const job_server::Options &opt)
+    {
+        if (!opt.warm)
+        {
+            return {};
+        }
+        for (const char *name : {"TRAINER_PS", "TRAINER_STALL_SECS", "TRAINER_MEMORY_BUDGET",
+                                 "TRAINER_STATS"})
+        {
+            const char *v = std::getenv(name);
+            if (v && *v && std::strcmp(v, "0") != 0)
+            {
+                return {};
+            }
+        }
+        topology::Topology topo = topology::default_topology();
+        if (!opt.config.empty() && !topology::load(opt.config, topo))
+        {
+            return {};
+        }
+        long workers = topo.workers;
+        const char *env = std::getenv("TRAINER_WORKERS");
+        if ((env && *env && !parse_int(env, workers)) || workers != 1)
+        {
+            return {};
+        }
+        const char *transport = std::getenv("TRAINER_TRANSPORT");
+        if (transport && *transport)
+        {
+            if (std::strcmp(transport, "pipe") != 0 && std::strcmp(transport, "socketpair") != 0)
+            {
+                return {}; // the forked run reports it
+            }
+            for (topology::Stage &st : topo.stages)
+            {
+                st.transport = std::strcmp(transport, "pipe") == 0 ? topology::Transport::Pipe
+                                                                   : topology::Transport::SocketPair;
+            }
+        }
+        return topo.stages;
+    }
+
+    /// @brief Whether job can run on a lane (one worker, no fusion).
+    bool fits_lane(const Job &job)
+    {
+        return job.workers <= 1 && !job.fuse;
+    }
+
+    /**
+     * @brief Start st as a warm process: "<prog> --serve <fd>".
+     *
+     * The stage's environment and CPUs from the topology are applied
+     * once here; per-stage settings cannot change between jobs.
+     */
+    bool spawn_warm(const topology::Stage &st, Warm &w)
+    {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+        {
+            std::perror("trainer: socketpair");
+            return false;
+        }
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            std::perror("trainer: fork");
+            close(sv[0]);
+            close(sv[1]);
+            return false;
+        }
+        if (pid == 0)
+        {
+            // Between jobs the stage's stdin and stdout are /dev/null.
+            const int null_fd = open("/dev/null", O_RDWR);
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            fcntl(sv[1], F_SETFD, 0);
+            for (const auto &kv : st.env)
+            {
+                setenv(kv.first.c_str(), kv.second.c_str(), 1);
+            }
+            if (!st.shared)
+            {
+                setenv("DDP_RANK", "0", 1);
+            }
+            if (!st.cpus.empty())
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int cpu : st.cpus)
+                {
+                    CPU_SET(cpu, &set);
+                }
+                if (sched_setaffinity(0, sizeof(set), &set) != 0)
+                {
+                    std::perror("sched_setaffinity");
+                }
+            }
+            const std::string control = std::to_string(sv[1]);
+            execlp(st.prog.c_str(), st.prog.c_str(), "--serve", control.c_str(),
+                   static_cast<char *>(nullptr));
+            std::perror(("trainer: exec " + st.prog).c_str());
+            _exit(1);
+        }
+        close(sv[1]);
+        w.pid = pid;
+        w.control = sv[0];
+        w.busy = false;
+        return true;
+    }
+
+    /// @brief Stop a warm process: closing its control socket ends it.
+    void stop_warm(Warm &w)
+    {
+        if (w.pid < 0)
+        {
+            return;
+        }
+        close(w.control);
+        waitpid(w.pid, nullptr, 0);
+        w = Warm{};
+    }
+
+    /**
+     * @brief Handle a message (or hangup) on a warm process's control socket.
+     *
+     * @return false if the process is gone (it is reaped).
+     */
+    bool read_exit(Runner &r, Warm &w)
+    {
+        std::string msg;
+        std::vector<int> fds;
+        int rc = 0;
+        if (net::recv_fds(w.control, msg, fds, 0) > 0 && w.busy &&
+            std::sscanf(msg.c_str(), "EXIT %d", &rc) == 1)
+        {
+            w.busy = false;
+            r.status = (r.status != 0 || rc != 0) ? 1 : 0;
+            return true;
+        }
+        if (w.busy)
+        {
+            r.status = 1;
+        }
+        stop_warm(w);
+        return false;
+    }
+
+    /// @brief Send "DONE" for the lane's job once no stage is busy.
+    void finish_lane_job(Runner &r)
+    {
+        if (r.job == 0 || r.done >= 0 ||
+            std::any_of(r.lane.begin(), r.lane.end(), [](const Warm &w) { return w.busy; }))
+        {
+            return;
+        }
+        reply(r.client, "DONE " + std::to_string(r.job) + " " + std::to_string(r.status));
+        close(r.client);
+        std::cerr << "trainer: job " << r.job << " finished\n";
+        r.client = -1;
+        r.job = 0;
+    }
+
+    /**
+     * @brief Run job on slot r's lane.
+     *
+     * Each stage is sent its arguments ({csv} is the job's file), the
+     * job's BACKWARD_MODE / MODEL_FILE, and the ends of its edges; the
+     * last stage writes to the client. Stages of the lane that have
+     * exited are started again first.
+     *
+     * @return false if the lane cannot take the job (nothing was sent).
+     */
+    bool start_lane_job(Runner &r, const Job &job, const std::vector<topology::Stage> &stages)
+    {
+        for (std::size_t i = 0; i < stages.size(); ++i)
+        {
+            if (r.lane[i].pid < 0 && !spawn_warm(stages[i], r.lane[i]))
+            {
+                return false;
+            }
+        }
+
+        // edges[i] leads from stage i to stage i + 1.
+        std::vector<std::array<int, 2>> edges;
+        auto close_edges = [&edges]() {
+            for (const auto &e : edges)
+            {
+                close(e[0]);
+                close(e[1]);
+            }
+        };
+        for (std::size_t i = 0; i + 1 < stages.size(); ++i)
+        {
+            std::array<int, 2> e;
+            if (!topology::make_edge(stages[i], e.data()))
+            {
+                close_edges();
+                return false;
+            }
+            edges.push_back(e);
+        }
+        const int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (null_fd < 0)
+        {
+            close_edges();
+            return false;
+        }
+
+        r.job = job.id;
+        r.client = job.client;
+        r.status = 0;
+        reply(job.client, "START " + std::to_string(job.id));
+        for (std::size_t i = 0; i < stages.size(); ++i)
+        {
+            std::string msg;
+            for (std::string a : stages[i].args)
+            {
+                if (a == "{shard}")
+                {
+                    continue;
+                }
+                for (std::size_t at = a.find("{csv}"); at != std::string::npos;
+                     at = a.find("{csv}", at + job.csv.size()))
+                {
+                    a.replace(at, 5, job.csv);
+                }
+                msg += "ARG " + a + "\n";
+            }
+            msg += "ENV BACKWARD_MODE=" + job.phase + "\n";
+            if (!job.model.empty())
+            {
+                msg += "ENV MODEL_FILE=" + job.model + "\n";
+            }
+            const int in = i == 0 ? null_fd : edges[i - 1][0];
+            const int out = i + 1 == stages.size() ? job.client : edges[i][1];
+            if (net::send_fds(r.lane[i].control, msg, {in, out}))
+            {
+                r.lane[i].busy = true;
+            }
+            else
+            {
+                // Its neighbours see end of input once the edges close.
+                std::cerr << "trainer: warm " << stages[i].name << " did not take job "
+                          << job.id << "\n";
+                stop_warm(r.lane[i]);
+                r.status = 1;
+            }
+        }
+        close(null_fd);
+        close_edges();
+        finish_lane_job(r);
+        return true;
+    }
+
+    /// @brief Number of queued jobs that run before job.
+    std::size_t jobs_ahead(const std::vector<Job> &queue, const Job &job)
+    {
+        return static_cast<std::size_t>(std::count_if(
+            queue.begin(), queue.end(),
+            [&job](const Job &other) { return runs_after(job, other); }));
+    }
+
+} // namespace
+
+namespace job_server
+{
+    Options options_from_env()
+    {
+        Options opt;
+        const char *path = std::getenv("TRAINER_SOCKET");
+        if (path && *path)
+        {
+            opt.socket_path = path;
+        }
+        const char *jobs = std::getenv("TRAINER_JOBS");
+        long n = 0;
+        if (jobs && *jobs && parse_int(jobs, n) && n > 0)
+        {
+            opt.jobs = static_cast<int>(n);
+        }
+        const char *warm = std::getenv("TRAINER_WARM");
+        opt.warm = !(warm && std::strcmp(warm, "0") == 0);
+        return opt;
+    }
+
+    int serve(const Options &opt)
+    {
+        const int listen_fd = listen_unix(opt.socket_path);
+        if (listen_fd < 0)
+        {
+            return 1;
+        }
+
+        struct sigaction sa = {};
+        sa.sa_handler = stop_handler;
+        sigaction(SIGINT, &sa, nullptr);
+        sigaction(SIGTERM, &sa, nullptr);
+
+        // Each slot's lane is started now, so the first jobs find it warm.
+        const std::vector<topology::Stage> stages = warm_stages(opt);
+        std::vector<Runner> runners(static_cast<std::size_t>(opt.jobs));
+        for (Runner &r : runners)
+        {
+            r.lane.resize(stages.size());
+            for (std::size_t i = 0; i < stages.size(); ++i)
+            {
+                spawn_warm(stages[i], r.lane[i]);
+            }
+        }
+        std::cerr << "trainer: daemon on " << opt.socket_path
+                  << " running " << opt.jobs << " jobs at a time"
+                  << (stages.empty() ? ", each in a forked runner" : " on warm stages") << "\n";
+
+        std::vector<Job> queue;                // heap ordered by runs_after
+        std::map<int, std::string> pending;    // client fd -> partial request
+        std::uint64_t next_id = 1;
+        std::uint64_t seq = 0;
+        bool draining = false;
+
+        while (!g_stop)
+        {
+            const bool busy = std::any_of(runners.begin(), runners.end(),
+                                          [](const Runner &r) { return r.job != 0; });
+            if (draining && queue.empty() && !busy)
+            {
+                break;
+            }
+
+            // Dispatch: a free slot takes the best queued job.
+            for (Runner &r : runners)
+            {
+                if (r.job != 0 || queue.empty())
+                {
+                    continue;
+                }
+                std::pop_heap(queue.begin(), queue.end(), runs_after);
+                Job job = queue.back();
+                queue.pop_back();
+                if (!r.lane.empty() && fits_lane(job) && start_lane_job(r, job, stages))
+                {
+                    std::cerr << "trainer: job " << job.id << " on lane "
+                              << &r - runners.data() << "\n";
+                    continue;
+                }
+                if (!start_runner(r, job, opt))
+                {
+                    reply(job.client, "ERROR runner unavailable");
+                }
+                else
+                {
+                    std::cerr << "trainer: job " << job.id << " on runner " << r.pid << "\n";
+                }
+                close(job.client);
+            }
+
+            std::vector<pollfd> fds;
+            if (!draining)
+            {
+                fds.push_back({listen_fd, POLLIN, 0});
+            }
+            for (const auto &p : pending)
+            {
+                fds.push_back({p.first, POLLIN, 0});
+            }
+            for (const Runner &r : runners)
+            {
+                if (r.job != 0 && r.done >= 0)
+                {
+                    fds.push_back({r.done, POLLIN, 0});
+                }
+                for (const Warm &w : r.lane)
+                {
+                    if (w.pid >= 0)
+                    {
+                        fds.push_back({w.control, POLLIN, 0});
+                    }
+                }
+            }
+            if (poll(fds.data(), fds.size(), 1000) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                std::perror("trainer: poll");
+                break;
+            }
+
+            for (const pollfd &p : fds)
+            {
+                if (!p.revents)
+                {
+                    continue;
+                }
+                if (p.fd == listen_fd)
+                {
+                    const int c = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (c >= 0)
+                    {
+                        pending[c];
+                    }
+                    continue;
+                }
+
+                auto runner = std::find_if(runners.begin(), runners.end(),
+                                           [&p](const Runner &r) { return r.job != 0 && r.done == p.fd; });
+                if (runner != runners.end())
+                {
+                    // The pipe only becomes readable when the runner exits.
+                    close(runner->done);
+                    waitpid(runner->pid, nullptr, 0);
+                    std::cerr << "trainer: job " << runner->job << " finished\n";
+                    runner->done = -1;
+                    runner->job = 0;
+                    continue;
+                }
+
+                // A warm stage finished its part of a job, or exited.
+                bool warm = false;
+                for (Runner &r : runners)
+                {
+                    for (std::size_t i = 0; i < r.lane.size() && !warm; ++i)
+                    {
+                        if (r.lane[i].pid >= 0 && r.lane[i].control == p.fd)
+                        {
+                            warm = true;
+                            if (!read_exit(r, r.lane[i]))
+                            {
+                                std::cerr << "trainer: warm " << stages[i].name
+                                          << " exited; restarting it for the next job\n";
+                            }
+                            finish_lane_job(r);
+                        }
+                    }
+                }
+                if (warm)
+                {
+                    continue;
+                }
+
+                // A client request; it is complete at the first newline.
+                char buf[1024];
+                const ssize_t n = read(p.fd, buf, sizeof(buf));
+                std::string &req = pending[p.fd];
+                if (n > 0)
+                {
+                    req.append(buf, static_cast<std::size_t>(n));
+                }
+                const std::size_t nl = req.find('\n');
+                if (nl == std::string::npos)
+                {
+                    if (n <= 0 || req.size() > 4096)
+                    {
+                        close(p.fd);
+                        pending.erase(p.fd);
+                    }
+                    continue;
+                }
+                const std::string line = req.substr(0, nl);
+                pending.erase(p.fd);
+
+                Job job;
+                std::string err;
+                if (line == "SHUTDOWN")
+                {
+                    draining = true;
+                    reply(p.fd, "OK draining " + std::to_string(queue.size()) + " queued jobs");
+                    close(p.fd);
+                }
+                else if (!parse_job(line, job, err))
+                {
+                    reply(p.fd, "ERROR " + err);
+                    close(p.fd);
+                }
+                else
+                {
+                    job.id = next_id++;
+                    job.seq = seq++;
+                    job.client = p.fd;
+                    reply(p.fd, "QUEUED " + std::to_string(job.id) + " " +
+                                    std::to_string(jobs_ahead(queue, job)));
+                    queue.push_back(job);
+                    std::push_heap(queue.begin(), queue.end(), runs_after);
+                }
+            }
+        }
+
+        // Refuse what is still queued; running jobs finish first.
+        close(listen_fd);
+        unlink(opt.socket_path.c_str());
+        for (const Job &job : queue)
+        {
+            reply(job.client, "ERROR daemon shutting down");
+            close(job.client);
+        }
+        for (const auto &p : pending)
+        {
+            close(p.first);
+        }
+        for (Runner &r : runners)
+        {
+            if (r.job != 0 && r.done >= 0)
+            {
+                close(r.done);
+                waitpid(r.pid, nullptr, 0);
+            }
+            for (Warm &w : r.lane)
+            {
+                if (w.busy)
+                {
+                    read_exit(r, w);
+                }
+            }
+            finish_lane_job(r);
+            for (Warm &w : r.lane)
+            {
+                stop_warm(w);
+            }
+        }
+        std::cerr << "trainer: daemon stopped\n";
+        return 0;
+    }
+
+    int submit(const std::string &socket_path, const std::string &request)
+    {
+        const int fd = connect_unix(socket_path);
+        if (fd < 0)
+        {
+            std::cerr << "trainer: no daemon on " << socket_path << "\n";
+            return 1;
+        }
+        reply(fd, request);
+
+        // Copy everything through; remember how the job ended.
+        int rc = 1;
+        std::string line;
+        char buf[65536];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR))
+        {
+            if (n < 0)
+            {
+                continue;
+            }
+            std::cout.write(buf, n);
+            for (ssize_t i = 0; i < n; ++i)
+            {
+                if (buf[i] != '\n')
+                {
+                    line.push_back(buf[i]);
+                    continue;
+                }
+                int status = 0;
+                unsigned long id = 0;
+                if (std::sscanf(line.c_str(), "DONE %lu %d", &id, &status) == 2)
+                {
+                    rc = status;
+                }
+                else if (line.compare(0, 3, "OK ") == 0)
+                {
+                    rc = 0;
+                }
+                line.clear();
+            }
+        }
+        std::cout.flush();
+        close(fd);
+        return rc;
+    }
+
+} // namespace job_server
@@ -0,0 +1,467 @@
+/// @file lbfgs.cpp
+/// @brief Implementation of the lbfgs executable.
+#include "lbfgs.hpp"
+#include "common.hpp"
+#include "dataset.hpp"
+#include "math_layer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    /// @brief Samples per gradient shard (the unit of the reduction).
+    constexpr std::size_t SHARD = 1024;
+
+    /// @brief Samples copied out of the mapping per gradient call.
+    constexpr std::size_t BLOCK = 256;
+
+    /// @brief Armijo sufficient-decrease constant.
+    constexpr double ARMIJO_C1 = 1e-4;
+
+    /// @brief Halvings of the step before the line search gives up.
+    constexpr int MAX_BACKTRACKS = 40;
+
+    /**
+     * @brief Read a positive integer from an environment variable.
+     *
+     * @param name     Variable name.
+     * @param fallback Value used if unset or invalid.
+     * @return Parsed value.
+     */
+    long env_long(const char *name, long fallback)
+    {
+        const char *env = std::getenv(name);
+        if (!env || !*env)
+        {
+            return fallback;
+        }
+        char *end = nullptr;
+        const long v = std::strtol(env, &end, 10);
+        return (end && *end == '\0' && v > 0) ? v : fallback;
+    }
+
+    /// @brief As env_long() for a positive real number.
+    double env_double(const char *name, double fallback)
+    {
+        const char *env = std::getenv(name);
+        if (!env || !*env)
+        {
+            return fallback;
+        }
+        char *end = nullptr;
+        const double v = std::strtod(env, &end);
+        return (end && *end == '\0' && v > 0.0) ? v : fallback;
+    }
+
+    double dot(const std::vector<double> &a, const std::vector<double> &b)
+    {
+        double sum = 0.0;
+        for (std::size_t i = 0; i < a.size(); ++i)
+        {
+            sum += a[i] * b[i];
+        }
+        return sum;
+    }
+
+    /**
+     * @brief Mean loss and gradient over the whole mapped dataset.
+     *
+     * Thread t handles shards t, t + T, t + 2T, ... with its own
+     * TrainState (the model's scratch buffers). The sums of shard s go
+     * to slot s and are added up in shard order afterwards, so the
+     * result is the same for every thread count. Threads 1..T-1 are
+     * started once and woken for each evaluation; the caller's thread
+     * is thread 0.
+     */
+    class Objective
+    {
+    public:
+        Objective(const dataset::MappedDataset &ds, const math::TrainConfig &config, int threads)
+            : ds_(ds), shards_((ds.count + SHARD - 1) / SHARD)
+        {
+            const std::size_t n = std::max<std::size_t>(1, std::min<std::size_t>(threads, shards_));
+            for (std::size_t t = 0; t < n; ++t)
+            {
+                workers_.push_back(Worker{math::make_train_state(common::INPUT_DIM, config), {}, {}, {}, {}, {}});
+            }
+            params_ = workers_.front().st.model.params.size();
+            shard_grad_.resize(shards_ * params_);
+            shard_loss_.resize(shards_);
+            for (std::size_t t = 1; t < n; ++t)
+            {
+                threads_.emplace_back(&Objective::loop, this, t);
+            }
+        }
+
+        ~Objective()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            for (std::thread &th : threads_)
+            {
+                th.join();
+            }
+        }
+
+        Objective(const Objective &) = delete;
+        Objective &operator=(const Objective &) = delete;
+
+        /// @brief The initial model (shape and starting parameters).
+        const math::Model &model() const { return workers_.front().st.model; }
+
+        std::size_t threads() const { return workers_.size(); }
+
+        std::uint64_t evaluations() const { return evaluations_; }
+
+        /**
+         * @brief Evaluate at w.
+         *
+         * @param w    Parameters (model layout).
+         * @param grad Output mean gradient.
+         * @return Mean loss.
+         */
+        double operator()(const std::vector<double> &w, std::vector<double> &grad)
+        {
+            ++evaluations_;
+            for (Worker &wk : workers_)
+            {
+                std::copy(w.begin(), w.end(), wk.st.model.params.begin());
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                ++round_;
+                running_ = threads_.size();
+            }
+            cv_.notify_all();
+            work(0);
+            {
+                std::unique_lock<std::mutex> lock(mu_);
+                cv_.wait(lock, [this] { return running_ == 0; });
+            }
+
+            grad.assign(params_, 0.0);
+            double loss = 0.0;
+            for (std::size_t s = 0; s < shards_; ++s)
+            {
+                const double *g = &shard_grad_[s * params_];
+                for (std::size_t j = 0; j < params_; ++j)
+                {
+                    grad[j] += g[j];
+                }
+                loss += shard_loss_[s];
+            }
+            const double scale = ds_.count ? 1.0 / ds_.count : 0.0;
+            for (double &g : grad)
+            {
+                g *= scale;
+            }
+            return loss * scale;
+        }
+
+    private:
+        struct Worker
+        {
+            math::TrainState st;
+            std::vector<float> x;     ///< Features of a block, row-major.
+            std::vector<float> y;
+            std::vector<float> loss;
+            std::vector<float> y_hat;
+            std::vector<float> grad;  ///< Float gradient of a block.
+        };
+
+        /// @brief Body of thread t: one work(t) per evaluation round.
+        void loop(std::size_t t)
+        {
+            std::uint64_t seen = 0;
+            std::unique_lock<std::mutex> lock(mu_);
+            for (;;)
+            {
+                cv_.wait(lock, [this, seen] { return stop_ || round_ != seen; });
+                if (stop_)
+                {
+                    return;
+                }
+                seen = round_;
+                lock.unlock();
+                work(t);
+                lock.lock();
+                if (--running_ == 0)
+                {
+                    cv_.notify_all();
+                }
+            }
+        }
+
+        void work(std::size_t t)
+        {
+            Worker &wk = workers_[t];
+            wk.x.resize(BLOCK * common::INPUT_DIM);
+            wk.y.resize(BLOCK);
+            wk.loss.resize(BLOCK);
+            wk.y_hat.resize(BLOCK);
+            wk.grad.resize(params_);
+
+            for (std::size_t s = t; s < shards_; s += workers_.size())
+            {
+                double *g = &shard_grad_[s * params_];
+                std::fill(g, g + params_, 0.0);
+                double loss = 0.0;
+
+                const std::size_t end = std::min(ds_.count, (s + 1) * SHARD);
+                for (std::size_t i = s * SHARD; i < end; i += BLOCK)
+                {
+                    // Samples are strided in the mapping; the batched
+                    // gradient wants packed rows.
+                    const std::size_t n = std::min(BLOCK, end - i);
+                    for (std::size_t k = 0; k < n; ++k)
+                    {
+                        const common::Sample &smp = ds_.samples[i + k];
+                        std::copy(smp.x, smp.x + common::INPUT_DIM, &wk.x[k * common::INPUT_DIM]);
+                        wk.y[k] = smp.y;
+                    }
+                    std::fill(wk.grad.begin(), wk.grad.end(), 0.0f);
+                    math::accumulate_gradient_batch(wk.st, wk.x.data(), wk.y.data(), n,
+                                                    wk.grad.data(), wk.loss.data(), wk.y_hat.data());
+                    for (std::size_t j = 0; j < params_; ++j)
+                    {
+                        g[j] += wk.grad[j];
+                    }
+                    for (std::size_t k = 0; k < n; ++k)
+                    {
+                        loss += wk.loss[k];
+                    }
+                }
+                shard_loss_[s] = loss;
+            }
+        }
+
+        const dataset::MappedDataset &ds_;
+        std::size_t shards_;
+        std::size_t params_ = 0;
+        std::vector<Worker> workers_;
+        std::vector<double> shard_grad_; ///< shards_ x params_ partial sums.
+        std::vector<double> shard_loss_;
+        std::uint64_t evaluations_ = 0;
+
+        std::mutex mu_;
+        std::condition_variable cv_;
+        std::uint64_t round_ = 0;   ///< Evaluations started.
+        std::size_t running_ = 0;   ///< Threads still working on this round.
+        bool stop_ = false;
+        std::vector<std::thread> threads_;
+    };
+
+    /// @brief One curvature pair of the L-BFGS history.
+    struct Pair
+    {
+        std::vector<double> s; ///< Parameter change.
+        std::vector<double> y; ///< Gradient change.
+        double rho;            ///< 1 / (s . y)
+    };
+
+    /**
+     * @brief L-BFGS two-loop recursion: d = -H g for the inverse Hessian
+     *        approximation H built from the history.
+     */
+    void direction(const std::deque<Pair> &history, const std::vector<double> &g, std::vector<double> &d)
+    {
+        d = g;
+        std::vector<double> alpha(history.size());
+        for (std::size_t i = history.size(); i-- > 0;)
+        {
+            alpha[i] = history[i].rho * dot(history[i].s, d);
+            for (std::size_t j = 0; j < d.size(); ++j)
+            {
+                d[j] -= alpha[i] * history[i].y[j];
+            }
+        }
+        if (!history.empty())
+        {
+            const Pair &last = history.back();
+            const double gamma = 1.0 / (last.rho * dot(last.y, last.y));
+            for (double &v : d)
+            {
+                v *= gamma;
+            }
+        }
+        for (std::size_t i = 0; i < history.size(); ++i)
+        {
+            const double beta = history[i].rho * dot(history[i].y, d);
+            for (std::size_t j = 0; j < d.size(); ++j)
+            {
+                d[j] += history[i].s[j] * (alpha[i] - beta);
+            }
+        }
+        for (double &v : d)
+        {
+            v = -v;
+        }
+    }
+} // namespace
+
+namespace lbfgs
+{
+    int run(const std::string &csv_path)
+    {
+        const long max_iters = env_long("LBFGS_ITERS", 100);
+        const std::size_t memory = static_cast<std::size_t>(env_long("LBFGS_HISTORY", 10));
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        const int threads = static_cast<int>(env_long("LBFGS_THREADS", cpus > 0 ? cpus : 1));
+        const double gtol = env_double("LBFGS_GTOL", 1e-6);
+        const double ftol = env_double("LBFGS_FTOL", 1e-9);
+        const char *model_env = std::getenv("MODEL_FILE");
+        const std::string model_path = (model_env && *model_env) ? model_env : "logs/model_params.txt";
+
+        math::TrainConfig config;
+        const char *spec = std::getenv("LBFGS_CONFIG");
+        if (spec && !math::parse_train_config(spec, config))
+        {
+            std::cerr << "lbfgs: bad LBFGS_CONFIG: " << spec << '\n';
+            return 1;
+        }
+
+        const std::string cache_path = dataset::default_cache_path(csv_path);
+        dataset::MappedDataset ds;
+        if (!dataset::ensure_cache(csv_path, cache_path) ||
+            !dataset::map_dataset(cache_path, ds))
+        {
+            return 1;
+        }
+        if (ds.count == 0)
+        {
+            std::cerr << "lbfgs: no samples in " << csv_path << '\n';
+            dataset::unmap_dataset(ds);
+            return 1;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        Objective objective(ds, config, threads);
+        math::Model model = objective.model();
+        std::cerr << "lbfgs: " << ds.count << " samples, " << model.params.size()
+                  << " parameters, " << objective.threads() << " threads, history "
+                  << memory << ", cache " << cache_path << '\n';
+
+        std::vector<double> w(model.params.begin(), model.params.end());
+        std::vector<double> g;
+        double f = objective(w, g);
+        double gnorm = std::sqrt(dot(g, g));
+
+        std::deque<Pair> history;
+        std::vector<double> d, w_next, g_next;
+        long iter = 0;
+        while (iter < max_iters && gnorm > gtol)
+        {
+            direction(history, g, d);
+            double slope = dot(g, d);
+            if (slope >= 0.0)
+            {
+                // Not a descent direction: start over from steepest descent.
+                history.clear();
+                d = g;
+                for (double &v : d)
+                {
+                    v = -v;
+                }
+                slope = -gnorm * gnorm;
+            }
+
+            // A unit step suits a scaled quasi-Newton direction; the very
+            // first (plain gradient) step is kept to unit length.
+            double step = history.empty() ? std::min(1.0, 1.0 / gnorm) : 1.0;
+            double f_next = 0.0;
+            bool accepted = false;
+            w_next.resize(w.size());
+            for (int k = 0; k < MAX_BACKTRACKS; ++k, step *= 0.5)
+            {
+                for (std::size_t j = 0; j < w.size(); ++j)
+                {
+                    w_next[j] = w[j] + step * d[j];
+                }
+                f_next = objective(w_next, g_next);
+                if (f_next <= f + ARMIJO_C1 * step * slope)
+                {
+                    accepted = true;
+                    break;
+                }
+            }
+            if (!accepted)
+            {
+                std::cerr << "lbfgs: line search found no decrease at iteration " << iter + 1 << '\n';
+                break;
+            }
+
+            Pair p{std::vector<double>(w.size()), std::vector<double>(w.size()), 0.0};
+            for (std::size_t j = 0; j < w.size(); ++j)
+            {
+                p.s[j] = w_next[j] - w[j];
+                p.y[j] = g_next[j] - g[j];
+            }
+            // Armijo alone does not guarantee positive curvature; a pair
+            // without it would make H indefinite.
+            const double sy = dot(p.s, p.y);
+            if (sy > 1e-12 * std::sqrt(dot(p.s, p.s) * dot(p.y, p.y)))
+            {
+                p.rho = 1.0 / sy;
+                history.push_back(std::move(p));
+                if (history.size() > memory)
+                {
+                    history.pop_front();
+                }
+            }
+
+            const double decrease = f - f_next;
+            w.swap(w_next);
+            g.swap(g_next);
+            f = f_next;
+            gnorm = std::sqrt(dot(g, g));
+            ++iter;
+            std::cout << "ITER " << iter << ' ' << f << ' ' << gnorm << ' ' << step << ' '
+                      << objective.evaluations() << '\n';
+            if (decrease <= ftol * std::max(1.0, std::fabs(f)))
+            {
+                break;
+            }
+        }
+        dataset::unmap_dataset(ds);
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "LBFGS_SUMMARY " << iter << ' ' << objective.evaluations() << ' ' << f << ' '
+                  << gnorm << ' ' << seconds << '\n';
+
+        std::copy(w.begin(), w.end(), model.params.begin());
+        if (!math::save_model(model_path, model))
+        {
+            std::cerr << "lbfgs: failed to save parameters to " << model_path << '\n';
+            return 1;
+        }
+        std::cerr << "lbfgs: saved parameters to " << model_path << '\n';
+        return 0;
+    }
+
+} // namespace lbfgs
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: lbfgs <csv_path>\n";
+        return 1;
+    }
+    return lbfgs::run(argv[1]);
+}
@@ -1,6 +1,7 @@
 /// @file logger.cpp
 /// @brief Implementation of the logger executable.
 #include "logger.hpp"
+#include "stage_io.hpp"
 
 #include <atomic>
 #include <csignal>
@@ -8,6 +9,7 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 namespace
 {
@@ -36,6 +38,13 @@ namespace
     {
         g_terminate_requested.store(true);
     }
+
+    /// @brief Running totals for one model's (loss, y_hat) column.
+    struct Totals
+    {
+        double loss = 0.0;
+        double yhat = 0.0;
+    };
 } // namespace
 
 namespace logger
@@ -43,18 +52,28 @@ namespace logger
     int run()
     {
         std::ios::sync_with_stdio(false);
-
-        // Install signal handlers.
+        stage_io::Capture capture("logger");
+        stage_io::Progress &progress = stage_io::progress();
+        stage_io::Quarantine quarantine("logger");
+        const stage_io::MemoryShare memory("logger");
+
+        // Install signal handlers. A served logger (--serve) runs once
+        // per job; requests from an earlier job do not carry over.
+        g_dump_requested.store(false);
+        g_terminate_requested.store(false);
         std::signal(SIGUSR1, handle_sigusr1);
         std::signal(SIGTERM, handle_sigterm);
 
         std::size_t count = 0;
-        double total_loss = 0.0;
-        double total_yhat = 0.0;
+        std::vector<Totals> totals;       // one entry per model column
+        std::vector<float> losses, y_hats; // current line
 
         std::string line;
+        std::uint64_t offset = 0; // of the next input line
         while (std::getline(std::cin, line))
         {
+            const std::uint64_t at = offset;
+            offset += line.size() + 1;
             if (line.empty())
             {
                 if (g_terminate_requested.load())
@@ -64,37 +83,65 @@ namespace logger
                 continue;
             }
 
+            progress.count_in();
             int id = 0;
-            float loss = 0.0f;
-            float y_hat = 0.0f;
+            losses.clear();
+            y_hats.clear();
 
             {
                 std::stringstream ss(line);
-                if (!(ss >> id >> loss >> y_hat))
+                float loss = 0.0f;
+                float y_hat = 0.0f;
+                const bool has_id = static_cast<bool>(ss >> id);
+                while (has_id && ss >> loss >> y_hat)
+                {
+                    losses.push_back(loss);
+                    y_hats.push_back(y_hat);
+                }
+                if (!has_id || losses.empty())
+                {
+                    quarantine.add("format", at, line);
+                    continue;
+                }
+                if (!totals.empty() && losses.size() != totals.size())
                 {
-                    std::cerr << "logger: failed to parse line: "
-                              << line << std::endl;
+                    quarantine.add("model_count", at, line);
                     continue;
                 }
             }
 
+            if (totals.empty())
+            {
+                totals.resize(losses.size());
+            }
+
             ++count;
-            total_loss += static_cast<double>(loss);
-            total_yhat += static_cast<double>(y_hat);
+            for (std::size_t k = 0; k < totals.size(); ++k)
+            {
+                totals[k].loss += static_cast<double>(losses[k]);
+                totals[k].yhat += static_cast<double>(y_hats[k]);
+            }
 
-            // Per-sample line for downstream logging / progress.
+            // Per-sample line for downstream logging / progress
+            // (first model only when several are evaluated).
             std::cout << "SAMPLE " << id
-                      << " LOSS " << loss
-                      << " YHAT " << y_hat << '\n';
+                      << " LOSS " << losses[0]
+                      << " YHAT " << y_hats[0] << '\n';
+            progress.count_out();
 
             if (g_dump_requested.load())
             {
                 g_dump_requested.store(false);
-                if (count > 0)
+                for (std::size_t k = 0; k < totals.size(); ++k)
                 {
-                    const double avg_loss = total_loss / static_cast<double>(count);
-                    const double avg_yhat = total_yhat / static_cast<double>(count);
-                    std::cerr << "[LOGGER SNAPSHOT] samples=" << count
+                    const double avg_loss = totals[k].loss / static_cast<double>(count);
+                    const double avg_yhat = totals[k].yhat / static_cast<double>(count);
+                    std::cerr << "[LOGGER SNAPSHOT] ";
+                    if (totals.size() > 1)
+                    {
+                        std::cerr << "model=" << k << ' ';
+                    }
+                    std::cerr << "samples=" << count
                               << " avg_loss=" << avg_loss
                               << " avg_yhat=" << avg_yhat << std::endl;
                 }
@@ -109,15 +156,27 @@ namespace logger
         // Final summary.
         if (count > 0)
         {
-            const double avg_loss = total_loss / static_cast<double>(count);
-            const double avg_yhat = total_yhat / static_cast<double>(count);
-
             // Machine-readable summary on stdout for the shell script:
-            // SUMMARY <samples> <avg_loss> <avg_yhat>
-            std::cout << "SUMMARY "
-                      << count << ' '
-                      << std::setprecision(6) << avg_loss << ' '
-                      << std::setprecision(6) << avg_yhat << '\n';
+            //   SUMMARY <samples> <avg_loss> <avg_yhat>
+            // or, with several models,
+            //   SUMMARY_MODEL <k> <samples> <avg_loss> <avg_yhat>
+            for (std::size_t k = 0; k < totals.size(); ++k)
+            {
+                const double avg_loss = totals[k].loss / static_cast<double>(count);
+                const double avg_yhat = totals[k].yhat / static_cast<double>(count);
+
+                if (totals.size() > 1)
+                {
+                    std::cout << "SUMMARY_MODEL " << k << ' ';
+                }
+                else
+                {
+                    std::cout << "SUMMARY ";
+                }
+                std::cout << count << ' '
+                          << std::setprecision(6) << avg_loss << ' '
+                          << std::setprecision(6) << avg_yhat << '\n';
+            }
         }
         else
         {
@@ -130,7 +189,25 @@ namespace logger
 
 } // namespace logger
 
-int main()
+int main(int argc, char *argv[])
 {
+    int control = -1;
+    if (stage_io::parse_serve_args(argc, argv, control))
+    {
+        return stage_io::serve("logger", control,
+                               [](const std::vector<std::string> &) { return logger::run(); });
+    }
+
+    stage_io::ReplayOptions replay;
+    const int replay_args = stage_io::parse_replay_args(argc, argv, replay);
+    if (replay_args > 0)
+    {
+        return stage_io::replay("logger", replay, logger::run);
+    }
+    if (replay_args < 0 || argc != 1)
+    {
+        std::cerr << "Usage: logger [--replay <file> [--repeat N] | --serve <fd>]\n";
+        return 1;
+    }
     return logger::run();
 }
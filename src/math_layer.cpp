@@ -9,21 +9,21 @@
 
 #include "math_layer.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
 
 namespace
 {
     using common::INPUT_DIM;
     using common::Sample;
 
-    /// @brief Hidden layer size for the small neural network.
-    constexpr std::size_t HIDDEN_DIM = 8;
-
-    /// @brief Learning rate for SGD.
-    constexpr float LEARNING_RATE = 0.001f;
-
     /// @brief Per-feature mean (for normalization).
     ///
     /// The synthetic data is generated with features ~ N(0, 1),
@@ -35,30 +35,8 @@ namespace
     constexpr std::array<float, INPUT_DIM> FEATURE_STD = {
         1.0f, 1.0f, 1.0f, 1.0f};
 
-    /// @brief Input-to-hidden weights W1[j][k] (j: hidden, k: input).
-    std::array<std::array<float, INPUT_DIM>, HIDDEN_DIM> g_W1 = {{
-        {{ 0.10f,  0.00f,  0.00f,  0.00f }},
-        {{ 0.00f,  0.10f,  0.00f,  0.00f }},
-        {{ 0.00f,  0.00f,  0.10f,  0.00f }},
-        {{ 0.00f,  0.00f,  0.00f,  0.10f }},
-        {{-0.10f,  0.00f,  0.00f,  0.00f }},
-        {{ 0.00f, -0.10f,  0.00f,  0.00f }},
-        {{ 0.00f,  0.00f, -0.10f,  0.00f }},
-        {{ 0.00f,  0.00f,  0.00f, -0.10f }},
-    }};
-
-    /// @brief Hidden biases b1[j].
-    std::array<float, HIDDEN_DIM> g_b1 = {
-        0.0f, 0.0f, 0.0f, 0.0f,
-        0.0f, 0.0f, 0.0f, 0.0f};
-
-    /// @brief Hidden-to-output weights w2[j].
-    std::array<float, HIDDEN_DIM> g_w2 = {
-        0.05f,  0.05f,  0.05f,  0.05f,
-       -0.05f, -0.05f, -0.05f, -0.05f};
-
-    /// @brief Output bias.
-    float g_b2 = 0.0f;
+    /// @brief Model trained by the single-model API (compute_forward etc.).
+    math::TrainState g_state = math::make_train_state(INPUT_DIM, math::TrainConfig{});
 
     /**
      * @brief Apply per-feature normalization.
@@ -100,101 +78,123 @@ namespace
     /**
      * @brief Forward pass through hidden and output layers.
      *
-     * @param s    Input sample (features in s.x).
-     * @param z1   Output pre-activations of hidden layer (size HIDDEN_DIM).
-     * @param a1   Output activations of hidden layer (size HIDDEN_DIM).
+     * @param m    Model to evaluate.
+     * @param x    Input features (m.input_dim values).
+     * @param z1   Output pre-activations of hidden layer (size hidden_dim).
+     * @param a1   Output activations of hidden layer (size hidden_dim).
      * @param yhat Output scalar prediction.
      */
-    void forward_all(const Sample &s,
-                     std::array<float, HIDDEN_DIM> &z1,
-                     std::array<float, HIDDEN_DIM> &a1,
+    void forward_all(const math::Model &m,
+                     const float *x,
+                     float *z1,
+                     float *a1,
                      float &yhat)
     {
+        const float *W1 = m.W1();
+        const float *b1 = m.b1();
+        const float *w2 = m.w2();
+
         // Hidden layer
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+        for (std::size_t j = 0; j < m.hidden_dim; ++j)
         {
-            float z = g_b1[j];
-            for (std::size_t k = 0; k < INPUT_DIM; ++k)
+            float z = b1[j];
+            for (std::size_t k = 0; k < m.input_dim; ++k)
             {
-                z += g_W1[j][k] * s.x[k];
+                z += W1[j * m.input_dim + k] * x[k];
             }
             z1[j] = z;
             a1[j] = relu(z);
         }
 
         // Output layer (linear)
-        float z2 = g_b2;
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+        float z2 = m.b2();
+        for (std::size_t j = 0; j < m.hidden_dim; ++j)
         {
-            z2 += g_w2[j] * a1[j];
+            z2 += w2[j] * a1[j];
         }
         yhat = z2;
     }
 
     /**
-     * @brief Compute loss and gradients, and update parameters.
+     * @brief Compute loss and accumulate gradients.
      *
-     * Uses MSE loss and SGD on the 2-layer network:
+     * Uses MSE loss on the 2-layer network:
      *   L = 0.5 * (y_hat - y)^2.
      *
-     * @param s            Input sample (features + label).
-     * @param y_hat        Prediction from forward pass.
-     * @param z1           Hidden pre-activations (size HIDDEN_DIM).
-     * @param a1           Hidden activations (size HIDDEN_DIM).
-     * @param loss_out     Output loss.
-     * @param grad_norm_out Output L2 norm of the gradient.
+     * @param m        Model the gradient is taken of.
+     * @param x        Input features (m.input_dim values).
+     * @param y        Target label.
+     * @param y_hat    Prediction from forward pass.
+     * @param z1       Hidden pre-activations (size hidden_dim).
+     * @param a1       Hidden activations (size hidden_dim).
+     * @param grad     Gradient accumulator (model layout).
+     * @param loss_out Output loss.
      */
-    void backward_internal(const Sample &s,
+    void backward_internal(const math::Model &m,
+                           const float *x,
+                           float y,
                            float y_hat,
-                           const std::array<float, HIDDEN_DIM> &z1,
-                           const std::array<float, HIDDEN_DIM> &a1,
-                           float &loss_out,
-                           float &grad_norm_out)
+                           const float *z1,
+                           const float *a1,
+                           float *grad,
+                           float &loss_out)
     {
-        const float diff = y_hat - s.y;
+        const std::size_t H = m.hidden_dim;
+        const std::size_t D = m.input_dim;
+        const float diff = y_hat - y;
 
         // Loss: 0.5 * (y_hat - y)^2
         loss_out = 0.5f * diff * diff;
 
-        // Output layer gradients
-        float dL_dz2 = diff;
+        float *dL_dW1 = grad;
+        float *dL_db1 = dL_dW1 + H * D;
+        float *dL_dw2 = dL_db1 + H;
+        float &dL_db2 = dL_dw2[H];
 
-        std::array<float, HIDDEN_DIM> dL_dw2{};
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+        // Output layer gradients
+        const float dL_dz2 = diff;
+        const float *w2 = m.w2();
+        for (std::size_t j = 0; j < H; ++j)
         {
-            dL_dw2[j] = dL_dz2 * a1[j];
+            dL_dw2[j] += dL_dz2 * a1[j];
         }
-        float dL_db2 = dL_dz2;
+        dL_db2 += dL_dz2;
 
-        // Backprop into hidden layer
-        std::array<float, HIDDEN_DIM> dL_dz1{};
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+        // Backprop into hidden layer and input-to-hidden gradients
+        for (std::size_t j = 0; j < H; ++j)
         {
-            float dL_da1 = dL_dz2 * g_w2[j];
-            dL_dz1[j] = (z1[j] > 0.0f) ? dL_da1 : 0.0f;
-        }
-
-        // Input-to-hidden gradients
-        std::array<std::array<float, INPUT_DIM>, HIDDEN_DIM> dL_dW1{};
-        std::array<float, HIDDEN_DIM> dL_db1{};
+            const float dL_da1 = dL_dz2 * w2[j];
+            const float dL_dz1 = (z1[j] > 0.0f) ? dL_da1 : 0.0f;
 
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
-        {
-            dL_db1[j] = dL_dz1[j];
-            for (std::size_t k = 0; k < INPUT_DIM; ++k)
+            dL_db1[j] += dL_dz1;
+            for (std::size_t k = 0; k < D; ++k)
             {
-                dL_dW1[j][k] = dL_dz1[j] * s.x[k];
+                dL_dW1[j * D + k] += dL_dz1 * x[k];
             }
         }
+    }
+
+    /**
+     * @brief L2 norm of a gradient in model layout.
+     *
+     * @param m    Model whose layout grad follows.
+     * @param grad Gradient.
+     * @return sqrt(sum(g^2)), accumulated in double.
+     */
+    float gradient_norm(const math::Model &m, const float *grad)
+    {
+        const std::size_t H = m.hidden_dim;
+        const std::size_t D = m.input_dim;
+        const float *dL_db1 = grad + H * D;
+        const float *dL_dw2 = dL_db1 + H;
 
-        // Gradient norm
         double norm_sq = 0.0;
 
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+        for (std::size_t j = 0; j < H; ++j)
         {
-            for (std::size_t k = 0; k < INPUT_DIM; ++k)
+            for (std::size_t k = 0; k < D; ++k)
             {
-                const float g = dL_dW1[j][k];
+                const float g = grad[j * D + k];
                 norm_sq += static_cast<double>(g) * g;
             }
             const float gb1 = dL_db1[j];
@@ -202,59 +202,376 @@ namespace
             norm_sq += static_cast<double>(gb1) * gb1;
             norm_sq += static_cast<double>(gw2) * gw2;
         }
-        norm_sq += static_cast<double>(dL_db2) * dL_db2;
+        norm_sq += static_cast<double>(dL_dw2[H]) * dL_dw2[H];
+
+        return static_cast<float>(std::sqrt(norm_sq));
+    }
+
+    /**
+     * @brief One value per sample of a block, as a GCC vector.
+     *
+     * The compiler lowers operations on it to the target's SIMD width,
+     * so the batched kernels vectorize at -O2 without intrinsics.
+     */
+    typedef float Lanes __attribute__((vector_size(sizeof(float) * math::BATCH_BLOCK)));
+
+    /// @brief Load BATCH_BLOCK floats (no alignment requirement).
+    inline Lanes load_lanes(const float *p)
+    {
+        Lanes v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    /// @brief Store BATCH_BLOCK floats (no alignment requirement).
+    inline void store_lanes(float *p, const Lanes &v)
+    {
+        std::memcpy(p, &v, sizeof(v));
+    }
+
+    /// @brief Sum of all lanes.
+    inline float sum_lanes(const Lanes &v)
+    {
+        float s = 0.0f;
+        for (std::size_t b = 0; b < math::BATCH_BLOCK; ++b)
+        {
+            s += v[b];
+        }
+        return s;
+    }
 
-        grad_norm_out = static_cast<float>(std::sqrt(norm_sq));
+    /**
+     * @brief Forward pass of one block of at most BATCH_BLOCK samples.
+     *
+     * Transposes the block's features into xt (D x B) and computes the
+     * pre-activations z (H x B) and predictions, one sample per lane.
+     * A short block is zero-padded; callers ignore the padded lanes.
+     *
+     * @return Number of real samples in the block.
+     */
+    std::size_t forward_block(const math::Model &m,
+                              const float *X,
+                              std::size_t n,
+                              float *xt,
+                              float *z,
+                              Lanes &y_hat)
+    {
+        constexpr std::size_t B = math::BATCH_BLOCK;
+        const std::size_t D = m.input_dim;
+        const std::size_t H = m.hidden_dim;
+        const std::size_t nb = std::min(n, B);
+        const float *W1 = m.W1();
+        const float *b1 = m.b1();
+        const float *w2 = m.w2();
+        const Lanes zero = {};
+
+        for (std::size_t k = 0; k < D; ++k)
+        {
+            for (std::size_t b = 0; b < nb; ++b)
+            {
+                xt[k * B + b] = X[b * D + k];
+            }
+            std::fill(xt + k * B + nb, xt + (k + 1) * B, 0.0f);
+        }
 
-        // Parameter update (SGD)
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+        y_hat = zero + m.b2();
+        for (std::size_t j = 0; j < H; ++j)
         {
-            for (std::size_t k = 0; k < INPUT_DIM; ++k)
+            Lanes zj = zero + b1[j];
+            for (std::size_t k = 0; k < D; ++k)
             {
-                g_W1[j][k] -= LEARNING_RATE * dL_dW1[j][k];
+                zj += W1[j * D + k] * load_lanes(xt + k * B);
             }
-            g_b1[j] -= LEARNING_RATE * dL_db1[j];
-            g_w2[j] -= LEARNING_RATE * dL_dw2[j];
+            store_lanes(z + j * B, zj);
+            y_hat += w2[j] * (zj > 0.0f ? zj : zero);
         }
-        g_b2 -= LEARNING_RATE * dL_db2;
+        return nb;
+    }
+
+    /// @brief Below this many samples the padded block costs more than it saves.
+    constexpr std::size_t SCALAR_TAIL = math::BATCH_BLOCK / 4;
+
+    /// @brief Size the batch scratch: xt (D x B) and z (H x B).
+    void reserve_batch(math::TrainState &st)
+    {
+        const math::Model &m = st.model;
+        st.batch.resize((m.input_dim + m.hidden_dim) * math::BATCH_BLOCK);
     }
 
 } // namespace
 
 namespace math
 {
-    void normalize_sample(common::Sample &s)
+    Model make_model(std::size_t input_dim, std::size_t hidden_dim)
     {
-        normalize_features(s.x);
+        Model m;
+        m.input_dim = input_dim;
+        m.hidden_dim = hidden_dim;
+        m.params.assign(hidden_dim * input_dim + 2 * hidden_dim + 1, 0.0f);
+
+        float *W1 = m.W1();
+        float *w2 = m.w2();
+        for (std::size_t j = 0; j < hidden_dim && input_dim > 0; ++j)
+        {
+            const float sign = ((j / input_dim) % 2 == 0) ? 1.0f : -1.0f;
+            W1[j * input_dim + j % input_dim] = sign * 0.10f;
+            w2[j] = sign * 0.05f;
+        }
+        return m;
     }
 
-    void augment_features(common::Sample &s)
+    float forward(const Model &m, const float *x)
     {
-        augment(s.x);
+        const float *W1 = m.W1();
+        const float *b1 = m.b1();
+        const float *w2 = m.w2();
+
+        float z2 = m.b2();
+        for (std::size_t j = 0; j < m.hidden_dim; ++j)
+        {
+            float z = b1[j];
+            for (std::size_t k = 0; k < m.input_dim; ++k)
+            {
+                z += W1[j * m.input_dim + k] * x[k];
+            }
+            z2 += w2[j] * relu(z);
+        }
+        return z2;
     }
 
-    void compute_forward(const common::Sample &s, float &y_hat)
+    TrainState make_train_state(std::size_t input_dim, const TrainConfig &config)
     {
-        std::array<float, HIDDEN_DIM> z1{};
-        std::array<float, HIDDEN_DIM> a1{};
-        forward_all(s, z1, a1, y_hat);
+        TrainState st;
+        st.model = make_model(input_dim, config.hidden_dim);
+        st.config = config;
+        st.velocity.assign(st.model.params.size(), 0.0f);
+        st.grad.assign(st.model.params.size(), 0.0f);
+        st.z1.assign(config.hidden_dim, 0.0f);
+        st.a1.assign(config.hidden_dim, 0.0f);
+        return st;
     }
 
-    void compute_backward_and_update(const common::Sample &s,
-                                     float y_hat,
-                                     float &loss_out,
-                                     float &grad_norm)
+    bool parse_train_config(const std::string &spec, TrainConfig &out)
     {
-        std::array<float, HIDDEN_DIM> z1{};
-        std::array<float, HIDDEN_DIM> a1{};
-        float y_hat_check = 0.0f;
-        forward_all(s, z1, a1, y_hat_check);
-        (void)y_hat; // not used; could be checked against y_hat_check if desired.
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            if (item.empty())
+            {
+                continue;
+            }
+            const std::size_t eq = item.find('=');
+            if (eq == std::string::npos)
+            {
+                return false;
+            }
+            const std::string key = item.substr(0, eq);
+            const std::string value = item.substr(eq + 1);
+            std::stringstream vs(value);
 
-        backward_internal(s, y_hat_check, z1, a1, loss_out, grad_norm);
+            if (key == "hidden")
+            {
+                if (!(vs >> out.hidden_dim) || out.hidden_dim == 0) return false;
+            }
+            else if (key == "lr")
+            {
+                if (!(vs >> out.learning_rate)) return false;
+            }
+            else if (key == "momentum")
+            {
+                if (!(vs >> out.momentum)) return false;
+            }
+            else if (key == "opt")
+            {
+                if (value == "sgd") out.optimizer = Optimizer::Sgd;
+                else if (value == "momentum") out.optimizer = Optimizer::Momentum;
+                else return false;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
     }
 
-    bool save_parameters(const std::string &path)
+    void accumulate_gradient(TrainState &st,
+                             const float *x,
+                             float y,
+                             float *grad,
+                             float &loss,
+                             float &y_hat)
+    {
+        forward_all(st.model, x, st.z1.data(), st.a1.data(), y_hat);
+        backward_internal(st.model, x, y, y_hat,
+                          st.z1.data(), st.a1.data(), grad, loss);
+    }
+
+    void apply_gradient(TrainState &st, const float *grad, float scale)
+    {
+        std::vector<float> &p = st.model.params;
+        const float lr = st.config.learning_rate;
+
+        if (st.config.optimizer == Optimizer::Momentum)
+        {
+            const float mu = st.config.momentum;
+            for (std::size_t i = 0; i < p.size(); ++i)
+            {
+                st.velocity[i] = mu * st.velocity[i] + scale * grad[i];
+                p[i] -= lr * st.velocity[i];
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < p.size(); ++i)
+            {
+                p[i] -= lr * (scale * grad[i]);
+            }
+        }
+    }
+
+    void train_step(TrainState &st,
+                    const float *x,
+                    float y,
+                    float &loss,
+                    float &y_hat,
+                    float &grad_norm)
+    {
+        std::fill(st.grad.begin(), st.grad.end(), 0.0f);
+        accumulate_gradient(st, x, y, st.grad.data(), loss, y_hat);
+        grad_norm = gradient_norm(st.model, st.grad.data());
+        apply_gradient(st, st.grad.data(), 1.0f);
+    }
+
+    void forward_batch(TrainState &st, const float *X, std::size_t n, float *y_hat)
+    {
+        const std::size_t D = st.model.input_dim;
+
+        reserve_batch(st);
+        float *xt = st.batch.data();
+        float *z = xt + D * BATCH_BLOCK;
+
+        for (; n > 0 && n < SCALAR_TAIL; --n, X += D)
+        {
+            *y_hat++ = forward(st.model, X);
+        }
+        while (n > 0)
+        {
+            Lanes yb;
+            const std::size_t nb = forward_block(st.model, X, n, xt, z, yb);
+            for (std::size_t b = 0; b < nb; ++b)
+            {
+                y_hat[b] = yb[b];
+            }
+            X += nb * D;
+            y_hat += nb;
+            n -= nb;
+        }
+    }
+
+    void accumulate_gradient_batch(TrainState &st,
+                                   const float *X,
+                                   const float *Y,
+                                   std::size_t n,
+                                   float *grad,
+                                   float *loss,
+                                   float *y_hat)
+    {
+        constexpr std::size_t B = BATCH_BLOCK;
+        const Model &m = st.model;
+        const std::size_t D = m.input_dim;
+        const std::size_t H = m.hidden_dim;
+        const Lanes zero = {};
+
+        reserve_batch(st);
+        float *xt = st.batch.data();
+        float *z = xt + D * B;
+
+        float *dL_dW1 = grad;
+        float *dL_db1 = dL_dW1 + H * D;
+        float *dL_dw2 = dL_db1 + H;
+        const float *w2 = m.w2();
+
+        for (; n > 0 && n < SCALAR_TAIL; --n, X += D)
+        {
+            accumulate_gradient(st, X, *Y++, grad, *loss++, *y_hat++);
+        }
+        while (n > 0)
+        {
+            Lanes yb;
+            const std::size_t nb = forward_block(m, X, n, xt, z, yb);
+
+            // Padded lanes get diff = 0 and so contribute nothing below.
+            Lanes diff = zero;
+            for (std::size_t b = 0; b < nb; ++b)
+            {
+                diff[b] = yb[b] - Y[b];
+                y_hat[b] = yb[b];
+                loss[b] = 0.5f * diff[b] * diff[b];
+            }
+            dL_dw2[H] += sum_lanes(diff);
+
+            for (std::size_t j = 0; j < H; ++j)
+            {
+                const Lanes zj = load_lanes(z + j * B);
+                const Lanes dz = zj > 0.0f ? diff * w2[j] : zero;
+                dL_dw2[j] += sum_lanes(diff * (zj > 0.0f ? zj : zero));
+                dL_db1[j] += sum_lanes(dz);
+                for (std::size_t k = 0; k < D; ++k)
+                {
+                    dL_dW1[j * D + k] += sum_lanes(dz * load_lanes(xt + k * B));
+                }
+            }
+
+            X += nb * D;
+            Y += nb;
+            loss += nb;
+            y_hat += nb;
+            n -= nb;
+        }
+    }
+
+    ModelStack stack_models(const std::vector<Model> &models)
+    {
+        ModelStack st;
+        st.input_dim = models.empty() ? 0 : models.front().input_dim;
+        for (const Model &m : models)
+        {
+            st.W1.insert(st.W1.end(), m.W1(), m.W1() + m.hidden_dim * m.input_dim);
+            st.b1.insert(st.b1.end(), m.b1(), m.b1() + m.hidden_dim);
+            st.w2.insert(st.w2.end(), m.w2(), m.w2() + m.hidden_dim);
+            st.b2.push_back(m.b2());
+            st.hidden_end.push_back(st.b1.size());
+        }
+        return st;
+    }
+
+    void forward_stack(const ModelStack &stack, const float *x, float *y_hat)
+    {
+        const std::size_t D = stack.input_dim;
+
+        // One pass over the stacked hidden units; each model owns the
+        // contiguous row range [previous hidden_end, hidden_end).
+        std::size_t j = 0;
+        for (std::size_t m = 0; m < stack.b2.size(); ++m)
+        {
+            float z2 = stack.b2[m];
+            for (; j < stack.hidden_end[m]; ++j)
+            {
+                float z = stack.b1[j];
+                const float *row = &stack.W1[j * D];
+                for (std::size_t k = 0; k < D; ++k)
+                {
+                    z += row[k] * x[k];
+                }
+                z2 += stack.w2[j] * relu(z);
+            }
+            y_hat[m] = z2;
+        }
+    }
+
+    bool save_model(const std::string &path, const Model &m)
     {
         std::ofstream ofs(path);
         if (!ofs)
@@ -262,39 +579,39 @@ namespace math
             return false;
         }
 
-        ofs << HIDDEN_DIM << ' ' << INPUT_DIM << '\n';
+        ofs << m.hidden_dim << ' ' << m.input_dim << '\n';
 
         // W1
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+        for (std::size_t j = 0; j < m.hidden_dim; ++j)
         {
-            for (std::size_t k = 0; k < INPUT_DIM; ++k)
+            for (std::size_t k = 0; k < m.input_dim; ++k)
             {
-                ofs << g_W1[j][k] << ' ';
+                ofs << m.W1()[j * m.input_dim + k] << ' ';
             }
             ofs << '\n';
         }
 
         // b1
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+        for (std::size_t j = 0; j < m.hidden_dim; ++j)
         {
-            ofs << g_b1[j] << ' ';
+            ofs << m.b1()[j] << ' ';
         }
         ofs << '\n';
 
         // w2
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+        for (std::size_t j = 0; j < m.hidden_dim; ++j)
         {
-            ofs << g_w2[j] << ' ';
+            ofs << m.w2()[j] << ' ';
         }
         ofs << '\n';
 
         // b2
-        ofs << g_b2 << '\n';
+        ofs << m.b2() << '\n';
 
         return static_cast<bool>(ofs);
     }
 
-    bool load_parameters(const std::string &path)
+    bool load_model(const std::string &path, Model &m)
     {
         std::ifstream ifs(path);
         if (!ifs)
@@ -305,36 +622,194 @@ namespace math
         std::size_t hidden_dim = 0;
         std::size_t input_dim = 0;
         ifs >> hidden_dim >> input_dim;
-        if (!ifs || hidden_dim != HIDDEN_DIM || input_dim != INPUT_DIM)
+        if (!ifs || hidden_dim == 0 || input_dim == 0)
         {
             return false;
         }
 
-        // W1
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+        Model loaded = make_model(input_dim, hidden_dim);
+        for (float &p : loaded.params)
+        {
+            ifs >> p;
+        }
+        if (!ifs)
         {
-            for (std::size_t k = 0; k < INPUT_DIM; ++k)
+            return false;
+        }
+
+        m = std::move(loaded);
+        return true;
+    }
+
+    void normalize_sample(common::Sample &s)
+    {
+        normalize_features(s.x);
+    }
+
+    void augment_features(common::Sample &s)
+    {
+        augment(s.x);
+    }
+
+    bool parse_expansion(const std::string &spec, std::size_t input_dim, Expansion &out)
+    {
+        out = Expansion{};
+        out.input_dim = input_dim;
+
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            if (item == "pairs")
             {
-                ifs >> g_W1[j][k];
+                for (std::size_t i = 0; i < input_dim; ++i)
+                {
+                    for (std::size_t j = i + 1; j < input_dim; ++j)
+                    {
+                        out.terms.push_back({i, j});
+                    }
+                }
+            }
+            else if (item.compare(0, 4, "pow:") == 0)
+            {
+                char *end = nullptr;
+                const long d = std::strtol(item.c_str() + 4, &end, 10);
+                if (*end != '\0' || d < 2)
+                {
+                    return false;
+                }
+                for (std::size_t i = 0; i < input_dim; ++i)
+                {
+                    for (long k = 2; k <= d; ++k)
+                    {
+                        // x_i^k is the product of k factors x_i.
+                        const std::vector<std::size_t> power(static_cast<std::size_t>(k), i);
+                        out.terms.push_back(power);
+                    }
+                }
+            }
+            else if (item.compare(0, 6, "cross:") == 0)
+            {
+                std::vector<std::size_t> term;
+                std::stringstream fs(item.substr(6));
+                std::string factor;
+                while (std::getline(fs, factor, '*'))
+                {
+                    char *end = nullptr;
+                    const long i = std::strtol(factor.c_str(), &end, 10);
+                    if (factor.empty() || *end != '\0' || i < 0 ||
+                        static_cast<std::size_t>(i) >= input_dim)
+                    {
+                        return false;
+                    }
+                    term.push_back(static_cast<std::size_t>(i));
+                }
+                if (term.size() < 2)
+                {
+                    return false;
+                }
+                out.terms.push_back(std::move(term));
+            }
+            else if (!item.empty())
+            {
+                return false;
             }
         }
+        return true;
+    }
 
-        // b1
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+    void expand_batch(const Expansion &e, const float *X, std::size_t n,
+                      float *out, std::vector<float> &scratch)
+    {
+        constexpr std::size_t B = BATCH_BLOCK;
+        const std::size_t D = e.input_dim;
+        const std::size_t T = e.terms.size();
+        const std::size_t W = D + T;
+        scratch.resize((D + T) * B);
+        float *xt = scratch.data();
+        float *tt = xt + D * B;
+
+        for (std::size_t start = 0; start < n; start += B)
         {
-            ifs >> g_b1[j];
+            const std::size_t nb = std::min(n - start, B);
+            const float *Xb = X + start * D;
+            float *Ob = out + start * W;
+
+            // Transpose the block (zero-padded) so a term spans all lanes.
+            for (std::size_t k = 0; k < D; ++k)
+            {
+                for (std::size_t b = 0; b < nb; ++b)
+                {
+                    xt[k * B + b] = Xb[b * D + k];
+                }
+                std::fill(xt + k * B + nb, xt + (k + 1) * B, 0.0f);
+            }
+
+            for (std::size_t t = 0; t < T; ++t)
+            {
+                const std::vector<std::size_t> &factors = e.terms[t];
+                Lanes v = load_lanes(xt + factors[0] * B);
+                for (std::size_t f = 1; f < factors.size(); ++f)
+                {
+                    v *= load_lanes(xt + factors[f] * B);
+                }
+                store_lanes(tt + t * B, v);
+            }
+
+            for (std::size_t b = 0; b < nb; ++b)
+            {
+                std::copy(Xb + b * D, Xb + (b + 1) * D, Ob + b * W);
+                for (std::size_t t = 0; t < T; ++t)
+                {
+                    Ob[b * W + D + t] = tt[t * B + b];
+                }
+            }
         }
+    }
 
-        // w2
-        for (std::size_t j = 0; j < HIDDEN_DIM; ++j)
+    std::size_t stream_dim_from_env()
+    {
+        const char *spec = std::getenv("FORWARD_EXPAND");
+        Expansion e;
+        if (!spec || !parse_expansion(spec, INPUT_DIM, e))
         {
-            ifs >> g_w2[j];
+            return INPUT_DIM;
         }
+        return expanded_dim(e);
+    }
 
-        // b2
-        ifs >> g_b2;
+    void compute_forward(const common::Sample &s, float &y_hat)
+    {
+        y_hat = forward(g_state.model, s.x);
+    }
 
-        return static_cast<bool>(ifs);
+    void compute_backward_and_update(const common::Sample &s,
+                                     float y_hat,
+                                     float &loss_out,
+                                     float &grad_norm)
+    {
+        float y_hat_check = 0.0f;
+        (void)y_hat; // not used; could be checked against y_hat_check if desired.
+
+        train_step(g_state, s.x, s.y, loss_out, y_hat_check, grad_norm);
+    }
+
+    bool save_parameters(const std::string &path)
+    {
+        return save_model(path, g_state.model);
+    }
+
+    bool load_parameters(const std::string &path)
+    {
+        Model loaded;
+        if (!load_model(path, loaded) ||
+            loaded.hidden_dim != g_state.model.hidden_dim ||
+            loaded.input_dim != g_state.model.input_dim)
+        {
+            return false;
+        }
+        g_state.model = std::move(loaded);
+        return true;
     }
 
 } // namespace math
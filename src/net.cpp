@@ -0,0 +1,317 @@
+/// @file net.cpp
+/// @brief Implementation of the socket helpers.
+#include "net.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    /**
+     * @brief Fill a socket address for a rank.
+     *
+     * @param ep   Base endpoint.
+     * @param rank Rank.
+     * @param addr Output address storage.
+     * @param len  Output address length.
+     * @return true on success, false if the address is invalid.
+     */
+    bool rank_address(const net::Endpoint &ep,
+                      int rank,
+                      sockaddr_storage &addr,
+                      socklen_t &len)
+    {
+        std::memset(&addr, 0, sizeof(addr));
+        if (ep.is_unix)
+        {
+            const std::string path = ep.path + '.' + std::to_string(rank);
+            sockaddr_un *un = reinterpret_cast<sockaddr_un *>(&addr);
+            if (path.size() >= sizeof(un->sun_path))
+            {
+                return false;
+            }
+            un->sun_family = AF_UNIX;
+            std::memcpy(un->sun_path, path.c_str(), path.size() + 1);
+            len = sizeof(sockaddr_un);
+            return true;
+        }
+
+        sockaddr_in *in = reinterpret_cast<sockaddr_in *>(&addr);
+        in->sin_family = AF_INET;
+        in->sin_port = htons(static_cast<uint16_t>(ep.port + rank));
+        if (inet_pton(AF_INET, ep.host.c_str(), &in->sin_addr) != 1)
+        {
+            return false;
+        }
+        len = sizeof(sockaddr_in);
+        return true;
+    }
+
+    /**
+     * @brief Disable Nagle on TCP sockets; gradient messages are latency bound.
+     */
+    void set_nodelay(const net::Endpoint &ep, int fd)
+    {
+        if (!ep.is_unix)
+        {
+            const int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+    }
+} // namespace
+
+namespace net
+{
+    bool parse_endpoint(const std::string &spec, Endpoint &out)
+    {
+        if (spec.compare(0, 5, "unix:") == 0 && spec.size() > 5)
+        {
+            out.is_unix = true;
+            out.path = spec.substr(5);
+            return true;
+        }
+        if (spec.compare(0, 4, "tcp:") == 0)
+        {
+            const std::size_t colon = spec.rfind(':');
+            if (colon <= 4)
+            {
+                return false;
+            }
+            out.is_unix = false;
+            out.host = spec.substr(4, colon - 4);
+            char *end = nullptr;
+            const long port = std::strtol(spec.c_str() + colon + 1, &end, 10);
+            if (!end || *end != '\0' || port <= 0 || port > 65535)
+            {
+                return false;
+            }
+            out.port = static_cast<int>(port);
+            return true;
+        }
+        return false;
+    }
+
+    int listen_rank(const Endpoint &ep, int rank)
+    {
+        sockaddr_storage addr{};
+        socklen_t len = 0;
+        if (!rank_address(ep, rank, addr, len))
+        {
+            std::fprintf(stderr, "net: invalid address for rank %d\n", rank);
+            return -1;
+        }
+
+        const int fd = socket(ep.is_unix ? AF_UNIX : AF_INET,
+                              SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            std::perror("socket");
+            return -1;
+        }
+
+        if (ep.is_unix)
+        {
+            unlink_rank(ep, rank);
+        }
+        else
+        {
+            const int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+
+        if (bind(fd, reinterpret_cast<sockaddr *>(&addr), len) < 0 ||
+            listen(fd, 16) < 0)
+        {
+            std::perror("bind/listen");
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    int connect_rank(const Endpoint &ep, int rank, int timeout_ms)
+    {
+        sockaddr_storage addr{};
+        socklen_t len = 0;
+        if (!rank_address(ep, rank, addr, len))
+        {
+            std::fprintf(stderr, "net: invalid address for rank %d\n", rank);
+            return -1;
+        }
+
+        const timespec retry_delay{0, 10 * 1000 * 1000}; // 10 ms
+        for (int waited = 0; waited <= timeout_ms; waited += 10)
+        {
+            const int fd = socket(ep.is_unix ? AF_UNIX : AF_INET,
+                                  SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                std::perror("socket");
+                return -1;
+            }
+            if (connect(fd, reinterpret_cast<sockaddr *>(&addr), len) == 0)
+            {
+                set_nodelay(ep, fd);
+                return fd;
+            }
+            const int err = errno;
+            close(fd);
+            if (err != ENOENT && err != ECONNREFUSED && err != EINTR)
+            {
+                errno = err;
+                std::perror("connect");
+                return -1;
+            }
+            nanosleep(&retry_delay, nullptr);
+        }
+
+        std::fprintf(stderr, "net: timed out connecting to rank %d\n", rank);
+        return -1;
+    }
+
+    int accept_peer(const Endpoint &ep, int listen_fd)
+    {
+        int fd;
+        do
+        {
+            fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        } while (fd < 0 && errno == EINTR);
+        if (fd < 0)
+        {
+            std::perror("accept");
+            return -1;
+        }
+        set_nodelay(ep, fd);
+        return fd;
+    }
+
+    void unlink_rank(const Endpoint &ep, int rank)
+    {
+        if (ep.is_unix)
+        {
+            unlink((ep.path + '.' + std::to_string(rank)).c_str());
+        }
+    }
+
+    bool send_all(int fd, const void *buf, std::size_t len)
+    {
+        const char *p = static_cast<const char *>(buf);
+        while (len > 0)
+        {
+            const ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            p += n;
+            len -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    bool recv_all(int fd, void *buf, std::size_t len)
+    {
+        char *p = static_cast<char *>(buf);
+        while (len > 0)
+        {
+            const ssize_t n = recv(fd, p, len, 0);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            if (n == 0)
+            {
+                return false;
+            }
+            p += n;
+            len -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    bool send_fds(int sock, const std::string &msg, const std::vector<int> &fds)
+    {
+        struct iovec iov;
+        iov.iov_base = const_cast<char *>(msg.data());
+        iov.iov_len = msg.size();
+
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+        struct msghdr mh = {};
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        if (!fds.empty())
+        {
+            mh.msg_control = control.data();
+            mh.msg_controllen = control.size();
+            struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+            cm->cmsg_level = SOL_SOCKET;
+            cm->cmsg_type = SCM_RIGHTS;
+            cm->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+            std::memcpy(CMSG_DATA(cm), fds.data(), sizeof(int) * fds.size());
+        }
+
+        ssize_t n;
+        while ((n = sendmsg(sock, &mh, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+        {
+        }
+        return n == static_cast<ssize_t>(msg.size());
+    }
+
+    long recv_fds(int sock, std::string &msg, std::vector<int> &fds, std::size_t max_fds)
+    {
+        char buf[4096];
+        struct iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = sizeof(buf);
+
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * max_fds));
+        struct msghdr mh = {};
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = control.data();
+        mh.msg_controllen = control.size();
+
+        ssize_t n;
+        while ((n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+        {
+        }
+        fds.clear();
+        for (struct cmsghdr *cm = n > 0 ? CMSG_FIRSTHDR(&mh) : nullptr; cm; cm = CMSG_NXTHDR(&mh, cm))
+        {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+            {
+                const std::size_t count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    int fd;
+                    std::memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+                    fds.push_back(fd);
+                }
+            }
+        }
+        if (n < 0)
+        {
+            return -1;
+        }
+        msg.assign(buf, static_cast<std::size_t>(n));
+        return static_cast<long>(n);
+    }
+
+} // namespace net
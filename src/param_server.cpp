@@ -0,0 +1,437 @@
+/// @file param_server.cpp
+/// @brief Implementation of the param_server executable.
+#include "param_server.hpp"
+#include "common.hpp"
+#include "compress.hpp"
+#include "math_layer.hpp"
+#include "net.hpp"
+#include "stage_io.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    /// @brief Server-side view of one worker.
+    struct WorkerState
+    {
+        int fd = -1;                   ///< Connection (-1 until HELLO).
+        std::uint64_t clock = 0;       ///< Pushes applied so far.
+        std::uint64_t pulled = 0;      ///< Model version last sent to it.
+        bool done = false;             ///< Sent DONE or disconnected.
+        bool waiting = false;          ///< Has a deferred PULL.
+        std::uint64_t wait_clock = 0;  ///< Clock of the deferred PULL.
+        Clock::time_point wait_since;  ///< When the deferred PULL arrived.
+    };
+
+    /**
+     * @brief Read an integer environment variable.
+     */
+    long env_long(const char *name, long fallback)
+    {
+        const char *env = std::getenv(name);
+        if (!env || !*env)
+        {
+            return fallback;
+        }
+        char *end = nullptr;
+        const long v = std::strtol(env, &end, 10);
+        return (end && *end == '\0' && v >= 0) ? v : fallback;
+    }
+
+    /// @brief Workers that have sent HELLO.
+    std::size_t registered(const std::vector<WorkerState> &workers)
+    {
+        return static_cast<std::size_t>(std::count_if(
+            workers.begin(), workers.end(), [](const WorkerState &w) { return w.fd >= 0; }));
+    }
+
+    /// @brief The server's whole state.
+    struct Server
+    {
+        math::TrainState st;
+        compress::Compressor decoder; ///< Decodes PUSH_PACKED payloads.
+        std::vector<char> payload;    ///< Receive buffer for PUSH_PACKED.
+        std::uint64_t packed_pushes = 0;
+        std::vector<WorkerState> workers;
+        std::uint64_t staleness = 0;
+        std::uint64_t version = 0;
+        bool linear_lr = true; ///< DDP_LR_SCALING: lr times the pushed batch.
+
+        // Statistics.
+        std::uint64_t samples = 0;
+        std::uint64_t staleness_sum = 0;
+        std::uint64_t staleness_max = 0;
+        std::uint64_t blocked_pulls = 0;
+        double blocked_seconds = 0.0;
+
+        /// @brief Smallest clock of the workers still training.
+        std::uint64_t min_clock() const
+        {
+            std::uint64_t m = UINT64_MAX;
+            for (const WorkerState &w : workers)
+            {
+                if (!w.done)
+                {
+                    m = std::min(m, w.clock);
+                }
+            }
+            return m;
+        }
+
+        /// @brief Send the current parameters to worker id.
+        bool send_params(std::uint32_t id)
+        {
+            WorkerState &w = workers[id];
+            param_server::MsgHeader h{};
+            h.type = param_server::MSG_PARAMS;
+            h.worker = id;
+            h.clock = version;
+            h.floats = static_cast<std::uint32_t>(st.model.params.size());
+            w.pulled = version;
+            return net::send_all(w.fd, &h, sizeof(h)) &&
+                   net::send_all(w.fd, st.model.params.data(),
+                                 h.floats * sizeof(float));
+        }
+
+        /// @brief Answer deferred pulls that the staleness bound now allows.
+        void release_waiting()
+        {
+            const std::uint64_t bound = min_clock();
+            for (std::uint32_t id = 0; id < workers.size(); ++id)
+            {
+                WorkerState &w = workers[id];
+                if (w.waiting && !w.done &&
+                    (bound == UINT64_MAX || w.wait_clock <= bound + staleness))
+                {
+                    w.waiting = false;
+                    blocked_seconds += std::chrono::duration<double>(
+                        Clock::now() - w.wait_since).count();
+                    if (!send_params(id))
+                    {
+                        w.done = true;
+                    }
+                }
+            }
+        }
+    };
+
+    /**
+     * @brief Handle one message from a connection.
+     *
+     * @param srv Server state.
+     * @param fd  Connection with a readable message.
+     * @param id  In/out: worker id bound to fd (-1 before HELLO).
+     * @return false if the connection should be closed.
+     */
+    bool handle_message(Server &srv, int fd, int &id)
+    {
+        param_server::MsgHeader h{};
+        if (!net::recv_all(fd, &h, sizeof(h)))
+        {
+            return false;
+        }
+
+        if (h.type == param_server::MSG_HELLO)
+        {
+            if (h.worker >= srv.workers.size() || srv.workers[h.worker].fd >= 0)
+            {
+                std::cerr << "param_server: bad worker id " << h.worker << '\n';
+                return false;
+            }
+            id = static_cast<int>(h.worker);
+            srv.workers[id].fd = fd;
+            return true;
+        }
+        if (id < 0)
+        {
+            std::cerr << "param_server: message before HELLO\n";
+            return false;
+        }
+
+        WorkerState &w = srv.workers[id];
+        switch (h.type)
+        {
+        case param_server::MSG_PULL:
+            if (h.clock <= srv.min_clock() + srv.staleness)
+            {
+                return srv.send_params(static_cast<std::uint32_t>(id));
+            }
+            // Too far ahead of the slowest worker: answer later.
+            w.waiting = true;
+            w.wait_clock = h.clock;
+            w.wait_since = Clock::now();
+            ++srv.blocked_pulls;
+            return true;
+
+        case param_server::MSG_PUSH:
+        case param_server::MSG_PUSH_PACKED:
+        {
+            std::vector<float> &grad = srv.st.grad;
+            if (h.type == param_server::MSG_PUSH_PACKED)
+            {
+                // h.floats is the payload size in bytes here; never take
+                // more than a valid encoding of the gradient can need.
+                if (h.floats > compress::max_payload(grad.size()))
+                {
+                    std::cerr << "param_server: compressed gradient of " << h.floats
+                              << " bytes is too large\n";
+                    return false;
+                }
+                srv.payload.resize(h.floats);
+                std::fill(grad.begin(), grad.end(), 0.0f);
+                if (!net::recv_all(fd, srv.payload.data(), srv.payload.size()))
+                {
+                    return false;
+                }
+                if (!compress::decode_add(srv.decoder, srv.payload.data(),
+                                          srv.payload.size(), grad.data(), grad.size()))
+                {
+                    std::cerr << "param_server: malformed compressed gradient\n";
+                    return false;
+                }
+                ++srv.packed_pushes;
+            }
+            else if (h.floats != grad.size())
+            {
+                std::cerr << "param_server: gradient size mismatch\n";
+                return false;
+            }
+            else if (!net::recv_all(fd, grad.data(), h.floats * sizeof(float)))
+            {
+                return false;
+            }
+            if (h.samples > 0)
+            {
+                // As in DDP: the summed gradient at the base lr is the
+                // batch mean with lr scaled by the batch.
+                math::apply_gradient(srv.st, grad.data(), srv.linear_lr ? 1.0f : 1.0f / h.samples);
+            }
+            const std::uint64_t stale = srv.version - w.pulled;
+            srv.staleness_sum += stale;
+            srv.staleness_max = std::max(srv.staleness_max, stale);
+            srv.samples += h.samples;
+            ++srv.version;
+            w.clock = h.clock + 1;
+            srv.release_waiting();
+            return true;
+        }
+
+        case param_server::MSG_DONE:
+            return false;
+
+        default:
+            std::cerr << "param_server: unknown message type " << h.type << '\n';
+            return false;
+        }
+    }
+} // namespace
+
+namespace param_server
+{
+    int run()
+    {
+        const stage_io::MemoryShare memory("param_server");
+        const char *ep_env = std::getenv("PS_ENDPOINT");
+        net::Endpoint ep;
+        if (!ep_env || !net::parse_endpoint(ep_env, ep))
+        {
+            std::cerr << "param_server: PS_ENDPOINT must be unix:<path> or "
+                         "tcp:<host>:<port>\n";
+            return 1;
+        }
+
+        math::TrainConfig config;
+        const char *configs = std::getenv("MODEL_CONFIGS");
+        if (configs && *configs)
+        {
+            const std::string first = std::string(configs).substr(
+                0, std::string(configs).find(';'));
+            if (!math::parse_train_config(first, config))
+            {
+                std::cerr << "param_server: bad MODEL_CONFIGS entry: " << first << '\n';
+                return 1;
+            }
+        }
+        const char *model_env = std::getenv("MODEL_FILE");
+        const std::string model_path = (model_env && *model_env)
+            ? std::string(model_env) : "logs/model_params.txt";
+
+        Server srv;
+        // Sized like the workers' streams (wider under FORWARD_EXPAND).
+        srv.st = math::make_train_state(math::stream_dim_from_env(), config);
+        srv.workers.resize(static_cast<std::size_t>(std::max(1L, env_long("PS_WORKERS", 1))));
+        srv.staleness = static_cast<std::uint64_t>(env_long("PS_STALENESS", 2));
+        const char *scaling = std::getenv("DDP_LR_SCALING");
+        if (scaling && *scaling)
+        {
+            if (std::strcmp(scaling, "none") == 0)
+            {
+                srv.linear_lr = false;
+            }
+            else if (std::strcmp(scaling, "linear") != 0)
+            {
+                std::cerr << "param_server: invalid DDP_LR_SCALING=" << scaling
+                          << ", using linear\n";
+            }
+        }
+        const long hello_ms = env_long("PS_HELLO_TIMEOUT_MS", 30000);
+
+        const int listen_fd = net::listen_rank(ep, 0);
+        if (listen_fd < 0)
+        {
+            return 1;
+        }
+
+        // Connections and the worker id each one registered as.
+        std::vector<int> conn_fds;
+        std::vector<int> conn_ids;
+        std::size_t accepted = 0;
+        const Clock::time_point start = Clock::now();
+        const Clock::time_point hello_deadline = start + std::chrono::milliseconds(hello_ms);
+        bool failed = false;
+
+        while (!failed && srv.min_clock() != UINT64_MAX)
+        {
+            // A worker that never registers would hold min_clock() back
+            // forever: give them all until the deadline.
+            int timeout = -1;
+            if (registered(srv.workers) < srv.workers.size())
+            {
+                const long left = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    hello_deadline - Clock::now()).count());
+                if (left <= 0)
+                {
+                    std::cerr << "param_server: only " << registered(srv.workers) << " of "
+                              << srv.workers.size() << " workers registered within "
+                              << hello_ms << " ms\n";
+                    failed = true;
+                    break;
+                }
+                timeout = static_cast<int>(std::min(left, 1000L));
+            }
+
+            std::vector<pollfd> fds;
+            if (accepted < srv.workers.size())
+            {
+                fds.push_back({listen_fd, POLLIN, 0});
+            }
+            for (int fd : conn_fds)
+            {
+                fds.push_back({fd, POLLIN, 0});
+            }
+            if (poll(fds.data(), fds.size(), timeout) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                std::perror("param_server: poll");
+                break;
+            }
+
+            for (const pollfd &p : fds)
+            {
+                if (p.revents == 0)
+                {
+                    continue;
+                }
+                if (p.fd == listen_fd)
+                {
+                    const int fd = net::accept_peer(ep, listen_fd);
+                    if (fd >= 0)
+                    {
+                        conn_fds.push_back(fd);
+                        conn_ids.push_back(-1);
+                        ++accepted;
+                    }
+                    continue;
+                }
+
+                const std::size_t i = static_cast<std::size_t>(
+                    std::find(conn_fds.begin(), conn_fds.end(), p.fd) - conn_fds.begin());
+                if (!handle_message(srv, p.fd, conn_ids[i]))
+                {
+                    // DONE, disconnect or protocol error: the worker leaves
+                    // the staleness computation. A connection lost before
+                    // HELLO is a worker that will never register.
+                    if (conn_ids[i] >= 0)
+                    {
+                        srv.workers[conn_ids[i]].done = true;
+                    }
+                    else if (registered(srv.workers) < srv.workers.size())
+                    {
+                        std::cerr << "param_server: a worker disconnected before HELLO with "
+                                  << registered(srv.workers) << " of " << srv.workers.size()
+                                  << " registered\n";
+                        failed = true;
+                    }
+                    close(p.fd);
+                    conn_fds.erase(conn_fds.begin() + i);
+                    conn_ids.erase(conn_ids.begin() + i);
+                    srv.release_waiting();
+                }
+            }
+        }
+
+        const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        close(listen_fd);
+        net::unlink_rank(ep, 0);
+        for (int fd : conn_fds)
+        {
+            close(fd);
+        }
+
+        if (failed)
+        {
+            std::cerr << "param_server: training failed; model not saved\n";
+            return 1;
+        }
+
+        int rc = 0;
+        if (!math::save_model(model_path, srv.st.model))
+        {
+            std::cerr << "param_server: failed to save parameters to " << model_path << '\n';
+            rc = 1;
+        }
+        else
+        {
+            std::cerr << "param_server: saved parameters to " << model_path << '\n';
+        }
+
+        const double mean_stale = srv.version
+            ? static_cast<double>(srv.staleness_sum) / srv.version : 0.0;
+        std::cerr << "PS_SUMMARY " << srv.staleness << ' '
+                  << srv.version << ' '
+                  << (elapsed > 0 ? srv.samples / elapsed : 0.0) << ' '
+                  << mean_stale << ' '
+                  << srv.staleness_max << ' '
+                  << srv.blocked_pulls << ' '
+                  << srv.blocked_seconds << '\n';
+        if (srv.packed_pushes > 0)
+        {
+            std::cerr << "param_server: decoded " << srv.packed_pushes
+                      << " compressed pushes decode_us_per_push="
+                      << srv.decoder.stats.decode_seconds * 1e6 / srv.packed_pushes << '\n';
+        }
+        return rc;
+    }
+
+} // namespace param_server
+
+int main()
+{
+    return param_server::run();
+}
@@ -3,56 +3,159 @@
 #include "preprocess.hpp"
 #include "common.hpp"
 #include "math_layer.hpp"
+#include "stage_io.hpp"
+#include "transform.hpp"
 
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 
-namespace preprocess
+namespace
 {
-    int run(const std::string &csv_path)
+    /**
+     * @brief Normalize the CSV records of one shard from in to stdout.
+     *
+     * @param in     CSV input.
+     * @param shard  Index of the shard to emit (0-based).
+     * @param shards Total number of shards.
+     * @param fused  Downstream stateless stages run in this process.
+     * @return 0 on success.
+     */
+    int process(std::istream &in, int shard, int shards,
+                const std::vector<const transform::Stateless *> &fused)
     {
-        std::ifstream in(csv_path);
-        if (!in)
-        {
-            std::cerr << "preprocess: failed to open CSV file: "
-                      << csv_path << std::endl;
-            return 1;
-        }
+        // The outgoing edge is the last fused stage's.
+        stage_io::Capture capture(fused.empty() ? "preprocess" : fused.back()->stage);
+        stage_io::Progress &progress = stage_io::progress();
+        stage_io::Quarantine quarantine("preprocess");
+        const stage_io::MemoryShare memory("preprocess");
+        // Under BATCH_TARGET_P99_MS, output is flushed in batches sized
+        // and timed by the controller; reading the CSV never blocks.
+        stage_io::BatchController batching("preprocess", 128, memory, 64, in, -1);
 
         std::string line;
-        while (std::getline(in, line))
+        long index = -1;
+        std::uint64_t offset = 0; // of the next line in the CSV
+        for (;;)
         {
+            batching.wait_record();
+            if (!std::getline(in, line))
+            {
+                break;
+            }
+            const std::uint64_t at = offset;
+            offset += line.size() + 1;
             if (line.empty())
             {
                 continue;
             }
+            progress.count_in();
+            if (++index % shards != shard)
+            {
+                continue;
+            }
 
             common::Sample s{};
             if (!common::parse_csv_line(line, s))
             {
-                std::cerr << "preprocess: failed to parse line: " << line << std::endl;
+                quarantine.add(common::reject_reason(line, ',', common::INPUT_DIM + 2), at, line);
                 continue;
             }
 
             // Normalize features using math layer.
             math::normalize_sample(s);
+            transform::apply_fused(fused, s);
 
             // Output whitespace-separated line to stdout.
             std::cout << common::sample_to_line(s) << '\n';
+            progress.count_out();
+            batching.wrote_record();
         }
 
         return 0;
     }
 
+    int usage()
+    {
+        std::cerr << "Usage: preprocess <csv_path> [<shard>/<shards>] [--fuse <stages>]\n"
+                  << "       preprocess --replay <csv_path> [--repeat N]\n"
+                  << "       preprocess --serve <fd>\n";
+        return 1;
+    }
+
+    /**
+     * @brief Run on command-line arguments (without the program name):
+     *        <csv_path> [<shard>/<shards>] [--fuse <stages>].
+     *
+     * @return Exit status; 1 with the usage on bad arguments.
+     */
+    int run_command(std::vector<std::string> args)
+    {
+        // Optional trailing "--fuse <stages>".
+        std::string fuse;
+        if (args.size() >= 3 && args[args.size() - 2] == "--fuse")
+        {
+            fuse = args.back();
+            args.resize(args.size() - 2);
+        }
+
+        int shard = 0;
+        int shards = 1;
+        if (args.size() == 2 &&
+            (std::sscanf(args[1].c_str(), "%d/%d", &shard, &shards) != 2 ||
+             shards < 1 || shard < 0 || shard >= shards))
+        {
+            return usage();
+        }
+        if (args.size() != 1 && args.size() != 2)
+        {
+            return usage();
+        }
+        return preprocess::run(args[0], shard, shards, fuse);
+    }
+} // namespace
+
+namespace preprocess
+{
+    int run(const std::string &csv_path, int shard, int shards, const std::string &fuse)
+    {
+        std::vector<const transform::Stateless *> fused;
+        if (!transform::parse_fuse_list(fuse, fused))
+        {
+            return 1;
+        }
+
+        std::ifstream in(csv_path);
+        if (!in)
+        {
+            std::cerr << "preprocess: failed to open CSV file: "
+                      << csv_path << std::endl;
+            return 1;
+        }
+        return process(in, shard, shards, fused);
+    }
+
 } // namespace preprocess
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    int control = -1;
+    if (stage_io::parse_serve_args(argc, argv, control))
     {
-        std::cerr << "Usage: preprocess <csv_path>\n";
-        return 1;
+        return stage_io::serve("preprocess", control, run_command);
+    }
+
+    stage_io::ReplayOptions replay;
+    const int replay_args = stage_io::parse_replay_args(argc, argv, replay);
+    if (replay_args > 0)
+    {
+        return stage_io::replay("preprocess", replay, [] { return process(std::cin, 0, 1, {}); });
+    }
+    if (replay_args < 0)
+    {
+        return usage();
     }
-    return preprocess::run(argv[1]);
+    return run_command(std::vector<std::string>(argv + 1, argv + argc));
 }
@@ -0,0 +1,787 @@
+/// @file stage_io.cpp
+/// @brief Implementation of stream capture and in-memory replay.
+#include "stage_io.hpp"
+#include "net.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    /// @brief Set while replay() runs the stage body.
+    bool replaying = false;
+
+    double ms_between(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+    {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    /// @brief Buffered stream over a descriptor (a served job's stdin or stdout).
+    class FdBuf : public std::streambuf
+    {
+    public:
+        explicit FdBuf(int fd) : fd_(fd), in_(1 << 16), out_(1 << 16)
+        {
+            setg(in_.data(), in_.data(), in_.data());
+            setp(out_.data(), out_.data() + out_.size());
+        }
+
+        ~FdBuf() override
+        {
+            sync();
+        }
+
+    protected:
+        int_type underflow() override
+        {
+            ssize_t n;
+            while ((n = read(fd_, in_.data(), in_.size())) < 0 && errno == EINTR)
+            {
+            }
+            if (n <= 0)
+            {
+                return traits_type::eof();
+            }
+            setg(in_.data(), in_.data(), in_.data() + n);
+            return traits_type::to_int_type(*gptr());
+        }
+
+        int_type overflow(int_type ch) override
+        {
+            if (sync() != 0)
+            {
+                return traits_type::eof();
+            }
+            if (!traits_type::eq_int_type(ch, traits_type::eof()))
+            {
+                *pptr() = traits_type::to_char_type(ch);
+                pbump(1);
+            }
+            return traits_type::not_eof(ch);
+        }
+
+        int sync() override
+        {
+            const char *p = pbase();
+            bool ok = true;
+            while (p < pptr())
+            {
+                const ssize_t n = write(fd_, p, static_cast<std::size_t>(pptr() - p));
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n < 0)
+                {
+                    ok = false;
+                    break;
+                }
+                p += n;
+            }
+            setp(out_.data(), out_.data() + out_.size());
+            return ok ? 0 : -1;
+        }
+
+    private:
+        int fd_;
+        std::vector<char> in_;
+        std::vector<char> out_;
+    };
+
+    /// @brief Read-only streambuf over a memory range.
+    class MemoryBuf : public std::streambuf
+    {
+    public:
+        MemoryBuf(char *begin, char *end)
+        {
+            setg(begin, begin, end);
+        }
+
+        void rewind()
+        {
+            setg(eback(), eback(), egptr());
+        }
+    };
+
+    /**
+     * @brief A stage's file in the directory named by an environment
+     *        variable, or "" if it is unset.
+     *
+     * @param dir_env Variable naming the directory (created if missing).
+     * @param stage   Stage name; ".<rank>" is added with several workers.
+     * @param ext     File extension, e.g. ".cap".
+     */
+    std::string stage_path(const char *dir_env, const char *stage, const char *ext)
+    {
+        const char *dir = std::getenv(dir_env);
+        if (!dir || !*dir)
+        {
+            return "";
+        }
+        mkdir(dir, 0755);
+
+        std::string path = std::string(dir) + "/" + stage;
+        const char *world = std::getenv("DDP_WORLD_SIZE");
+        const char *rank = std::getenv("DDP_RANK");
+        if (world && std::atoi(world) > 1 && rank && *rank)
+        {
+            path += std::string(".") + rank;
+        }
+        return path + ext;
+    }
+
+    /// @brief Map the slot named by TRAINER_PROGRESS=<fd>:<slot>, or nullptr.
+    stage_io::Progress *attach_progress()
+    {
+        const char *env = std::getenv("TRAINER_PROGRESS");
+        int fd = -1;
+        long slot = -1;
+        if (!env || std::sscanf(env, "%d:%ld", &fd, &slot) != 2 || fd < 0 || slot < 0)
+        {
+            return nullptr;
+        }
+        const std::size_t bytes = (slot + 1) * sizeof(stage_io::Progress);
+        void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        return static_cast<stage_io::Progress *>(p) + slot;
+    }
+} // namespace
+
+namespace stage_io
+{
+    Capture::Capture(const char *stage)
+    {
+        const std::string path = stage_path("CAPTURE_DIR", stage, ".cap");
+        if (path.empty())
+        {
+            return;
+        }
+        // The first sync_with_stdio(false) replaces std::cout's buffer;
+        // make sure that happens before the tee is put in front of it.
+        std::ios::sync_with_stdio(false);
+        file_.open(path, std::ios::binary | std::ios::trunc);
+        if (!file_)
+        {
+            std::cerr << stage << ": cannot open capture file " << path << "\n";
+            return;
+        }
+        saved_ = std::cout.rdbuf();
+        tee_ = new TeeBuf(saved_, file_.rdbuf());
+        std::cout.rdbuf(tee_);
+    }
+
+    Capture::~Capture()
+    {
+        if (tee_)
+        {
+            std::cout.flush();
+            std::cout.rdbuf(saved_);
+            delete tee_;
+        }
+    }
+
+    Capture::TeeBuf::int_type Capture::TeeBuf::overflow(int_type ch)
+    {
+        if (traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            return traits_type::not_eof(ch);
+        }
+        const char c = traits_type::to_char_type(ch);
+        const bool ok = !traits_type::eq_int_type(a_->sputc(c), traits_type::eof()) &&
+                        !traits_type::eq_int_type(b_->sputc(c), traits_type::eof());
+        return ok ? ch : traits_type::eof();
+    }
+
+    std::streamsize Capture::TeeBuf::xsputn(const char *s, std::streamsize n)
+    {
+        const std::streamsize wa = a_->sputn(s, n);
+        const std::streamsize wb = b_->sputn(s, n);
+        return std::min(wa, wb);
+    }
+
+    int Capture::TeeBuf::sync()
+    {
+        const int ra = a_->pubsync();
+        const int rb = b_->pubsync();
+        return (ra == 0 && rb == 0) ? 0 : -1;
+    }
+
+    Progress &progress()
+    {
+        static Progress local;
+        static Progress *const slot = attach_progress();
+        return slot ? *slot : local;
+    }
+
+    Diagnostics::Diagnostics(const char *stage) : stage_(stage)
+    {
+        const char *burst = std::getenv("DIAG_BURST");
+        if (burst && *burst)
+        {
+            burst_ = std::strtoull(burst, nullptr, 10);
+        }
+        const char *interval = std::getenv("DIAG_INTERVAL_MS");
+        if (interval && *interval)
+        {
+            interval_ = std::chrono::milliseconds(std::strtol(interval, nullptr, 10));
+        }
+    }
+
+    Diagnostics::~Diagnostics()
+    {
+        for (const Kind &k : kinds_)
+        {
+            if (k.total > burst_)
+            {
+                write(std::string(stage_) + ": " + k.name + ": " + std::to_string(k.total) +
+                      " total, " + std::to_string(k.total - burst_) + " not shown\n");
+            }
+        }
+    }
+
+    void Diagnostics::report(const char *kind, const std::string &detail)
+    {
+        auto it = std::find_if(kinds_.begin(), kinds_.end(),
+                               [kind](const Kind &k) { return std::strcmp(k.name, kind) == 0; });
+        if (it == kinds_.end())
+        {
+            kinds_.push_back(Kind{kind});
+            it = kinds_.end() - 1;
+        }
+
+        Kind &k = *it;
+        if (++k.total <= burst_)
+        {
+            write(std::string(stage_) + ": " + kind + ": " + detail + "\n");
+            k.last_note = std::chrono::steady_clock::now();
+            return;
+        }
+        ++k.unreported;
+        const auto now = std::chrono::steady_clock::now();
+        if (now - k.last_note >= interval_)
+        {
+            write(std::string(stage_) + ": " + kind + ": " + std::to_string(k.unreported) +
+                  " more suppressed\n");
+            k.unreported = 0;
+            k.last_note = now;
+        }
+    }
+
+    std::uint64_t Diagnostics::count(const char *kind) const
+    {
+        for (const Kind &k : kinds_)
+        {
+            if (std::strcmp(k.name, kind) == 0)
+            {
+                return k.total;
+            }
+        }
+        return 0;
+    }
+
+    void Diagnostics::write(const std::string &line) const
+    {
+        std::cerr.write(line.data(), static_cast<std::streamsize>(line.size()));
+    }
+
+    std::size_t memory_limit()
+    {
+        const char *env = std::getenv("STAGE_MEMORY_LIMIT");
+        return env && *env ? std::strtoull(env, nullptr, 10) : 0;
+    }
+
+    MemoryShare::MemoryShare(const char *stage) : stage_(stage), limit_(memory_limit())
+    {
+    }
+
+    MemoryShare::~MemoryShare()
+    {
+        if (limit_ == 0)
+        {
+            return;
+        }
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        const double peak = usage.ru_maxrss * 1024.0; // ru_maxrss is in KiB
+        char line[160];
+        std::snprintf(line, sizeof(line), "%s: memory peak=%.1f MiB share=%.1f MiB (%.0f%%)%s\n",
+                      stage_, peak / (1 << 20), limit_ / double(1 << 20), 100.0 * peak / limit_,
+                      peak > limit_ ? " over share" : "");
+        std::cerr << line;
+    }
+
+    std::size_t MemoryShare::fit(const char *what, std::size_t requested,
+                                 std::size_t bytes_each, std::size_t divisor) const
+    {
+        if (limit_ == 0)
+        {
+            return requested;
+        }
+        const std::size_t allowed = std::max<std::size_t>(1, limit_ / divisor / std::max<std::size_t>(1, bytes_each));
+        if (requested <= allowed)
+        {
+            return requested;
+        }
+        std::cerr << stage_ << ": " << what << ' ' << requested << " -> " << allowed
+                  << " to fit the memory share\n";
+        return allowed;
+    }
+
+    Quarantine::Quarantine(const char *stage)
+        : stage_(stage), path_(stage_path("QUARANTINE_DIR", stage, ".bad")), diag_(stage)
+    {
+    }
+
+    Quarantine::~Quarantine()
+    {
+        if (total_ == 0)
+        {
+            return;
+        }
+        file_.close();
+        std::string line = std::string(stage_) + ": rejected " + std::to_string(total_) + " rows (";
+        for (std::size_t i = 0; i < reasons_.size(); ++i)
+        {
+            line += (i ? " " : "") + std::string(reasons_[i].first) + "=" +
+                    std::to_string(reasons_[i].second);
+        }
+        line += path_.empty() ? ")\n" : ") -> " + path_ + "\n";
+        std::cerr.write(line.data(), static_cast<std::streamsize>(line.size()));
+    }
+
+    void Quarantine::add(const char *reason, std::uint64_t offset, const std::string &row)
+    {
+        ++total_;
+        progress().count_rejected();
+        auto it = std::find_if(reasons_.begin(), reasons_.end(),
+                               [reason](const std::pair<const char *, std::uint64_t> &r) {
+                                   return std::strcmp(r.first, reason) == 0;
+                               });
+        if (it == reasons_.end())
+        {
+            reasons_.emplace_back(reason, 0);
+            it = reasons_.end() - 1;
+        }
+        ++it->second;
+
+        // The file is created with the first bad row; bad rows tend to
+        // come in runs, so it is written out in large chunks.
+        if (!path_.empty() && !file_.is_open())
+        {
+            const std::size_t limit = memory_limit();
+            buf_.resize(limit ? std::min<std::size_t>(1 << 20, std::max<std::size_t>(limit / 16, 4096))
+                              : 1 << 20);
+            file_.rdbuf()->pubsetbuf(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+            file_.open(path_, std::ios::binary | std::ios::trunc);
+            if (!file_)
+            {
+                std::cerr << stage_ << ": cannot open quarantine file " << path_ << "\n";
+                path_.clear();
+            }
+        }
+        if (path_.empty())
+        {
+            diag_.report(reason, "offset " + std::to_string(offset) + ": " + row);
+            return;
+        }
+        file_ << offset << '\t' << reason << '\t' << row << '\n';
+    }
+
+    BatchController::BatchController(const char *stage, std::size_t initial,
+                                     const MemoryShare &memory, std::size_t bytes_each,
+                                     std::istream &in, int in_fd)
+        : stage_(stage), in_(in), in_fd_(in_fd), size_(std::max<std::size_t>(1, initial)), max_(size_),
+          created_(std::chrono::steady_clock::now())
+    {
+        const char *target = std::getenv("BATCH_TARGET_P99_MS");
+        target_ms_ = target && *target ? std::strtod(target, nullptr) : 0.0;
+        // Replayed input is all there at once; there is no latency to steer.
+        enabled_ = target_ms_ > 0 && !replaying;
+        if (!enabled_)
+        {
+            return;
+        }
+        const char *max = std::getenv("BATCH_MAX");
+        const std::size_t configured = max && *max ? std::strtoull(max, nullptr, 10) : 4096;
+        max_ = memory.fit("BATCH_MAX", std::max<std::size_t>(1, configured), bytes_each, 4);
+        size_ = std::min(size_, max_);
+        deadline_ms_ = target_ms_ / 2;
+        window_.reserve(128);
+        // std::cin flushes std::cout before every read; batches are
+        // flushed here instead.
+        in_.tie(nullptr);
+
+        const std::string path = stage_path("BATCH_METRICS_DIR", stage, ".metrics");
+        if (!path.empty())
+        {
+            metrics_.open(path, std::ios::trunc);
+            if (!metrics_)
+            {
+                std::cerr << stage << ": cannot open batch metrics file " << path << "\n";
+            }
+        }
+    }
+
+    BatchController::~BatchController()
+    {
+        flush_records();
+        if (!enabled_ || batches_ == 0)
+        {
+            return;
+        }
+        char line[256];
+        std::snprintf(line, sizeof(line),
+                      "%s: batching target_p99_ms=%g p99_ms=%.3f batches=%llu size=%zu grows=%llu "
+                      "shrinks=%llu deadline_flushes=%llu\n",
+                      stage_, target_ms_, p99_ms_, static_cast<unsigned long long>(batches_), size_,
+                      static_cast<unsigned long long>(grows_), static_cast<unsigned long long>(shrinks_),
+                      static_cast<unsigned long long>(deadline_flushes_));
+        std::cerr << line;
+    }
+
+    bool BatchController::wait_input(bool batch_empty)
+    {
+        if (!enabled_)
+        {
+            return true;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        const double left = batch_empty ? 0.0 : deadline_ms_ - ms_between(batch_start_, now);
+        if (!batch_empty && left <= 0)
+        {
+            ++deadline_flushes_;
+            return false;
+        }
+        if (in_.rdbuf()->in_avail() > 0 || in_fd_ < 0)
+        {
+            if (batch_empty)
+            {
+                batch_start_ = now;
+            }
+            return true;
+        }
+
+        // Nothing to read: what was written so far is what downstream is
+        // waiting for.
+        std::cout.flush();
+        const int timeout = batch_empty ? -1 : static_cast<int>(std::ceil(left));
+        pollfd pfd{in_fd_, POLLIN, 0};
+        int ready = 0;
+        while ((ready = poll(&pfd, 1, timeout)) < 0 && errno == EINTR)
+        {
+        }
+        if (ready == 0)
+        {
+            ++deadline_flushes_;
+            return false;
+        }
+        if (batch_empty)
+        {
+            batch_start_ = std::chrono::steady_clock::now();
+        }
+        return true;
+    }
+
+    void BatchController::filled()
+    {
+        if (enabled_)
+        {
+            fill_end_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    void BatchController::done(std::size_t n)
+    {
+        if (!enabled_ || n == 0)
+        {
+            return;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        const double fill_ms = ms_between(batch_start_, fill_end_);
+        const double proc_ms = ms_between(fill_end_, now);
+
+        // The batch's first record waited longest: its latency stands
+        // for the batch.
+        if (window_.size() < 128)
+        {
+            window_.push_back(fill_ms + proc_ms);
+        }
+        else
+        {
+            window_[next_slot_] = fill_ms + proc_ms;
+            next_slot_ = (next_slot_ + 1) % window_.size();
+        }
+        std::vector<double> sorted(window_);
+        const std::size_t rank = (sorted.size() * 99 + 99) / 100 - 1;
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        p99_ms_ = sorted[rank];
+
+        const double per_record = proc_ms / n;
+        proc_ms_per_record_ = batches_ ? 0.8 * proc_ms_per_record_ + 0.2 * per_record : per_record;
+        const std::streamsize queued = std::max<std::streamsize>(0, in_.rdbuf()->in_avail());
+
+        // Shrink at once; grow only on a settled window, a full batch
+        // and input already waiting.
+        const char *action = "hold";
+        std::size_t next = size_;
+        if (p99_ms_ > target_ms_ && size_ > 1)
+        {
+            next = size_ / 2;
+            action = "shrink";
+            ++shrinks_;
+        }
+        else if (p99_ms_ < target_ms_ / 2 && window_.size() >= 8 && n >= size_ && queued > 0 && size_ < max_)
+        {
+            next = std::min(max_, size_ * 2);
+            action = "grow";
+            ++grows_;
+        }
+        if (next != size_)
+        {
+            // Latencies measured at the old size no longer apply.
+            window_.clear();
+            next_slot_ = 0;
+        }
+        deadline_ms_ = std::max(0.0, target_ms_ / 2 - proc_ms_per_record_ * next);
+
+        if (metrics_.is_open())
+        {
+            char line[256];
+            std::snprintf(line, sizeof(line),
+                          "%.6f size=%zu next=%zu deadline_ms=%.3f fill_ms=%.3f proc_ms=%.3f "
+                          "queue_bytes=%lld p99_ms=%.3f action=%s\n",
+                          ms_between(created_, now) / 1000.0, size_, next, deadline_ms_, fill_ms, proc_ms,
+                          static_cast<long long>(queued), p99_ms_, action);
+            metrics_ << line;
+        }
+        size_ = next;
+        ++batches_;
+    }
+
+    void BatchController::wait_record()
+    {
+        while (!wait_input(pending_ == 0))
+        {
+            flush_records();
+        }
+    }
+
+    void BatchController::wrote_record()
+    {
+        if (enabled_ && ++pending_ >= size_)
+        {
+            flush_records();
+        }
+    }
+
+    void BatchController::flush_records()
+    {
+        if (pending_ == 0)
+        {
+            return;
+        }
+        filled();
+        std::cout.flush();
+        done(pending_);
+        pending_ = 0;
+    }
+
+    int parse_replay_args(int argc, char *argv[], ReplayOptions &opts)
+    {
+        if (argc < 2 || std::strcmp(argv[1], "--replay") != 0)
+        {
+            return 0;
+        }
+        if (argc != 3 && !(argc == 5 && std::strcmp(argv[3], "--repeat") == 0))
+        {
+            return -1;
+        }
+        opts.path = argv[2];
+        if (argc == 5)
+        {
+            char *end = nullptr;
+            opts.repeat = std::strtol(argv[4], &end, 10);
+            if (*end != '\0' || opts.repeat < 1)
+            {
+                return -1;
+            }
+        }
+        return 1;
+    }
+
+    int replay(const char *stage, const ReplayOptions &opts, const std::function<int()> &body)
+    {
+        std::ifstream in(opts.path, std::ios::binary);
+        if (!in)
+        {
+            std::cerr << stage << ": cannot open replay file " << opts.path << "\n";
+            return 1;
+        }
+        std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        const long records = std::count(data.begin(), data.end(), '\n');
+
+        // As in Capture: switch stdio syncing off before redirecting.
+        std::ios::sync_with_stdio(false);
+        MemoryBuf mem(data.data(), data.data() + data.size());
+        std::streambuf *const saved = std::cin.rdbuf(&mem);
+
+        int rc = 0;
+        replaying = true;
+        const auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < opts.repeat && rc == 0; ++i)
+        {
+            mem.rewind();
+            std::cin.clear();
+            rc = body();
+        }
+        std::cout.flush();
+        replaying = false;
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cin.rdbuf(saved);
+
+        const double total_records = static_cast<double>(records) * opts.repeat;
+        const double total_bytes = static_cast<double>(data.size()) * opts.repeat;
+        std::cerr << "REPLAY " << stage << " records=" << records << " bytes=" << data.size()
+                  << " repeat=" << opts.repeat << " seconds=" << seconds
+                  << " records_per_s=" << (seconds > 0 ? total_records / seconds : 0.0)
+                  << " mb_per_s=" << (seconds > 0 ? total_bytes / seconds / 1e6 : 0.0) << "\n";
+        return rc;
+    }
+
+    bool parse_serve_args(int argc, char *argv[], int &control)
+    {
+        if (argc != 3 || std::strcmp(argv[1], "--serve") != 0)
+        {
+            return false;
+        }
+        char *end = nullptr;
+        const long fd = std::strtol(argv[2], &end, 10);
+        if (*end != '\0' || fd < 0)
+        {
+            return false;
+        }
+        control = static_cast<int>(fd);
+        return true;
+    }
+
+    int serve(const char *stage, int control,
+              const std::function<int(const std::vector<std::string> &args)> &body)
+    {
+        // As in replay(): switch stdio syncing off before redirecting.
+        std::ios::sync_with_stdio(false);
+        std::signal(SIGPIPE, SIG_IGN);
+        const int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+        std::ios saved_format(nullptr);
+        saved_format.copyfmt(std::cout);
+        std::ostream *const saved_tie = std::cin.tie();
+
+        for (;;)
+        {
+            std::string msg;
+            std::vector<int> fds;
+            const long n = net::recv_fds(control, msg, fds, 2);
+            if (n <= 0 || fds.size() != 2)
+            {
+                for (const int fd : fds)
+                {
+                    close(fd);
+                }
+                if (n == 0)
+                {
+                    return 0;
+                }
+                std::cerr << stage << ": malformed serve request\n";
+                return 1;
+            }
+
+            // The job's arguments and environment; the old values come back afterwards.
+            struct Saved
+            {
+                std::string name;
+                bool had;
+                std::string value;
+            };
+            std::vector<std::string> args;
+            std::vector<Saved> saved;
+            std::stringstream ss(msg);
+            std::string line;
+            while (std::getline(ss, line))
+            {
+                if (line.compare(0, 4, "ARG ") == 0)
+                {
+                    args.push_back(line.substr(4));
+                }
+                else if (line.compare(0, 4, "ENV ") == 0 && line.find('=') != std::string::npos)
+                {
+                    const std::size_t eq = line.find('=');
+                    const std::string name = line.substr(4, eq - 4);
+                    const char *old = std::getenv(name.c_str());
+                    saved.push_back(Saved{name, old != nullptr, old ? old : ""});
+                    setenv(name.c_str(), line.c_str() + eq + 1, 1);
+                }
+            }
+
+            dup2(fds[0], STDIN_FILENO);
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            int rc;
+            {
+                FdBuf in(STDIN_FILENO);
+                FdBuf out(STDOUT_FILENO);
+                std::streambuf *const cin_buf = std::cin.rdbuf(&in);
+                std::streambuf *const cout_buf = std::cout.rdbuf(&out);
+                rc = body(args);
+                std::cout.flush();
+                std::cin.rdbuf(cin_buf);
+                std::cout.rdbuf(cout_buf);
+            }
+            std::cin.clear();
+            std::cout.clear();
+            std::cout.copyfmt(saved_format);
+            std::cin.tie(saved_tie);
+
+            // Close the job's streams: downstream sees end of input.
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            for (auto it = saved.rbegin(); it != saved.rend(); ++it)
+            {
+                if (it->had)
+                {
+                    setenv(it->name.c_str(), it->value.c_str(), 1);
+                }
+                else
+                {
+                    unsetenv(it->name.c_str());
+                }
+            }
+
+            const std::string reply = "EXIT " + std::to_string(rc);
+            if (!net::send_fds(control, reply, {}))
+            {
+                return 0;
+            }
+        }
+    }
+
+} // namespace stage_io
@@ -0,0 +1,268 @@
+/// @file topology.cpp
+/// @brief Implementation of the pipeline description parser.
+#include "topology.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    std::vector<std::string> split(const std::string &s, char sep)
+    {
+        std::vector<std::string> out;
+        std::stringstream ss(s);
+        std::string item;
+        while (std::getline(ss, item, sep))
+        {
+            out.push_back(item);
+        }
+        return out;
+    }
+
+    /// @brief Parse a non-negative integer; false on trailing garbage.
+    bool parse_size(const std::string &s, long &out)
+    {
+        char *end = nullptr;
+        out = std::strtol(s.c_str(), &end, 10);
+        return !s.empty() && *end == '\0' && out >= 0;
+    }
+
+    /// @brief Parse a CPU list such as "0-3,6".
+    bool parse_cpus(const std::string &s, std::vector<int> &out)
+    {
+        for (const std::string &item : split(s, ','))
+        {
+            const std::size_t dash = item.find('-');
+            long lo = 0;
+            long hi = 0;
+            if (!parse_size(item.substr(0, dash), lo) ||
+                !parse_size(dash == std::string::npos ? item.substr(0, dash) : item.substr(dash + 1), hi) ||
+                hi < lo)
+            {
+                return false;
+            }
+            for (long c = lo; c <= hi; ++c)
+            {
+                out.push_back(static_cast<int>(c));
+            }
+        }
+        return !out.empty();
+    }
+
+    /// @brief Apply one key=value option to a stage.
+    bool apply_option(const std::string &key, const std::string &value, topology::Stage &st)
+    {
+        long n = 0;
+        if (key == "bin")
+        {
+            st.prog = value;
+        }
+        else if (key == "args")
+        {
+            st.args = split(value, ',');
+        }
+        else if (key == "cpus")
+        {
+            return parse_cpus(value, st.cpus);
+        }
+        else if (key == "env")
+        {
+            const std::size_t eq = value.find('=');
+            if (eq == 0 || eq == std::string::npos)
+            {
+                return false;
+            }
+            st.env.emplace_back(value.substr(0, eq), value.substr(eq + 1));
+        }
+        else if (key == "transport")
+        {
+            if (value == "pipe")
+            {
+                st.transport = topology::Transport::Pipe;
+            }
+            else if (value == "socketpair")
+            {
+                st.transport = topology::Transport::SocketPair;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (key == "pipe_size")
+        {
+            if (!parse_size(value, n))
+            {
+                return false;
+            }
+            st.pipe_size = static_cast<std::size_t>(n);
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+} // namespace
+
+namespace topology
+{
+    bool parse(std::istream &in, Topology &out, std::string &err)
+    {
+        out = Topology{};
+        std::string line;
+        int line_no = 0;
+        bool seen_shared = false;
+        while (std::getline(in, line))
+        {
+            ++line_no;
+            const std::string where = "line " + std::to_string(line_no) + ": ";
+            line = line.substr(0, line.find('#'));
+            std::stringstream ss(line);
+            std::string word;
+            if (!(ss >> word))
+            {
+                continue;
+            }
+
+            if (word == "workers")
+            {
+                long n = 0;
+                if (!(ss >> word) || !parse_size(word, n) || n < 1 || (ss >> word))
+                {
+                    err = where + "expected 'workers <N>' with N >= 1";
+                    return false;
+                }
+                out.workers = static_cast<int>(n);
+                continue;
+            }
+            if (word != "stage")
+            {
+                err = where + "unknown directive '" + word + "'";
+                return false;
+            }
+
+            Stage st;
+            if (!(ss >> st.name))
+            {
+                err = where + "stage without a name";
+                return false;
+            }
+            st.prog = "bin/" + st.name;
+            while (ss >> word)
+            {
+                if (word == "shared")
+                {
+                    st.shared = true;
+                    continue;
+                }
+                const std::size_t eq = word.find('=');
+                if (word.compare(0, eq, "replicas") == 0)
+                {
+                    err = where + "stages cannot have their own replica count; use "
+                                  "'workers <N>' (per-worker stages) or 'shared' (one instance)";
+                    return false;
+                }
+                if (eq == std::string::npos ||
+                    !apply_option(word.substr(0, eq), word.substr(eq + 1), st))
+                {
+                    err = where + "bad option '" + word + "'";
+                    return false;
+                }
+            }
+            if (seen_shared && !st.shared)
+            {
+                err = where + "per-worker stage '" + st.name + "' after a shared stage";
+                return false;
+            }
+            seen_shared = seen_shared || st.shared;
+            out.stages.push_back(std::move(st));
+        }
+
+        if (out.stages.empty())
+        {
+            err = "no stages";
+            return false;
+        }
+        if (out.stages.front().shared)
+        {
+            err = "the first stage cannot be shared";
+            return false;
+        }
+        return true;
+    }
+
+    bool load(const std::string &path, Topology &out)
+    {
+        std::ifstream ifs(path);
+        if (!ifs)
+        {
+            std::cerr << "topology: cannot open " << path << "\n";
+            return false;
+        }
+        std::string err;
+        if (!parse(ifs, out, err))
+        {
+            std::cerr << "topology: " << path << ": " << err << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    Topology default_topology()
+    {
+        std::stringstream ss("stage preprocess args={csv},{shard}\n"
+                             "stage forward_layer\n"
+                             "stage backward_layer\n"
+                             "stage logger shared\n");
+        Topology t;
+        std::string err;
+        parse(ss, t, err);
+        return t;
+    }
+
+    bool make_edge(const Stage &from, int fds[2])
+    {
+        if (from.transport == Transport::SocketPair)
+        {
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+            {
+                std::perror(("socketpair " + from.name).c_str());
+                return false;
+            }
+            if (from.pipe_size > 0)
+            {
+                const int size = static_cast<int>(from.pipe_size);
+                setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+                setsockopt(fds[0], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+            }
+            shutdown(fds[0], SHUT_WR);
+            shutdown(fds[1], SHUT_RD);
+        }
+        else
+        {
+            if (pipe(fds) < 0)
+            {
+                std::perror(("pipe " + from.name).c_str());
+                return false;
+            }
+            if (from.pipe_size > 0 &&
+                fcntl(fds[1], F_SETPIPE_SZ, static_cast<int>(from.pipe_size)) < 0)
+            {
+                std::perror(("F_SETPIPE_SZ " + from.name).c_str());
+            }
+        }
+        for (int i = 0; i < 2; ++i)
+        {
+            fcntl(fds[i], F_SETFD, fcntl(fds[i], F_GETFD) | FD_CLOEXEC);
+        }
+        return true;
+    }
+
+} // namespace topology
@@ -1,18 +1,43 @@
 /// @file trainer.cpp
 /// @brief Implementation of the trainer (orchestrator) executable.
 #include "trainer.hpp"
+#include "autotune.hpp"
+#include "job_server.hpp"
+#include "stage_io.hpp"
+#include "topology.hpp"
+#include "transform.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <dirent.h>
 #include <fcntl.h>     // for fcntl, FD_CLOEXEC
+#include <poll.h>
+#include <sched.h>
+#include <fstream>
+#include <initializer_list>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
 namespace
 {
+    /// @brief Topology used when neither --config nor TRAINER_CONFIG is given.
+    const char *const DEFAULT_CONFIG = "config/pipeline.conf";
+
     volatile std::sig_atomic_t g_child_exited = 0;
 
     void sigchld_handler(int)
@@ -20,19 +45,12 @@ namespace
         g_child_exited = 1;
     }
 
-    void set_cloexec(int fd)
-    {
-        int flags = fcntl(fd, F_GETFD);
-        if (flags >= 0) {
-            flags |= FD_CLOEXEC;
-            fcntl(fd, F_SETFD, flags);
-        }
-    }
-
     int spawn_child(const char *prog,
                     char *const argv[],
                     int stdin_fd,
-                    int stdout_fd)
+                    int stdout_fd,
+                    int stderr_fd = -1,
+                    const topology::Stage *stage = nullptr)
     {
         pid_t pid = fork();
 
@@ -56,6 +74,30 @@ namespace
                 }
             }
 
+            if (stderr_fd >= 0 && stderr_fd != STDERR_FILENO) {
+                if (dup2(stderr_fd, STDERR_FILENO) < 0) {
+                    std::perror("dup2 stderr");
+                    _exit(1);
+                }
+            }
+
+            // Per-stage settings from the topology apply to this child only.
+            if (stage) {
+                for (const auto &kv : stage->env) {
+                    setenv(kv.first.c_str(), kv.second.c_str(), 1);
+                }
+                if (!stage->cpus.empty()) {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    for (int cpu : stage->cpus) {
+                        CPU_SET(cpu, &set);
+                    }
+                    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+                        std::perror("sched_setaffinity");
+                    }
+                }
+            }
+
             execvp(prog, argv);
             std::perror("execvp");
             _exit(1);
@@ -64,125 +106,1312 @@ namespace
         return pid;
     }
 
+    /**
+     * @brief Number of data-parallel pipelines from TRAINER_WORKERS.
+     *
+     * @param fallback Value used if TRAINER_WORKERS is unset or invalid.
+     * @return Value of TRAINER_WORKERS if it is a positive integer, else fallback.
+     */
+    int get_workers(int fallback)
+    {
+        const char *env = std::getenv("TRAINER_WORKERS");
+        if (!env || !*env)
+        {
+            return fallback;
+        }
+        char *end = nullptr;
+        const long v = std::strtol(env, &end, 10);
+        return (end && *end == '\0' && v > 0) ? static_cast<int>(v) : fallback;
+    }
 
-} // namespace
+    /**
+     * @brief Build a stage's argv strings, expanding {csv} and {shard}.
+     *
+     * "{shard}" alone is dropped when there is a single worker.
+     */
+    std::vector<std::string> stage_args(const topology::Stage &st,
+                                        const std::string &csv_path,
+                                        int worker, int workers)
+    {
+        const std::string shard = std::to_string(worker) + "/" + std::to_string(workers);
+        std::vector<std::string> args = {st.prog};
+        for (std::string a : st.args)
+        {
+            if (a == "{shard}" && workers == 1)
+            {
+                continue;
+            }
+            for (const auto &ph : {std::make_pair(std::string("{csv}"), csv_path),
+                                   std::make_pair(std::string("{shard}"), shard)})
+            {
+                for (std::size_t at = a.find(ph.first); at != std::string::npos;
+                     at = a.find(ph.first, at + ph.second.size()))
+                {
+                    a.replace(at, ph.first.size(), ph.second);
+                }
+            }
+            args.push_back(a);
+        }
+        return args;
+    }
 
-namespace trainer
-{
-    int run(const std::string &csv_path)
+    /**
+     * @brief Spawn a stage from its argv strings.
+     *
+     * @param stderr_fd Stage's stderr (-1: inherit the trainer's).
+     * @param progress  TRAINER_PROGRESS value for the stage ("" for none).
+     */
+    int spawn_stage(const topology::Stage &st, const std::vector<std::string> &args,
+                    int stdin_fd, int stdout_fd, int stderr_fd, const std::string &progress)
     {
-        // Install SIGCHLD handler so we can notice if a child dies unexpectedly.
-        std::signal(SIGCHLD, sigchld_handler);
+        std::vector<char *> argv;
+        for (const std::string &a : args)
+        {
+            argv.push_back(const_cast<char *>(a.c_str()));
+        }
+        argv.push_back(nullptr);
+        if (progress.empty())
+        {
+            return spawn_child(st.prog.c_str(), argv.data(), stdin_fd, stdout_fd, stderr_fd, &st);
+        }
+        topology::Stage watched = st;
+        watched.env.emplace_back("TRAINER_PROGRESS", progress);
+        return spawn_child(st.prog.c_str(), argv.data(), stdin_fd, stdout_fd, stderr_fd, &watched);
+    }
 
-        int pipe_pre_to_fwd[2];
-        int pipe_fwd_to_bwd[2];
-        int pipe_bwd_to_log[2];
+    /**
+     * @brief Whether to train through bin/param_server (TRAINER_PS=1).
+     *
+     * Only applies to training; test runs never start a server.
+     *
+     * @return true if TRAINER_PS is "1" and BACKWARD_MODE is not test.
+     */
+    bool use_param_server()
+    {
+        const char *ps = std::getenv("TRAINER_PS");
+        const char *mode = std::getenv("BACKWARD_MODE");
+        const bool test = mode && (std::strcmp(mode, "test") == 0 ||
+                                   std::strcmp(mode, "TEST") == 0);
+        return ps && std::strcmp(ps, "1") == 0 && !test;
+    }
 
-        if (pipe(pipe_pre_to_fwd) < 0)
+    /**
+     * @brief Whether to fuse stateless stages into their upstream stage.
+     *
+     * @return true if TRAINER_FUSE is "1".
+     */
+    bool use_fusion()
+    {
+        const char *fuse = std::getenv("TRAINER_FUSE");
+        return fuse && std::strcmp(fuse, "1") == 0;
+    }
+
+    /**
+     * @brief Whether a stage can run fused into its upstream stage.
+     *
+     * forward_layer stops qualifying once it loads FORWARD_PLUGINS or
+     * expands features (FORWARD_EXPAND), which only the forward_layer
+     * process does.
+     */
+    bool fusable(const std::string &stage)
+    {
+        const char *plugins = std::getenv("FORWARD_PLUGINS");
+        const char *expand = std::getenv("FORWARD_EXPAND");
+        if (stage == "forward_layer" &&
+            ((plugins && *plugins) || (expand && *expand)))
         {
-            std::perror("pipe pre->fwd");
-            return 1;
+            return false;
         }
-        if (pipe(pipe_fwd_to_bwd) < 0)
+        return transform::find(stage) != nullptr;
+    }
+
+    /**
+     * @brief Parse a byte size: a number with an optional K, M or G
+     *        suffix (powers of 1024), e.g. "512M".
+     *
+     * @return false if malformed or zero.
+     */
+    bool parse_bytes(const char *s, std::size_t &out)
+    {
+        char *end = nullptr;
+        const double v = std::strtod(s, &end);
+        double scale = 1.0;
+        switch (*end)
         {
-            std::perror("pipe fwd->bwd");
-            return 1;
+        case 'k': case 'K': scale = 1024.0; ++end; break;
+        case 'm': case 'M': scale = 1024.0 * 1024; ++end; break;
+        case 'g': case 'G': scale = 1024.0 * 1024 * 1024; ++end; break;
+        default: break;
         }
-        if (pipe(pipe_bwd_to_log) < 0)
+        if (end == s || *end != '\0' || !(v > 0.0))
         {
-            std::perror("pipe bwd->log");
-            return 1;
+            return false;
         }
+        out = static_cast<std::size_t>(v * scale);
+        return out > 0;
+    }
 
-        // Mark all pipe FDs as close-on-exec. Children that need them will
-        // dup2 them onto stdin/stdout before exec; the dup'd FDs (0/1) will NOT
-        // have FD_CLOEXEC, so they survive exec, while the originals are closed.
-        set_cloexec(pipe_pre_to_fwd[0]);
-        set_cloexec(pipe_pre_to_fwd[1]);
-        set_cloexec(pipe_fwd_to_bwd[0]);
-        set_cloexec(pipe_fwd_to_bwd[1]);
-        set_cloexec(pipe_bwd_to_log[0]);
-        set_cloexec(pipe_bwd_to_log[1]);
-
-        // Copy CSV path into a mutable buffer for argv.
-        char csv_arg[1024];
-        std::strncpy(csv_arg, csv_path.c_str(), sizeof(csv_arg) - 1);
-        csv_arg[sizeof(csv_arg) - 1] = '\0';
-
-        // Executable paths (built into bin/ by build.sh)
-        const char *pre_prog = "bin/preprocess";
-        const char *fwd_prog = "bin/forward_layer";
-        const char *bwd_prog = "bin/backward_layer";
-        const char *log_prog = "bin/logger";
-
-        // argv arrays (argv[0] should be the program name/path)
-        char *pre_argv[] = {
-            const_cast<char *>(pre_prog),
-            csv_arg,
-            nullptr
-        };
+    /// @brief Capacity of a pipe whose size is not set (Linux default).
+    constexpr std::size_t DEFAULT_PIPE_SIZE = 64 * 1024;
 
-        char *fwd_argv[] = {
-            const_cast<char *>(fwd_prog),
-            nullptr
-        };
+    /// @brief Below this a stage process hardly fits its code and stdio.
+    constexpr std::size_t MIN_STAGE_MEMORY = 8 << 20;
 
-        char *bwd_argv[] = {
-            const_cast<char *>(bwd_prog),
-            nullptr
-        };
+    /**
+     * @brief Fit the pipeline into a memory budget.
+     *
+     * An eighth of the budget is for edge buffers: an edge keeps its
+     * configured size (DEFAULT_PIPE_SIZE if none) unless its even part
+     * of that eighth is smaller, in which case it shrinks to it (whole
+     * pages). The rest is split evenly between the processes.
+     *
+     * @param budget    Total bytes (TRAINER_MEMORY_BUDGET).
+     * @param processes Processes the run spawns.
+     * @param edges     Writer of every edge, once per edge; their
+     *                  pipe_size is updated.
+     * @return Each process's share in bytes.
+     */
+    std::size_t plan_memory(std::size_t budget, std::size_t processes,
+                            const std::vector<topology::Stage *> &edges)
+    {
+        const std::size_t page = 4096;
+        std::size_t per_edge = edges.empty() ? 0 : budget / 8 / edges.size() / page * page;
+        per_edge = std::max(per_edge, page);
+
+        std::size_t pipes = 0;
+        for (topology::Stage *st : edges)
+        {
+            const std::size_t size = st->pipe_size ? st->pipe_size : DEFAULT_PIPE_SIZE;
+            if (size > per_edge)
+            {
+                st->pipe_size = per_edge;
+            }
+            pipes += std::min(size, per_edge);
+        }
+
+        const std::size_t share = budget > pipes ? (budget - pipes) / processes : 0;
+        std::cerr << "trainer: memory budget " << budget / double(1 << 20) << " MiB: "
+                  << edges.size() << " edges, " << pipes / 1024 << " KiB of buffers; "
+                  << processes << " processes x " << share / double(1 << 20) << " MiB\n";
+        if (share < MIN_STAGE_MEMORY)
+        {
+            std::cerr << "trainer: warning: a share below " << (MIN_STAGE_MEMORY >> 20)
+                      << " MiB is smaller than a stage process needs\n";
+        }
+        return share;
+    }
+
+    /// @brief A spawned stage and, once reaped, its resource usage.
+    struct Child
+    {
+        pid_t pid;
+        std::string stage;  ///< Executable name, e.g. "forward_layer".
+        int worker;         ///< Pipeline index, -1 for shared stages.
+        int exit_code = -1; ///< Exit status, or 128 + signal.
+        struct rusage usage = {};
+
+        // Watchdog state (see reap_children()).
+        bool running = true;
+        int slot = -1;                ///< Progress slot, -1 if not watched.
+        std::vector<int> upstream{};  ///< Slots feeding this stage (empty: reads a file).
+        std::uint64_t seen_in = 0;    ///< Counters at the last check.
+        std::uint64_t seen_out = 0;
+        std::chrono::steady_clock::time_point since{}; ///< Last progress, or last idle check.
+        bool reported = false;        ///< Current stall already reported.
+        std::uint64_t rejected = 0;   ///< Rows it quarantined (see stage_io::Quarantine).
+        bool stopping = false;        ///< Asked its upstream stages to stop.
+        bool stopped = false;         ///< Stopped on a downstream request; any exit is fine.
+    };
+
+    /// @brief What the watchdog does once it has reported a stall.
+    enum class StallAction
+    {
+        Report,  ///< Only report it; the run goes on.
+        Restart, ///< Kill the pipeline and run it again.
+        Abort    ///< Kill the pipeline; the run fails.
+    };
+
+    /// @brief Stall watchdog settings.
+    struct Watchdog
+    {
+        double stall_secs = 0.0;                  ///< 0 disables the watchdog.
+        StallAction action = StallAction::Report;
+        int restarts = 1;                         ///< Restarts allowed per run.
+    };
 
-        char *log_argv[] = {
-            const_cast<char *>(log_prog),
-            nullptr
+    /// @brief How often a running watchdog looks at the counters.
+    constexpr int WATCH_INTERVAL_MS = 100;
+
+    /**
+     * @brief Watchdog settings from the environment.
+     *
+     *   - TRAINER_STALL_SECS     : seconds without progress before a stage
+     *                              counts as stalled (unset or 0: off).
+     *   - TRAINER_STALL_ACTION   : report (default), restart or abort.
+     *                              With restart the last stage's output
+     *                              is buffered and reaches stdout only
+     *                              once an attempt completes, so a killed
+     *                              attempt leaves no partial records, but
+     *                              nothing is streamed while it runs.
+     *   - TRAINER_STALL_RESTARTS : restarts allowed per run (default 1).
+     */
+    Watchdog watchdog_from_env()
+    {
+        Watchdog wd;
+        const char *secs = std::getenv("TRAINER_STALL_SECS");
+        if (secs && *secs)
+        {
+            char *end = nullptr;
+            const double v = std::strtod(secs, &end);
+            if (*end != '\0' || !(v >= 0.0))
+            {
+                std::cerr << "trainer: invalid TRAINER_STALL_SECS=" << secs
+                          << ", watchdog off\n";
+            }
+            else
+            {
+                wd.stall_secs = v;
+            }
+        }
+
+        const char *action = std::getenv("TRAINER_STALL_ACTION");
+        if (action && *action)
+        {
+            if (std::strcmp(action, "restart") == 0)
+            {
+                wd.action = StallAction::Restart;
+            }
+            else if (std::strcmp(action, "abort") == 0)
+            {
+                wd.action = StallAction::Abort;
+            }
+            else if (std::strcmp(action, "report") != 0)
+            {
+                std::cerr << "trainer: invalid TRAINER_STALL_ACTION=" << action
+                          << ", using report\n";
+            }
+        }
+
+        const char *restarts = std::getenv("TRAINER_STALL_RESTARTS");
+        if (restarts && *restarts)
+        {
+            wd.restarts = std::max(0, std::atoi(restarts));
+        }
+        return wd;
+    }
+
+    /**
+     * @brief The stages' progress counters, one stage_io::Progress per
+     *        slot in a memfd the children inherit.
+     */
+    class ProgressBoard
+    {
+    public:
+        explicit ProgressBoard(std::size_t slots) : bytes_(slots * sizeof(stage_io::Progress))
+        {
+            fd_ = memfd_create("trainer-progress", 0);
+            if (fd_ < 0 || ftruncate(fd_, static_cast<off_t>(bytes_)) != 0)
+            {
+                std::perror("trainer: progress memfd");
+                return;
+            }
+            void *p = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if (p == MAP_FAILED)
+            {
+                std::perror("trainer: progress mmap");
+                return;
+            }
+            slots_ = static_cast<stage_io::Progress *>(p);
+        }
+
+        ~ProgressBoard()
+        {
+            if (slots_)
+            {
+                munmap(slots_, bytes_);
+            }
+            if (fd_ >= 0)
+            {
+                close(fd_);
+            }
+        }
+
+        ProgressBoard(const ProgressBoard &) = delete;
+        ProgressBoard &operator=(const ProgressBoard &) = delete;
+
+        bool ok() const { return slots_ != nullptr; }
+
+        /// @brief Zero all counters (before a restart).
+        void reset() { std::memset(static_cast<void *>(slots_), 0, bytes_); }
+
+        /// @brief TRAINER_PROGRESS value handing a slot to a stage.
+        std::string env(int slot) const
+        {
+            return std::to_string(fd_) + ":" + std::to_string(slot);
+        }
+
+        const stage_io::Progress &operator[](int slot) const { return slots_[slot]; }
+
+    private:
+        std::size_t bytes_;
+        int fd_ = -1;
+        stage_io::Progress *slots_ = nullptr;
+    };
+
+    /**
+     * @brief Whether children's stderr goes through a StderrMux
+     *        (TRAINER_STDERR_MUX, default on; "0" turns it off).
+     */
+    bool use_stderr_mux()
+    {
+        const char *mux = std::getenv("TRAINER_STDERR_MUX");
+        return !(mux && std::strcmp(mux, "0") == 0);
+    }
+
+    /**
+     * @brief Collects the children's stderr, one pipe each, and copies it
+     *        to the trainer's stderr line by line as
+     *          [<seconds since start> <stage>[.<worker>]] <line>
+     *
+     * Lines from different stages can no longer tear into each other,
+     * and each one says which process wrote it and when.
+     */
+    class StderrMux
+    {
+    public:
+        explicit StderrMux(std::chrono::steady_clock::time_point start)
+            : ep_(epoll_create1(EPOLL_CLOEXEC)), start_(start)
+        {
+            if (ep_ < 0)
+            {
+                std::perror("trainer: epoll_create1");
+            }
+        }
+
+        ~StderrMux()
+        {
+            drain();
+            if (ep_ >= 0)
+            {
+                close(ep_);
+            }
+        }
+
+        StderrMux(const StderrMux &) = delete;
+        StderrMux &operator=(const StderrMux &) = delete;
+
+        /**
+         * @brief Open the stderr pipe of a child about to be spawned.
+         *
+         * @param label Name shown on its lines.
+         * @return Write end for the child (close-on-exec; close it after
+         *         spawning), or -1 to let the child inherit stderr.
+         */
+        int open(const std::string &label)
+        {
+            int fds[2];
+            if (ep_ < 0 || pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0)
+            {
+                return -1;
+            }
+            // Only the read end is non-blocking; the child writes normally.
+            fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) & ~O_NONBLOCK);
+
+            sources_.push_back(std::unique_ptr<Source>(new Source{fds[0], label, {}}));
+            struct epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.ptr = sources_.back().get();
+            epoll_ctl(ep_, EPOLL_CTL_ADD, fds[0], &ev);
+            return fds[1];
+        }
+
+        /**
+         * @brief Wait up to timeout_ms for output and copy what arrived.
+         *
+         * Returns early on a signal (SIGCHLD) as well.
+         */
+        void pump(int timeout_ms)
+        {
+            struct epoll_event events[16];
+            const int n = epoll_wait(ep_, events, 16, timeout_ms);
+            for (int i = 0; i < n; ++i)
+            {
+                read_source(*static_cast<Source *>(events[i].data.ptr));
+            }
+        }
+
+        /// @brief Copy whatever is buffered now and close every pipe.
+        void drain()
+        {
+            for (const std::unique_ptr<Source> &src : sources_)
+            {
+                read_source(*src);
+                finish(*src);
+            }
+        }
+
+    private:
+        struct Source
+        {
+            int fd;
+            std::string label;
+            std::string partial; ///< Start of an unfinished line.
         };
 
-        // Spawn children with appropriate pipe ends for stdin/stdout.
-        pid_t pre_pid = spawn_child(pre_prog, pre_argv,
-                                    /*stdin_fd=*/-1,
-                                    /*stdout_fd=*/pipe_pre_to_fwd[1]);
-        if (pre_pid < 0) return 1;
-
-        pid_t fwd_pid = spawn_child(fwd_prog, fwd_argv,
-                                    /*stdin_fd=*/pipe_pre_to_fwd[0],
-                                    /*stdout_fd=*/pipe_fwd_to_bwd[1]);
-        if (fwd_pid < 0) return 1;
-
-        pid_t bwd_pid = spawn_child(bwd_prog, bwd_argv,
-                                    /*stdin_fd=*/pipe_fwd_to_bwd[0],
-                                    /*stdout_fd=*/pipe_bwd_to_log[1]);
-        if (bwd_pid < 0) return 1;
-
-        pid_t log_pid = spawn_child(log_prog, log_argv,
-                                    /*stdin_fd=*/pipe_bwd_to_log[0],
-                                    /*stdout_fd=*/-1); // logger uses parent's stdout
-        if (log_pid < 0) return 1;
-
-        // Parent closes its copies of pipe ends.
-        close(pipe_pre_to_fwd[0]);
-        close(pipe_pre_to_fwd[1]);
-        close(pipe_fwd_to_bwd[0]);
-        close(pipe_fwd_to_bwd[1]);
-        close(pipe_bwd_to_log[0]);
-        close(pipe_bwd_to_log[1]);
-
-        // Wait for children to exit.
+        /// @brief Longest line kept whole; longer ones are split.
+        static constexpr std::size_t MAX_LINE = 64 * 1024;
+
+        void read_source(Source &src)
+        {
+            char buf[4096];
+            for (;;)
+            {
+                if (src.fd < 0)
+                {
+                    return;
+                }
+                const ssize_t got = read(src.fd, buf, sizeof(buf));
+                if (got < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (got <= 0)
+                {
+                    if (got == 0)
+                    {
+                        finish(src);
+                    }
+                    return;
+                }
+                src.partial.append(buf, static_cast<std::size_t>(got));
+
+                std::size_t begin = 0;
+                for (std::size_t nl; (nl = src.partial.find('\n', begin)) != std::string::npos;
+                     begin = nl + 1)
+                {
+                    emit(src, src.partial.substr(begin, nl - begin));
+                }
+                src.partial.erase(0, begin);
+                if (src.partial.size() >= MAX_LINE)
+                {
+                    emit(src, src.partial);
+                    src.partial.clear();
+                }
+            }
+        }
+
+        /// @brief Flush an unfinished last line and close the pipe.
+        void finish(Source &src)
+        {
+            if (src.fd < 0)
+            {
+                return;
+            }
+            if (!src.partial.empty())
+            {
+                emit(src, src.partial);
+                src.partial.clear();
+            }
+            epoll_ctl(ep_, EPOLL_CTL_DEL, src.fd, nullptr);
+            close(src.fd);
+            src.fd = -1;
+        }
+
+        /// @brief Write one prefixed line with a single write(2).
+        void emit(const Source &src, const std::string &line)
+        {
+            const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+            char stamp[32];
+            std::snprintf(stamp, sizeof(stamp), "[%10.6f ", t);
+            const std::string out = stamp + src.label + "] " + line + "\n";
+            for (std::size_t done = 0; done < out.size();)
+            {
+                const ssize_t n = write(STDERR_FILENO, out.data() + done, out.size() - done);
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    return;
+                }
+                done += static_cast<std::size_t>(n);
+            }
+        }
+
+        int ep_;
+        std::chrono::steady_clock::time_point start_;
+        std::vector<std::unique_ptr<Source>> sources_;
+    };
+
+    /// @brief First line of a /proc file, "" if unreadable.
+    std::string proc_line(const std::string &path)
+    {
+        std::ifstream ifs(path);
+        std::string line;
+        std::getline(ifs, line);
+        return line;
+    }
+
+    /**
+     * @brief Report where a stalled process is: the state, wait channel
+     *        and (if readable; it usually needs root) kernel stack of
+     *        each of its threads.
+     */
+    void report_tasks(pid_t pid)
+    {
+        const std::string dir = "/proc/" + std::to_string(pid) + "/task";
+        DIR *d = opendir(dir.c_str());
+        if (!d)
+        {
+            return;
+        }
+        while (const dirent *e = readdir(d))
+        {
+            if (e->d_name[0] == '.')
+            {
+                continue;
+            }
+            const std::string task = dir + "/" + e->d_name;
+            // State is the field after "(comm)" in stat.
+            const std::string stat = proc_line(task + "/stat");
+            const std::size_t paren = stat.rfind(')');
+            const std::string state = paren != std::string::npos && paren + 2 < stat.size()
+                ? stat.substr(paren + 2, 1) : "?";
+            std::cerr << "trainer:   task " << e->d_name << " state=" << state
+                      << " wchan=" << proc_line(task + "/wchan") << '\n';
+
+            std::ifstream stack(task + "/stack");
+            std::string frame;
+            while (std::getline(stack, frame))
+            {
+                std::cerr << "trainer:     " << frame << '\n';
+            }
+        }
+        closedir(d);
+    }
+
+    /**
+     * @brief Check the watched children for stalls.
+     *
+     * A stage stalls when its counters have not moved for stall_secs
+     * while input is pending for it: its upstream stages wrote more
+     * records than it read, or it reads a file (the first stage). Each
+     * stall is reported once, with the stage's /proc state.
+     *
+     * @return true if a new stall was found.
+     */
+    bool check_stalls(std::vector<Child> &children, const Watchdog &wd,
+                      const ProgressBoard &board,
+                      std::chrono::steady_clock::time_point now)
+    {
+        bool found = false;
+        for (Child &c : children)
+        {
+            if (!c.running || c.slot < 0)
+            {
+                continue;
+            }
+            const std::uint64_t in = board[c.slot].records_in.load(std::memory_order_relaxed);
+            const std::uint64_t out = board[c.slot].records_out.load(std::memory_order_relaxed);
+            std::uint64_t upstream_out = 0;
+            for (int u : c.upstream)
+            {
+                upstream_out += board[u].records_out.load(std::memory_order_relaxed);
+            }
+            const bool pending = c.upstream.empty() || upstream_out > in;
+
+            if (in != c.seen_in || out != c.seen_out || !pending)
+            {
+                c.seen_in = in;
+                c.seen_out = out;
+                c.since = now;
+                c.reported = false;
+                continue;
+            }
+
+            const double idle = std::chrono::duration<double>(now - c.since).count();
+            if (c.reported || idle < wd.stall_secs)
+            {
+                continue;
+            }
+            c.reported = true;
+            found = true;
+            std::cerr << "trainer: stall: " << c.stage << " (worker " << c.worker
+                      << ", pid " << c.pid << ") made no progress for " << idle
+                      << " s with input pending (in=" << in << " out=" << out;
+            if (!c.upstream.empty())
+            {
+                std::cerr << " upstream_out=" << upstream_out;
+            }
+            std::cerr << ")\n";
+            report_tasks(c.pid);
+        }
+        return found;
+    }
+
+    /**
+     * @brief Stop the stages feeding a stage that needs no more input.
+     *
+     * A stage sets stop_requested in its progress slot (e.g.
+     * backward_layer stopping early) and then exits without reading
+     * the rest of its input. The stages before it in its worker's chain
+     * get SIGTERM and are marked stopped, so their exit (by SIGTERM, or
+     * SIGPIPE if they write first) does not fail the run.
+     */
+    void stop_upstream(std::vector<Child> &children, const ProgressBoard &board)
+    {
+        for (Child &c : children)
+        {
+            if (c.stopping || c.slot < 0 || c.worker < 0 ||
+                board[c.slot].stop_requested.load(std::memory_order_acquire) == 0)
+            {
+                continue;
+            }
+            c.stopping = true;
+            std::cerr << "trainer: " << c.stage << '.' << c.worker
+                      << " needs no more input; stopping its upstream stages\n";
+            for (Child &u : children)
+            {
+                if (u.worker == c.worker && u.slot >= 0 && u.slot < c.slot && !u.stopped)
+                {
+                    u.stopped = true;
+                    if (u.running)
+                    {
+                        kill(u.pid, SIGTERM);
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Wait for all children to exit, keeping each one's status and
+     *        resource usage.
+     *
+     * Without a watchdog (TRAINER_STALL_SECS) or stderr multiplexer
+     * (mux == nullptr) this blocks in wait4. Otherwise it polls: it
+     * copies the children's stderr as it arrives and checks for stalls
+     * at least every WATCH_INTERVAL_MS; on a stall with action restart
+     * or abort it kills every child and goes on reaping them. Stop
+     * requests (see stop_upstream()) are handled whenever it wakes.
+     *
+     * @return true if the watchdog killed the pipeline.
+     */
+    bool reap_children(std::vector<Child> &children, const Watchdog &wd,
+                       const ProgressBoard *board, StderrMux *mux)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (Child &c : children)
+        {
+            c.since = start;
+        }
+
+        bool killed = false;
         int status = 0;
-        pid_t wpid;
-        while ((wpid = wait(&status)) > 0)
+        struct rusage usage;
+        for (;;)
         {
+            const bool watching = board && wd.stall_secs > 0.0 && !killed;
+            g_child_exited = 0;
+            const pid_t wpid = wait4(-1, &status, watching || mux ? WNOHANG : 0, &usage);
+            if (wpid < 0)
+            {
+                break;
+            }
+            if (board)
+            {
+                stop_upstream(children, *board);
+            }
+            if (wpid == 0)
+            {
+                if (watching &&
+                    check_stalls(children, wd, *board, std::chrono::steady_clock::now()) &&
+                    wd.action != StallAction::Report)
+                {
+                    std::cerr << "trainer: killing the pipeline\n";
+                    for (const Child &c : children)
+                    {
+                        if (c.running)
+                        {
+                            kill(c.pid, SIGKILL);
+                        }
+                    }
+                    killed = true;
+                }
+                else if (mux)
+                {
+                    mux->pump(g_child_exited ? 0 : WATCH_INTERVAL_MS);
+                }
+                else if (!g_child_exited)
+                {
+                    poll(nullptr, 0, WATCH_INTERVAL_MS);
+                }
+                continue;
+            }
+
+            // Show the child's last words before its exit status.
+            if (mux)
+            {
+                mux->pump(0);
+            }
+
+            Child *child = nullptr;
+            for (Child &c : children)
+            {
+                if (c.pid == wpid)
+                {
+                    child = &c;
+                }
+            }
+
+            int code = -1;
             if (WIFEXITED(status))
             {
+                code = WEXITSTATUS(status);
                 std::cerr << "trainer: child " << wpid
-                          << " exited with status " << WEXITSTATUS(status) << '\n';
+                          << " exited with status " << code << '\n';
             }
             else if (WIFSIGNALED(status))
             {
+                code = 128 + WTERMSIG(status);
                 std::cerr << "trainer: child " << wpid
                           << " terminated by signal " << WTERMSIG(status) << '\n';
             }
+            if (child)
+            {
+                child->running = false;
+                child->exit_code = code;
+                child->usage = usage;
+            }
+        }
+        if (mux)
+        {
+            mux->drain();
+        }
+        return killed;
+    }
+
+    /**
+     * @brief Tear down a pipeline that could not be set up completely:
+     *        close the parent's pipe ends, then kill and reap the
+     *        children spawned so far.
+     */
+    void abandon_pipeline(std::vector<Child> &children, std::initializer_list<int> fds)
+    {
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+        for (Child &c : children)
+        {
+            if (c.running)
+            {
+                kill(c.pid, SIGKILL);
+            }
+        }
+        for (Child &c : children)
+        {
+            while (c.running && waitpid(c.pid, nullptr, 0) < 0 && errno == EINTR)
+            {
+            }
+            c.running = false;
+        }
+    }
+
+    /// @brief Copy an attempt's buffered output (see run()) to stdout.
+    void copy_output(int fd)
+    {
+        std::cout.flush();
+        lseek(fd, 0, SEEK_SET);
+        char buf[65536];
+        for (;;)
+        {
+            const ssize_t n = read(fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return;
+            }
+            for (ssize_t done = 0; done < n;)
+            {
+                const ssize_t w = write(STDOUT_FILENO, buf + done, static_cast<std::size_t>(n - done));
+                if (w < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (w <= 0)
+                {
+                    return;
+                }
+                done += w;
+            }
+        }
+    }
+
+    double seconds(const struct timeval &tv)
+    {
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    /**
+     * @brief Write per-stage statistics to the TRAINER_STATS file.
+     *
+     * Format, one line per child, one per child that rejected input rows,
+     * then the trainer's wall time:
+     *   STAGE <stage> <worker> <pid> <exit> <user_s> <sys_s> <max_rss_kb>
+     *   REJECTED <stage> <worker> <rows>
+     *   WALL <seconds>
+     *
+     * @param path         Output path.
+     * @param children     Reaped children.
+     * @param wall_seconds Wall-clock time of the whole run.
+     */
+    void write_stats(const char *path, const std::vector<Child> &children, double wall_seconds)
+    {
+        std::ofstream ofs(path);
+        for (const Child &c : children)
+        {
+            ofs << "STAGE " << c.stage << ' ' << c.worker << ' ' << c.pid << ' '
+                << c.exit_code << ' ' << seconds(c.usage.ru_utime) << ' '
+                << seconds(c.usage.ru_stime) << ' ' << c.usage.ru_maxrss << '\n';
+        }
+        for (const Child &c : children)
+        {
+            if (c.rejected > 0)
+            {
+                ofs << "REJECTED " << c.stage << ' ' << c.worker << ' ' << c.rejected << '\n';
+            }
+        }
+        ofs << "WALL " << wall_seconds << '\n';
+        if (!ofs)
+        {
+            std::cerr << "trainer: cannot write TRAINER_STATS file " << path << '\n';
+        }
+    }
+
+} // namespace
+
+namespace trainer
+{
+    int run(const std::string &csv_path, bool fuse, const std::string &config_path)
+    {
+        topology::Topology topo = topology::default_topology();
+        if (!config_path.empty() && !topology::load(config_path, topo))
+        {
+            return 1;
+        }
+
+        // Install SIGCHLD handler so we can notice if a child dies unexpectedly.
+        std::signal(SIGCHLD, sigchld_handler);
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<Child> children;
+
+        // Number of data-parallel pipelines (TRAINER_WORKERS, else the config).
+        const int workers = get_workers(topo.workers);
+
+        // Split the stages into the per-worker chain and the shared tail.
+        std::vector<topology::Stage> chain;
+        std::vector<topology::Stage> shared;
+        for (const topology::Stage &st : topo.stages)
+        {
+            (st.shared ? shared : chain).push_back(st);
         }
 
+        // With fusion on, stateless stages directly after preprocess run
+        // inside it (preprocess --fuse) instead of as processes of their
+        // own. Stages with their own environment or CPUs stay separate.
+        if (fuse && chain.front().name == "preprocess")
+        {
+            std::string fuse_list;
+            while (chain.size() > 1 && fusable(chain[1].name) &&
+                   chain[1].env.empty() && chain[1].cpus.empty())
+            {
+                fuse_list += (fuse_list.empty() ? "" : ",") + chain[1].name;
+                chain.front().transport = chain[1].transport;
+                chain.front().pipe_size = chain[1].pipe_size;
+                chain.erase(chain.begin() + 1);
+            }
+            if (!fuse_list.empty())
+            {
+                std::cerr << "trainer: fusing " << fuse_list << " into preprocess\n";
+                chain.front().args.push_back("--fuse");
+                chain.front().args.push_back(fuse_list);
+            }
+        }
+
+        // TRAINER_TRANSPORT=pipe|socketpair overrides the transport of
+        // every edge but a fan-in from several workers (always a pipe).
+        const char *transport = std::getenv("TRAINER_TRANSPORT");
+        if (transport && *transport)
+        {
+            topology::Transport t;
+            if (std::strcmp(transport, "pipe") == 0)
+            {
+                t = topology::Transport::Pipe;
+            }
+            else if (std::strcmp(transport, "socketpair") == 0)
+            {
+                t = topology::Transport::SocketPair;
+            }
+            else
+            {
+                std::cerr << "trainer: invalid TRAINER_TRANSPORT=" << transport << '\n';
+                return 1;
+            }
+            for (std::size_t i = 0; i < chain.size(); ++i)
+            {
+                if (i + 1 < chain.size() || workers == 1 || shared.empty())
+                {
+                    chain[i].transport = t;
+                }
+            }
+            for (topology::Stage &st : shared)
+            {
+                st.transport = t;
+            }
+        }
+
+        // TRAINER_MEMORY_BUDGET: shrink edge buffers to fit and hand every
+        // process its share (STAGE_MEMORY_LIMIT, inherited).
+        std::size_t budget = 0;
+        const char *budget_env = std::getenv("TRAINER_MEMORY_BUDGET");
+        if (budget_env && *budget_env)
+        {
+            if (!parse_bytes(budget_env, budget))
+            {
+                std::cerr << "trainer: invalid TRAINER_MEMORY_BUDGET=" << budget_env << '\n';
+                return 1;
+            }
+            std::vector<topology::Stage *> edges;
+            for (int w = 0; w < workers; ++w)
+            {
+                for (std::size_t i = 0; i + 1 < chain.size(); ++i)
+                {
+                    edges.push_back(&chain[i]);
+                }
+            }
+            if (!shared.empty())
+            {
+                edges.push_back(&chain.back());
+            }
+            for (std::size_t i = 0; i + 1 < shared.size(); ++i)
+            {
+                edges.push_back(&shared[i]);
+            }
+            const std::size_t processes = workers * chain.size() + shared.size() +
+                                          (use_param_server() ? 1 : 0);
+            const std::size_t share = plan_memory(budget, processes, edges);
+            setenv("STAGE_MEMORY_LIMIT", std::to_string(share).c_str(), 1);
+        }
+
+        // Each stage gets a slot of shared progress counters (slot = its
+        // index in children) for the stall watchdog and the rejected-row
+        // totals.
+        const Watchdog watchdog = watchdog_from_env();
+        std::unique_ptr<ProgressBoard> board(
+            new ProgressBoard(workers * chain.size() + shared.size() + 1));
+        if (!board->ok())
+        {
+            board.reset();
+        }
+
+        for (int attempt = 0;; ++attempt)
+        {
+            children.clear();
+            if (board)
+            {
+                board->reset();
+            }
+
+            // Each child's stderr reaches the trainer's through a pipe of
+            // its own (see StderrMux); err is the write end for the next
+            // child, closed here once it is spawned.
+            std::unique_ptr<StderrMux> mux;
+            if (use_stderr_mux())
+            {
+                mux.reset(new StderrMux(start));
+            }
+            // Under restart, the records written to stdout are held per
+            // attempt so that a killed attempt's cannot reach the
+            // consumer ahead of the rerun's.
+            int output = -1;
+            if (watchdog.stall_secs > 0.0 && watchdog.action == StallAction::Restart)
+            {
+                output = memfd_create("trainer-output", MFD_CLOEXEC);
+                if (output < 0)
+                {
+                    std::perror("trainer: memfd_create");
+                    return 1;
+                }
+            }
+
+            int err = -1;
+            auto open_err = [&](const std::string &label) {
+                err = mux ? mux->open(label) : -1;
+                return err;
+            };
+            auto close_err = [&]() {
+                if (err >= 0)
+                {
+                    close(err);
+                    err = -1;
+                }
+            };
+
+            // Setup errors below kill what this attempt already started.
+            auto fail = [&](std::initializer_list<int> fds) {
+                close_err();
+                abandon_pipeline(children, fds);
+                if (output >= 0)
+                {
+                    close(output);
+                }
+                return 1;
+            };
+
+            // All chains write into one fan-in edge. Several writers only
+            // keep whole lines on a pipe (see common::AtomicLineBuf).
+            int fan_in[2] = {-1, -1};
+            if (!shared.empty())
+            {
+                if (workers > 1 && chain.back().transport != topology::Transport::Pipe)
+                {
+                    std::cerr << "trainer: the edge from " << chain.back().name
+                              << " into " << shared.front().name
+                              << " carries several workers and must be a pipe\n";
+                    return fail({});
+                }
+                // Mark all pipe FDs as close-on-exec. Children that need them will
+                // dup2 them onto stdin/stdout before exec; the dup'd FDs (0/1) will NOT
+                // have FD_CLOEXEC, so they survive exec, while the originals are closed.
+                if (!topology::make_edge(chain.back(), fan_in))
+                {
+                    return fail({});
+                }
+            }
+
+            const char *ps_prog = "bin/param_server";
+
+            // With several workers, each backward_layer joins a gradient ring
+            // at DDP_ENDPOINT (default: UNIX sockets under /tmp). Children
+            // inherit these variables; DDP_RANK is set per worker below.
+            if (workers > 1)
+            {
+                const char *ep = std::getenv("DDP_ENDPOINT");
+                const std::string endpoint = (ep && *ep)
+                    ? std::string(ep)
+                    : "unix:/tmp/trainer-ddp-" + std::to_string(getpid());
+                setenv("DDP_ENDPOINT", endpoint.c_str(), 1);
+                setenv("DDP_WORLD_SIZE", std::to_string(workers).c_str(), 1);
+            }
+
+            // TRAINER_PS=1: training goes through a parameter server instead
+            // of the gradient ring. The server owns and saves the model; the
+            // workers find it through PS_ENDPOINT.
+            if (use_param_server())
+            {
+                const char *ep = std::getenv("PS_ENDPOINT");
+                const std::string endpoint = (ep && *ep)
+                    ? std::string(ep)
+                    : "unix:/tmp/trainer-ps-" + std::to_string(getpid());
+                setenv("PS_ENDPOINT", endpoint.c_str(), 1);
+                setenv("PS_WORKERS", std::to_string(workers).c_str(), 1);
+
+                char *ps_argv[] = {
+                    const_cast<char *>(ps_prog),
+                    nullptr
+                };
+                pid_t ps_pid = spawn_child(ps_prog, ps_argv,
+                                           /*stdin_fd=*/-1,
+                                           /*stdout_fd=*/-1,
+                                           /*stderr_fd=*/open_err("param_server"));
+                close_err();
+                if (ps_pid < 0)
+                {
+                    return fail({fan_in[0], fan_in[1]});
+                }
+                children.push_back(Child{ps_pid, "param_server", -1});
+            }
+
+            // One chain of per-worker stages (by default preprocess ->
+            // forward_layer -> backward_layer) per worker; all chains write
+            // into the fan-in edge of the first shared stage (the logger).
+            std::vector<int> tails; // progress slots of the chains' last stages
+            for (int w = 0; w < workers; ++w)
+            {
+                // Every stage of chain w sees its rank (backward_layer joins
+                // the ring with it; stream captures are named after it).
+                setenv("DDP_RANK", std::to_string(w).c_str(), 1);
+
+                // Spawn the chain left to right, each stage reading the edge
+                // the previous one writes.
+                int upstream = -1;
+                for (std::size_t i = 0; i < chain.size(); ++i)
+                {
+                    const bool last = i + 1 == chain.size();
+                    int edge[2] = {-1, -1};
+                    if (!last && !topology::make_edge(chain[i], edge))
+                    {
+                        return fail({fan_in[0], fan_in[1], upstream});
+                    }
+
+                    const int slot = static_cast<int>(children.size());
+                    pid_t pid = spawn_stage(chain[i], stage_args(chain[i], csv_path, w, workers),
+                                            /*stdin_fd=*/upstream,
+                                            /*stdout_fd=*/last ? (fan_in[1] >= 0 ? fan_in[1] : output) : edge[1],
+                                            /*stderr_fd=*/open_err(chain[i].name + "." + std::to_string(w)),
+                                            board ? board->env(slot) : "");
+                    close_err();
+                    if (pid < 0)
+                    {
+                        return fail({fan_in[0], fan_in[1], upstream, edge[0], edge[1]});
+                    }
+                    children.push_back(Child{pid, chain[i].name, w});
+                    if (board)
+                    {
+                        children.back().slot = slot;
+                        if (i > 0)
+                        {
+                            children.back().upstream = {slot - 1};
+                        }
+                        if (last)
+                        {
+                            tails.push_back(slot);
+                        }
+                    }
+
+                    // Parent closes its copies of this chain's edge ends.
+                    if (upstream >= 0)
+                    {
+                        close(upstream);
+                    }
+                    if (!last)
+                    {
+                        close(edge[1]);
+                    }
+                    upstream = edge[0];
+                }
+            }
+
+            // Shared stages have no rank.
+            unsetenv("DDP_RANK");
+
+            int upstream = fan_in[0];
+            if (fan_in[1] >= 0)
+            {
+                close(fan_in[1]);
+                fan_in[1] = -1;
+            }
+            for (std::size_t i = 0; i < shared.size(); ++i)
+            {
+                const bool last = i + 1 == shared.size();
+                int edge[2] = {-1, -1};
+                if (!last && !topology::make_edge(shared[i], edge))
+                {
+                    return fail({upstream});
+                }
+
+                // The last stage writes to the trainer's stdout (or to
+                // this attempt's output buffer).
+                const int slot = static_cast<int>(children.size());
+                pid_t pid = spawn_stage(shared[i], stage_args(shared[i], csv_path, 0, 1),
+                                        /*stdin_fd=*/upstream,
+                                        /*stdout_fd=*/last ? output : edge[1],
+                                        /*stderr_fd=*/open_err(shared[i].name),
+                                        board ? board->env(slot) : "");
+                close_err();
+                if (pid < 0)
+                {
+                    return fail({upstream, edge[0], edge[1]});
+                }
+                children.push_back(Child{pid, shared[i].name, -1});
+                if (board)
+                {
+                    children.back().slot = slot;
+                    children.back().upstream = i == 0 ? tails : std::vector<int>{slot - 1};
+                }
+
+                close(upstream);
+                if (!last)
+                {
+                    close(edge[1]);
+                }
+                upstream = edge[0];
+            }
+
+            const bool killed = reap_children(children, watchdog, board.get(), mux.get());
+            if (output >= 0)
+            {
+                if (!killed)
+                {
+                    copy_output(output);
+                }
+                close(output);
+            }
+            if (!killed || watchdog.action != StallAction::Restart || attempt >= watchdog.restarts)
+            {
+                break;
+            }
+            std::cerr << "trainer: restarting the pipeline (restart " << attempt + 1
+                      << " of " << watchdog.restarts << ")\n";
+        }
+
+        // Input rows the stages quarantined, summed over the pipeline.
+        std::uint64_t rejected = 0;
+        std::string rejected_by;
+        for (Child &c : children)
+        {
+            if (board && c.slot >= 0)
+            {
+                c.rejected = (*board)[c.slot].records_rejected.load(std::memory_order_relaxed);
+            }
+            if (c.rejected > 0)
+            {
+                rejected += c.rejected;
+                rejected_by += " " + c.stage + (c.worker >= 0 ? "." + std::to_string(c.worker) : "") +
+                               "=" + std::to_string(c.rejected);
+            }
+        }
+        if (rejected > 0)
+        {
+            std::cerr << "trainer: rejected rows:" << rejected_by << " total=" << rejected << '\n';
+        }
+
+        if (budget > 0)
+        {
+            // Summed peaks bound what the pipeline held at any one time.
+            double peak = 0.0;
+            for (const Child &c : children)
+            {
+                peak += c.usage.ru_maxrss * 1024.0;
+            }
+            std::cerr << "trainer: memory peak total=" << peak / (1 << 20) << " MiB of budget "
+                      << budget / double(1 << 20) << " MiB"
+                      << (peak > budget ? " (over budget)" : "") << '\n';
+        }
+
+        const char *stats_path = std::getenv("TRAINER_STATS");
+        if (stats_path && *stats_path)
+        {
+            const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+            write_stats(stats_path, children, wall.count());
+        }
+
+        for (const Child &c : children)
+        {
+            if (c.exit_code != 0 && !c.stopped)
+            {
+                return 1;
+            }
+        }
         return 0;
     }
 
@@ -190,10 +1419,82 @@ namespace trainer
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    // trainer --submit <key=value ...> | shutdown: talk to a daemon.
+    if (argc >= 3 && std::strcmp(argv[1], "--submit") == 0)
     {
-        std::cerr << "Usage: trainer <csv_path>\n";
+        std::string request = std::strcmp(argv[2], "shutdown") == 0 ? "SHUTDOWN" : "JOB";
+        for (int k = request == "JOB" ? 2 : 3; k < argc; ++k)
+        {
+            request += std::string(" ") + argv[k];
+        }
+        return job_server::submit(job_server::options_from_env().socket_path, request);
+    }
+
+    bool fuse = use_fusion();
+    bool daemon = false;
+    bool tune = false;
+    const char *config_env = std::getenv("TRAINER_CONFIG");
+    std::string config = (config_env && *config_env) ? config_env : "";
+    int i = 1;
+    for (; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--fuse") == 0)
+        {
+            fuse = true;
+        }
+        else if (std::strcmp(argv[i], "--daemon") == 0)
+        {
+            daemon = true;
+        }
+        else if (std::strcmp(argv[i], "--autotune") == 0)
+        {
+            tune = true;
+        }
+        else if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+        {
+            config = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc)
+        {
+            // Also reaches daemon jobs, which run in children of this process.
+            setenv("TRAINER_MEMORY_BUDGET", argv[++i], 1);
+        }
+        else
+        {
+            break;
+        }
+    }
+    if ((daemon && tune) ||
+        (daemon ? i != argc : (i != argc - 1 || std::strncmp(argv[i], "--", 2) == 0)))
+    {
+        std::cerr << "Usage: trainer [--fuse] [--config <file>] [--memory-budget <size>] <csv_path>\n"
+                  << "       trainer --autotune [--fuse] [--config <file>] <csv_path>\n"
+                  << "       trainer --daemon [--config <file>] [--memory-budget <size>]\n"
+                  << "       trainer --submit csv=<path> [phase=train|test] [model=<path>]\n"
+                  << "                        [priority=<n>] [workers=<n>] [fuse=0|1]\n"
+                  << "       trainer --submit shutdown\n";
         return 1;
     }
-    return trainer::run(argv[1]);
+
+    // Without an explicit config the shipped one is used if present;
+    // it describes the built-in default layout.
+    if (config.empty() && access(DEFAULT_CONFIG, R_OK) == 0)
+    {
+        config = DEFAULT_CONFIG;
+    }
+    if (tune)
+    {
+        return autotune::run(argv[i], fuse, config);
+    }
+
+    // A profile saved by --autotune fills in settings the environment
+    // leaves unset.
+    autotune::apply_profile();
+    if (daemon)
+    {
+        job_server::Options opt = job_server::options_from_env();
+        opt.config = config;
+        return job_server::serve(opt);
+    }
+    return trainer::run(argv[i], fuse, config);
 }
@@ -0,0 +1,59 @@
+/// @file transform.cpp
+/// @brief Implementation of the stateless stage registry.
+#include "transform.hpp"
+#include "math_layer.hpp"
+
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+    /// @brief Stateless stages, by executable name.
+    const transform::Stateless STAGES[] = {
+        {"preprocess", math::normalize_sample},
+        {"forward_layer", math::augment_features},
+    };
+} // namespace
+
+namespace transform
+{
+    const Stateless *find(const std::string &stage)
+    {
+        for (const Stateless &s : STAGES)
+        {
+            if (stage == s.stage)
+            {
+                return &s;
+            }
+        }
+        return nullptr;
+    }
+
+    bool parse_fuse_list(const std::string &spec, std::vector<const Stateless *> &out)
+    {
+        std::stringstream ss(spec);
+        std::string name;
+        while (std::getline(ss, name, ','))
+        {
+            const Stateless *s = find(name);
+            if (!s)
+            {
+                std::cerr << "transform: cannot fuse '" << name
+                          << "': not a stateless stage\n";
+                return false;
+            }
+            out.push_back(s);
+        }
+        return true;
+    }
+
+    void apply_fused(const std::vector<const Stateless *> &stages, common::Sample &s)
+    {
+        for (const Stateless *st : stages)
+        {
+            common::round_to_wire(s);
+            st->apply(s);
+        }
+    }
+
+} // namespace transform